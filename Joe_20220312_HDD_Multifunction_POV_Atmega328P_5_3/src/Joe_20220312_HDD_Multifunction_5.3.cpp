@@ -4,7 +4,13 @@
 // Rev 5.1 7  March 2022 -- New approach
 // Rev 5.2 12 March 2022 -- Add multi-functionality
 // See explanitory comments in Joe_20220228_HHD_Clock_5.0 and _5.1
+// Patterns, clock face and LED output come from the POV pattern library shared with the
+// ESP32 version (../Joe_POV_Common/PovPatterns)
 #include <Arduino.h>
+#include "frameBuffer.h"
+#include "patterns.h"
+#include "clockFace.h"
+#include "povOutput.h"
 
 // all of my outputs (LED drivers) are on PORTB (0-based bits 1, 2, 3)
 const int redLED = PB1;   // D9  = PB1  (All leds are on port B)
@@ -25,33 +31,23 @@ const int checkerNumber_pin = 0; // A0 (ADC0)
 int pattern = 0;
 int checkerNumber = 0;
 
-const byte BLACK = 0b00000000;   // RGB 000 mapped to Port B LED pins
-const byte RED = 0b00000010;     // RGB 001 mapped to Port B LED pins
-const byte GREEN = 0b00000100;   // RGB 010 mapped to Port B LED pins
-const byte YELLOW = 0b00000110;  // RGB 011 mapped to Port B LED pins
-const byte BLUE = 0b00001000;    // RGB 100 mapped to Port B LED pins
-const byte MAGENTA = 0b00001010; // RGB 101 mapped to Port B LED pins
-const byte CYAN = 0b00001100;    // RGB 110 mapped to Port B LED pins
-const byte WHITE = 0b00001110;   // RGB 111 mapped to Port B LED pins
+// Map to 3-bit RGB colors (BLACK .. WHITE, see patterns.h)
+const String RGBstr[8] = {"Black", "Red", "Green", "Yellow", "Blue", "Magenta", "Cyan", "White"};
 
-const String RGBstr[8] = {"Black", "Blue", "Green", "Cyan", "Red", "Magenta", "Yellow", "White"};
+// frame columns to the 3 x RGB LEDs on PORTB (see povOutput.h)
+typedef PovOutput<ConsecutiveRgb<uint8_t, redLED>, AvrPortB> ledOutput;
 
-long milliseconds = 0; //
-int seconds = 0;       // integer number of seconds
-int minutes = 0;       // integer number of minutes
-int hours = 0;         // integer number of hours
-int newseconds = 0;    // integer number of seconds
-int newminutes = 0;    // integer number of minutes
-int newhours = 0;      // integer number of hours
+// one revolution of 60 columns (one per timer tick), produced by the patterns (see patterns.h)
+PovFrame<CLOCK_POSITIONS> frame;
+int column = CLOCK_POSITIONS; // column being displayed; CLOCK_POSITIONS = dark until trigger
 
-byte ClockFace[60];    // 60 valid positions, each with 3-bit RGB value to be displayed
-int clockPosition = 0; // position (0-59) on the clockface; index for ClockFace[]
+// clock face model: graduations < hour < minute < second layers (see clockFace.h)
+ClockLayers clockLayers;
+unsigned long secondMillis = 0; // millis() of the last clock face update
 
 volatile boolean Triggered = false; // flag on sync interrupt
 volatile boolean clockTick = false; // flag on timer interrupt
 boolean ACTIVATED = false;          // flag on pushbutton interrupt
-boolean INITIALIZED = false;        // flag for clockface
-boolean DONE_RADAR = false;         // flag to display radar beacon only once per period
 
 //-----[ user-configurable factors - emperically determined ]------------------------
 float fudgeFactor = 3.85;     // Timer1 clock is divided by 4 relative to expected
@@ -71,6 +67,9 @@ ISR(TIMER1_COMPA_vect);
 void set_loop_fn();
 void trigger();
 void calculateClockFace();
+void startPattern();
+bool playFrame();
+void showColumn(uint8_t value);
 void blink();
 void loop_fn_clock();
 void loop_fn_radar();
@@ -131,12 +130,6 @@ void setup()
   //  calibrate();
   OCR1A = compareTarget; // default to clock
 
-  // calculate initial time-reference (ToDo: set refTime w thumbwheel and PushButton_interrupt)
-  milliseconds = millis();
-  seconds = (int)(milliseconds / 1000.0) % 60;
-  minutes = (int)(milliseconds / 60000.0) % 60;
-  hours = (int)(milliseconds / 3600000.0) % 12;
-
   // read function from pattern bits
   set_loop_fn();
 
@@ -190,119 +183,87 @@ ISR(TIMER1_COMPA_vect)
 }
 
 /*------------------------------------------------------------------------------
-   calculateClockFace() -- set the 60 values of the data to be displayed on clock
+   calculateClockFace() -- move the clock hands; redraw only the positions that changed
   ------------------------------------------------------------------------------*/
 void calculateClockFace()
 {
-  // ClockFace[i] is an array modelling the 60 positions of the clock face, with
-  // each element set to the RGB value of color that should be displayed in that position
-  // this function updates this model with a minimum of instructions
-
-  if (!INITIALIZED)
+  // time since reset (ToDo: set refTime w thumbwheel and PushButton_interrupt)
+  unsigned long seconds = secondMillis / 1000;
+  clockLayers.setTime((seconds / 3600) % 12, (seconds / 60) % 60, seconds % 60);
+  // one frame, so the dirty positions are all that needs redrawing
+  for (uint8_t r = 0; r < clockLayers.dirtyCount(); r++)
   {
-    // blank the clockface
-    for (i = 0; i < 60; i++)
-    {
-      ClockFace[i] = 0;
-    }
-
-    // mark the "graduations"
-    for (i = 0; i < 60; i += 5)
-    {
-      if (i % 15 == 0)
-      {
-        // quater - mark yellow
-        ClockFace[i] = YELLOW;
-      }
-      else
-      {
-        // 1/12th - mark white
-        ClockFace[i] = WHITE;
-      }
-    }
-
-    // raise flag
-    INITIALIZED = true;
+    renderPositions(clockLayers.face(), frame, offset, clockLayers.dirty(r).first, clockLayers.dirty(r).last);
   }
+}
 
-  // Get new time; change only values that need to be changed
-  // Assign (if needed) in this order so each supercedes previous,
-  //   if more than one hand is in the same position on the clock
-  // Calculate/assign seconds every time b/c this function is called every second
-  newseconds = (int)(milliseconds / 1000.0) % 60;
-  ClockFace[seconds] = BLACK; // blank the old one
-  // if the old second hand was "covering" something else, rewrite that w supercession
-  if (seconds == minutes)
-  {
-    ClockFace[minutes] = BLUE;
-  }
-  else if (seconds == hours)
-  {
-    ClockFace[hours] = GREEN;
-  }
-  else if (seconds % 5 == 0)
+/*------------------------------------------------------------------------------
+   startPattern() -- common start of every pattern: reset timer (one tick per column),
+   LEDs off, blank frame
+  ------------------------------------------------------------------------------*/
+void startPattern()
+{
+  cli();
+  // Reset timer
+  TCCR1A = 0; // Timer 1 is 16 bits; counts up to 65535
+  TCCR1B = 0;
+  TCNT1 = 0;
+  TIMSK1 = (1 << OCIE1A);
+  TCCR1B = 0b00001001;   // CTC mode, clock tick period 62.5nS
+  OCR1A = compareTarget; // one tick per column
+  // clear leds
+  ledOutput::off();
+  // don't show the previous pattern's frame; the pattern produces its own
+  produceBlank(frame);
+  column = CLOCK_POSITIONS;
+  sei();
+}
+
+/*------------------------------------------------------------------------------
+   playFrame() -- show the frame one column at a time: column 0 at the photo-trigger,
+   the next one at each timer tick; returns true at the photo-trigger, when a pattern
+   can produce its next revolution
+  ------------------------------------------------------------------------------*/
+bool playFrame()
+{
+  if (Triggered)
   {
-    if (seconds % 15 == 0)
-    {
-      ClockFace[seconds] = YELLOW;
-    }
-    else
-    {
-      ClockFace[seconds] = WHITE;
-    }
+    Triggered = false; // lower the Triggered flag
+    clockTick = false;
+    column = 0;
+    showColumn(frame.get(column));
+    return true;
   }
 
-  // calculate/assign minutes only when seconds gets back to 0
-  if (newseconds == 0)
+  if (clockTick)
   {
-    newminutes = (int)(milliseconds / 60000.0) % 60;
-    ClockFace[minutes] = BLACK; // blank the old one
-    // if the minute hand was "covering" something else, rewrite that w supercession
-    if (minutes == hours)
+    clockTick = false; // lower the clockTick flag
+    if (column < CLOCK_POSITIONS - 1)
     {
-      ClockFace[hours] = GREEN;
+      showColumn(frame.get(++column));
     }
-    else if (minutes % 5 == 0)
+    else
     {
-      if (minutes % 15 == 0)
-      {
-        ClockFace[minutes] = YELLOW;
-      }
-      else
-      {
-        ClockFace[minutes] = WHITE;
-      }
+      // end of revolution; dark until the next photo-trigger
+      column = CLOCK_POSITIONS;
+      ledOutput::off();
     }
   }
+  return false;
+}
 
-  // calculate/assign hours only when minutes gets back to 0
-  if (newminutes == 0)
+/*------------------------------------------------------------------------------
+   showColumn() -- light a column; thin columns go dark again after intervalOn
+   (draw skinnier lines), the others stay lit until the next column
+  ------------------------------------------------------------------------------*/
+void showColumn(uint8_t value)
+{
+  ledOutput::on(value);
+  if (ledOutput::thin(value))
   {
-    newhours = (int)(milliseconds / 3600000.0) % 12;
-    ClockFace[hours] = BLACK; // blank the old one
-    // if the hour hand was "covering" something else, rewrite that w supercession
-    if (hours % 5 == 0)
-    {
-      if (hours % 15 == 0)
-      {
-        ClockFace[hours] = YELLOW;
-      }
-      else
-      {
-        ClockFace[hours] = WHITE;
-      }
-    }
+    delayMicroseconds(intervalOn);
+    ledOutput::off();
   }
-
-  if (newminutes == 0)
-    ClockFace[newhours] = GREEN; // write the new one
-  if (newseconds == 0)
-    ClockFace[newminutes] = BLUE; // write the new one
-  ClockFace[newseconds] = RED;    // write the new one
-
-  seconds = newseconds;
-  minutes = newminutes;
-  hours = newhours;
 }
 
 /*------------------------------------------------------------------------------
@@ -338,50 +299,19 @@ void blink()
   ------------------------------------------------------------------------------*/
 void loop_fn_clock()
 {
-  cli();
-  // Reset timer
-  TCCR1A = 0; // Timer 1 is 16 bits; counts up to 65535
-  TCCR1B = 0;
-  TCNT1 = 0;
-  TIMSK1 = (1 << OCIE1A);
-  TCCR1B = 0b00001001;   // CTC mode, clock tick period 62.5nS
-  OCR1A = compareTarget; // default
-  // clear leds
-  PORTB &= ~((1 << redLED) | (1 << greenLED) | (1 << blueLED));
-  sei();
+  startPattern();
+  secondMillis = millis();
+  calculateClockFace();
+  renderFrame(clockLayers.face(), frame, offset); // whole face once; then only what moves
   // perform this function until reset
   while (!ACTIVATED)
   {
-    // (process trigger interrupt)
-    if (Triggered)
-    {
-      clockPosition = 0; // ToDo -- use relative number to "align the clock face"
-      // display the 0-marker; provides offset and reverses b/c disk rotates ccw
-      PORTB = ClockFace[59 - ((offset + clockPosition) % 60)];
-      delayMicroseconds(intervalOn);
-      PORTB &= ~((1 << redLED) | (1 << greenLED) | (1 << blueLED));
-      Triggered = false; // lower the Triggered flag
-    }
-
-    // display clock face
-    if (clockTick)
-    {
-      clockPosition++;
-      // set my active LED bits - up to the 60th position
-      if (clockPosition < 60)
-      { // provides offset and reverses b/c disk rotates ccw
-        PORTB = ClockFace[59 - ((offset + clockPosition) % 60)];
-        delayMicroseconds(intervalOn);
-        PORTB &= ~((1 << redLED) | (1 << greenLED) | (1 << blueLED));
-      }
-      clockTick = false; // lower the clockTick flag
-    }
+    playFrame();
 
     // every 1 seconds, recalculate the time
-    // assign milliseconds here to avoid having to do so again in calculateClockFace()
-    milliseconds = millis();
-    if (milliseconds % 1000 == 0)
+    if (millis() - secondMillis >= 1000)
     {
+      secondMillis += 1000;
       calculateClockFace();
     }
   }
@@ -392,49 +322,19 @@ void loop_fn_clock()
   ------------------------------------------------------------------------------*/
 void loop_fn_radar()
 {
-  cli();
-  // Reset timer
-  TCCR1A = 0; // Timer 1 is 16 bits; counts up to 65535
-  TCCR1B = 0;
-  TCNT1 = 0;
-  TIMSK1 = (1 << OCIE1A);
-  TCCR1B = 0b00001010;              // CTC mode, clock tick period 0.5uS
-  OCR1A = compareTarget;            // default
-  unsigned int periodTicks = 21995; // empirically determined for CS2:0 = 010
-  unsigned int radarSlot = 0;       // also in ticks
-  // clear leds
-  PORTB &= ~((1 << redLED) | (1 << greenLED) | (1 << blueLED));
-  sei();
+  startPattern();
+  int radarSlot = -1;
   // perform this function until reset
   while (!ACTIVATED)
   {
-    if (Triggered)
+    if (playFrame())
     {
-      Triggered = false;
-      DONE_RADAR = false;
-      // mark sync spot
-      PORTB |= ((1 << redLED) | (1 << greenLED) | (1 << blueLED));
-      delayMicroseconds(intervalOn);
-      PORTB &= ~((1 << redLED) | (1 << greenLED) | (1 << blueLED));
-      // calculate how long to wait to display radar beacon
-      radarSlot = (unsigned int)(periodTicks * (millis() % 5000) / 5000.0);
-      OCR1A = radarSlot;
-      // now return to loop to wait for clockTick
-    }
-
-    if (clockTick)
-    {
-      if (!DONE_RADAR)
-      { // only once per period
-        PORTB |= (1 << redLED);
-        delayMicroseconds(intervalOn);
-        PORTB &= ~(1 << redLED);
-        DONE_RADAR = true;
-        clockTick = false;
-      }
-      else
+      // beacon goes once around every 5 s; produce a new frame only when it moves
+      int slot = (int)((millis() % 5000) * CLOCK_POSITIONS / 5000);
+      if (slot != radarSlot)
       {
-        clockTick = false;
+        radarSlot = slot;
+        produceRadar(frame, radarSlot, RED);
       }
     }
   }
@@ -445,35 +345,13 @@ void loop_fn_radar()
   ------------------------------------------------------------------------------*/
 void loop_fn_RedBlack()
 {
-  cli();
-  // Reset timer
-  TCCR1A = 0; // Timer 1 is 16 bits; counts up to 65535
-  TCCR1B = 0;
-  TCNT1 = 0;
-  TIMSK1 = (1 << OCIE1A);
-  TCCR1B = 0b00001010;              // CTC mode, clock tick period 0.5uS
-  unsigned int periodTicks = 21995; // empirically determined for CS2:0 = 010
-  //  unsigned int radarSlot = ( periodTicks / 8 ) + adjustmentFactor;    // also in ticks
-  unsigned int radarSlot = (periodTicks / 8); // also in ticks
-  OCR1A = radarSlot;                          // fire 8 times per disk rotation
-  // clear leds
-  PORTB &= ~((1 << redLED) | (1 << greenLED) | (1 << blueLED));
-  sei();
+  startPattern();
+  // eight bands, alternating red/black
+  produceBands(frame, 8, redBlack, 2);
   // perform this function until reset
   while (!ACTIVATED)
   {
-    if (Triggered)
-    {
-      i = 0;
-      Triggered = false;
-    }
-
-    if (clockTick)
-    {
-      // slot for eight bands, alternating red/black
-      PORTB ^= (1 << redLED);
-      clockTick = false;
-    }
+    playFrame();
   }
 }
 
@@ -482,37 +360,13 @@ void loop_fn_RedBlack()
   ------------------------------------------------------------------------------*/
 void loop_fn_colors()
 {
-  cli();
-  // Reset timer
-  TCCR1A = 0; // Timer 1 is 16 bits; counts up to 65535
-  TCCR1B = 0;
-  TCNT1 = 0;
-  TIMSK1 = (1 << OCIE1A);
-  TCCR1B = 0b00001010;              // CTC mode, clock tick period 0.5uS
-  unsigned int periodTicks = 21995; // empirically determined for CS2:0 = 010
-  //  unsigned int radarSlot = ( periodTicks / 8 ) + adjustmentFactor;    // also in ticks
-  unsigned int radarSlot = (periodTicks / 8); // also in ticks
-  int slotColor = 0;
-  OCR1A = radarSlot; // fire 8 times per disk rotation
-  // clear leds
-  PORTB &= ~((1 << redLED) | (1 << greenLED) | (1 << blueLED));
-  sei();
+  startPattern();
+  // eight bands of the 8 x 3-bit RGB colors, including black
+  produceBands(frame, 8, allColors, 8);
   // perform this function until reset
   while (!ACTIVATED)
   {
-    if (Triggered)
-    {
-      i = 0;
-      Triggered = false;
-    }
-
-    if (clockTick)
-    {
-      // slot for eight colors, including black (3-bit values RGB)
-      slotColor = ((++i % 8) << 1);
-      PORTB = ((PINB & 0b11110001) | slotColor);
-      clockTick = false;
-    }
+    playFrame();
   }
 }
 
@@ -521,36 +375,21 @@ void loop_fn_colors()
   ------------------------------------------------------------------------------*/
 void loop_fn_checkers()
 {
-  cli();
-  // Reset timer
-  TCCR1A = 0; // Timer 1 is 16 bits; counts up to 65535
-  TCCR1B = 0;
-  TCNT1 = 0;
-  TIMSK1 = (1 << OCIE1A);
-  TCCR1B = 0b00001010;              // CTC mode, clock tick period 0.5uS
-  unsigned int periodTicks = 21995; // empirically determined for CS2:0 = 010
-  //  unsigned int radarSlot = ( periodTicks / 8 ) + adjustmentFactor;    // also in ticks
-  unsigned int radarSlot = (periodTicks / 8); // default; also in ticks
-  OCR1A = radarSlot;                          // fire 8 times per disk rotation
-  // clear leds
-  PORTB &= ~((1 << redLED) | (1 << greenLED) | (1 << blueLED));
-  sei();
+  startPattern();
+  int lastCheckerNumber = -1;
   // perform this function until reset
   while (!ACTIVATED)
   {
-    if (Triggered)
+    if (playFrame())
     {
-      Triggered = false;
       // get an even number between 0 and 60, for checker pattern
       checkerNumber = 2 * map(analogRead(checkerNumber_pin), 0, 1023, 0, 30);
-      radarSlot = (periodTicks / checkerNumber);
-      OCR1A = radarSlot; // fire checkerNumber times per disk rotation
-    }
-
-    if (clockTick)
-    {
-      PORTB ^= (1 << redLED); // toggle red led
-      clockTick = false;
+      if (checkerNumber != lastCheckerNumber)
+      {
+        // checkerNumber bands alternating red/black
+        produceBands(frame, checkerNumber, redBlack, 2);
+        lastCheckerNumber = checkerNumber;
+      }
     }
   }
 }
@@ -560,40 +399,21 @@ void loop_fn_checkers()
   ------------------------------------------------------------------------------*/
 void loop_fn_checker_colors()
 {
-  cli();
-  // Reset timer
-  TCCR1A = 0; // Timer 1 is 16 bits; counts up to 65535
-  TCCR1B = 0;
-  TCNT1 = 0;
-  TIMSK1 = (1 << OCIE1A);
-  TCCR1B = 0b00001010;              // CTC mode, clock tick period 0.5uS
-  unsigned int periodTicks = 21995; // empirically determined for CS2:0 = 010
-  //  unsigned int radarSlot = ( periodTicks / 8 ) + adjustmentFactor;    // also in ticks
-  unsigned int radarSlot = (periodTicks / 8); // default; also in ticks
-  int slotColor = 0;
-  OCR1A = radarSlot; // fire 8 times per disk rotation
-  // clear leds
-  PORTB &= ~((1 << redLED) | (1 << greenLED) | (1 << blueLED));
-  sei();
+  startPattern();
+  int lastCheckerNumber = -1;
   // perform this function until reset
   while (!ACTIVATED)
   {
-    if (Triggered)
+    if (playFrame())
     {
-      i = 0;
-      Triggered = false;
       // get an even number between 0 and 60, for checker pattern
       checkerNumber = 2 * map(analogRead(checkerNumber_pin), 0, 1023, 0, 30);
-      radarSlot = (periodTicks / checkerNumber);
-      OCR1A = radarSlot; // fire checkerNumber times per disk rotation
-    }
-
-    if (clockTick)
-    {
-      // checkerNumber slots of eight colors, including black (3-bit values RGB)
-      slotColor = ((++i % 8) << 1);
-      PORTB = ((PINB & 0b11110001) | slotColor);
-      clockTick = false;
+      if (checkerNumber != lastCheckerNumber)
+      {
+        // checkerNumber bands cycling through the 8 x 3-bit RGB colors, including black
+        produceBands(frame, checkerNumber, allColors, 8);
+        lastCheckerNumber = checkerNumber;
+      }
     }
   }
 }
@@ -603,54 +423,19 @@ void loop_fn_checker_colors()
   ------------------------------------------------------------------------------*/
 void loop_fn_fan()
 {
-  cli();
-  // Reset timer
-  TCCR1A = 0; // Timer 1 is 16 bits; counts up to 65535
-  TCCR1B = 0;
-  TCNT1 = 0;
-  TIMSK1 = (1 << OCIE1A);
-  TCCR1B = 0b00001010;              // CTC mode, clock tick period 0.5uS
-  OCR1A = compareTarget;            // default
-  unsigned int periodTicks = 21995; // empirically determined for CS2:0 = 010
-  unsigned int radarSlot = 0;       // also in ticks
-  // clear leds
-  PORTB &= ~((1 << redLED) | (1 << greenLED) | (1 << blueLED));
-  sei();
+  startPattern();
+  int radarSlot = -1;
   // perform this function until reset
   while (!ACTIVATED)
   {
-    if (Triggered)
+    if (playFrame())
     {
-      Triggered = false;
-      DONE_RADAR = false;
-      // mark sync spot
-      PORTB |= ((1 << redLED) | (1 << greenLED) | (1 << blueLED));
-      delayMicroseconds(intervalOn);
-      PORTB &= ~((1 << redLED) | (1 << greenLED) | (1 << blueLED));
-      // calculate how long to wait to display radar beacon
-      radarSlot = (unsigned int)(periodTicks * (millis() % 5000) / 5000.0);
-      OCR1A = radarSlot;
-      // now return to loop to wait for clockTick
-    }
-
-    if (clockTick)
-    {
-      if (!DONE_RADAR)
-      { // only once per period
-        // mark beginning of fan
-        PORTB |= ((1 << redLED) | (1 << blueLED) | (1 << blueLED));
-        delayMicroseconds(intervalOn);
-        // clear green and blue
-        PORTB &= ~((1 << blueLED) | (1 << blueLED));
-        // leave led on twice the duration as delay to get there
-        delayMicroseconds((2 * radarSlot * T1microsPerTick) - intervalOn);
-        PORTB &= ~(1 << redLED);
-        DONE_RADAR = true;
-        clockTick = false;
-      }
-      else
+      // fan edge goes once around every 5 s; produce a new frame only when it moves
+      int slot = (int)((millis() % 5000) * CLOCK_POSITIONS / 5000);
+      if (slot != radarSlot)
       {
-        clockTick = false;
+        radarSlot = slot;
+        produceFan(frame, radarSlot, RED);
       }
     }
   }
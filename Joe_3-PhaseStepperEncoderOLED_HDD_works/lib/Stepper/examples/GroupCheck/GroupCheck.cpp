@@ -0,0 +1,209 @@
+// GroupCheck -- check coordinated moves of 3 axes (StepperLine.h, as StepperGroup uses it), on a PC
+// Queues a path of straight segments for 3 simulated axes, refilling the queue as the
+// step timer ISR would empty it, and takes every tick, keeping each axis's position and
+// the time.  Checks that
+//   - every axis reaches the end of each segment on the segment's last tick (the axes
+//     start and finish together), having taken exactly the steps asked for
+//   - no axis strays more than half a step from the straight line between
+// and reports the speed at each junction (lookahead: collinear segments don't slow
+// down, corners slow to the jump limit), the path time against stopping at every
+// junction, and the time take() needs per tick on this machine (the step rate ceiling).
+// Prints one CSV line per tick: time, the 3 positions, tick delay; summary on stderr.
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -I../../src GroupCheck.cpp -o groupcheck
+//   ./groupcheck --delay 200 --accel 20000 --jump 500 > path.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "StepperLine.h"
+
+#define AXES 3
+
+// the path: relative moves, us per major axis step
+struct leg
+{
+    long delta[AXES];
+    unsigned long delay;
+};
+
+const leg path[] = {
+    {{1000, 0, 0}, 200},    // x, then on in a straight line: no slowing down
+    {{1000, 0, 0}, 200},
+    {{1000, 500, 0}, 200},  // a gentle turn
+    {{0, 1500, 300}, 200},  // a right angle
+    {{-700, -700, 0}, 250}, // diagonal back, slower
+    {{-10, 3, 1}, 200},     // a short one
+    {{-1290, -1303, -301}, 200},
+};
+const int legs = sizeof(path) / sizeof(path[0]);
+
+// move settings (command line)
+struct settings
+{
+    unsigned long delay = 0;    // us per major axis step; 0 = as the path says
+    unsigned long accel = 20000; // major axis steps/s^2
+    unsigned long jump = 500;   // steps/s
+};
+
+// queues the next leg if there is room; returns the legs queued so far
+int refill(StepperLineQueue &queue, const settings &s, int queued)
+{
+    while (queued < legs)
+    {
+        unsigned long delay = (s.delay > 0) ? s.delay : path[queued].delay;
+        if (!queue.plan(path[queued].delta, delay))
+        {
+            break; // full
+        }
+        queue.commit(); // nothing runs concurrently here
+        queued++;
+    }
+    return queued;
+}
+
+// runs the path; returns its time (s); stopAll = plan each leg alone (stop at every junction)
+double run(const settings &s, bool stopAll, bool print, int &failures)
+{
+    StepperLineQueue queue;
+    queue.setAcceleration(s.accel, s.jump);
+    long position[AXES] = {0, 0, 0}, start[AXES] = {0, 0, 0};
+    double time = 0;
+    int queued = 0, leg = 0;
+    unsigned long tick = 0, major = 0;
+    double worst = 0;
+    uint8_t step, reverse;
+    unsigned long delay;
+
+    while (true)
+    {
+        if (!stopAll)
+        {
+            queued = refill(queue, s, queued);
+        }
+        else if (queue.empty() && queued < legs)
+        {
+            // one leg at a time: each stops at its end
+            queue.plan(path[queued].delta, (s.delay > 0) ? s.delay : path[queued].delay);
+            queue.commit();
+            queued++;
+        }
+        if (!queue.take(step, reverse, delay))
+        {
+            break;
+        }
+        if (tick == 0)
+        {
+            major = 0;
+            for (int axis = 0; axis < AXES; axis++)
+            {
+                long d = labs(path[leg].delta[axis]);
+                major = (d > (long)major) ? d : major;
+            }
+        }
+        time += delay * 1e-6;
+        tick++;
+        for (int axis = 0; axis < AXES; axis++)
+        {
+            if (step & (1 << axis))
+            {
+                position[axis] += (reverse & (1 << axis)) ? -1 : 1;
+            }
+            // distance from the straight line, at this tick
+            double ideal = start[axis] + (double)path[leg].delta[axis] * tick / major;
+            worst = fmax(worst, fabs(position[axis] - ideal));
+        }
+        if (print)
+        {
+            printf("%.6f,%ld,%ld,%ld,%lu\n", time, position[0], position[1], position[2], delay);
+        }
+        if (tick == major) // the end of the leg: every axis there?
+        {
+            for (int axis = 0; axis < AXES; axis++)
+            {
+                start[axis] += path[leg].delta[axis];
+                if (position[axis] != start[axis])
+                {
+                    fprintf(stderr, "leg %d: axis %d at %ld, not %ld\n", leg, axis, position[axis], start[axis]);
+                    failures++;
+                }
+            }
+            if (print && leg + 1 < legs)
+            {
+                fprintf(stderr, "junction %d: %lu us/step (%.0f steps/s)\n", leg, delay, 1e6 / delay);
+            }
+            leg++;
+            tick = 0;
+        }
+    }
+    if (leg != legs)
+    {
+        fprintf(stderr, "ran %d legs of %d\n", leg, legs);
+        failures++;
+    }
+    if (worst > 0.5 + 1e-9)
+    {
+        fprintf(stderr, "an axis strayed %.3f steps from the line\n", worst);
+        failures++;
+    }
+    if (print)
+    {
+        fprintf(stderr, "largest distance from the line %.3f steps\n", worst);
+    }
+    return time;
+}
+
+int main(int argc, char **argv)
+{
+    settings s;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--delay"))
+            s.delay = atol(argv[i + 1]);
+        else if (!strcmp(argv[i], "--accel"))
+            s.accel = atol(argv[i + 1]);
+        else if (!strcmp(argv[i], "--jump"))
+            s.jump = atol(argv[i + 1]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--delay us] [--accel steps/s^2] [--jump steps/s]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    int failures = 0;
+    printf("t_s,x,y,z,delay_us\n");
+    double joined = run(s, false, true, failures);
+    double stopping = run(s, true, false, failures);
+    fprintf(stderr, "path %.4f s with lookahead, %.4f s stopping at every junction\n", joined, stopping);
+
+    // per-tick cost: take() through the whole path, many times
+    const int runs = 200;
+    unsigned long ticks = 0, sum = 0;
+    clock_t begin = clock();
+    for (int r = 0; r < runs; r++)
+    {
+        StepperLineQueue queue;
+        queue.setAcceleration(s.accel, s.jump);
+        int queued = refill(queue, s, 0);
+        uint8_t step, reverse;
+        unsigned long delay;
+        while (queue.take(step, reverse, delay))
+        {
+            sum += step + delay;
+            ticks++;
+            if ((ticks & 255) == 0)
+            {
+                queued = refill(queue, s, queued);
+            }
+        }
+    }
+    double ns = 1e9 * (clock() - begin) / CLOCKS_PER_SEC / ticks;
+    fprintf(stderr, "take(): %.1f ns/tick on this machine, up to %.0f ticks/s (planning included) [%lu]\n", ns,
+            1e9 / ns, sum & 1);
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "all axes in step");
+    return failures ? 1 : 0;
+}
@@ -88,6 +88,522 @@
 
 #include "Arduino.h"
 #include "Stepper.h"
+#include "StepperTimer.h"
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR // (AVR) ISR code needs no special placement
+#endif
+
+void stepperTimerISR();
+
+/*
+ * Step timer: one hardware timer, shared by all instances (and StepperGroup,
+ * see StepperTimer.h), times the steps of the asynchronous moves.  Each
+ * platform provides
+ *   stepTimerStart(us) - (re)start it: interrupt after us
+ *   stepTimerArm(us)   - from the ISR: interrupt again after us
+ *   stepTimerStop()
+ *   stepTimerPoll()    - (no timer) call the "ISR" when it is due
+ * and STEPPER_MAX_WAIT, the longest period it can time (longer waits are
+ * timed in pieces).  STEPPER_LOCK()/STEPPER_UNLOCK() keep the ISR out.
+ */
+#if defined(ESP32)
+
+#ifndef STEPPER_TIMER
+#define STEPPER_TIMER 1 // hw timer 0-3
+#endif
+#define STEPPER_MAX_WAIT 1000000UL
+static hw_timer_t *step_timer = NULL;
+static portMUX_TYPE step_timer_mux = portMUX_INITIALIZER_UNLOCKED;
+#define STEPPER_LOCK() portENTER_CRITICAL(&step_timer_mux)
+#define STEPPER_UNLOCK() portEXIT_CRITICAL(&step_timer_mux)
+
+static void IRAM_ATTR onStepTimerInterrupt()
+{
+  portENTER_CRITICAL_ISR(&step_timer_mux);
+  stepperTimerISR();
+  portEXIT_CRITICAL_ISR(&step_timer_mux);
+}
+
+void stepTimerSetup()
+{
+  if (step_timer == NULL)
+  {
+    // prescaler 80 to clock at 1mhz, 1us/tick
+    step_timer = timerBegin(STEPPER_TIMER, 80, true);
+    timerAttachInterrupt(step_timer, &onStepTimerInterrupt, true);
+  }
+}
+
+void stepTimerStart(unsigned long wait)
+{
+  timerWrite(step_timer, 0);
+  timerAlarmWrite(step_timer, wait, true);
+  timerAlarmEnable(step_timer);
+}
+
+void IRAM_ATTR stepTimerArm(unsigned long wait)
+{
+  // the counter has just reloaded: takes effect for this period (auto-reload)
+  timerAlarmWrite(step_timer, wait, true);
+}
+
+void IRAM_ATTR stepTimerStop()
+{
+  timerAlarmDisable(step_timer);
+}
+
+void stepTimerPoll()
+{
+}
+
+#elif defined(ESP8266)
+
+#define STEPPER_MAX_WAIT 1000000UL // timer1 counts 23 bits, 5 ticks/us (TIM_DIV16)
+#define STEPPER_LOCK() noInterrupts()
+#define STEPPER_UNLOCK() interrupts()
+
+static void IRAM_ATTR onStepTimerInterrupt()
+{
+  stepperTimerISR();
+}
+
+void stepTimerSetup()
+{
+}
+
+void stepTimerStart(unsigned long wait)
+{
+  timer1_attachInterrupt(onStepTimerInterrupt);
+  timer1_enable(TIM_DIV16, TIM_EDGE, TIM_SINGLE);
+  timer1_write(wait * 5);
+}
+
+void IRAM_ATTR stepTimerArm(unsigned long wait)
+{
+  timer1_write(wait * 5);
+}
+
+void IRAM_ATTR stepTimerStop()
+{
+  timer1_disable();
+}
+
+void stepTimerPoll()
+{
+}
+
+#elif defined(__AVR__)
+
+// Timer1 in CTC mode, 64 CPU clocks per tick (4us at 16MHz)
+#define STEPPER_MAX_WAIT 200000UL
+static uint8_t step_timer_sreg;
+#define STEPPER_LOCK() \
+  step_timer_sreg = SREG; \
+  cli()
+#define STEPPER_UNLOCK() SREG = step_timer_sreg
+
+static inline uint16_t stepTimerTicks(unsigned long wait)
+{
+  unsigned long ticks = wait * (F_CPU / 1000000UL) / 64;
+  return (ticks > 1) ? ticks - 1 : 1;
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+  stepperTimerISR();
+}
+
+void stepTimerSetup()
+{
+}
+
+void stepTimerStart(unsigned long wait)
+{
+  TCCR1A = 0;
+  TCCR1B = _BV(WGM12) | _BV(CS11) | _BV(CS10);
+  TCNT1 = 0;
+  OCR1A = stepTimerTicks(wait);
+  TIFR1 = _BV(OCF1A);
+  TIMSK1 |= _BV(OCIE1A);
+}
+
+void stepTimerArm(unsigned long wait)
+{
+  OCR1A = stepTimerTicks(wait);
+}
+
+void stepTimerStop()
+{
+  TIMSK1 &= ~_BV(OCIE1A);
+  TCCR1B = 0;
+}
+
+void stepTimerPoll()
+{
+}
+
+#else
+
+// no timer: isBusy() (and so step()) checks the time and calls the "ISR"
+#define STEPPER_MAX_WAIT 0xFFFFFFFFUL
+#define STEPPER_LOCK()
+#define STEPPER_UNLOCK()
+static bool poll_running = false;
+static unsigned long poll_start = 0, poll_wait = 0;
+
+void stepTimerSetup()
+{
+}
+
+void stepTimerStart(unsigned long wait)
+{
+  poll_start = micros();
+  poll_wait = wait;
+  poll_running = true;
+}
+
+void stepTimerArm(unsigned long wait)
+{
+  poll_start += poll_wait;
+  poll_wait = wait;
+}
+
+void stepTimerStop()
+{
+  poll_running = false;
+}
+
+void stepTimerPoll()
+{
+  if (poll_running && micros() - poll_start >= poll_wait)
+  {
+    stepperTimerISR();
+  }
+}
+
+#endif
+
+/*
+ * Phase output: when all of a motor's pins are on one output port, each step
+ * is a single masked port write, so the coils change together (ESP32:
+ * GPIO.out_w1tc/w1ts, pins 0-31 or 32-39; ESP8266: GPOC/GPOS, pins 0-15;
+ * AVR: PORTx).  Each platform provides
+ *   stepPortBit(pin, bit, set, clear) - the pin's bit, and the registers that
+ *                                       set and clear it; false if none
+ *   stepPortWrite(set, clear, mask, bits)
+ * Otherwise (pins on different ports) the pins are written with digitalWrite().
+ */
+#if defined(ESP32)
+
+static bool stepPortBit(int pin, stepper_port_t &bit, volatile stepper_port_t *&set, volatile stepper_port_t *&clear)
+{
+  if (pin < 0 || pin > 39)
+  {
+    return false;
+  }
+  if (pin < 32)
+  {
+    bit = 1UL << pin;
+    set = &GPIO.out_w1ts;
+    clear = &GPIO.out_w1tc;
+  }
+  else
+  {
+    bit = 1UL << (pin - 32);
+    set = &GPIO.out1_w1ts.val;
+    clear = &GPIO.out1_w1tc.val;
+  }
+  return true;
+}
+
+static inline void IRAM_ATTR stepPortWrite(volatile stepper_port_t *set, volatile stepper_port_t *clear,
+                                           stepper_port_t mask, stepper_port_t bits)
+{
+  *clear = mask & ~bits;
+  *set = bits;
+}
+
+#elif defined(ESP8266)
+
+static bool stepPortBit(int pin, stepper_port_t &bit, volatile stepper_port_t *&set, volatile stepper_port_t *&clear)
+{
+  if (pin < 0 || pin > 15) // GPIO16 is not in GPO
+  {
+    return false;
+  }
+  bit = 1UL << pin;
+  set = &GPOS;
+  clear = &GPOC;
+  return true;
+}
+
+static inline void IRAM_ATTR stepPortWrite(volatile stepper_port_t *set, volatile stepper_port_t *clear,
+                                           stepper_port_t mask, stepper_port_t bits)
+{
+  *clear = mask & ~bits;
+  *set = bits;
+}
+
+#elif defined(__AVR__)
+
+static bool stepPortBit(int pin, stepper_port_t &bit, volatile stepper_port_t *&set, volatile stepper_port_t *&clear)
+{
+  uint8_t port = digitalPinToPort(pin);
+  if (port == NOT_A_PIN)
+  {
+    return false;
+  }
+  bit = digitalPinToBitMask(pin);
+  set = portOutputRegister(port);
+  clear = set; // one register: read-modify-write
+  return true;
+}
+
+static inline void stepPortWrite(volatile stepper_port_t *set, volatile stepper_port_t *clear,
+                                 stepper_port_t mask, stepper_port_t bits)
+{
+  (void)clear;
+  uint8_t sreg = SREG; // keep interrupts off the port while it is rewritten
+  cli();
+  *set = (*set & ~mask) | bits;
+  SREG = sreg;
+}
+
+#else
+
+// no port access: digitalWrite() each pin
+static bool stepPortBit(int pin, stepper_port_t &bit, volatile stepper_port_t *&set, volatile stepper_port_t *&clear)
+{
+  (void)pin;
+  (void)bit;
+  (void)set;
+  (void)clear;
+  return false;
+}
+
+static inline void stepPortWrite(volatile stepper_port_t *set, volatile stepper_port_t *clear,
+                                 stepper_port_t mask, stepper_port_t bits)
+{
+  (void)set;
+  (void)clear;
+  (void)mask;
+  (void)bits;
+}
+
+#endif
+
+/*
+ * PWM output, for microstepping (StepperSine.h).  Each platform provides
+ *   stepPwmAttach(pins, count, base) - make the pins PWM outputs; false if
+ *                                      they can't be (base: ESP32 LEDC
+ *                                      channels, handed out on first use)
+ *   stepPwmWrite(pin, base, index, duty) - duty of pin, index of pins
+ *   stepPwmDetach(pins, count, base) - back to digital outputs
+ * and STEPPER_PWM_BITS, the duty resolution.
+ */
+#if defined(ESP32)
+
+#include <soc/ledc_struct.h> // stepPwmWrite(), from the ISR
+
+#define STEPPER_PWM_BITS 10       // at 20 kHz: 80 MHz / 2^10 fits
+#define STEPPER_PWM_FREQUENCY 20000 // Hz, above hearing
+static uint8_t stepper_pwm_channels = 0; // LEDC channels handed out
+
+static bool stepPwmAttach(const int *pins, int count, int8_t &base)
+{
+  if (base < 0)
+  {
+    if (stepper_pwm_channels + count > 16)
+    {
+      return false;
+    }
+    base = stepper_pwm_channels;
+    stepper_pwm_channels += count;
+  }
+  for (int i = 0; i < count; i++)
+  {
+    ledcSetup(base + i, STEPPER_PWM_FREQUENCY, STEPPER_PWM_BITS);
+    ledcAttachPin(pins[i], base + i);
+  }
+  return true;
+}
+
+// from the step ISR: ledcWrite() takes a mutex and lives in flash, so the channel
+// registers are written directly (channels 0-7 high-speed, 8-15 low-speed, which also
+// need the update bit); the new duty starts with the next PWM cycle
+static inline void IRAM_ATTR stepPwmWrite(int pin, int8_t base, uint8_t index, uint16_t duty)
+{
+  (void)pin;
+  uint8_t channel = base + index;
+  LEDC.channel_group[channel / 8].channel[channel % 8].duty.duty = (uint32_t)duty << 4;
+  LEDC.channel_group[channel / 8].channel[channel % 8].conf0.sig_out_en = 1;
+  LEDC.channel_group[channel / 8].channel[channel % 8].conf1.duty_start = 1;
+  if (channel >= 8)
+  {
+    LEDC.channel_group[1].channel[channel % 8].conf0.low_speed_update = 1;
+  }
+}
+
+static void stepPwmDetach(const int *pins, int count, int8_t base)
+{
+  (void)base;
+  for (int i = 0; i < count; i++)
+  {
+    ledcDetachPin(pins[i]);
+    pinMode(pins[i], OUTPUT);
+  }
+}
+
+#elif defined(__AVR__)
+
+#define STEPPER_PWM_BITS 8
+
+// analogWrite() pins, except Timer1's: it is the step timer
+static bool stepPwmAttach(const int *pins, int count, int8_t &base)
+{
+  (void)base;
+  for (int i = 0; i < count; i++)
+  {
+    uint8_t timer = digitalPinToTimer(pins[i]);
+    if (timer == NOT_ON_TIMER || timer == TIMER1A || timer == TIMER1B
+#ifdef TIMER1C
+        || timer == TIMER1C
+#endif
+    )
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static inline void stepPwmWrite(int pin, int8_t base, uint8_t index, uint16_t duty)
+{
+  (void)base;
+  (void)index;
+  analogWrite(pin, duty);
+}
+
+static void stepPwmDetach(const int *pins, int count, int8_t base)
+{
+  (void)base;
+  for (int i = 0; i < count; i++)
+  {
+    digitalWrite(pins[i], LOW); // turns the pin's PWM off
+  }
+}
+
+#elif defined(ESP8266)
+
+// the core's analogWrite() runs on timer1, the step timer: no microstepping
+static bool stepPwmAttach(const int *pins, int count, int8_t &base)
+{
+  (void)pins;
+  (void)count;
+  (void)base;
+  return false;
+}
+
+static inline void stepPwmWrite(int pin, int8_t base, uint8_t index, uint16_t duty)
+{
+  (void)pin;
+  (void)base;
+  (void)index;
+  (void)duty;
+}
+
+static void stepPwmDetach(const int *pins, int count, int8_t base)
+{
+  (void)pins;
+  (void)count;
+  (void)base;
+}
+
+#else
+
+#define STEPPER_PWM_BITS 8 // analogWrite()
+
+static bool stepPwmAttach(const int *pins, int count, int8_t &base)
+{
+  (void)pins;
+  (void)count;
+  (void)base;
+  return true;
+}
+
+static inline void stepPwmWrite(int pin, int8_t base, uint8_t index, uint16_t duty)
+{
+  (void)base;
+  (void)index;
+  analogWrite(pin, duty);
+}
+
+static void stepPwmDetach(const int *pins, int count, int8_t base)
+{
+  (void)base;
+  for (int i = 0; i < count; i++)
+  {
+    digitalWrite(pins[i], LOW);
+  }
+}
+
+#endif
+
+#ifndef STEPPER_PWM_BITS
+#define STEPPER_PWM_BITS 8
+#endif
+
+void stepTimerLock()
+{
+  STEPPER_LOCK();
+}
+
+void stepTimerUnlock()
+{
+  STEPPER_UNLOCK();
+}
+
+const unsigned long stepTimerMaxWait = STEPPER_MAX_WAIT;
+
+// the Stepper or StepperGroup the step timer works for, and its ISR
+static void *timer_owner = NULL;
+static stepTimerHandler timer_handler = NULL;
+
+bool stepTimerClaim(void *owner, stepTimerHandler handler)
+{
+  if (timer_owner != NULL && timer_owner != owner)
+  {
+    return false;
+  }
+  timer_owner = owner;
+  timer_handler = handler;
+  return true;
+}
+
+void IRAM_ATTR stepTimerRelease(void *owner)
+{
+  if (timer_owner == owner)
+  {
+    timer_owner = NULL;
+  }
+}
+
+/*
+ * step timer interrupt: hand over to the owner of the timer
+ */
+void IRAM_ATTR stepperTimerISR()
+{
+  if (timer_owner != NULL)
+  {
+    timer_handler(timer_owner);
+  }
+}
+
+void IRAM_ATTR Stepper::timerHandler(void *stepper)
+{
+  ((Stepper *)stepper)->onStepTimer();
+}
 
 /*
  * two-wire constructor.
@@ -99,6 +615,21 @@ Stepper::Stepper(int number_of_steps, int motor_pin_1, int motor_pin_2)
   this->direction = 0;                     // motor direction
   this->last_step_time = 0;                // time stamp in us of the last step taken
   this->number_of_steps = number_of_steps; // total number of steps for this motor
+  this->INTERRUPTED = false;
+  this->running = false;                   // no asynchronous move yet
+  this->pending_direction = 1;
+  this->timer_wait = 0;
+  this->accel = 0;                         // no ramp: every step at the setSpeed() rate
+  this->jerk = 0;
+  this->microsteps = 1;                    // the phase table, no PWM
+  this->angle_step = 0;
+  this->angle = 0;
+  this->pwm_base = -1;
+  this->stall_pending = false;            // no encoder check until attachEncoder()
+  this->gave_up = false;
+  this->stall_count = 0;
+  this->stall_owed = 0;
+  this->stall_delay = 0;
 
   // Arduino pins for the motor control connection:
   this->motor_pin_1 = motor_pin_1;
@@ -115,6 +646,9 @@ Stepper::Stepper(int number_of_steps, int motor_pin_1, int motor_pin_2)
 
   // pin_count is used by the stepMotor() method:
   this->pin_count = 2;
+  this->half_step = false; // full step
+  this->phase_count = 0;
+  this->setupPhases();
 }
 
 /*
@@ -130,6 +664,21 @@ Stepper::Stepper(int number_of_steps, int motor_pin_1, int motor_pin_2,
   this->direction = 0;                     // motor direction
   this->last_step_time = 0;                // time stamp in us of the last step taken
   this->number_of_steps = number_of_steps; // total number of steps for this motor
+  this->INTERRUPTED = false;
+  this->running = false;                   // no asynchronous move yet
+  this->pending_direction = 1;
+  this->timer_wait = 0;
+  this->accel = 0;                         // no ramp: every step at the setSpeed() rate
+  this->jerk = 0;
+  this->microsteps = 1;                    // the phase table, no PWM
+  this->angle_step = 0;
+  this->angle = 0;
+  this->pwm_base = -1;
+  this->stall_pending = false;            // no encoder check until attachEncoder()
+  this->gave_up = false;
+  this->stall_count = 0;
+  this->stall_owed = 0;
+  this->stall_delay = 0;
 
   // Arduino pins for the motor control connection:
   this->motor_pin_1 = motor_pin_1;
@@ -147,6 +696,9 @@ Stepper::Stepper(int number_of_steps, int motor_pin_1, int motor_pin_2,
 
   // pin_count is used by the stepMotor() method:
   this->pin_count = 3;
+  this->half_step = true; // the 6-step sequence
+  this->phase_count = 0;
+  this->setupPhases();
 }
 
 /*
@@ -160,6 +712,21 @@ Stepper::Stepper(int number_of_steps, int motor_pin_1, int motor_pin_2,
   this->direction = 0;                     // motor direction
   this->last_step_time = 0;                // time stamp in us of the last step taken
   this->number_of_steps = number_of_steps; // total number of steps for this motor
+  this->INTERRUPTED = false;
+  this->running = false;                   // no asynchronous move yet
+  this->pending_direction = 1;
+  this->timer_wait = 0;
+  this->accel = 0;                         // no ramp: every step at the setSpeed() rate
+  this->jerk = 0;
+  this->microsteps = 1;                    // the phase table, no PWM
+  this->angle_step = 0;
+  this->angle = 0;
+  this->pwm_base = -1;
+  this->stall_pending = false;            // no encoder check until attachEncoder()
+  this->gave_up = false;
+  this->stall_count = 0;
+  this->stall_owed = 0;
+  this->stall_delay = 0;
 
   // Arduino pins for the motor control connection:
   this->motor_pin_1 = motor_pin_1;
@@ -178,6 +745,9 @@ Stepper::Stepper(int number_of_steps, int motor_pin_1, int motor_pin_2,
 
   // pin_count is used by the stepMotor() method:
   this->pin_count = 4;
+  this->half_step = false; // the 4-step sequence
+  this->phase_count = 0;
+  this->setupPhases();
 }
 
 /*
@@ -192,6 +762,21 @@ Stepper::Stepper(int number_of_steps, int motor_pin_1, int motor_pin_2,
   this->direction = 0;                     // motor direction
   this->last_step_time = 0;                // time stamp in us of the last step taken
   this->number_of_steps = number_of_steps; // total number of steps for this motor
+  this->INTERRUPTED = false;
+  this->running = false;                   // no asynchronous move yet
+  this->pending_direction = 1;
+  this->timer_wait = 0;
+  this->accel = 0;                         // no ramp: every step at the setSpeed() rate
+  this->jerk = 0;
+  this->microsteps = 1;                    // the phase table, no PWM
+  this->angle_step = 0;
+  this->angle = 0;
+  this->pwm_base = -1;
+  this->stall_pending = false;            // no encoder check until attachEncoder()
+  this->gave_up = false;
+  this->stall_count = 0;
+  this->stall_owed = 0;
+  this->stall_delay = 0;
 
   // Arduino pins for the motor control connection:
   this->motor_pin_1 = motor_pin_1;
@@ -209,6 +794,9 @@ Stepper::Stepper(int number_of_steps, int motor_pin_1, int motor_pin_2,
 
   // pin_count is used by the stepMotor() method:
   this->pin_count = 5;
+  this->half_step = true; // the 10-step sequence
+  this->phase_count = 0;
+  this->setupPhases();
 }
 
 /*
@@ -220,241 +808,476 @@ void Stepper::setSpeed(long whatSpeed)
 }
 
 /*
- * Moves the motor steps_to_move steps.  If the number is negative,
- * the motor moves in the reverse direction.
+ * Sets the acceleration (steps/s^2) of the moves queued after it: each move
+ * then speeds up from standstill to its step rate, and slows down to a stop
+ * on its last step.  jerk (steps/s^3) > 0 ramps the acceleration too
+ * (S-curve), for smoother starts.  0 (the default) = no ramp.
  */
-void Stepper::step(int steps_to_move)
+void Stepper::setAcceleration(long accel, long jerk)
 {
-  int steps_left = abs(steps_to_move); // how many steps to take
+  this->accel = (accel > 0) ? accel : 0;
+  this->jerk = (jerk > 0) ? jerk : 0;
+}
 
-  // determine direction based on whether steps_to_mode is + or -:
-  if (steps_to_move > 0)
+/*
+ * Half step (true) or full step (false).  Half stepping puts a state between
+ * each two full step states, so the motor takes twice the steps per
+ * revolution.  The default is the sequence the library always used: full
+ * step for 2 and 4 wires, half step for 3 and 5.  2 wires only full step.
+ */
+void Stepper::setHalfStep(bool half_step)
+{
+  this->half_step = half_step;
+  this->setupPhases();
+}
+
+/*
+ * Splits each full step into microsteps (2, 4 .. 32) driven with PWM duties
+ * from the sine table, or (1) goes back to the phase table.  False if the
+ * wiring (3 or 4 pins) or the pins can't.  Keeps the motor where it is: the
+ * first microstep angle is that of the phase table state, and back, the
+ * nearest state.
+ */
+bool Stepper::setMicrostep(uint8_t microsteps)
+{
+  if (microsteps == 0 || microsteps > STEPPER_MAX_MICROSTEPS || (microsteps & (microsteps - 1)) != 0)
   {
-    this->direction = 1;
+    return false;
   }
-  if (steps_to_move < 0)
+  if (stepperFullStepAngle(this->pin_count) == 0)
   {
-    this->direction = 0;
+    return microsteps == 1; // 2 and 5 pins: phase tables only
   }
+  const int pins[4] = {this->motor_pin_1, this->motor_pin_2, this->motor_pin_3, this->motor_pin_4};
 
-  // decrement the number of steps, moving one step each time, unless INTERRUPTED
-  //  (flag set by interrupt() method, enabling external interruption of otherwise-blocking loop):
-  while (steps_left > 0 && !INTERRUPTED)
+  if (microsteps == 1)
   {
-    yield(); // guard against WDT-timeout crashes on some controllers, e.g. heltec's wifi kit 32
-    unsigned long now = micros();
-    // move only if the appropriate delay has passed:
-    if (now - this->last_step_time >= this->step_delay)
+    if (this->microsteps == 1)
     {
-      // get the timeStamp of when you stepped:
-      this->last_step_time = now;
-      // increment or decrement the step number,
-      // depending on direction:
-      if (this->direction == 1)
-      {
-        this->step_number++;
-        if (this->step_number == this->number_of_steps)
-        {
-          this->step_number = 0;
-        }
-      }
-      else
-      {
-        if (this->step_number == 0)
-        {
-          this->step_number = this->number_of_steps;
-        }
-        this->step_number--;
-      }
-      // decrement the steps left:
-      steps_left--;
-      // step the motor to step number 0, 1, ..., {3 or 10}
-      switch (this->pin_count)
-      {
-      case 5:
-        stepMotor(this->step_number % 10);
-        break;
-      case 3:
-        stepMotor(this->step_number % 6);
-        break;
-      default: // 2, 4
-        stepMotor(this->step_number % 4);
-        break;
-      }
+      return true;
     }
+    STEPPER_LOCK();
+    uint16_t per_state = stepperFullStepAngle(this->pin_count) / (this->half_step ? 2 : 1);
+    uint16_t from_first = (this->angle + STEPPER_SINE_TURN - stepperPhaseAngle(this->pin_count, this->half_step, 0)) %
+                          STEPPER_SINE_TURN;
+    this->phase = ((from_first + per_state / 2) / per_state) % this->phase_count;
+    this->microsteps = 1;
+    STEPPER_UNLOCK();
+    stepPwmDetach(pins, this->pin_count, this->pwm_base);
+    stepMotor(this->phase);
+    return true;
+  }
+
+  if (this->microsteps == 1 && !stepPwmAttach(pins, this->pin_count, this->pwm_base))
+  {
+    return false;
   }
+  STEPPER_LOCK();
+  if (this->microsteps == 1)
+  {
+    this->angle = stepperPhaseAngle(this->pin_count, this->half_step, this->phase);
+  }
+  this->microsteps = microsteps;
+  this->angle_step = stepperFullStepAngle(this->pin_count) / microsteps;
+  this->microMotor();
+  STEPPER_UNLOCK();
+  return true;
 }
 
 /*
- * Moves the motor forward or backwards.
+ * Takes one step at once, without timing it (for sketches that time the
+ * steps themselves).  Not while asynchronous moves are running.
  */
-void Stepper::stepMotor(int thisStep)
+void Stepper::stepNow(int direction)
 {
-  if (this->pin_count == 2)
+  this->advance(direction);
+  this->last_step_time = micros();
+}
+
+/*
+ * Moves the motor steps_to_move steps.  If the number is negative,
+ * the motor moves in the reverse direction.  Blocks until done: queues
+ * the move, then waits for the step timer to finish it.
+ */
+void Stepper::step(int steps_to_move)
+{
+  // wait for queue space (or the timer), then for the move, unless INTERRUPTED
+  //  (flag set by interrupt() method, enabling external interruption of otherwise-blocking loop):
+  while (!this->stepAsync(steps_to_move) && !INTERRUPTED)
   {
-    switch (thisStep)
-    {
-    case 0: // 01
-      digitalWrite(motor_pin_1, LOW);
-      digitalWrite(motor_pin_2, HIGH);
-      break;
-    case 1: // 11
-      digitalWrite(motor_pin_1, HIGH);
-      digitalWrite(motor_pin_2, HIGH);
-      break;
-    case 2: // 10
-      digitalWrite(motor_pin_1, HIGH);
-      digitalWrite(motor_pin_2, LOW);
-      break;
-    case 3: // 00
-      digitalWrite(motor_pin_1, LOW);
-      digitalWrite(motor_pin_2, LOW);
-      break;
-    }
+    yield(); // guard against WDT-timeout crashes on some controllers, e.g. heltec's wifi kit 32
+  }
+  while (this->isBusy() && !INTERRUPTED)
+  {
+    yield();
+  }
+  if (INTERRUPTED)
+  {
+    this->stop();
+  }
+}
+
+/*
+ * Queues a move of steps_to_move steps at the speed set by setSpeed(), and
+ * returns at once.  Returns false (nothing queued) if the queue is full or
+ * another Stepper's move is using the step timer.
+ */
+bool Stepper::stepAsync(int steps_to_move)
+{
+  return this->queueMove(steps_to_move, this->step_delay);
+}
+
+/*
+ * Queues a move of steps_to_move steps, step_delay us apart, and returns at
+ * once.  The first step of a move follows the last step of the one before
+ * it by step_delay, so back-to-back moves keep their step rate.  With an
+ * acceleration set (setAcceleration()), step_delay is the cruise rate, and
+ * the move ramps up to it and back down.
+ */
+bool Stepper::queueMove(int steps_to_move, unsigned long step_delay)
+{
+  if (this->stall_pending)
+  {
+    this->retry(); // the steps a stall left owed go first
+  }
+  // plan the ramp here, not in the ISR (the one division / square root per move)
+  StepperProfile profile;
+  profile.plan((steps_to_move < 0) ? -(long)steps_to_move : steps_to_move, step_delay, this->accel, this->jerk);
+  stepTimerSetup();
+  STEPPER_LOCK();
+  if (!stepTimerClaim(this, &Stepper::timerHandler))
+  {
+    STEPPER_UNLOCK(); // another Stepper or StepperGroup is moving
+    return false;
+  }
+  bool queued = this->queue.push(steps_to_move, profile);
+  this->gave_up = this->gave_up && !queued;
+  this->startMoves();
+  STEPPER_UNLOCK();
+  return queued;
+}
+
+/*
+ * (Locked, owning the timer) when idle, starts the timer for the first step
+ * queued, or lets the timer go if there is none.
+ */
+void Stepper::startMoves()
+{
+  int direction;
+  unsigned long first_delay;
+  if (this->running || this->stall_pending)
+  {
+    return;
   }
-  if (this->pin_count == 3)
+  if (this->queue.take(direction, first_delay))
   {
-    switch (thisStep)
+    this->running = true;
+    this->pending_direction = direction;
+    unsigned long since = micros() - this->last_step_time;
+    unsigned long wait = (since < first_delay) ? first_delay - since : 1;
+    unsigned long piece = (wait < STEPPER_MAX_WAIT) ? wait : STEPPER_MAX_WAIT;
+    this->timer_wait = wait - piece;
+    stepTimerStart(piece);
+  }
+  else
+  {
+    stepTimerRelease(this); // nothing to move after all
+  }
+}
+
+/*
+ * True while queued moves are still being stepped (or wait for a retry).
+ */
+bool Stepper::isBusy()
+{
+  stepTimerPoll();
+  if (this->stall_pending)
+  {
+    this->retry();
+  }
+  return this->running || this->stall_pending;
+}
+
+/*
+ * Stops after the step in progress, dropping the queued moves.
+ */
+void Stepper::stop()
+{
+  STEPPER_LOCK();
+  if (this->running)
+  {
+    stepTimerStop();
+    this->running = false;
+  }
+  stepTimerRelease(this); // (kept while a stall waited for its retry)
+  this->queue.clear();
+  this->timer_wait = 0;
+  this->stall_pending = false;
+  STEPPER_UNLOCK();
+}
+
+/*
+ * Checks the moves against an encoder: read_count() (called from the step
+ * ISR) counts counts per steps motor steps.  When the motor lags more than
+ * window steps behind the steps it was given, it has stalled: the move stops,
+ * and the steps owed are queued again, slower.  Starts from the position
+ * now.  A NULL read_count turns the check off.
+ */
+void Stepper::attachEncoder(StepperEncoderRead read_count, long counts, long steps, unsigned int window)
+{
+  STEPPER_LOCK();
+  this->stall.attach(read_count, counts, steps, window);
+  this->stall_count = 0;
+  this->stall_pending = false;
+  this->gave_up = false;
+  STEPPER_UNLOCK();
+}
+
+/*
+ * Each stall is retried up to retries times, each retry backoff percent
+ * slower than the move that stalled (default 3, 50%).
+ */
+void Stepper::setStallRetry(uint8_t retries, uint8_t backoff)
+{
+  this->stall.setRetry(retries, backoff);
+}
+
+unsigned int Stepper::stallCount()
+{
+  return this->stall_count;
+}
+
+bool Stepper::stalled()
+{
+  return this->gave_up;
+}
+
+/*
+ * After a stall: takes the steps the move still owes (those the motor lost,
+ * and those not taken yet) at the backed-off speed, then the moves queued
+ * after it; or, with the retries used up, gives up and drops them all.
+ */
+void Stepper::retry()
+{
+  STEPPER_LOCK();
+  if (!this->stall_pending || micros() - this->last_step_time < STEPPER_STALL_SETTLE)
+  {
+    STEPPER_UNLOCK();
+    return; // (still settling)
+  }
+  // where the rotor settled: whole electrical cycles behind
+  uint16_t cycle = (this->microsteps > 1) ? STEPPER_SINE_TURN / this->angle_step : this->phase_count;
+  long owed = this->stall_owed + this->stall.settledLag(cycle);
+  this->stall.sync();
+  unsigned long delay = this->stall_delay;
+  this->gave_up = !this->stall.retry(delay, owed);
+  STEPPER_UNLOCK();
+  if (this->gave_up)
+  {
+    this->stop();
+    return;
+  }
+
+  StepperProfile profile; // (outside the lock: the ramp's square root)
+  profile.plan((owed < 0) ? -owed : owed, delay, this->accel, this->jerk);
+  STEPPER_LOCK();
+  this->stall_pending = false;
+  if (owed != 0)
+  {
+    this->queue.restart(owed, profile);
+  }
+  this->startMoves();
+  STEPPER_UNLOCK();
+}
+
+/*
+ * Step timer interrupt (with the ISR locked out of everything else): take the
+ * step that is due, and time the next one.
+ */
+void IRAM_ATTR Stepper::onStepTimer()
+{
+  if (this->timer_wait > 0)
+  {
+    this->schedule(this->timer_wait); // the next piece of a long wait
+    return;
+  }
+  this->last_step_time = micros();
+  this->advance(this->pending_direction);
+
+  if (this->stall.attached() && this->stall.check())
+  {
+    // stalled: stop here, keeping the timer and the queued moves for retry()
+    this->stall_owed = this->queue.dropMove();
+    this->stall_delay = this->queue.moveDelay();
+    this->stall_count++;
+    this->stall_pending = true;
+    stepTimerStop();
+    this->running = false;
+    return;
+  }
+
+  int direction;
+  unsigned long step_delay;
+  if (this->queue.take(direction, step_delay))
+  {
+    this->pending_direction = direction;
+    this->schedule(step_delay);
+  }
+  else
+  {
+    stepTimerStop(); // all moves done
+    this->running = false;
+    stepTimerRelease(this);
+  }
+}
+
+/*
+ * Times the next timer interrupt wait us from now (from the ISR).
+ */
+void IRAM_ATTR Stepper::schedule(unsigned long wait)
+{
+  unsigned long piece = (wait < STEPPER_MAX_WAIT) ? wait : STEPPER_MAX_WAIT;
+  this->timer_wait = wait - piece;
+  stepTimerArm((piece > 0) ? piece : 1);
+}
+
+/*
+ * Takes one step in direction (1 or -1).
+ */
+void IRAM_ATTR Stepper::advance(int direction)
+{
+  this->stall.stepped(direction);
+  this->direction = (direction > 0) ? 1 : 0;
+  // increment or decrement the step number,
+  // depending on direction:
+  if (this->direction == 1)
+  {
+    this->step_number++;
+    if (this->step_number == this->number_of_steps)
     {
-    case 0: // 001
-      digitalWrite(motor_pin_1, LOW);
-      digitalWrite(motor_pin_2, LOW);
-      digitalWrite(motor_pin_3, HIGH);
-      break;
-    case 1: // 101
-      digitalWrite(motor_pin_1, HIGH);
-      digitalWrite(motor_pin_2, LOW);
-      digitalWrite(motor_pin_3, HIGH);
-      break;
-    case 2: // 100
-      digitalWrite(motor_pin_1, HIGH);
-      digitalWrite(motor_pin_2, LOW);
-      digitalWrite(motor_pin_3, LOW);
-      break;
-    case 3: // 110
-      digitalWrite(motor_pin_1, HIGH);
-      digitalWrite(motor_pin_2, HIGH);
-      digitalWrite(motor_pin_3, LOW);
-      break;
-    case 4: // 010
-      digitalWrite(motor_pin_1, LOW);
-      digitalWrite(motor_pin_2, HIGH);
-      digitalWrite(motor_pin_3, LOW);
-      break;
-    case 5: // 011
-      digitalWrite(motor_pin_1, LOW);
-      digitalWrite(motor_pin_2, HIGH);
-      digitalWrite(motor_pin_3, HIGH);
-      break;
+      this->step_number = 0;
     }
   }
-  if (this->pin_count == 4)
+  else
   {
-    switch (thisStep)
+    if (this->step_number == 0)
     {
-    case 0: // 1010
-      digitalWrite(motor_pin_1, HIGH);
-      digitalWrite(motor_pin_2, LOW);
-      digitalWrite(motor_pin_3, HIGH);
-      digitalWrite(motor_pin_4, LOW);
-      break;
-    case 1: // 0110
-      digitalWrite(motor_pin_1, LOW);
-      digitalWrite(motor_pin_2, HIGH);
-      digitalWrite(motor_pin_3, HIGH);
-      digitalWrite(motor_pin_4, LOW);
-      break;
-    case 2: // 0101
-      digitalWrite(motor_pin_1, LOW);
-      digitalWrite(motor_pin_2, HIGH);
-      digitalWrite(motor_pin_3, LOW);
-      digitalWrite(motor_pin_4, HIGH);
-      break;
-    case 3: // 1001
-      digitalWrite(motor_pin_1, HIGH);
-      digitalWrite(motor_pin_2, LOW);
-      digitalWrite(motor_pin_3, LOW);
-      digitalWrite(motor_pin_4, HIGH);
-      break;
+      this->step_number = this->number_of_steps;
     }
+    this->step_number--;
+  }
+  if (this->microsteps > 1)
+  {
+    // the next (or previous) microstep angle
+    this->angle += (this->direction == 1) ? this->angle_step : STEPPER_SINE_TURN - this->angle_step;
+    this->angle = (this->angle >= STEPPER_SINE_TURN) ? this->angle - STEPPER_SINE_TURN : this->angle;
+    microMotor();
+    return;
+  }
+  // and the motor to the next (or previous) state of its phase table:
+  if (this->direction == 1)
+  {
+    this->phase = (this->phase + 1 < this->phase_count) ? this->phase + 1 : 0;
   }
+  else
+  {
+    this->phase = (this->phase > 0) ? this->phase - 1 : this->phase_count - 1;
+  }
+  stepMotor(this->phase);
+}
 
-  if (this->pin_count == 5)
+/*
+ * Moves the motor to state thisStep of its phase table: one port write when
+ * the pins share a port, else a digitalWrite() per pin.
+ */
+void IRAM_ATTR Stepper::stepMotor(int thisStep)
+{
+  stepper_port_t bits = this->phase_words[thisStep];
+  if (this->port_mask != 0)
   {
-    switch (thisStep)
+    stepPortWrite(this->port_set, this->port_clear, this->port_mask, bits);
+    return;
+  }
+  const int pins[5] = {this->motor_pin_1, this->motor_pin_2, this->motor_pin_3, this->motor_pin_4, this->motor_pin_5};
+  for (int i = 0; i < this->pin_count; i++)
+  {
+    digitalWrite(pins[i], ((bits >> i) & 1) ? HIGH : LOW);
+  }
+}
+
+/*
+ * Sets the PWM duties of the pins for the electrical angle (microstepping).
+ */
+void IRAM_ATTR Stepper::microMotor()
+{
+  const int pins[4] = {this->motor_pin_1, this->motor_pin_2, this->motor_pin_3, this->motor_pin_4};
+  uint16_t duty[4];
+  stepperMicroDuties(this->pin_count, this->angle, STEPPER_PWM_BITS, duty);
+  for (int i = 0; i < this->pin_count; i++)
+  {
+    stepPwmWrite(pins[i], this->pwm_base, i, duty[i]);
+  }
+}
+
+/*
+ * Builds the phase table for the wiring and step mode: the port bits of each
+ * state (or, with the pins on different ports, the pin levels: bit 0 =
+ * motor_pin_1).
+ */
+void Stepper::setupPhases()
+{
+  const int pins[5] = {this->motor_pin_1, this->motor_pin_2, this->motor_pin_3, this->motor_pin_4, this->motor_pin_5};
+  uint8_t count;
+  const uint8_t *levels = stepperPhases(this->pin_count, this->half_step, count);
+
+  // all the pins on one port?
+  stepper_port_t bits[5] = {0, 0, 0, 0, 0};
+  volatile stepper_port_t *set = NULL, *clear = NULL;
+  bool one_port = true;
+  for (int i = 0; i < this->pin_count && one_port; i++)
+  {
+    volatile stepper_port_t *pin_set, *pin_clear;
+    one_port = stepPortBit(pins[i], bits[i], pin_set, pin_clear) && (i == 0 || pin_set == set);
+    set = pin_set;
+    clear = pin_clear;
+  }
+
+  STEPPER_LOCK();
+  this->port_mask = 0; // 0 = digitalWrite()
+  for (int i = 0; i < this->pin_count && one_port; i++)
+  {
+    this->port_mask |= bits[i];
+  }
+  for (uint8_t state = 0; state < count; state++)
+  {
+    stepper_port_t word = 0;
+    for (int i = 0; i < this->pin_count; i++)
     {
-    case 0: // 01101
-      digitalWrite(motor_pin_1, LOW);
-      digitalWrite(motor_pin_2, HIGH);
-      digitalWrite(motor_pin_3, HIGH);
-      digitalWrite(motor_pin_4, LOW);
-      digitalWrite(motor_pin_5, HIGH);
-      break;
-    case 1: // 01001
-      digitalWrite(motor_pin_1, LOW);
-      digitalWrite(motor_pin_2, HIGH);
-      digitalWrite(motor_pin_3, LOW);
-      digitalWrite(motor_pin_4, LOW);
-      digitalWrite(motor_pin_5, HIGH);
-      break;
-    case 2: // 01011
-      digitalWrite(motor_pin_1, LOW);
-      digitalWrite(motor_pin_2, HIGH);
-      digitalWrite(motor_pin_3, LOW);
-      digitalWrite(motor_pin_4, HIGH);
-      digitalWrite(motor_pin_5, HIGH);
-      break;
-    case 3: // 01010
-      digitalWrite(motor_pin_1, LOW);
-      digitalWrite(motor_pin_2, HIGH);
-      digitalWrite(motor_pin_3, LOW);
-      digitalWrite(motor_pin_4, HIGH);
-      digitalWrite(motor_pin_5, LOW);
-      break;
-    case 4: // 11010
-      digitalWrite(motor_pin_1, HIGH);
-      digitalWrite(motor_pin_2, HIGH);
-      digitalWrite(motor_pin_3, LOW);
-      digitalWrite(motor_pin_4, HIGH);
-      digitalWrite(motor_pin_5, LOW);
-      break;
-    case 5: // 10010
-      digitalWrite(motor_pin_1, HIGH);
-      digitalWrite(motor_pin_2, LOW);
-      digitalWrite(motor_pin_3, LOW);
-      digitalWrite(motor_pin_4, HIGH);
-      digitalWrite(motor_pin_5, LOW);
-      break;
-    case 6: // 10110
-      digitalWrite(motor_pin_1, HIGH);
-      digitalWrite(motor_pin_2, LOW);
-      digitalWrite(motor_pin_3, HIGH);
-      digitalWrite(motor_pin_4, HIGH);
-      digitalWrite(motor_pin_5, LOW);
-      break;
-    case 7: // 10100
-      digitalWrite(motor_pin_1, HIGH);
-      digitalWrite(motor_pin_2, LOW);
-      digitalWrite(motor_pin_3, HIGH);
-      digitalWrite(motor_pin_4, LOW);
-      digitalWrite(motor_pin_5, LOW);
-      break;
-    case 8: // 10101
-      digitalWrite(motor_pin_1, HIGH);
-      digitalWrite(motor_pin_2, LOW);
-      digitalWrite(motor_pin_3, HIGH);
-      digitalWrite(motor_pin_4, LOW);
-      digitalWrite(motor_pin_5, HIGH);
-      break;
-    case 9: // 00101
-      digitalWrite(motor_pin_1, LOW);
-      digitalWrite(motor_pin_2, LOW);
-      digitalWrite(motor_pin_3, HIGH);
-      digitalWrite(motor_pin_4, LOW);
-      digitalWrite(motor_pin_5, HIGH);
-      break;
+      if (levels[state] & (1 << i))
+      {
+        word |= one_port ? bits[i] : (stepper_port_t)1 << i;
+      }
     }
+    this->phase_words[state] = word;
+  }
+  this->port_set = set;
+  this->port_clear = clear;
+  // keep the motor where it is: the same state in the new table (2 pins
+  // have one table), else the nearest one
+  if (this->phase_count == 0)
+  {
+    this->phase = 0; // new motor
+  }
+  else if (count > this->phase_count)
+  {
+    this->phase = 2 * this->phase + ((this->pin_count == 3) ? 1 : 0);
+  }
+  else if (count < this->phase_count)
+  {
+    this->phase = this->phase / 2;
   }
+  this->phase_count = count;
+  STEPPER_UNLOCK();
 }
 
 /*
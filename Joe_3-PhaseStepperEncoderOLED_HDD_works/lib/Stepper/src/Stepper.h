@@ -84,12 +84,49 @@
  * The circuits can be found at
  *
  * http://www.arduino.cc/en/Tutorial/Stepper
+ *
+ * Asynchronous moves: stepAsync() and queueMove() queue a move and return at
+ * once; a hardware timer ISR takes the steps (ESP32: timer STEPPER_TIMER,
+ * ESP8266: timer1, AVR: Timer1), so the sketch can do other work while the
+ * motor moves, and queued moves follow each other without a pause.  One
+ * Stepper (or StepperGroup, StepperGroup.h) at a time owns the timer.
+ * step() queues its move and waits for it.  On other boards the moves are
+ * polled from step() and isBusy().
+ *
+ * Acceleration: after setAcceleration(), each move ramps up from standstill
+ * to its speed and back down to a stop (trapezoidal, or S-curve with a jerk
+ * limit), so speeds above the motor's pull-in rate can be reached; the ISR
+ * times the steps with integer math only (StepperRamp.h).
+ *
+ * Outputs: the sequences above are tables (StepperPhases.h), with half step
+ * variants (setHalfStep()).  When all of a motor's pins are on one output
+ * port (ESP32: GPIO 0-31 or 32-39, ESP8266: GPIO 0-15, AVR: one PORTx), a
+ * step is a single masked port write, instead of a digitalWrite() per pin.
+ *
+ * Microstepping: setMicrostep() splits each full step of a 3 or 4 pin motor
+ * into 2 .. 32 microsteps.  The pins become PWM outputs whose duties follow
+ * a sine table (StepperSine.h) as the ISR steps the electrical angle: smoother
+ * and quieter at low speed, and finer positions.  Count microsteps in the
+ * constructor's number of steps.  Needs PWM pins (ESP32: any, through LEDC;
+ * AVR: analogWrite() pins not on Timer1; not on ESP8266, whose PWM uses the
+ * step timer).
+ *
+ * Stall recovery: attachEncoder() has the ISR compare the steps given with
+ * an encoder's count; when the motor falls behind (stalls, or slips at a
+ * speed it can't pull), the move stops, and its steps still owed are taken
+ * again, slower (StepperStall.h), before the moves queued after it; from
+ * isBusy() or the next queueMove().
  */
 
 // ensure this library description is only included once
 #ifndef Stepper_h
 #define Stepper_h
 
+#include "StepperQueue.h"
+#include "StepperPhases.h"
+#include "StepperSine.h"
+#include "StepperStall.h"
+
 // library interface description
 class Stepper
 {
@@ -106,10 +143,31 @@ public:
 
         // speed setter method:
         void setSpeed(long whatSpeed);
+        void setAcceleration(long accel, long jerk = 0); // steps/s^2, steps/s^3; 0 = no ramp
+        void setHalfStep(bool half_step);                // false = full step
+        bool setMicrostep(uint8_t microsteps);           // per full step, 2 .. 32 (3 and 4 pins); 1 = off
 
-        // mover method:
+        // mover method (blocking):
         void step(int number_of_steps);
 
+        // asynchronous mover methods (return false if the queue is full, or
+        // another Stepper or a StepperGroup is using the step timer):
+        bool stepAsync(int number_of_steps); // at the setSpeed() speed
+        bool queueMove(int number_of_steps, unsigned long step_delay); // delay in us
+        bool isBusy();                       // moves still queued or in progress
+        void stop();                         // drop all queued moves
+
+        // one step at once, untimed (not while asynchronous moves run):
+        void stepNow(int direction); // 1 or -1
+
+        // encoder check (StepperStall.h): counts encoder counts per steps motor
+        // steps; a lag of more than window steps is a stall, and the steps
+        // owed are queued again, slower:
+        void attachEncoder(StepperEncoderRead read_count, long counts, long steps, unsigned int window);
+        void setStallRetry(uint8_t retries, uint8_t backoff); // per stall; percent slower each retry
+        unsigned int stallCount();                            // stalls since attachEncoder()
+        bool stalled();                                       // the last stall used up its retries
+
         // interrupt otherwise blocking code
         void interrupt();
         void clear_interrupt();
@@ -118,6 +176,15 @@ public:
 
 private:
         void stepMotor(int this_step);
+        void microMotor();
+        void retry();
+        void startMoves();
+        void setupPhases();
+        void advance(int direction);
+        void schedule(unsigned long wait);
+        void onStepTimer();
+        static void timerHandler(void *stepper);
+        friend class StepperGroup; // steps the motor
 
         int direction;            // Direction of rotation
         unsigned long step_delay; // delay between steps, in ms, based on speed
@@ -135,6 +202,37 @@ private:
         unsigned long last_step_time; // time stamp in us of when the last step was taken
 
         bool INTERRUPTED; // bool to interrupt otherwise blocking code
+
+        // phase table (StepperPhases.h), as output port words:
+        bool half_step;                                 // half or full step sequence
+        uint8_t phase;                                  // state the motor is in
+        uint8_t phase_count;                            // states in the table
+        stepper_port_t phase_words[STEPPER_MAX_PHASES]; // port bits set in each state (digitalWrite(): bit 0 = motor_pin_1)
+        stepper_port_t port_mask;                       // all the motor's port bits; 0 = pins on different ports, digitalWrite()
+        volatile stepper_port_t *port_set;              // register that sets port bits
+        volatile stepper_port_t *port_clear;            // register that clears them (AVR: the port itself)
+
+        // microstepping (StepperSine.h), PWM on the pins:
+        uint8_t microsteps; // per full step; 1 = the phase table
+        uint8_t angle_step; // angle units per microstep
+        uint16_t angle;     // electrical angle, 0 .. STEPPER_SINE_TURN - 1
+        int8_t pwm_base;    // first PWM channel (ESP32 LEDC); -1 = none yet
+
+        // asynchronous moves:
+        StepperQueue queue;         // moves not taken yet
+        volatile bool running;      // the step timer is running for this motor
+        int pending_direction;      // of the step the timer is timing
+        unsigned long timer_wait;   // us still to wait after this timer period (long delays are timed in pieces)
+        long accel;                 // steps/s^2 of the moves queued next; 0 = no ramp
+        long jerk;                  // steps/s^3; 0 = trapezoidal ramp
+
+        // encoder check:
+        StepperStall stall;
+        volatile bool stall_pending;      // the ISR stopped on a stall: retry() restarts the move
+        volatile bool gave_up;            // retries used up
+        volatile unsigned int stall_count;
+        long stall_owed;                  // steps of the move not taken when it stalled
+        unsigned long stall_delay;        // cruise step delay of the move that stalled
 };
 
 #endif
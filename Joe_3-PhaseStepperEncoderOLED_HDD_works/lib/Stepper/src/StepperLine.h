@@ -0,0 +1,284 @@
+/*
+ * StepperLine.h - straight-line moves of several axes, for StepperGroup
+ *
+ * A queue of segments (steps per axis); the step timer ISR takes them off one
+ * tick at a time.  Each tick is one step of the segment's longest (major)
+ * axis; the other axes step on the ticks Bresenham's line algorithm picks
+ * (an axis with d of the M major steps steps when its error, started at M/2
+ * and raised by d each tick, reaches M), so every axis moves in proportion
+ * and all of them start and finish together.  The tick rate follows a
+ * StepperRamp, in major axis steps.
+ *
+ * Lookahead: a segment need not stop before the next one.  Its speed at the
+ * junction is limited by how much each axis's speed jumps there (the "jump"
+ * of setAcceleration(), in steps/s, as the corner changes direction), and
+ * by the acceleration: each segment must be able to slow down to the next
+ * junction, and the last one queued to a stop.  Each new segment plans the
+ * segments not started yet again, backwards (slowing down in time) and
+ * forwards (speeding up from the segment in progress).  The segment in
+ * progress keeps its plan, so queue ahead: a segment that starts with
+ * nothing queued after it stops at its end.
+ *
+ * Single producer (sketch), single consumer (ISR), as StepperQueue; the
+ * sketch plans outside the ISR lock and publishes with commit().
+ *
+ * Kept free of Arduino headers so it can be compiled natively.
+ */
+
+// ensure this library description is only included once
+#ifndef StepperLine_h
+#define StepperLine_h
+
+#include <stdint.h>
+#include <math.h>
+#include "StepperRamp.h"
+
+#ifndef STEPPER_GROUP_AXES
+#define STEPPER_GROUP_AXES 3 // axes per group, at most 8
+#endif
+
+#ifndef STEPPER_LINE_QUEUE_SIZE
+#if defined(__AVR__)
+#define STEPPER_LINE_QUEUE_SIZE 4 // segments; a power of 2
+#else
+#define STEPPER_LINE_QUEUE_SIZE 8 // segments; a power of 2
+#endif
+#endif
+
+struct StepperSegment
+{
+        unsigned long steps[STEPPER_GROUP_AXES]; // per axis, unsigned
+        uint8_t reverse;                         // bit per axis: stepping backwards
+        unsigned long major;                     // ticks: steps of the longest axis
+        float cruise;                            // major axis steps/s
+        float corner;                            // junction speed limit, as a fraction of cruise
+        float exit;                              // planned exit speed, as a fraction of cruise
+        StepperProfile profile;                  // major axis step timing
+};
+
+class StepperLineQueue
+{
+public:
+        StepperLineQueue()
+        {
+                this->axes = STEPPER_GROUP_AXES;
+                this->accel = 0;
+                this->jump = 0;
+                this->clear();
+        }
+
+        void setAxes(uint8_t axes) { this->axes = (axes < STEPPER_GROUP_AXES) ? axes : STEPPER_GROUP_AXES; }
+
+        /*
+         * accel: major axis steps/s^2 (0 = no ramps: constant speed); jump: the
+         * largest sudden speed change of any axis at a junction, steps/s.
+         */
+        void setAcceleration(unsigned long accel, unsigned long jump)
+        {
+                this->accel = accel;
+                this->jump = jump;
+        }
+
+        /*
+         * Plans a segment of delta[axis] steps (negative = backwards), step_delay
+         * us per major axis step, and the segments queued but not started, with
+         * it last (sketch side).  Nothing is queued until commit().  Returns
+         * false if the queue is full or the segment has no steps.
+         */
+        bool plan(const long *delta, unsigned long step_delay)
+        {
+                uint8_t next = (this->head + 1) & (STEPPER_LINE_QUEUE_SIZE - 1);
+                if (next == this->tail)
+                {
+                        return false;
+                }
+                StepperSegment &segment = this->moves[this->head];
+                segment.major = 0;
+                segment.reverse = 0;
+                for (uint8_t axis = 0; axis < this->axes; axis++)
+                {
+                        segment.steps[axis] = (delta[axis] < 0) ? -delta[axis] : delta[axis];
+                        segment.reverse |= (delta[axis] < 0) ? 1 << axis : 0;
+                        segment.major = (segment.steps[axis] > segment.major) ? segment.steps[axis] : segment.major;
+                }
+                if (segment.major == 0)
+                {
+                        return false;
+                }
+                segment.cruise = 1e6f / ((step_delay > 0) ? step_delay : 1);
+                segment.corner = this->corner(segment, delta);
+                segment.exit = 0;
+                this->planned_tail = this->tail;
+                this->replan(next);
+                return true;
+        }
+
+        /*
+         * Queues the segment plan() planned (sketch side, with the ISR locked
+         * out).  Returns false, queueing nothing, if a segment started since
+         * plan(): plan it again.
+         */
+        bool commit()
+        {
+                if (this->tail != this->planned_tail)
+                {
+                        return false;
+                }
+                const uint8_t mask = STEPPER_LINE_QUEUE_SIZE - 1;
+                uint8_t next = (this->head + 1) & mask;
+                for (uint8_t index = this->tail; index != next; index = (index + 1) & mask)
+                {
+                        this->moves[index].exit = this->planned_exit[index];
+                        this->moves[index].profile = this->planned_profile[index];
+                }
+                for (uint8_t axis = 0; axis < this->axes; axis++)
+                {
+                        this->last_velocity[axis] = this->next_velocity[axis];
+                }
+                this->head = next; // publish the segment
+                return true;
+        }
+
+        /*
+         * Takes the next tick (ISR side): a bit per axis to step, a bit per axis
+         * stepping backwards, and the delay after the tick before.  Returns false
+         * when no ticks are left.
+         */
+        inline bool take(uint8_t &step, uint8_t &reverse, unsigned long &tick_delay)
+        {
+                if (this->ticks_left == 0)
+                {
+                        if (this->tail == this->head)
+                        {
+                                return false;
+                        }
+                        this->current = this->moves[this->tail];
+                        this->running_exit = this->current.exit;
+                        this->tail = (this->tail + 1) & (STEPPER_LINE_QUEUE_SIZE - 1);
+                        this->ramp.start(this->current.profile);
+                        this->ticks_left = this->current.major;
+                        for (uint8_t axis = 0; axis < this->axes; axis++)
+                        {
+                                this->error[axis] = this->current.major / 2;
+                        }
+                }
+                this->ticks_left--;
+                step = 0;
+                for (uint8_t axis = 0; axis < this->axes; axis++)
+                {
+                        this->error[axis] += this->current.steps[axis];
+                        if (this->error[axis] >= this->current.major)
+                        {
+                                this->error[axis] -= this->current.major;
+                                step |= 1 << axis;
+                        }
+                }
+                reverse = this->current.reverse;
+                tick_delay = this->ramp.next();
+                return true;
+        }
+
+        bool empty() const { return this->ticks_left == 0 && this->head == this->tail; }
+
+        // drops all segments (only while the ISR can't take())
+        void clear()
+        {
+                this->head = this->tail = this->planned_tail = 0;
+                this->ticks_left = 0;
+                this->running_exit = 0;
+                for (uint8_t axis = 0; axis < STEPPER_GROUP_AXES; axis++)
+                {
+                        this->last_velocity[axis] = 0;
+                        this->error[axis] = 0;
+                }
+        }
+
+private:
+        // junction speed limit of segment (after the last one queued): the
+        // fraction of both cruise speeds at which no axis jumps more than jump
+        float corner(const StepperSegment &segment, const long *delta)
+        {
+                float worst = 0;
+                for (uint8_t axis = 0; axis < this->axes; axis++)
+                {
+                        this->next_velocity[axis] = segment.cruise * delta[axis] / (float)segment.major;
+                        float change = fabsf(this->next_velocity[axis] - this->last_velocity[axis]);
+                        worst = (change > worst) ? change : worst;
+                }
+                if (this->accel == 0)
+                {
+                        return 1; // no ramps
+                }
+                return (worst <= this->jump) ? 1 : this->jump / worst;
+        }
+
+        // speed (fraction f of cruise) as steps from standstill
+        unsigned long speedSteps(const StepperSegment &segment, float f) const
+        {
+                return StepperProfile::speedSteps(f * segment.cruise, this->accel);
+        }
+
+        // plans the segments from planned_tail up to (not including) end, into
+        // planned_exit and planned_profile (the ISR may be taking them)
+        void replan(uint8_t end)
+        {
+                const uint8_t mask = STEPPER_LINE_QUEUE_SIZE - 1;
+                const uint8_t first = this->planned_tail;
+                const float a2 = 2.0f * this->accel;
+
+                // backwards: the last one stops, and each must be able to slow
+                // down from its entry to its exit (speeds as fractions of cruise:
+                // a junction is the same fraction of the cruise on both sides)
+                float exit = 0;
+                uint8_t index = end;
+                do
+                {
+                        index = (index - 1) & mask;
+                        const StepperSegment &segment = this->moves[index];
+                        this->planned_exit[index] = exit;
+                        float v = exit * segment.cruise;
+                        float entry = sqrtf(v * v + a2 * segment.major) / segment.cruise;
+                        entry = (entry < segment.corner) ? entry : segment.corner;
+                        exit = (entry < 1) ? entry : 1;
+                } while (index != first);
+
+                // forwards: from the exit of the segment in progress (0 when idle,
+                // or when it was the last queued), each must be able to speed up
+                // from its entry to its exit
+                float entry = this->running_exit;
+                for (index = first; index != end; index = (index + 1) & mask)
+                {
+                        const StepperSegment &segment = this->moves[index];
+                        unsigned long step_delay = (unsigned long)(1e6f / segment.cruise + 0.5f);
+                        float v = entry * segment.cruise;
+                        float reach = sqrtf(v * v + a2 * segment.major) / segment.cruise;
+                        exit = (this->planned_exit[index] < reach) ? this->planned_exit[index] : reach;
+                        this->planned_exit[index] = exit;
+                        this->planned_profile[index].plan(segment.major, step_delay, this->accel, 0,
+                                                          this->speedSteps(segment, entry),
+                                                          this->speedSteps(segment, exit));
+                        entry = exit;
+                }
+        }
+
+        StepperSegment moves[STEPPER_LINE_QUEUE_SIZE];
+        volatile uint8_t head;   // next free slot
+        volatile uint8_t tail;   // next segment to take
+        uint8_t planned_tail;    // tail when plan() ran
+        uint8_t axes;
+        unsigned long accel;     // major axis steps/s^2
+        unsigned long jump;      // steps/s
+        float last_velocity[STEPPER_GROUP_AXES]; // steps/s of each axis in the last segment queued
+        float next_velocity[STEPPER_GROUP_AXES]; // and in the one being planned
+        float planned_exit[STEPPER_LINE_QUEUE_SIZE];             // plan() results, for commit()
+        StepperProfile planned_profile[STEPPER_LINE_QUEUE_SIZE];
+
+        // ISR side:
+        StepperSegment current;  // segment being taken
+        float running_exit;      // its planned exit speed (fraction of its cruise)
+        unsigned long ticks_left;
+        unsigned long error[STEPPER_GROUP_AXES]; // Bresenham error of each axis
+        StepperRamp ramp;        // times the ticks of current
+};
+
+#endif
@@ -29,6 +29,13 @@ double newMeasuredSpeed = 0, oldMeasuredSpeed = 0;
 String newDirection = "ccw", oldDirection = newDirection;
 unsigned long newMicros = 0, oldMicros = 0; // loop timing
 unsigned long delta_t = 0;                  // in usec
+unsigned int stalls = 0;                    // caught by the encoder check
+
+// encoder count for the stepper's stall check (called from its timer ISR)
+long readEncoder()
+{
+  return (long)encoder.getCount();
+}
 
 // initialize OLED display geometry
 const int col_space = 40;
@@ -83,6 +90,17 @@ void setup()
   myStepper.setSpeed(newSpeed);
   myStepper.step(stepsPerCycle);
 
+  // calibrate: encoder counts per electrical cycle, stepped slowly enough not to slip,
+  // then let the stepper check its steps against the encoder
+  long startCount = (long)encoder.getCount();
+  myStepper.step(stepsPerCycle);
+  long countsPerCycle = (long)encoder.getCount() - startCount;
+  Serial.println("Encoder counts per cycle = " + String(countsPerCycle));
+  if (countsPerCycle != 0)
+  {
+    myStepper.attachEncoder(readEncoder, countsPerCycle, stepsPerCycle, 4);
+  }
+
   // set up persistent display
   Heltec.display->clear();
   Heltec.display->display();
@@ -108,24 +126,32 @@ void setup()
 
 void loop()
 {
-  myStepper.step(stepsPerCycle);
-
-  if (++loopcount % 3 == 0)
+  // keep the stepper's move queue topped up; its timer ISR steps the motor meanwhile,
+  // so reading the encoder and refreshing the display no longer slow the motor down
+  if (myStepper.stepAsync(stepsPerCycle) && ++loopcount % 3 == 0)
   {
-    // including the following encoder-measurement-code slows the loop enough to affect performance
-    // this runs ok w/o it...
-    //
-    //  newPosition = encoder.getCount();
-    //  newMicros = micros();
-    //  delta_t = newMicros - oldMicros;
-    //  oldMicros = newMicros;
-    //  newMeasuredSpeed = (double)((newPosition - oldPosition) * 1000000 / (double)delta_t);
     speedIncrement = map(newSpeed, 0, 3000, 20, 1);
     newSpeed += speedIncrement;
     myStepper.setSpeed(newSpeed);
   }
-  if (loopcount % 10)
+
+  // the motor slipped at this speed: the stepper retries the steps it lost, slower;
+  // back the ramp off a little below where it stalled
+  if (myStepper.stallCount() != stalls)
+  {
+    stalls = myStepper.stallCount();
+    newSpeed = newSpeed * 9 / 10;
+    myStepper.setSpeed(newSpeed);
+    Serial.println("Stall " + String(stalls) + ": speed backed off to " + String(newSpeed));
+  }
+
+  newMicros = micros();
+  delta_t = newMicros - oldMicros;
+  if (delta_t > 250000) // update display periodically
   {
+    newPosition = encoder.getCount();
+    newMeasuredSpeed = (double)((newPosition - oldPosition) * 1000000 / (double)delta_t);
+    oldMicros = newMicros;
 
     update_display("", "", String(oldSpeed),
                    String(oldMeasuredSpeed), "", "",
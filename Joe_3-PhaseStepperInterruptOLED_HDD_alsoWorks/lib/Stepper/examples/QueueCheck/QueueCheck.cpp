@@ -0,0 +1,164 @@
+// QueueCheck -- check the step timing of queued moves (Stepper::queueMove(), step()), on a PC
+// Builds Stepper.cpp with no board defined, so its step timer is the polled one: isBusy()
+// calls the "ISR" when a step is due.  micros() is a simulated clock that yield() moves on
+// by 1 us, and the motor's four pins are read back at each yield() for the time and the
+// direction of each step (the 4 wire full step table, StepperPhases.h).  Checks that
+//   - moves of 5 steps at 1000 us, -3 at 2000 us and 2 at 10000 us, queued back to back,
+//     take each step its own move's delay after the step before it, in the move's
+//     direction: the first step of each 1000, 2000 and 10000 us after the last step of the
+//     move before it (for the first, a stepNow() just before they were queued)
+//   - two back-to-back step(6) calls at 5000 us (setSpeed(60), 200 steps per turn) keep
+//     the 5000 us spacing, across the second call's first step too
+// Prints one CSV line per step: time (us), direction, interval (us); the summary on stderr.
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -I. -I../../src QueueCheck.cpp ../../src/Stepper.cpp -o queuecheck
+//   ./queuecheck > queue.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "Arduino.h"
+#include "Stepper.h"
+
+#define PINS 4
+const int pins[PINS] = {8, 9, 10, 11};
+
+// a step, as seen on the pins
+struct stepSeen
+{
+    unsigned long time; // us
+    int direction;      // 1, -1; 0 = not a neighbouring state of the table
+};
+
+unsigned long now_us = 1000000; // the simulated clock
+uint8_t levels = 0;             // the pins' levels, bit 0 = pins[0]
+uint8_t seen = 0;               // the levels at the last step seen
+std::vector<stepSeen> steps;
+
+unsigned long micros() { return now_us; }
+unsigned long millis() { return now_us / 1000; }
+void pinMode(uint8_t pin, uint8_t mode) {}
+void analogWrite(uint8_t pin, int value) {}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    for (int i = 0; i < PINS; i++)
+    {
+        if (pins[i] == pin)
+        {
+            levels = value ? (levels | (1 << i)) : (levels & ~(1 << i));
+        }
+    }
+}
+
+// the state of the levels in the phase table; -1 if none
+int phaseOf(uint8_t word)
+{
+    uint8_t count;
+    const uint8_t *table = stepperPhases(PINS, false, count);
+    for (int i = 0; i < count; i++)
+    {
+        if (table[i] == word)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// a change of the levels is a step, taken now
+void observe()
+{
+    if (levels == seen)
+    {
+        return;
+    }
+    int from = phaseOf(seen), to = phaseOf(levels), direction = 0;
+    if (from >= 0 && to >= 0)
+    {
+        direction = ((to - from + PINS) % PINS == 1) ? 1 : ((from - to + PINS) % PINS == 1) ? -1 : 0;
+    }
+    steps.push_back({now_us, direction});
+    seen = levels;
+}
+
+void yield()
+{
+    observe();
+    now_us++;
+}
+
+// the steps seen from first on against the moves (steps, delay) that should have made
+// them; returns the number of steps wrong (or missing, or extra)
+long compare(size_t first, const long *moves, const unsigned long *delays, int count)
+{
+    long wrong = 0;
+    size_t n = first;
+    for (int m = 0; m < count; m++)
+    {
+        for (long i = 0; i < labs(moves[m]); i++, n++)
+        {
+            if (n >= steps.size())
+            {
+                wrong++;
+                continue;
+            }
+            unsigned long interval = steps[n].time - steps[n - 1].time;
+            wrong += (interval != delays[m] || steps[n].direction != ((moves[m] < 0) ? -1 : 1)) ? 1 : 0;
+        }
+    }
+    return wrong + ((steps.size() > n) ? (long)(steps.size() - n) : 0);
+}
+
+int main()
+{
+    int failures = 0;
+    Stepper motor(200, pins[0], pins[1], pins[2], pins[3]);
+
+    // the last step of a move before: then the three moves, queued at once
+    motor.stepNow(1);
+    yield();
+    size_t first = steps.size();
+    const long moves[3] = {5, -3, 2};
+    const unsigned long delays[3] = {1000, 2000, 10000};
+    for (int m = 0; m < 3; m++)
+    {
+        if (!motor.queueMove(moves[m], delays[m]))
+        {
+            fprintf(stderr, "queueMove(%ld, %lu) refused\n", moves[m], delays[m]);
+            failures++;
+        }
+    }
+    while (motor.isBusy())
+    {
+        yield();
+    }
+    yield(); // (sees the last step)
+    long wrong = compare(first, moves, delays, 3);
+    fprintf(stderr, "5 steps at 1000 us, -3 at 2000 us, 2 at 10000 us, queued back to back: %ld steps off time\n",
+            wrong);
+    failures += wrong ? 1 : 0;
+
+    // idle a while; then two step(6) calls, back to back (the first step of the first
+    // comes at once, as the motor has been still longer than a step)
+    now_us += 100000;
+    motor.setSpeed(60);
+    first = steps.size() + 1;
+    motor.step(6);
+    motor.step(6);
+    yield(); // (sees the last step)
+    const long twice[2] = {5, 6};
+    const unsigned long spacing[2] = {5000, 5000};
+    wrong = compare(first, twice, spacing, 2);
+    fprintf(stderr, "step(6), step(6) at 5000 us: %ld steps off time\n", wrong);
+    failures += wrong ? 1 : 0;
+
+    printf("t_us,direction,interval_us\n");
+    for (size_t n = 0; n < steps.size(); n++)
+    {
+        printf("%lu,%d,%lu\n", steps[n].time, steps[n].direction, n ? steps[n].time - steps[n - 1].time : 0);
+    }
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "queued moves on time");
+    return failures ? 1 : 0;
+}
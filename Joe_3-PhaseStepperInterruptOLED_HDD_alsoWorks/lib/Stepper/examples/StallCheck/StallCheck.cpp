@@ -0,0 +1,225 @@
+// StallCheck -- check stall detection and recovery (StepperStall.h), on a PC
+// Runs moves through StepperQueue and StepperStall as Stepper's step timer ISR does, on a
+// simulated motor with an encoder:
+//   - the rotor follows the steps while their rate stays under the motor's pull-out rate;
+//     above it, the rotor slips: it stops turning while the steps run on
+//   - a load bump (a stretch of the move) lowers the pull-out rate for a while
+//   - when the steps stop, the rotor settles a whole number of electrical cycles behind,
+//     within STEPPER_STALL_SETTLE
+//   - the encoder counts the rotor (--cps counts per step), with +-1 count of jitter
+// Checks that moves under the pull-out rate never trip the check (no false alarms), and
+// that a move that slips is caught within 3/2 window steps and retried slower, the moves
+// after it at their own speed, until the rotor ends exactly on the target.  Reports the
+// detection latency (steps and time from the slip to the stop) and the path time against
+// running it all at the speed that never slips.  Prints one CSV line per step of the
+// slipping run: time, steps given, rotor, encoder, lag; summary on stderr.
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -I../../src StallCheck.cpp -o stallcheck
+//   ./stallcheck --window 4 --cps 4 --pullout 4000 --bump 2500 > stall.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "StepperQueue.h"
+#include "StepperStall.h"
+
+// settings (command line)
+struct settings
+{
+    int moves = 6;               // the path: moves of
+    long steps = 1000;           // steps each
+    unsigned long delay = 300;   // us per step at cruise (3333 steps/s: above the bump's pull-out)
+    unsigned long accel = 20000; // steps/s^2
+    long pullout = 4000;         // steps/s the motor can follow
+    long bump = 2500;            // steps/s it can follow during the load bump
+    long bump_from = 2200, bump_to = 2600; // rotor positions of the bump
+    int cycle = 6;               // steps per electrical cycle (3-phase, half step)
+    int cps = 4;                 // encoder counts per step
+    unsigned int window = 4;     // steps of lag that are a stall
+};
+
+// the simulated motor and encoder
+struct motor
+{
+    long given = 0;        // steps given
+    double rotor = 0;      // steps turned
+    bool slipping = false; // out of step
+    long slip_at = -1;     // steps given when the rotor first slipped
+    long behind = 0;       // whole cycles lost, in steps
+} sim;
+int counts_per_step = 4;
+
+long readEncoder()
+{
+    return (long)floor(sim.rotor * counts_per_step) + (rand() % 3) - 1; // +-1 count jitter
+}
+
+// one step given at rate steps/s
+void stepMotor(const settings &s, int direction, double rate)
+{
+    sim.given += direction;
+    bool bump = sim.rotor >= s.bump_from && sim.rotor < s.bump_to;
+    double pullout = bump ? s.bump : s.pullout;
+    if (!sim.slipping && rate > pullout)
+    {
+        sim.slipping = true;
+        sim.slip_at = (sim.slip_at < 0) ? sim.given : sim.slip_at;
+    }
+    if (!sim.slipping)
+    {
+        sim.rotor = sim.given - sim.behind - 0.3 * direction * rate / pullout; // load angle, under a step
+    }
+}
+
+// the steps stopped: a slipped rotor settles whole cycles behind
+void settle(const settings &s)
+{
+    sim.behind = s.cycle * lround((sim.given - sim.rotor) / s.cycle);
+    sim.rotor = sim.given - sim.behind;
+    sim.slipping = false;
+}
+
+// runs the path to the end, with stall recovery as Stepper does; returns its time (s)
+double run(const settings &s, unsigned long delay, bool print, int &stalls, long &latency_steps,
+           double &latency_us, int &failures)
+{
+    sim = motor();
+    StepperQueue queue;
+    StepperStall stall;
+    stall.attach(readEncoder, s.cps, 1, s.window);
+    StepperProfile profile;
+    profile.plan(s.steps, delay, s.accel, 0);
+    int queued = 0;
+    double time = 0, since_slip = 0;
+    int direction;
+    unsigned long step_delay;
+    stalls = 0;
+    latency_steps = 0;
+    latency_us = 0;
+
+    while (true)
+    {
+        while (queued < s.moves && queue.push(s.steps, profile))
+        {
+            queued++; // keep the queue topped up, as a sketch would
+        }
+        if (!queue.take(direction, step_delay))
+        {
+            break;
+        }
+        time += step_delay * 1e-6;
+        since_slip += sim.slipping ? step_delay : 0;
+        stepMotor(s, direction, 1e6 / step_delay);
+        stall.stepped(direction);
+        if (print)
+        {
+            printf("%.6f,%ld,%.2f,%ld,%ld\n", time, sim.given, sim.rotor, readEncoder(), stall.lag());
+        }
+        if (stall.check())
+        {
+            // as Stepper::onStepTimer(), then Stepper::retry()
+            stalls++;
+            if (sim.slipping)
+            {
+                latency_steps = (sim.given - sim.slip_at > latency_steps) ? sim.given - sim.slip_at : latency_steps;
+                latency_us = (since_slip > latency_us) ? since_slip : latency_us;
+            }
+            else
+            {
+                fprintf(stderr, "false alarm at step %ld (lag %ld)\n", sim.given, stall.lag());
+                failures++;
+            }
+            long owed = queue.dropMove();
+            unsigned long retry_delay = queue.moveDelay();
+            settle(s);
+            time += STEPPER_STALL_SETTLE * 1e-6;
+            owed += stall.settledLag(s.cycle);
+            stall.sync();
+            if (!stall.retry(retry_delay, owed))
+            {
+                fprintf(stderr, "gave up at %.0f of %ld steps\n", sim.rotor, s.moves * s.steps);
+                failures++;
+                return time;
+            }
+            sim.slip_at = -1;
+            since_slip = 0;
+            StepperProfile slower;
+            slower.plan(owed < 0 ? -owed : owed, retry_delay, s.accel, 0);
+            queue.restart(owed, slower);
+            if (print)
+            {
+                fprintf(stderr, "stall %d at rotor %.0f: %ld steps owed, retrying at %lu us/step\n", stalls,
+                        sim.rotor, owed, retry_delay);
+            }
+        }
+    }
+    settle(s);
+    long end = lround(sim.rotor);
+    if (end != s.moves * s.steps)
+    {
+        fprintf(stderr, "ended at %ld, not %ld\n", end, s.moves * s.steps);
+        failures++;
+    }
+    return time;
+}
+
+int main(int argc, char **argv)
+{
+    settings s;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--moves"))
+            s.moves = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--steps"))
+            s.steps = atol(argv[i + 1]);
+        else if (!strcmp(argv[i], "--delay"))
+            s.delay = atol(argv[i + 1]);
+        else if (!strcmp(argv[i], "--accel"))
+            s.accel = atol(argv[i + 1]);
+        else if (!strcmp(argv[i], "--pullout"))
+            s.pullout = atol(argv[i + 1]);
+        else if (!strcmp(argv[i], "--bump"))
+            s.bump = atol(argv[i + 1]);
+        else if (!strcmp(argv[i], "--cps"))
+            s.cps = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--window"))
+            s.window = atoi(argv[i + 1]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--moves n] [--steps n] [--delay us] [--accel steps/s^2] [--pullout steps/s] "
+                            "[--bump steps/s] [--cps counts] [--window steps]\n", argv[0]);
+            return 1;
+        }
+    }
+    counts_per_step = s.cps;
+    srand(1);
+
+    int failures = 0, stalls;
+    long latency_steps;
+    double latency_us;
+
+    // under the pull-out rate everywhere: must never trip
+    unsigned long safe = (unsigned long)(1e6 / s.bump) + 1;
+    double safe_time = run(s, safe, false, stalls, latency_steps, latency_us, failures);
+    fprintf(stderr, "at %lu us/step (never slips): %.4f s, %d stalls\n", safe, safe_time, stalls);
+
+    // faster than the bump allows: slips there, recovers
+    printf("t_s,given,rotor,encoder,lag\n");
+    double fast_time = run(s, s.delay, true, stalls, latency_steps, latency_us, failures);
+    fprintf(stderr, "at %lu us/step: %.4f s with %d stalls, caught %ld steps (%.0f us) after the slip\n", s.delay,
+            fast_time, stalls, latency_steps, latency_us);
+    if (stalls == 0 && s.delay < 1e6 / s.bump)
+    {
+        fprintf(stderr, "no stall caught\n");
+        failures++;
+    }
+    if (latency_steps > (long)(s.window + (s.window + 1) / 2 + 1))
+    {
+        fprintf(stderr, "caught late: %ld steps, window %u\n", latency_steps, s.window);
+        failures++;
+    }
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "stalls caught and recovered");
+    return failures ? 1 : 0;
+}
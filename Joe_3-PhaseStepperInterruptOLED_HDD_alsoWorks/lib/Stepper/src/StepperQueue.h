@@ -0,0 +1,127 @@
+/*
+ * StepperQueue.h - move queue for the asynchronous Stepper API
+ *
+ * A fixed-size ring buffer of moves (signed step count, planned speed
+ * profile, see StepperRamp.h).  The sketch pushes moves (Stepper::queueMove(),
+ * stepAsync()); the step timer ISR takes them off one step at a time, timing
+ * each step with a StepperRamp, so moves follow each other without a gap.  Single producer, single consumer: push() only moves
+ * the head, take() only the tail, so neither needs to lock the other out.
+ *
+ * Kept free of Arduino headers so it can be compiled natively.
+ */
+
+// ensure this library description is only included once
+#ifndef StepperQueue_h
+#define StepperQueue_h
+
+#include <stdint.h>
+#include "StepperRamp.h"
+
+#ifndef STEPPER_QUEUE_SIZE
+#if defined(__AVR__)
+#define STEPPER_QUEUE_SIZE 4 // moves; a power of 2 (2K of RAM on an Uno)
+#else
+#define STEPPER_QUEUE_SIZE 8 // moves; a power of 2
+#endif
+#endif
+
+struct StepperMove
+{
+        long steps;             // negative = reverse
+        StepperProfile profile; // step timing
+};
+
+class StepperQueue
+{
+public:
+        StepperQueue() { clear(); }
+
+        /*
+         * Adds a move (sketch side).  Returns false if the queue is full.
+         */
+        bool push(long steps, const StepperProfile &profile)
+        {
+                if (steps == 0)
+                {
+                        return true; // nothing to do
+                }
+                uint8_t next = (this->head + 1) & (STEPPER_QUEUE_SIZE - 1);
+                if (next == this->tail)
+                {
+                        return false;
+                }
+                this->moves[this->head].steps = steps;
+                this->moves[this->head].profile = profile;
+                this->head = next; // publish the move
+                return true;
+        }
+
+        /*
+         * Takes the next step (ISR side): its direction (1 or -1) and its delay
+         * after the step before it.  Returns false when no steps are left.
+         */
+        inline bool take(int &direction, unsigned long &step_delay)
+        {
+                if (this->steps_left == 0)
+                {
+                        if (this->tail == this->head)
+                        {
+                                return false;
+                        }
+                        const StepperMove &move = this->moves[this->tail];
+                        this->steps_left = (move.steps < 0) ? -move.steps : move.steps;
+                        this->move_direction = (move.steps < 0) ? -1 : 1;
+                        this->move_profile = move.profile; // the slot may be reused once taken
+                        this->ramp.start(this->move_profile);
+                        this->tail = (this->tail + 1) & (STEPPER_QUEUE_SIZE - 1);
+                }
+                this->steps_left--;
+                direction = this->move_direction;
+                step_delay = this->ramp.next();
+                return true;
+        }
+
+        bool empty() const { return this->steps_left == 0 && this->head == this->tail; }
+
+        // cruise step delay (us) of the move being taken
+        unsigned long moveDelay() const { return this->move_profile.delay; }
+
+        // ends the move being taken (ISR side); returns its steps not taken
+        long dropMove()
+        {
+                long left = (long)this->steps_left * this->move_direction;
+                this->steps_left = 0;
+                return left;
+        }
+
+        /*
+         * Takes steps (negative = reverse), timed by profile, next: ahead of the
+         * queued moves (only while the ISR can't take()).
+         */
+        void restart(long steps, const StepperProfile &profile)
+        {
+                this->steps_left = (steps < 0) ? -steps : steps;
+                this->move_direction = (steps < 0) ? -1 : 1;
+                this->move_profile = profile;
+                this->ramp.start(this->move_profile);
+        }
+
+        // drops all moves (only while the ISR can't take())
+        void clear()
+        {
+                this->head = this->tail = 0;
+                this->steps_left = 0;
+                this->move_direction = 1;
+        }
+
+private:
+        StepperMove moves[STEPPER_QUEUE_SIZE];
+        volatile uint8_t head; // next free slot
+        volatile uint8_t tail; // next move to take
+        unsigned long steps_left; // in the move being taken
+        int move_direction;
+        StepperProfile move_profile;
+        StepperRamp ramp; // times the steps of move_profile
+};
+
+#endif
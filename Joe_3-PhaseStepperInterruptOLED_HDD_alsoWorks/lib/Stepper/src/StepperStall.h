@@ -0,0 +1,175 @@
+/*
+ * StepperStall.h - encoder position check and stall recovery for Stepper
+ *
+ * With an encoder on the motor shaft, the steps the motor was given can be
+ * compared with the steps it turned.  A stepper that is overloaded, or
+ * driven faster than it can pull out, slips: the field runs on without the
+ * rotor, which falls back whole electrical cycles.  The lag (steps given
+ * minus steps turned) then grows by about a step per step, while a motor in
+ * step only lags by its load angle and the encoder's resolution.
+ *
+ * Every (window + 1) / 2 steps the step ISR reads the encoder; a lag of more
+ * than window steps is a stall, so one is caught at most 3/2 window steps
+ * after the rotor stops.  Stepper then stops the motor, lets the rotor come
+ * to rest (STEPPER_STALL_SETTLE), and takes the steps
+ * the move still owes (the lag, and those not taken yet) again, backoff
+ * percent slower, before the moves queued after it: up to retries times per
+ * stall; a retry that makes it restores them (see Stepper::attachEncoder()).
+ *
+ * Kept free of Arduino headers so it can be compiled natively.
+ */
+
+// ensure this library description is only included once
+#ifndef StepperStall_h
+#define StepperStall_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef STEPPER_STALL_SETTLE
+#define STEPPER_STALL_SETTLE 20000 // us for a stalled rotor to come to rest before the retry
+#endif
+
+// reads the encoder count (from the step ISR: keep it short, interrupt safe)
+typedef long (*StepperEncoderRead)();
+
+class StepperStall
+{
+public:
+        StepperStall()
+        {
+                this->read = NULL;
+                this->counts = this->steps = 1;
+                this->window = 0;
+                this->every = this->countdown = 1;
+                this->expected = 0;
+                this->base = 0;
+                this->retries = 3;
+                this->backoff = 50;
+                this->used = 0;
+                this->proving = 0;
+        }
+
+        /*
+         * counts encoder counts per steps motor steps (negative counts if the
+         * encoder counts down as the motor steps forward); window: the lag, in
+         * steps, beyond which the motor has stalled.  Starts at the motor's
+         * position now.
+         */
+        void attach(StepperEncoderRead read, long counts, long steps, unsigned int window)
+        {
+                this->read = read;
+                this->counts = (counts != 0) ? counts : 1;
+                this->steps = (steps > 0) ? steps : 1;
+                this->window = window;
+                this->every = (window + 1) / 2;
+                this->every = (this->every > 0) ? this->every : 1;
+                this->used = 0;
+                this->proving = 0;
+                if (read != NULL)
+                {
+                        this->sync();
+                }
+        }
+
+        bool attached() const { return this->read != NULL; }
+
+        // retries per stall, each backoff percent slower than the one before
+        void setRetry(uint8_t retries, uint8_t backoff)
+        {
+                this->retries = retries;
+                this->backoff = backoff;
+        }
+
+        // takes the motor's position now as in step (lag 0)
+        void sync()
+        {
+                this->base = this->read();
+                this->expected = 0;
+                this->countdown = this->every;
+        }
+
+        // counts a step given to the motor
+        inline void stepped(int direction)
+        {
+                this->expected += direction;
+                if (this->proving > 0 && --this->proving == 0)
+                {
+                        this->used = 0; // the retry made it: the next stall gets all its retries
+                }
+        }
+
+        /*
+         * After a step (ISR): true when the encoder is due, and the motor lags
+         * more than the window.
+         */
+        inline bool check()
+        {
+                if (--this->countdown > 0)
+                {
+                        return false;
+                }
+                this->countdown = this->every;
+                long lag = this->lag();
+                return lag > (long)this->window || -lag > (long)this->window;
+        }
+
+        // steps given minus steps turned, since sync()
+        long lag() const
+        {
+                int64_t turned = (int64_t)(this->read() - this->base) * this->steps;
+                long half = ((this->counts > 0) ? this->counts : -this->counts) / 2; // to the nearest step
+                turned += (turned >= 0) ? half : -half;
+                return this->expected - (long)(turned / this->counts);
+        }
+
+        /*
+         * The lag of a motor stopped after a stall, rounded to whole electrical
+         * cycles of cycle steps: the rotor settles in step with the coils
+         * again, so the encoder needn't resolve single steps.
+         */
+        long settledLag(unsigned int cycle) const
+        {
+                long lag = this->lag();
+                if (cycle == 0)
+                {
+                        return lag;
+                }
+                long half = (long)cycle / 2;
+                return ((lag >= 0) ? lag + half : lag - half) / (long)cycle * (long)cycle;
+        }
+
+        /*
+         * For the next retry, of owed steps: the step delay, backed off from
+         * delay; false when the retries are used up.
+         */
+        bool retry(unsigned long &delay, long owed)
+        {
+                if (this->used >= this->retries)
+                {
+                        this->used = 0;
+                        return false;
+                }
+                this->used++;
+                this->proving = (owed < 0) ? -owed : owed;
+                this->proving = (this->proving > 0) ? this->proving : 1;
+                delay = delay * (100 + this->backoff) / 100;
+                return true;
+        }
+
+private:
+        StepperEncoderRead read;
+        long counts;            // encoder counts per
+        long steps;             // these motor steps
+        unsigned int window;    // steps of lag that are a stall
+        unsigned int every;     // steps between encoder reads
+        unsigned int countdown; // to the next read
+        volatile long expected; // steps given since sync()
+        long base;              // encoder count at sync()
+        uint8_t retries;        // per stall
+        uint8_t backoff;        // percent slower per retry
+        uint8_t used;           // retries used on this stall
+        unsigned long proving;  // steps of the retry still to go
+};
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * StepperTimer.h - the step timer, shared by Stepper and StepperGroup
+ *
+ * One hardware timer times the steps of whichever Stepper or StepperGroup
+ * claimed it (Stepper.cpp has the platform code).  The owner claims it with
+ * the timer locked out, keeps it while it has moves to run, and releases it
+ * when they are done (or stopped); meanwhile the others' moves are refused.
+ * Internal to the library.
+ */
+
+// ensure this library description is only included once
+#ifndef StepperTimer_h
+#define StepperTimer_h
+
+typedef void (*stepTimerHandler)(void *owner); // the owner's ISR
+
+void stepTimerSetup();
+void stepTimerStart(unsigned long wait); // (re)start: interrupt after wait us
+void stepTimerArm(unsigned long wait);   // from the ISR: interrupt again after wait us
+void stepTimerStop();
+void stepTimerPoll(); // boards without a timer: run the ISR if it is due
+void stepTimerLock(); // keep the ISR out
+void stepTimerUnlock();
+extern const unsigned long stepTimerMaxWait; // longest wait the timer can time, us
+
+bool stepTimerClaim(void *owner, stepTimerHandler handler); // (locked) false if another owner has it
+void stepTimerRelease(void *owner);
+
+#endif
@@ -0,0 +1,355 @@
+// BemfSim -- run the sensorless commutation (bemf.h) on a model of the spindle, on a PC
+// The spindle is SpinUp's plant (angles in commutation steps, 120 per revolution), with the
+// stator field 2 steps ahead of the stage number, as the six-step table puts it.  Each phase
+// floats while it is LOW, and reads back-EMF against the center tap:
+//     bemf(phase p) = counts * speed / target speed * sin(angle - (2p + 1))   (steps, 60 deg each)
+// plus Gaussian noise and a commutation spike at the start of every step, quantised as the
+// ADC does.  The sketch's three parts run on it as on the ESP32:
+//   - the step timer (1 us ticks, auto-reload; onStepTimer() rewrites the alarm)
+//   - speedTask() every SPEED_TICK_MS, with the SpeedController, until the handoff
+//   - bemfTask(), one sample per SAMPLE_US (two analogRead()s), a vTaskDelay(1) sleeping
+//     to the next FreeRTOS tick, and the handoff and fallback
+// Checks that
+//   - the crossings lock and the sketch goes sensorless on the way up, then holds the
+//     target without falling back to open loop or slipping a pole
+//   - the crossings are found soon after the rotor passes them, and each window's
+//     commutation comes 30 degrees electrical after its crossing, within a few degrees
+//   - the sensing task lets the idle task run at least every 2 * BEMF_YIELD_US, a safe
+//     margin inside the 5 s task watchdog
+//   - all of the above with four times the noise
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -I../../include BemfSim.cpp -o bemfsim
+//   ./bemfsim [--counts ADC counts at the target] [--noise counts rms] [--spike counts]
+//             [--seconds s] [--csv]
+// The back-EMF scale assumes ~0.5 V peak at 550 RPM through the sense dividers; measure it
+// (the amplitude on a scope at a known speed) and put it here
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <random>
+#include "commutation.h"
+#include "speedControl.h"
+#include "bemf.h"
+
+// as the sketch
+const int stepsPerRevolution = 20 * 6;
+const int countsPerRevolution = 60;
+const float targetRPM = 550.0;
+#define START_STEP 40000     // us (stepLength)
+#define MIN_STEP 900         // us (minStepLength)
+#define BEMF_HANDOFF_RPM 200 // open loop until at least this fast
+#define BEMF_YIELD_US 100000 // sensing task lets the idle task run this often (after a crossing)
+#define TICK_US 1000         // FreeRTOS tick
+
+#define SAMPLE_US 25      // one bemfTask() pass: two analogRead()s and the rest
+#define SPIKE_DIV 8       // commutation spike lasts the first 1/8 of a step
+#define SETTLE_BAND 0.02  // rotor within 2% of the target = there
+#define MAX_ANGLE_MEAN 3   // degrees electrical the commutation may be off 30 after the crossing,
+#define MAX_ANGLE_ERROR 10 //   on average and at worst (the period lags an accelerating rotor)
+
+// motor and sensing (command line)
+struct settings
+{
+    double accel = 1500.0;  // steps/s^2 at standstill, load angle 90 deg (as SpinUp)
+    double free = 2000.0;   // steps/s; no-load speed
+    double windage = 250.0; // steps/s^2 of drag at the target speed
+    double friction = 20.0; // steps/s^2
+    double damping = 5.0;   // 1/s
+    double counts = 400.0;  // ADC counts of back-EMF peak at the target speed
+    double noise = 4.0;     // ADC counts rms
+    double spike = 300.0;   // ADC counts, the wrong way, at the start of each step
+    double seconds = 12.0;  // run length
+    bool csv = false;       // print the run's trace
+};
+
+// one run's outcome
+struct run
+{
+    double handoff;      // s; went sensorless (-1 = never)
+    double handoffRPM;
+    double atSpeed;      // s; sensorless, at the target and settled (-1 = never)
+    uint16_t fallbacks;  // back to open loop after the handoff
+    double maxError;     // steps/s; worst rotor speed error once at speed
+    double minLag;       // steps the rotor lagged the field once at speed, least and most
+    double maxLag;
+    long commutations;   // sensorless, timed from the crossing (not held to the target step)
+    double angleMean;    // degrees electrical past the crossing they came at
+    double angleWorst;   //   (most off 30)
+    long held;           // sensorless, held back to the target step
+    double lateMean;     // degrees electrical the rotor was past the crossing at crossing()
+    double lateWorst;    //   (most off 0; < 0 = found early, on noise)
+    long crossings;      // found while sensorless
+    long windows;        //   of the windows
+    uint32_t longestAwake; // us; most between two yields
+};
+
+/*------------------------------------------------------------------------------
+   Spindle -- the plant (SpinUp's, field in steps)
+  ------------------------------------------------------------------------------*/
+struct Spindle
+{
+    const settings &s;
+    double angle; // steps
+    double speed; // steps/s
+
+    Spindle(const settings &s) : s(s), angle(2), speed(0) {}
+
+    // advance by dt (s) with the field at step field
+    void advance(long field, double fieldSpeed, double dt)
+    {
+        const double target = targetRPM * stepsPerRevolution / 60.0;
+        double drive = s.accel * (1.0 - speed / s.free) * sin((field - angle) * M_PI / 3.0);
+        drive -= s.damping * (speed - fieldSpeed);
+        double drag = s.windage * (speed / target) * (speed / target) + s.friction;
+        drag = (speed > 0) ? drag : ((drive > drag) ? drag : (drive > 0 ? drive : 0)); // no drag backwards
+        speed += (drive - drag) * dt;
+        angle += speed * dt;
+    }
+
+    int64_t count() const { return (int64_t)floor(angle * countsPerRevolution / stepsPerRevolution); }
+
+    // back-EMF of phase (0-2), volts as ADC counts
+    double bemf(uint8_t phase) const
+    {
+        const double target = targetRPM * stepsPerRevolution / 60.0;
+        return s.counts * speed / target * sin((angle - (2 * phase + 1)) * M_PI / 3.0);
+    }
+};
+
+// steps from the crossing of phase's back-EMF (the rising one) to angle, -3..3
+double pastCrossing(double angle, uint8_t phase)
+{
+    double past = fmod(angle - (2 * phase + 1), 6.0);
+    past += (past < -3) ? 6 : 0;
+    return (past >= 3) ? past - 6 : past;
+}
+
+/*------------------------------------------------------------------------------
+   simulate() -- the sketch on the plant for s.seconds
+  ------------------------------------------------------------------------------*/
+run simulate(const settings &s, std::mt19937 &random)
+{
+    const double target = targetRPM * stepsPerRevolution / 60.0;
+    const uint32_t targetStep = (uint32_t)(60000000.0 / (targetRPM * stepsPerRevolution));
+    std::normal_distribution<double> noise(0.0, s.noise);
+    SpeedController speedController((float)stepsPerRevolution / countsPerRevolution, target);
+    Spindle spindle(s);
+    Commutator commutator(2, 5, 26);
+    BemfSensor bemfSensor;
+    run r = {-1, 0, -1, 0, 0, 1e9, -1e9, 0, 0, 30, 0, 0, 0, 0, 0, 0};
+
+    // the sketch's shared state
+    volatile uint32_t STEP_PERIOD = START_STEP;
+    uint32_t STEP_START = 0;
+    bool SENSORLESS = false;
+    float rpm = 0;
+
+    // step timer: counter zero at timerStart, fires at timerStart + alarm
+    commutator.start();
+    long steps = 0;
+    uint32_t timerStart = 0, alarm = START_STEP;
+    uint32_t nextTick = SPEED_TICK_MS * 1000;
+    int64_t lastCount = spindle.count();
+
+    // bemfTask()
+    uint8_t stage = commutator.stage();
+    uint32_t lastYield = 0, nextPass = 0;
+    bemfSensor.reset(stage, STEP_PERIOD);
+
+    // measurements
+    double settled = -1;
+    bool windowFound = false, windowHeld = false;
+    double angleSum = 0, lateSum = 0;
+    const uint32_t runMicros = (uint32_t)(s.seconds * 1e6);
+    for (uint32_t now = 0; now < runMicros; now++)
+    {
+        spindle.advance(steps + 2, 1e6 / STEP_PERIOD, 1e-6);
+
+        // onStepTimer()
+        if (now - timerStart >= alarm)
+        {
+            commutator.next();
+            steps++;
+            STEP_START = now;
+            alarm = STEP_PERIOD;
+            timerStart = now;
+            if (SENSORLESS && bemfWindowStart(commutator.stage()))
+            {
+                // this commutation drives the phase the window before it sensed
+                uint8_t driven = BEMF_PHASE[(commutator.stage() + COMMUTATION_STAGES - 1) % COMMUTATION_STAGES];
+                double angle = pastCrossing(spindle.angle, driven) * 60;
+                if (windowFound && !windowHeld)
+                {
+                    angleSum += angle;
+                    r.angleWorst = (fabs(angle - 30) > fabs(r.angleWorst - 30)) ? angle : r.angleWorst;
+                    r.commutations++;
+                }
+                r.held += (windowFound && windowHeld) ? 1 : 0;
+                r.windows++;
+                r.crossings += windowFound ? 1 : 0;
+            }
+            windowFound = bemfWindowStart(commutator.stage()) ? false : windowFound;
+        }
+
+        // speedTask()
+        if (now == nextTick)
+        {
+            nextTick += SPEED_TICK_MS * 1000;
+            int64_t count = spindle.count();
+            uint32_t step = speedController.update((int32_t)(count - lastCount));
+            lastCount = count;
+            step = (step < MIN_STEP) ? MIN_STEP : step;
+            step = SENSORLESS ? STEP_PERIOD : step;
+            STEP_PERIOD = step;
+            rpm = speedController.measured() * 60.0 / stepsPerRevolution;
+            if (s.csv)
+            {
+                printf("%.2f,%.1f,%.1f,%u,%d,%.2f\n", now / 1e6, spindle.speed, speedController.commanded(),
+                       STEP_PERIOD, SENSORLESS ? 1 : 0, steps + 2 - spindle.angle);
+            }
+
+            // at speed: sensorless, the rotor within SETTLE_BAND of the target (from then on,
+            // it must stay there)
+            if (settled < 0 && SENSORLESS && fabs(spindle.speed - target) < SETTLE_BAND * target)
+            {
+                settled = now / 1e6;
+            }
+            if (settled >= 0)
+            {
+                r.maxError = fmax(r.maxError, fabs(spindle.speed - target));
+                r.minLag = fmin(r.minLag, steps + 2 - spindle.angle);
+                r.maxLag = fmax(r.maxLag, steps + 2 - spindle.angle);
+            }
+        }
+
+        // bemfTask(): one pass per SAMPLE_US, unless asleep
+        if (now != nextPass)
+        {
+            continue;
+        }
+        nextPass = now + SAMPLE_US;
+        uint8_t current = commutator.stage();
+        bool moved = (stage != current);
+        while (stage != current)
+        {
+            stage = (stage + 1) % COMMUTATION_STAGES;
+            bemfSensor.stageChanged(stage, STEP_START, STEP_PERIOD);
+        }
+        double bemf = spindle.bemf(bemfSensor.phase()) + noise(random);
+        bemf -= (now - STEP_START < STEP_PERIOD / SPIKE_DIV) ? s.spike * (bemf > 0 ? 1 : -1) : 0;
+        bool crossed = bemfSensor.sample((int16_t)lround(bemf), now, targetStep);
+        if (crossed && SENSORLESS)
+        {
+            double past = pastCrossing(spindle.angle, bemfSensor.phase());
+            double late = (past - spindle.speed * (now - bemfSensor.crossing()) * 1e-6) * 60;
+            lateSum += late;
+            r.lateWorst = (fabs(late) > fabs(r.lateWorst)) ? late : r.lateWorst;
+            windowFound = true;
+            windowHeld = bemfSensor.delay() > bemfSensor.period() / 2;
+        }
+        if ((crossed || moved) && bemfSensor.closing() && SENSORLESS && commutator.stage() == stage)
+        {
+            // restart the step timer so the commutation that ends the window comes delay()
+            // after the crossing
+            uint32_t since = now - bemfSensor.crossing();
+            uint32_t delay = bemfSensor.delay();
+            uint32_t period = bemfSensor.period();
+            STEP_PERIOD = (period < targetStep) ? targetStep : period; // the next window's first step
+            timerStart = now;
+            alarm = (delay > since) ? delay - since : 1;
+        }
+        if (!SENSORLESS && bemfSensor.locked() && rpm >= BEMF_HANDOFF_RPM)
+        {
+            SENSORLESS = true;
+            r.handoff = (r.handoff < 0) ? now / 1e6 : r.handoff;
+            r.handoffRPM = (r.handoffRPM == 0) ? rpm : r.handoffRPM;
+        }
+        else if (SENSORLESS && !bemfSensor.locked())
+        {
+            SENSORLESS = false;
+            speedController.resync();
+            bemfSensor.reset(stage, STEP_PERIOD);
+            r.fallbacks++;
+        }
+        uint32_t awake = now + SAMPLE_US - lastYield;
+        if ((crossed && awake > BEMF_YIELD_US) || awake > 2 * BEMF_YIELD_US)
+        {
+            // vTaskDelay(1): asleep until the next tick
+            r.longestAwake = (awake > r.longestAwake) ? awake : r.longestAwake;
+            nextPass = (now / TICK_US + 1) * TICK_US;
+            lastYield = nextPass;
+        }
+    }
+    r.atSpeed = settled;
+    r.angleMean = r.commutations ? angleSum / r.commutations : 0;
+    r.lateMean = r.crossings ? lateSum / r.crossings : 0;
+    return r;
+}
+
+int failures = 0;
+void check(bool ok, const char *what)
+{
+    printf("  %-6s %s\n", ok ? "ok" : "FAILED", what);
+    failures += ok ? 0 : 1;
+}
+
+// the checks on one run
+void report(const settings &s, const run &r)
+{
+    char line[160];
+    printf("back-EMF %.0f counts at %.0f RPM, noise %.0f counts rms, spike %.0f counts:\n",
+           s.counts, targetRPM, s.noise, s.spike);
+    snprintf(line, sizeof(line), "sensorless at %.2f s (%.0f RPM), at %.0f RPM by %.2f s, %u fallbacks",
+             r.handoff, r.handoffRPM, targetRPM, r.atSpeed, r.fallbacks);
+    check(r.handoff > 0 && r.atSpeed > 0 && r.fallbacks == 0, line);
+    snprintf(line, sizeof(line), "held within %.1f steps/s, %.1f steps lag swing", r.maxError, r.maxLag - r.minLag);
+    check(r.atSpeed > 0 && r.maxLag - r.minLag < 6, line);
+    snprintf(line, sizeof(line), "%ld of %ld crossings found, %.1f deg after the rotor (worst %.1f)",
+             r.crossings, r.windows, r.lateMean, r.lateWorst);
+    check(r.windows > 0 && r.crossings == r.windows, line);
+    snprintf(line, sizeof(line), "on the way up, commutated %.1f deg after the crossing (worst %.1f), %ld times",
+             r.angleMean, r.angleWorst, r.commutations);
+    check(r.commutations > 0 && fabs(r.angleMean - 30) < MAX_ANGLE_MEAN && fabs(r.angleWorst - 30) < MAX_ANGLE_ERROR, line);
+    printf("  at the target, %ld commutations held back to the target step\n", r.held);
+    snprintf(line, sizeof(line), "idle task ran at least every %.0f ms", r.longestAwake / 1e3);
+    check(r.longestAwake <= 2 * BEMF_YIELD_US + SAMPLE_US, line);
+}
+
+int main(int argc, char **argv)
+{
+    settings s;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--csv"))
+            s.csv = true;
+        else if (i + 1 < argc && !strcmp(argv[i], "--counts"))
+            s.counts = atof(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "--noise"))
+            s.noise = atof(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "--spike"))
+            s.spike = atof(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "--seconds"))
+            s.seconds = atof(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--counts counts] [--noise counts] [--spike counts] [--seconds s] [--csv]\n", argv[0]);
+            return 1;
+        }
+    }
+    std::mt19937 random(1);
+    if (s.csv)
+    {
+        printf("t_s,rotor,commanded,step_us,sensorless,lag\n");
+        simulate(s, random);
+        return 0;
+    }
+
+    report(s, simulate(s, random));
+    s.noise *= 4;
+    report(s, simulate(s, random));
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+// CommutationCheck -- check the six-step commutation (commutation.h) and its timing, on a PC
+// Drives a Commutator on the sketch's phase pins into a RAM word standing in for GPIO.out,
+// as startCommutation() and onStepTimer() do, and runs the step timer (1 us ticks,
+// auto-reload, the alarm rewritten by each ISR) against speedTask() publishing
+// STEP_PERIOD every SPEED_TICK_MS from a SpeedController fed by an ideal rotor.  Checks that
+//   - each stage's set/clear words are disjoint and cover exactly the three phase pins
+//   - the phases go LLH HLH HLL HHL LHL LHH (phase1 phase2 phase3) from start(), over and
+//     over, changing exactly one phase per step and leaving the other GPIO bits alone
+//   - cycles() counts one per 6 steps
+//   - every stage lasts the STEP_PERIOD published before it began: a publish in the middle
+//     of a stage only takes effect from the next one (nothing torn, no stage cut short)
+//   - no stage is shorter than the floor or longer than the starting step
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -I../../include CommutationCheck.cpp -o commutationcheck
+//   ./commutationcheck
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "commutation.h"
+#include "speedControl.h"
+
+// as the sketch
+#define phase1 2
+#define phase2 5
+#define phase3 26
+#define START_STEP 40000 // us (stepLength)
+#define MIN_STEP 900     // us (minStepLength)
+#define OTHER_BITS 0x50a00f00UL // GPIO bits that aren't phases (must survive every write)
+#define RUN_SECONDS 20
+
+const int stepsPerRevolution = 20 * 6;
+const int countsPerRevolution = 60;
+const float targetRPM = 550.0;
+
+const char *EXPECTED[COMMUTATION_STAGES] = {"LLH", "HLH", "HLL", "HHL", "LHL", "LHH"};
+const uint32_t PINS = (1UL << phase1) | (1UL << phase2) | (1UL << phase3);
+
+int failures = 0;
+void check(bool ok, const char *what)
+{
+    printf("  %-6s %s\n", ok ? "ok" : "FAILED", what);
+    failures += ok ? 0 : 1;
+}
+
+// phase levels of the GPIO word, as "LLH"
+void levels(uint32_t gpio, char *text)
+{
+    const uint8_t pin[3] = {phase1, phase2, phase3};
+    for (int p = 0; p < 3; p++)
+    {
+        text[p] = (gpio & (1UL << pin[p])) ? 'H' : 'L';
+    }
+    text[3] = 0;
+}
+
+// the ISR's writes: w1tc, then w1ts
+void write(uint32_t &gpio, const phaseWords &stage)
+{
+    gpio &= ~stage.clear;
+    gpio |= stage.set;
+}
+
+int main()
+{
+    Commutator commutator(phase1, phase2, phase3);
+    char line[120];
+
+    printf("register words:\n");
+    bool ok = true;
+    for (uint8_t s = 0; s < COMMUTATION_STAGES; s++)
+    {
+        const phaseWords &w = commutator.words(s);
+        ok = ok && !(w.set & w.clear) && (w.set | w.clear) == PINS;
+    }
+    check(ok, "set and clear disjoint, covering exactly phase1-3");
+
+    // setup(): all phases HIGH, then startCommutation() drives stage 0 and starts the timer
+    uint32_t gpio = OTHER_BITS | PINS;
+    write(gpio, commutator.start());
+    char text[4];
+    levels(gpio, text);
+    bool sequenceOk = (text[0] == 'L' && text[1] == 'L' && text[2] == 'H') && (gpio & ~PINS) == OTHER_BITS;
+
+    SpeedController speedController((float)stepsPerRevolution / countsPerRevolution,
+                                    targetRPM * stepsPerRevolution / 60.0);
+    volatile uint32_t STEP_PERIOD = START_STEP;
+    uint32_t alarm = STEP_PERIOD; // timerAlarmWrite() in startCommutation()
+    uint32_t stageStart = 0;
+    std::vector<uint32_t> publishedAt(1, 0), publishedStep(1, START_STEP); // STEP_PERIOD history
+    uint32_t nextTick = SPEED_TICK_MS * 1000;
+    long steps = 0, countedSteps = 0, wrongLength = 0, midStagePublishes = 0;
+    uint32_t shortest = START_STEP, longest = 0, atSpeed = 0;
+    bool singleChange = true, cyclesOk = true;
+    const uint32_t runMicros = RUN_SECONDS * 1000000UL;
+    for (uint32_t now = 0; now < runMicros;)
+    {
+        uint32_t alarmAt = stageStart + alarm;
+        if (nextTick < alarmAt)
+        {
+            // speedTask(): the ideal rotor turns 2 steps per encoder count
+            now = nextTick;
+            nextTick += SPEED_TICK_MS * 1000;
+            int32_t counts = (steps - countedSteps) / 2;
+            countedSteps += 2 * counts;
+            uint32_t step = speedController.update(counts);
+            step = (step < MIN_STEP) ? MIN_STEP : step;
+            if (step != STEP_PERIOD)
+            {
+                midStagePublishes += (now != stageStart) ? 1 : 0;
+                publishedAt.push_back(now);
+                publishedStep.push_back(step);
+            }
+            STEP_PERIOD = step;
+            if (!atSpeed && speedController.atSpeed())
+            {
+                atSpeed = now;
+            }
+            continue;
+        }
+
+        // onStepTimer(): the counter reloads at the alarm; the stage that just ended
+        // must have lasted what was published last before it began (a speed tick at the
+        // very moment of the alarm comes after the ISR)
+        now = alarmAt;
+        uint32_t length = now - stageStart;
+        size_t p = publishedAt.size() - 1;
+        while (p > 0 && publishedAt[p] >= stageStart)
+        {
+            p--;
+        }
+        wrongLength += (length != publishedStep[p]) ? 1 : 0;
+        shortest = (length < shortest) ? length : shortest;
+        longest = (length > longest) ? length : longest;
+
+        uint32_t before = gpio;
+        write(gpio, commutator.next());
+        steps++;
+        int changed = __builtin_popcount((before ^ gpio) & PINS);
+        levels(gpio, text);
+        singleChange = singleChange && changed == 1;
+        sequenceOk = sequenceOk && (gpio & ~PINS) == OTHER_BITS &&
+                     text[0] == EXPECTED[steps % 6][0] && text[1] == EXPECTED[steps % 6][1] &&
+                     text[2] == EXPECTED[steps % 6][2];
+        cyclesOk = cyclesOk && commutator.cycles() == (uint32_t)(steps / 6);
+        alarm = STEP_PERIOD; // timerAlarmWrite(stepTimer, STEP_PERIOD, true)
+        stageStart = now;
+    }
+
+    printf("phase sequence, %ld steps over %d s:\n", steps, RUN_SECONDS);
+    check(sequenceOk, "LLH HLH HLL HHL LHL LHH from start(), other GPIO bits untouched");
+    check(singleChange, "one phase changes per step");
+    snprintf(line, sizeof(line), "cycles() = steps / 6 (%u)", commutator.cycles());
+    check(cyclesOk, line);
+
+    printf("timing:\n");
+    snprintf(line, sizeof(line), "%ld speed ticks changed STEP_PERIOD mid-stage; %ld stages of the wrong length",
+             midStagePublishes, wrongLength);
+    check(wrongLength == 0, line);
+    snprintf(line, sizeof(line), "stages %u..%u us (floor %d, start %d)", shortest, longest, MIN_STEP, START_STEP);
+    check(shortest >= MIN_STEP && longest <= START_STEP, line);
+    printf("  at %d RPM after %.2f s (ideal rotor)\n", (int)targetRPM, atSpeed / 1e6);
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+// SineDump -- print the PWM duties the sine drive (sineDrive.h) generates, on a PC
+// Runs SineDrive for a number of SINE_TICK_US ticks at a fixed speed, as the timer ISR
+// would, and prints one CSV line per tick: time, electrical angle, the three duties, and
+// the analytic reference duties for the ideal angle at that time.  The summary (stderr)
+// gives the largest duty error (counts), the angle drift from the integer phase increment,
+// and the peak phase and line-to-line duty swing.
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -I../../include SineDump.cpp -o sinedump
+//   ./sinedump --mode svpwm --step 900 --ticks 2000 > svpwm.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sineDrive.h"
+
+// simulation settings (command line)
+struct settings
+{
+    uint8_t mode = SINE_SVPWM;
+    uint32_t step = 900;       // us per six-step stage
+    uint32_t ticks = 2000;     // SINE_TICK_US each
+    uint16_t amplitude = 32767; // Q15
+    uint8_t bits = 10;         // PWM resolution
+};
+
+// ideal duty of phase (0-2) at electrical angle (radians)
+double referenceDuty(const settings &s, double angle, int phase)
+{
+    const double third = 2.0 * M_PI / 3.0;
+    double v[3];
+    for (int k = 0; k < 3; k++)
+    {
+        v[k] = cos(angle - k * third);
+    }
+    double wave = v[phase];
+    if (s.mode == SINE_SVPWM)
+    {
+        double high = fmax(v[0], fmax(v[1], v[2]));
+        double low = fmin(v[0], fmin(v[1], v[2]));
+        wave = (wave - (high + low) / 2) * 2.0 / sqrt(3.0);
+    }
+    double half = 1 << (s.bits - 1);
+    return half + wave * (s.amplitude / 32768.0) * (half - 1);
+}
+
+int main(int argc, char **argv)
+{
+    settings s;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--mode"))
+            s.mode = strcmp(argv[i + 1], "spwm") ? SINE_SVPWM : SINE_SPWM;
+        else if (!strcmp(argv[i], "--step"))
+            s.step = atol(argv[i + 1]);
+        else if (!strcmp(argv[i], "--ticks"))
+            s.ticks = atol(argv[i + 1]);
+        else if (!strcmp(argv[i], "--amplitude"))
+            s.amplitude = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--bits"))
+            s.bits = atoi(argv[i + 1]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--mode spwm|svpwm] [--step us] [--ticks n] [--amplitude q15] [--bits n]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    SineDrive drive(s.mode, s.bits);
+    drive.setAmplitude(s.amplitude);
+    drive.setStepMicros(s.step);
+
+    double maxError = 0, maxDrift = 0;
+    int lowest = 1 << s.bits, highest = 0, lineToLine = 0;
+    printf("t_us,angle_deg,duty1,duty2,duty3,ref1,ref2,ref3\n");
+    for (uint32_t tick = 0; tick <= s.ticks; tick++)
+    {
+        if (tick > 0)
+        {
+            drive.advance();
+        }
+        double t = (double)tick * SINE_TICK_US;
+        double ideal = 4.0 * M_PI / 3.0 + 2.0 * M_PI * t / (6.0 * s.step); // stage 0 = 240 degrees
+        double actual = 2.0 * M_PI * drive.angle() / SINE_FULL_TURN;
+        double drift = remainder(actual - ideal, 2.0 * M_PI);
+        maxDrift = fmax(maxDrift, fabs(drift));
+
+        printf("%.0f,%.2f", t, actual * 180.0 / M_PI);
+        for (int k = 0; k < 3; k++)
+        {
+            printf(",%d", drive.duty(k));
+        }
+        for (int k = 0; k < 3; k++)
+        {
+            // table steps are 360/SINE_TABLE_SIZE degrees: compare at the table's own angle
+            double reference = referenceDuty(s, actual - fmod(actual, 2.0 * M_PI / SINE_TABLE_SIZE), k);
+            maxError = fmax(maxError, fabs(drive.duty(k) - reference));
+            printf(",%.2f", referenceDuty(s, ideal, k));
+            lowest = (drive.duty(k) < lowest) ? drive.duty(k) : lowest;
+            highest = (drive.duty(k) > highest) ? drive.duty(k) : highest;
+        }
+        printf("\n");
+        int d01 = abs((int)drive.duty(0) - (int)drive.duty(1));
+        lineToLine = (d01 > lineToLine) ? d01 : lineToLine;
+    }
+
+    fprintf(stderr, "%s, %u us/stage (%.1f Hz electrical), %u ticks of %d us\n",
+            (s.mode == SINE_SPWM) ? "SPWM" : "SVPWM", s.step, 1e6 / (6.0 * s.step), s.ticks, SINE_TICK_US);
+    fprintf(stderr, "max duty error %.2f counts, angle drift %.4f deg\n", maxError, maxDrift * 180.0 / M_PI);
+    fprintf(stderr, "duty %d..%d of %d, line-to-line peak %d\n", lowest, highest, (1 << s.bits) - 1, lineToLine);
+    return 0;
+}
@@ -0,0 +1,282 @@
+// SpinUp -- spin the HDD spindle up with the speed controller (speedControl.h) on a plant model, on a PC
+// The plant is the spindle under six-step commutation, angles in commutation steps (120 per
+// revolution): the stator field sits at the commutated step, and the rotor accelerates by
+//     accel * (1 - speed / freeSpeed) * sin(load angle) - damping * (speed - field speed)
+//       - windage * speed^2 - friction
+// (load angle = 60 degrees electrical per step the rotor lags the field; the torque is
+// derated by the back-EMF, and turns into braking if the rotor falls 3 steps behind, so the
+// rotor can slip poles and stall; the damping, eddy currents in hub and platters, is what
+// makes the rotor's hunting about the field die down).  The encoder counts 60 per revolution,
+// as the sketch's.  speedTask() is run every SPEED_TICK_MS, as in the sketch (900 us floor):
+//   - spin-up: time until the controller is at speed and the rotor within 2% of the target
+//     for HOLD_SECONDS, in step (no pole slips) and with no resyncs
+//   - heavy: the same with the rotor's inertia doubled (two platters)
+//   - stall: at speed, a brake stronger than the motor for --brake-ms; the controller must
+//     get the rotor back to speed
+//   - the old open-loop gear schedule (adjustStepLength(), gears 1-4) on the same plant, for
+//     comparison
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -I../../include SpinUp.cpp -o spinup
+//   ./spinup [--accel steps/s^2] [--free steps/s] [--windage steps/s^2 at target] [--damping 1/s]
+//            [--brake-ms ms] [--csv]
+// The motor constants are guesses for a 2-platter 5400 RPM drive's spindle; the damping
+// especially (hunting dies down in ~1/5 s at 5/s) -- measure a ring-down and put it here
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "speedControl.h"
+
+// as the sketch
+const int stepsPerRevolution = 20 * 6;
+const int countsPerRevolution = 60;
+const float targetRPM = 550.0;
+#define START_STEP 40000 // us (stepLength)
+#define MIN_STEP 900     // us (minStepLength)
+
+#define SIM_DT 5e-6      // s; plant integration step
+#define RUN_SECONDS 40.0 // longest run
+#define SETTLE_BAND 0.02 // rotor within 2% of the target = there
+#define HOLD_SECONDS 5.0 // time the rotor must hold the target after getting there
+
+// motor and load (command line)
+struct settings
+{
+    double accel = 1500.0;  // steps/s^2 the motor gives the rotor at standstill, load angle 90 deg
+    double free = 2000.0;   // steps/s; no-load speed (back-EMF cancels the drive)
+    double windage = 250.0; // steps/s^2 of drag at the target speed (grows with speed^2)
+    double friction = 20.0; // steps/s^2
+    double damping = 5.0;   // 1/s; drag on the rotor's speed relative to the field's
+    double brakeMs = 500.0; // stall test: brake on this long
+    bool csv = false;       // print the spin-up trace
+};
+
+// one run's outcome
+struct run
+{
+    double atSpeed;  // s; controller at speed and rotor settled (-1 = never)
+    double maxError; // steps/s; worst rotor speed error while holding
+    double minLag;   // steps the rotor lagged the field while holding, least and most
+    double maxLag;   //   (6 steps apart = a pole slipped)
+    uint16_t resyncs;
+};
+
+/*------------------------------------------------------------------------------
+   Spindle -- the plant
+  ------------------------------------------------------------------------------*/
+struct Spindle
+{
+    const settings &s;
+    double inertia; // relative to one platter
+    double angle;   // steps
+    double speed;   // steps/s
+    double brake;   // steps/s^2 of load, on top of the windage
+
+    Spindle(const settings &s, double inertia) : s(s), inertia(inertia), angle(0), speed(0), brake(0) {}
+
+    // advance by SIM_DT with the field at step field
+    void advance(long field, double fieldSpeed)
+    {
+        const double target = targetRPM * stepsPerRevolution / 60.0;
+        double drive = s.accel * (1.0 - speed / s.free) * sin((field - angle) * M_PI / 3.0);
+        drive -= s.damping * (speed - fieldSpeed);
+        double drag = s.windage * (speed / target) * (speed / target) + s.friction + brake;
+        drag = (speed > 0) ? drag : ((drive > drag) ? drag : (drive > 0 ? drive : 0)); // no drag backwards
+        speed += (drive - drag) / inertia * SIM_DT;
+        angle += speed * SIM_DT;
+    }
+
+    int64_t count() const { return (int64_t)floor(angle * countsPerRevolution / stepsPerRevolution); }
+};
+
+/*------------------------------------------------------------------------------
+   spin() -- the sketch's step timer and speedTask() on the plant
+     inertia   - rotor inertia, relative to one platter
+     brakeAt   - s; brake on (stronger than the motor) for s.brakeMs, once at speed
+  ------------------------------------------------------------------------------*/
+run spin(const settings &s, double inertia, bool brakeAt, bool trace)
+{
+    const double target = targetRPM * stepsPerRevolution / 60.0;
+    SpeedController speedController((float)stepsPerRevolution / countsPerRevolution, target);
+    Spindle spindle(s, inertia);
+    uint32_t stepPeriod = START_STEP;
+    long field = 0;
+    double nextStep = stepPeriod * 1e-6, nextTick = SPEED_TICK_MS * 1e-3;
+    int64_t lastCount = 0;
+    double brakeOn = -1, brakeOff = -1, settled = -1;
+    run r = {-1, 0, 1e9, -1e9, 0};
+    for (double t = 0; t < RUN_SECONDS; t += SIM_DT)
+    {
+        if (t >= nextStep)
+        {
+            field++; // onStepTimer()
+            nextStep += stepPeriod * 1e-6;
+        }
+        spindle.brake = (brakeOn >= 0 && t >= brakeOn && t < brakeOff) ? 2 * s.accel : 0;
+        spindle.advance(field, 1e6 / stepPeriod);
+        if (t < nextTick)
+        {
+            continue;
+        }
+
+        // speedTask()
+        nextTick += SPEED_TICK_MS * 1e-3;
+        int64_t count = spindle.count();
+        uint32_t step = speedController.update((int32_t)(count - lastCount));
+        lastCount = count;
+        stepPeriod = (step < MIN_STEP) ? MIN_STEP : step;
+        if (trace)
+        {
+            printf("%.2f,%.1f,%.1f,%.1f,%u,%u\n", t, spindle.speed, speedController.commanded(),
+                   speedController.measured(), stepPeriod, speedController.resyncs());
+        }
+
+        // at speed: the controller at the target, the rotor within SETTLE_BAND of it
+        bool there = speedController.atSpeed() && fabs(spindle.speed - target) < SETTLE_BAND * target;
+        if (!there || (brakeOn >= 0 && t < brakeOff))
+        {
+            settled = -1; // (again) not yet
+            r.maxError = 0;
+            r.minLag = 1e9;
+            r.maxLag = -1e9;
+            continue;
+        }
+        settled = (settled < 0) ? t : settled;
+
+        // holding the target: after HOLD_SECONDS, brake once (stall test) or stop
+        r.maxError = fmax(r.maxError, fabs(spindle.speed - target));
+        r.minLag = fmin(r.minLag, field - spindle.angle);
+        r.maxLag = fmax(r.maxLag, field - spindle.angle);
+        if (t - settled < HOLD_SECONDS)
+        {
+            continue;
+        }
+        if (brakeAt && brakeOn < 0)
+        {
+            brakeOn = t;
+            brakeOff = t + s.brakeMs * 1e-3;
+            r.resyncs = speedController.resyncs();
+            continue;
+        }
+        r.atSpeed = brakeAt ? settled - brakeOff : settled;
+        break;
+    }
+    r.resyncs = speedController.resyncs() - r.resyncs;
+    return r;
+}
+
+/*------------------------------------------------------------------------------
+   oldGears() -- the old adjustStepLength() ramp (gears 1-4, once per 6-step cycle) on
+     the plant; returns the time to the 5th gear threshold (-1 if the rotor lost step)
+  ------------------------------------------------------------------------------*/
+double oldGears(const settings &s)
+{
+    const int gearSteps[4] = {50, 300, 50, 2};         // us taken off per cycle
+    const int gearThreshold[4] = {39950, 20000, 3000, 1100}; // us; next gear below this
+    Spindle spindle(s, 1.0);
+    long field = 0;
+    int gear = 0;
+    uint32_t stepLength = START_STEP;
+    double nextStep = stepLength * 1e-6;
+    for (double t = 0; t < 120.0; t += SIM_DT)
+    {
+        if (t >= nextStep)
+        {
+            if (++field % 6 == 0)
+            {
+                stepLength -= gearSteps[gear];
+                while (gear < 4 && stepLength < (uint32_t)gearThreshold[gear])
+                {
+                    gear++;
+                }
+                if (gear == 4)
+                {
+                    return (field - spindle.angle < 3) ? t : -1;
+                }
+            }
+            nextStep += stepLength * 1e-6;
+        }
+        spindle.advance(field, 1e6 / stepLength);
+    }
+    return -1;
+}
+
+// no pole slipped while holding the target
+bool inStep(const run &r)
+{
+    return r.maxLag - r.minLag < 6;
+}
+
+// one line on a run
+void describe(char *line, size_t size, const char *what, const run &r)
+{
+    char text[120];
+    if (r.atSpeed < 0)
+        snprintf(text, sizeof(text), "%s: not at %.0f RPM in %.0f s", what, targetRPM, RUN_SECONDS);
+    else
+        snprintf(text, sizeof(text), "%s: at %.0f RPM in %.2f s, held within %.1f steps/s, %.1f steps lag swing, %u resyncs",
+                 what, targetRPM, r.atSpeed, r.maxError, r.maxLag - r.minLag, r.resyncs);
+    snprintf(line, size, "%s", text);
+}
+
+int failures = 0;
+void check(bool ok, const char *what)
+{
+    printf("  %-6s %s\n", ok ? "ok" : "FAILED", what);
+    failures += ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    settings s;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--csv"))
+            s.csv = true;
+        else if (i + 1 < argc && !strcmp(argv[i], "--accel"))
+            s.accel = atof(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "--free"))
+            s.free = atof(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "--windage"))
+            s.windage = atof(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "--damping"))
+            s.damping = atof(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "--brake-ms"))
+            s.brakeMs = atof(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--accel steps/s^2] [--free steps/s] [--windage steps/s^2] [--damping 1/s] [--brake-ms ms] [--csv]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (s.csv)
+    {
+        printf("t_s,rotor,commanded,measured,step_us,resyncs\n");
+        spin(s, 1.0, false, true);
+        return 0;
+    }
+
+    char line[120];
+    printf("motor: %.0f steps/s^2, free-running %.0f RPM, windage %.0f steps/s^2 at %.0f RPM, damping %.1f/s\n",
+           s.accel, s.free * 60 / stepsPerRevolution, s.windage, targetRPM, s.damping);
+    run r = spin(s, 1.0, false, false);
+    describe(line, sizeof(line), "spin-up", r);
+    check(r.atSpeed > 0 && inStep(r) && r.resyncs == 0, line);
+    r = spin(s, 2.0, false, false);
+    describe(line, sizeof(line), "heavy (2x inertia)", r);
+    check(r.atSpeed > 0 && inStep(r), line);
+    r = spin(s, 1.0, true, false);
+    snprintf(line, sizeof(line), "stall (%.0f ms brake), after the brake", s.brakeMs);
+    describe(line, sizeof(line), line, r);
+    check(r.atSpeed > 0 && inStep(r), line);
+
+    double old = oldGears(s);
+    if (old > 0)
+        printf("  old gear schedule: %.2f s to the 5th gear threshold (1100 us)\n", old);
+    else
+        printf("  old gear schedule: rotor lost step before the 5th gear threshold\n");
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
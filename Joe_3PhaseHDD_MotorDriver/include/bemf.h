@@ -0,0 +1,240 @@
+#ifndef BEMF_H
+#define BEMF_H
+
+// Sensorless (back-EMF) commutation for the HDD spindle
+// Each phase is driven for three stages (180 degrees electrical) and floats for three; the
+// voltage of a floating phase, measured against the center tap, is the back-EMF of its coil.
+// The phase sampled in a stage (BEMF_PHASE, commutation.h) is the next to be driven: it
+// floats for the two stages before it is, and its back-EMF crosses zero once in them, where
+// driving it would give the most torque.  The stage it is driven in is commutated 30 degrees
+// electrical (half a step) after the crossing, whatever the commutation timer thought, which
+// leaves time for the detection and still gives ~87% of the torque (cos 30).
+//   ZeroCrossDetector - finds the crossing in one window's samples: ignores the first part of
+//                       each step (coil demagnetizing after commutation), notes the sign of the
+//                       back-EMF, and reports the first sample of BEMF_CONFIRM in a row with
+//                       the other sign (so it works for rising and falling crossings alike)
+//   BemfTracker       - step period from crossing to crossing, time to the next commutation,
+//                       and whether the crossings are regular enough to commutate from
+//   BemfSensor        - the two together, following the commutation from window to window
+// Note: kept free of Arduino/ESP32 headers so it can be compiled natively
+
+#include <stdint.h>
+#include "commutation.h"
+
+#define BEMF_BLANKING_DIV 4     // ignore the first 1/4 of each step
+#define BEMF_CONFIRM 2          // samples in a row past zero = a crossing
+#define BEMF_HYSTERESIS 8       // ADC counts around zero that count as neither sign
+#define BEMF_LOCK_CROSSINGS 12  // crossings in a row before commutating from the back-EMF (24 steps)
+#define BEMF_MAX_MISSES 3       // windows in a row without a crossing = lost (6 steps)
+
+class ZeroCrossDetector
+{
+public:
+    ZeroCrossDetector() : _crossing(0) { beginStep(0, 0); }
+
+    // new window: commutated at time now (us); step expected to last stepMicros
+    void beginStep(uint32_t now, uint32_t stepMicros)
+    {
+        blankStep(now, stepMicros);
+        _sign = 0;
+        _confirmed = 0;
+        _found = false;
+    }
+
+    // next step of the same window: ignore its start too, but keep the sign seen so far
+    void blankStep(uint32_t now, uint32_t stepMicros)
+    {
+        _start = now;
+        _blanking = stepMicros / BEMF_BLANKING_DIV;
+    }
+
+    /*------------------------------------------------------------------------------
+       sample() -- one back-EMF sample (floating phase minus center tap, ADC counts)
+       returns true once per step, when the crossing is confirmed (see crossing())
+      ------------------------------------------------------------------------------*/
+    bool sample(int16_t bemf, uint32_t now)
+    {
+        if (_found || (uint32_t)(now - _start) < _blanking)
+        {
+            return false;
+        }
+        int8_t sign = (bemf > BEMF_HYSTERESIS) ? 1 : ((bemf < -BEMF_HYSTERESIS) ? -1 : 0);
+        if (sign == 0)
+        {
+            return false;
+        }
+        if (_sign == 0)
+        {
+            _sign = sign; // back-EMF sign before the crossing
+            return false;
+        }
+        if (sign == _sign)
+        {
+            _confirmed = 0;
+            return false;
+        }
+        if (_confirmed++ == 0)
+        {
+            _crossing = now;
+        }
+        if (_confirmed >= BEMF_CONFIRM)
+        {
+            _found = true;
+        }
+        return _found;
+    }
+
+    bool found() const { return _found; }
+    uint32_t crossing() const { return _crossing; } // us; first sample past zero
+
+private:
+    uint32_t _start;
+    uint32_t _blanking;
+    uint32_t _crossing;
+    int8_t _sign;
+    uint8_t _confirmed;
+    bool _found;
+};
+
+class BemfTracker
+{
+public:
+    BemfTracker() { reset(0); }
+
+    // start over; stepMicros = current (open-loop) step length
+    void reset(uint32_t stepMicros)
+    {
+        _period = stepMicros;
+        _lastCrossing = 0;
+        _crossings = 0;
+        _misses = 0;
+        _locked = false;
+    }
+
+    /*------------------------------------------------------------------------------
+       crossed() -- a crossing was found at time (us); crossings come every other step
+       returns the delay (us, from time) to the commutation 30 degrees electrical later
+      ------------------------------------------------------------------------------*/
+    uint32_t crossed(uint32_t time)
+    {
+        uint32_t interval = (time - _lastCrossing) / 2;
+        if (_crossings == 1)
+        {
+            _period = interval; // first interval of a run: the open-loop guess may be far off
+        }
+        else if (_crossings > 1)
+        {
+            // limit wild intervals (noise) instead of following them, but don't reject them:
+            // a period left behind by a fast ramp would never catch up
+            interval = (interval < _period / 2) ? _period / 2 : interval;
+            interval = (interval > _period * 2) ? _period * 2 : interval;
+            _period = (3 * _period + interval) / 4;
+        }
+        _lastCrossing = time;
+        _misses = 0;
+        if (++_crossings >= BEMF_LOCK_CROSSINGS)
+        {
+            _locked = true;
+        }
+        return _period / 2;
+    }
+
+    // a window ended without a crossing (the next interval would span two)
+    void missed()
+    {
+        _crossings = 0;
+        if (++_misses >= BEMF_MAX_MISSES)
+        {
+            _locked = false;
+        }
+    }
+
+    uint32_t period() const { return _period; } // us per step, from the crossings
+    bool locked() const { return _locked; }
+
+private:
+    uint32_t _period;
+    uint32_t _lastCrossing;
+    uint16_t _crossings;
+    uint8_t _misses;
+    bool _locked;
+};
+
+/*------------------------------------------------------------------------------
+   BemfSensor -- what the sensing task runs: follow the commutation, sample the phase(),
+     and once the crossing is in and the next commutation ends the window (closing()),
+     time that commutation delay() after the crossing
+  ------------------------------------------------------------------------------*/
+class BemfSensor
+{
+public:
+    BemfSensor() { reset(0, 0); }
+
+    // start over at stage; stepMicros = current (open-loop) step length
+    void reset(uint8_t stage, uint32_t stepMicros)
+    {
+        _tracker.reset(stepMicros);
+        _stage = stage;
+        _windowStart = 0;
+        _delay = 0;
+    }
+
+    // the commutation moved on to stage at time now (us); step expected to last stepMicros
+    // (if the crossing came in the window's first step, closing() is true from here)
+    void stageChanged(uint8_t stage, uint32_t now, uint32_t stepMicros)
+    {
+        _stage = stage;
+        if (bemfWindowStart(stage))
+        {
+            if (!_detector.found())
+            {
+                _tracker.missed();
+            }
+            _detector.beginStep(now, stepMicros);
+            _windowStart = now;
+        }
+        else
+        {
+            _detector.blankStep(now, stepMicros);
+        }
+    }
+
+    /*------------------------------------------------------------------------------
+       sample() -- one back-EMF sample of phase() (floating phase minus center tap, ADC counts)
+         minStep  - shortest step allowed (us): the window's two steps are never commutated
+                    faster than this, so the field can't outrun the target speed (the rotor
+                    falls in step with it, as in open loop, and the crossing moves up into
+                    the window's first step)
+       returns true on the window's crossing
+      ------------------------------------------------------------------------------*/
+    bool sample(int16_t bemf, uint32_t now, uint32_t minStep)
+    {
+        if (!_detector.sample(bemf, now))
+        {
+            return false;
+        }
+        uint32_t crossing = _detector.crossing();
+        uint32_t delay = _tracker.crossed(crossing);
+        int32_t early = (int32_t)(_windowStart + 2 * minStep - (crossing + delay));
+        _delay = delay + ((early > 0) ? early : 0);
+        return true;
+    }
+
+    uint8_t phase() const { return BEMF_PHASE[_stage]; } // phase (0-2) to sample
+    uint8_t stage() const { return _stage; }
+    bool found() const { return _detector.found(); }     // this window's crossing is in
+    bool closing() const { return found() && !bemfWindowStart(_stage); } // time the next commutation
+    uint32_t crossing() const { return _detector.crossing(); }
+    uint32_t delay() const { return _delay; }            // us, from crossing()
+    uint32_t period() const { return _tracker.period(); } // us per step, from the crossings
+    bool locked() const { return _tracker.locked(); }
+
+private:
+    ZeroCrossDetector _detector;
+    BemfTracker _tracker;
+    uint8_t _stage;
+    uint32_t _windowStart; // us; commutation that began the window
+    uint32_t _delay;
+};
+
+#endif
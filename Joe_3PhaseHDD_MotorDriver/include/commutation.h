@@ -0,0 +1,89 @@
+#ifndef COMMUTATION_H
+#define COMMUTATION_H
+
+// 6-step commutation for the 3-phase HDD spindle
+// The six stages drive these phase levels (phase1 phase2 phase3; H = high), each stage
+// changing just one phase:   LLH  HLH  HLL  HHL  LHL  LHH
+// The levels are translated once into GPIO set/clear register words, so the commutation
+// timer ISR writes all three phases with one w1tc/w1ts pair and a table lookup
+// Note: kept free of Arduino/ESP32 headers so it can be compiled natively
+
+#include <stdint.h>
+
+#define COMMUTATION_STAGES 6
+
+// phase levels of each stage: bit 0 = phase1, bit 1 = phase2, bit 2 = phase3 (1 = HIGH)
+const uint8_t PHASE_LEVELS[COMMUTATION_STAGES] = {0b100, 0b101, 0b001, 0b011, 0b010, 0b110};
+
+// back-EMF sensing (see bemf.h): phase (0-2) to sample in each stage -- one that isn't
+// driven (LOW: transistor off, coil floating from the center tap), and the next to be driven
+const uint8_t BEMF_PHASE[COMMUTATION_STAGES] = {0, 1, 1, 2, 2, 0};
+
+// a phase's sensing window is the two stages before it is driven; true for the first
+inline bool bemfWindowStart(uint8_t stage)
+{
+    return BEMF_PHASE[stage] != BEMF_PHASE[(stage + COMMUTATION_STAGES - 1) % COMMUTATION_STAGES];
+}
+
+// register words for one stage
+struct phaseWords
+{
+    uint32_t set;   // write to GPIO.out_w1ts (phases driven HIGH)
+    uint32_t clear; // write to GPIO.out_w1tc (phases driven LOW)
+};
+
+class Commutator
+{
+public:
+    // pins - gpio numbers of phase1..3 (0-31, so they are all in GPIO.out)
+    Commutator(uint8_t pin1, uint8_t pin2, uint8_t pin3)
+    {
+        const uint32_t bit[3] = {(uint32_t)1 << pin1, (uint32_t)1 << pin2, (uint32_t)1 << pin3};
+        for (uint8_t stage = 0; stage < COMMUTATION_STAGES; stage++)
+        {
+            _words[stage].set = _words[stage].clear = 0;
+            for (uint8_t phase = 0; phase < 3; phase++)
+            {
+                if (PHASE_LEVELS[stage] & (1 << phase))
+                {
+                    _words[stage].set |= bit[phase];
+                }
+                else
+                {
+                    _words[stage].clear |= bit[phase];
+                }
+            }
+        }
+        _stage = 0;
+        _cycles = 0;
+    }
+
+    // back to stage 0; returns its words (to be written when the step timer starts)
+    const phaseWords &start()
+    {
+        _stage = 0;
+        return _words[0];
+    }
+
+    // advance to the next stage (called from the step timer ISR); returns its words
+    inline __attribute__((always_inline)) const phaseWords &next()
+    {
+        if (++_stage >= COMMUTATION_STAGES)
+        {
+            _stage = 0;
+            _cycles++;
+        }
+        return _words[_stage];
+    }
+
+    uint8_t stage() const { return _stage; }
+    uint32_t cycles() const { return _cycles; } // completed 6-step cycles
+    const phaseWords &words(uint8_t stage) const { return _words[stage]; }
+
+private:
+    phaseWords _words[COMMUTATION_STAGES];
+    volatile uint8_t _stage;
+    volatile uint32_t _cycles;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef SINEDRIVE_H
+#define SINEDRIVE_H
+
+// Sinusoidal (SPWM) or space-vector (SVPWM) drive for the HDD spindle
+// Instead of switching the phases between six levels, each phase gets a PWM duty that
+// follows a sinusoid, 120 degrees apart, so the stator field turns smoothly (less torque
+// ripple, and no step timer interrupt per stage limiting the speed)
+//   - a phase accumulator, advanced every SINE_TICK_US by a timer ISR, holds the electrical
+//     angle; one full turn = SINE_TABLE_SIZE table entries (60 degrees = one six-step stage)
+//   - the waveform table is computed once, in fixed point (Q15):
+//       SPWM  - cos(angle)
+//       SVPWM - cos(angle) minus the mean of the largest and smallest of the three phases,
+//               scaled back to full range (the common-mode part cancels between the phases,
+//               so the same duty range gives 2/sqrt(3), ~15%, more line-to-line voltage)
+//   - duty = half + waveform * gain, gain set by the amplitude
+// Phase k (0-2) follows the waveform at angle - k * 120 degrees, so the field points at
+// phase k at k * 120 degrees, as in the six-step table (commutation.h), where stage s is at
+// 240 + 60 * s degrees: both drives turn the motor the same way
+// Needs each phase driven push-pull (half bridge), as PWM averages the phase voltage
+// Note: kept free of Arduino/ESP32 headers so it can be compiled natively
+
+#include <stdint.h>
+#include <math.h>
+
+#define SINE_SPWM 1
+#define SINE_SVPWM 2
+
+#ifndef SINE_TICK_US
+#define SINE_TICK_US 50 // duty update period (us)
+#endif
+#define SINE_TABLE_SIZE 384 // entries per electrical turn (divisible by 6)
+#define SINE_ANGLE_SHIFT 22 // accumulator units per table entry = 1 << SINE_ANGLE_SHIFT
+#define SINE_FULL_TURN ((uint32_t)SINE_TABLE_SIZE << SINE_ANGLE_SHIFT)
+
+class SineDrive
+{
+public:
+    // mode - SINE_SPWM or SINE_SVPWM; dutyBits - PWM resolution (duty 0 .. 2^dutyBits - 1)
+    SineDrive(uint8_t mode, uint8_t dutyBits)
+    {
+        const float turn = 2.0f * (float)M_PI;
+        for (uint16_t i = 0; i < SINE_TABLE_SIZE; i++)
+        {
+            float angle = turn * i / SINE_TABLE_SIZE;
+            float wave = cosf(angle);
+            if (mode == SINE_SVPWM)
+            {
+                float a = wave, b = cosf(angle - turn / 3), c = cosf(angle - 2 * turn / 3);
+                float high = (a > b) ? ((a > c) ? a : c) : ((b > c) ? b : c);
+                float low = (a < b) ? ((a < c) ? a : c) : ((b < c) ? b : c);
+                wave = (wave - (high + low) / 2) * 2.0f / sqrtf(3.0f);
+            }
+            _wave[i] = (int16_t)lroundf(wave * 32767);
+        }
+        _half = (uint16_t)(1 << (dutyBits - 1));
+        _mode = mode;
+        setAmplitude(32767);
+        _increment = 0;
+        start(0);
+    }
+
+    // full = 32767 (Q15): duty swings over the whole range
+    void setAmplitude(uint16_t amplitude)
+    {
+        _gain = (uint16_t)(((uint32_t)amplitude * (_half - 1) + (1 << 14)) >> 15);
+        update();
+    }
+
+    // electrical speed, as the six-step stage length it replaces (us per 60 degrees);
+    // the divisions happen here, not in the ISR
+    void setStepMicros(uint32_t stepMicros)
+    {
+        _increment = (uint32_t)(((uint64_t)SINE_FULL_TURN * SINE_TICK_US) / (6ULL * stepMicros));
+    }
+
+    // go to the angle of six-step stage (0-5), and hold it until advanced
+    void start(uint8_t stage)
+    {
+        _angle = (uint32_t)((SINE_TABLE_SIZE * 2 / 3 + stage * SINE_TABLE_SIZE / 6) % SINE_TABLE_SIZE)
+                 << SINE_ANGLE_SHIFT;
+        update();
+    }
+
+    // one SINE_TICK_US tick (called from the timer ISR): advance the angle, new duties
+    inline __attribute__((always_inline)) void advance()
+    {
+        _angle += _increment;
+        if (_angle >= SINE_FULL_TURN)
+        {
+            _angle -= SINE_FULL_TURN;
+        }
+        update();
+    }
+
+    uint16_t duty(uint8_t phase) const { return _duty[phase]; } // phase 0-2
+    uint32_t angle() const { return _angle; }                   // SINE_FULL_TURN per turn
+    uint32_t increment() const { return _increment; }           // per tick
+    int16_t wave(uint16_t index) const { return _wave[index]; } // Q15
+    uint8_t mode() const { return _mode; }
+
+private:
+    inline __attribute__((always_inline)) void update()
+    {
+        uint16_t index = _angle >> SINE_ANGLE_SHIFT;
+        for (uint8_t phase = 0; phase < 3; phase++)
+        {
+            _duty[phase] = _half + (((int32_t)_wave[index] * _gain + (1 << 14)) >> 15);
+            index = (index >= SINE_TABLE_SIZE / 3) ? index - SINE_TABLE_SIZE / 3 : index + 2 * SINE_TABLE_SIZE / 3;
+        }
+    }
+
+    int16_t _wave[SINE_TABLE_SIZE];
+    uint16_t _half; // duty at zero
+    uint16_t _gain; // duty counts at the waveform peak
+    uint8_t _mode;
+    volatile uint32_t _increment;
+    uint32_t _angle;
+    uint16_t _duty[3];
+};
+
+#endif
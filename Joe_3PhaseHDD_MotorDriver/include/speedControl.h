@@ -0,0 +1,158 @@
+#ifndef SPEEDCONTROL_H
+#define SPEEDCONTROL_H
+
+// Closed-loop speed control for the HDD spindle (replaces the open-loop "gears")
+// Called once per fixed control tick with the encoder count delta; returns the commutation
+// step length.  Speeds are in commutation steps per second (120 per revolution).
+// The rotor turns in step with the commutation as long as it can keep up, so holding the
+// target is a matter of getting there without losing it:
+//   - the commutation ramps toward the target; the acceleration adapts, growing while the
+//     encoder shows the rotor keeping up and halving when it falls SPEED_MAX_SLIP behind
+//     (the ramp is held there until it catches up)
+//   - a rotor still behind after SPEED_STALL_TICKS has stalled (lost step): the ramp
+//     restarts from the speed the rotor is actually turning at (resync)
+//   - a rotor slipping poles only a little slower than the commutation doesn't show in the
+//     speed, so the steps commutated are also counted against the steps the encoder saw:
+//     SPEED_MAX_LAG steps behind is falling behind, too (so a floor on the step length
+//     must stay below the target's, or the commutation lags the commanded speed)
+// Speed is measured over a sliding window of ticks, since one tick sees only a few counts
+// Note: kept free of Arduino/ESP32 headers so it can be compiled natively
+
+#include <stdint.h>
+
+#ifndef SPEED_TICK_MS
+#define SPEED_TICK_MS 10 // control tick (ms)
+#endif
+#define SPEED_WINDOW 8          // ticks in the speed measurement window
+#define SPEED_START 25.0f       // steps/s; commutation never slower (40000 us steps)
+#define SPEED_MEASURABLE 200.0f // steps/s; slower than this, the window sees too few counts
+#define SPEED_MIN_ACCEL 50.0f   // steps/s^2
+#define SPEED_MAX_ACCEL 800.0f  // steps/s^2
+#define SPEED_ACCEL_GROWTH 5.0f // steps/s^2 added per tick while the rotor keeps up
+#define SPEED_MAX_SLIP 60.0f    // steps/s; commutation this far ahead of the rotor = falling behind
+#define SPEED_STALL_TICKS 25    // ticks falling behind in a row = stalled
+#define SPEED_MAX_LAG 9.0f      // steps the rotor may fall behind the commutation (a pole = 6)
+
+class SpeedController
+{
+public:
+    // stepsPerCount - commutation steps per encoder count (steps per rev / counts per rev)
+    SpeedController(float stepsPerCount, float targetSteps)
+    {
+        _stepsPerCount = stepsPerCount;
+        _tick = SPEED_TICK_MS / 1000.0f;
+        _target = targetSteps;
+        reset();
+    }
+
+    // start over from standstill
+    void reset()
+    {
+        for (uint8_t i = 0; i < SPEED_WINDOW; i++)
+        {
+            _window[i] = 0;
+        }
+        _windowSum = 0;
+        _slot = 0;
+        _filled = 0;
+        _measured = 0;
+        _commanded = SPEED_START;
+        _accel = SPEED_MIN_ACCEL;
+        _stallTicks = 0;
+        _resyncs = 0;
+        _lag = 0;
+    }
+
+    void setTarget(float targetSteps) { _target = targetSteps; }
+
+    /*------------------------------------------------------------------------------
+       update() -- one control tick
+         counts - encoder count change since the last tick (either direction)
+       returns the commutation step length (us)
+      ------------------------------------------------------------------------------*/
+    uint32_t update(int32_t counts)
+    {
+        // measured speed over the window
+        counts = (counts < 0) ? -counts : counts;
+        _windowSum += counts - _window[_slot];
+        _window[_slot] = counts;
+        _slot = (_slot + 1) % SPEED_WINDOW;
+        if (_filled < SPEED_WINDOW)
+        {
+            _filled++;
+        }
+        _measured = _windowSum * _stepsPerCount / (_filled * _tick);
+
+        // steps commutated this tick that the rotor didn't turn (a rotor ahead of the
+        // commutation is only pulled back, so it doesn't count)
+        _lag += _commanded * _tick - counts * _stepsPerCount;
+        _lag = (_lag < 0) ? 0 : _lag;
+
+        // (below SPEED_MEASURABLE the speed is too coarse, so only the lag tells)
+        float slip = _commanded - _measured;
+        bool slipping = _lag > SPEED_MAX_LAG;
+        if ((_commanded >= SPEED_MEASURABLE && slip > SPEED_MAX_SLIP) || slipping)
+        {
+            // falling behind: back the commutation off toward the rotor, go easier from here on
+            // (at least SPEED_MAX_SLIP / 2: a slipping rotor's measured speed may look fine)
+            float backOff = _commanded - SPEED_MAX_SLIP / 2;
+            _commanded = (_measured + SPEED_MAX_SLIP / 2 < backOff) ? _measured + SPEED_MAX_SLIP / 2 : backOff;
+            _lag = 0;
+            _accel = (_accel / 2 > SPEED_MIN_ACCEL) ? _accel / 2 : SPEED_MIN_ACCEL;
+            if (++_stallTicks >= SPEED_STALL_TICKS)
+            {
+                resync(); // stalled
+            }
+        }
+        else
+        {
+            // keeping up: ramp toward the target
+            _stallTicks = 0;
+            _accel = (_accel + SPEED_ACCEL_GROWTH < SPEED_MAX_ACCEL) ? _accel + SPEED_ACCEL_GROWTH : SPEED_MAX_ACCEL;
+            float rampStep = _accel * _tick;
+            if (_commanded < _target)
+            {
+                _commanded = (_commanded + rampStep < _target) ? _commanded + rampStep : _target;
+            }
+            else
+            {
+                _commanded = (_commanded - rampStep > _target) ? _commanded - rampStep : _target;
+            }
+        }
+        _commanded = (_commanded < SPEED_START) ? SPEED_START : _commanded;
+        return (uint32_t)(1000000.0f / _commanded);
+    }
+
+    // pick the rotor up where it is (after a stall, or when another drive mode gives up)
+    void resync()
+    {
+        _commanded = (_measured > SPEED_START) ? _measured : SPEED_START;
+        _accel = SPEED_MIN_ACCEL;
+        _stallTicks = 0;
+        _lag = 0;
+        _resyncs++;
+    }
+
+    float measured() const { return _measured; }   // steps/s
+    float commanded() const { return _commanded; } // steps/s
+    float target() const { return _target; }       // steps/s
+    bool atSpeed() const { return _commanded == _target; }
+    uint16_t resyncs() const { return _resyncs; }
+
+private:
+    float _stepsPerCount;
+    float _tick; // s
+    float _target;
+    int32_t _window[SPEED_WINDOW]; // counts per tick
+    int32_t _windowSum;
+    uint8_t _slot;
+    uint8_t _filled;
+    float _measured;
+    float _commanded;
+    float _accel; // steps/s^2
+    uint8_t _stallTicks;
+    uint16_t _resyncs;
+    float _lag; // steps the rotor is behind the commutation
+};
+
+#endif
@@ -2,19 +2,32 @@
    Joe Brendler 20 Dec 2022
 
    Basic idea - start with long 3-phase pulse signal, and gradually accelerate by reducing the pulse-lenth (stepLength)
-   ToDo -
-     + shift to direct register manipulation of consecutive gpios
-     + shift to hardware timer interrupts instead of delays in loop function
-       -- timer0 = stage duration (stepLentgh)
-       -- isr() = stage++; STEP=true; (flag to switchstep(stage) and set STEP=false)
-     + shift to
-     add PID control
+   Commutation runs in a hardware timer ISR (timer 0 = stage duration, stepLength), which
+   writes all 3 phases at once from a 6-stage table (see commutation.h); a closed-loop speed
+   controller on a fixed tick sets stepLength from the encoder (see speedControl.h), and
+   loop() only updates the display, so neither can stretch a step
+   Sensorless mode (build_flags = -D BEMF_MODE=1; needs the phase sense dividers below): once
+   the open-loop ramp is fast enough and the back-EMF zero crossings are regular, the
+   commutation that drives the sensed phase is timed 30 degrees electrical after its
+   crossing instead (see bemf.h; examples/BemfSim runs it on a model of the spindle)
+   Sine drive (build_flags = -D SINE_DRIVE=SINE_SPWM or SINE_SVPWM; needs half-bridge phase
+   drivers): the phases get LEDC PWM duties following a sinusoid instead, updated by the same
+   timer on a fixed tick from a phase accumulator the speed controller sets (see sineDrive.h)
+   The status screen is a StatusPanel (Joe_OLED_Common): only the values that changed are
+   redrawn, and only the part of the screen they cover is sent to the OLED
    */
 #include <Arduino.h>
 #include <heltec.h>
 #include "images.h"
+#include "commutation.h"
+#include "speedControl.h"
+#include "bemf.h"
+#include "sineDrive.h"
+#include <statusPanel.h>
+#include <oledFlush.h>
 
 #include <ESP32Encoder.h>
+#include <soc/ledc_struct.h> // sine drive duties, written from the ISR
 
 // define pins -- careful to define for your board, ESP32, 8266, etc
 #define encoder_a 18
@@ -24,16 +37,40 @@
 #define phase2 5
 #define phase3 26
 
-#define gearLED_0 17
-#define gearLED_1 22
-#define gearLED_2 27
+// sensorless mode: back-EMF sense inputs (ADC1), each through a divider from a phase
+// terminal, and one from the center tap (the zero reference)
+#ifndef BEMF_MODE
+#define BEMF_MODE 0
+#endif
+#define sense1 36
+#define sense2 37
+#define sense3 38
+#define senseCenter 39
+#define BEMF_HANDOFF_RPM 200 // open loop until at least this fast
+#define BEMF_YIELD_US 100000 // sensing task lets the idle task run this often (after a crossing)
+
+// sine drive: 0 = six-step, SINE_SPWM or SINE_SVPWM; phases on LEDC channels 0-2
+#ifndef SINE_DRIVE
+#define SINE_DRIVE 0
+#endif
+#if SINE_DRIVE && BEMF_MODE
+#error "the sine drive has no undriven phase to sense the back-EMF on"
+#endif
+#define SINE_PWM_FREQ 25000 // Hz, above hearing
+#define SINE_PWM_BITS 10
+#define SINE_CHANNEL_1 0
+
+// speed control status LEDs (were the gear LEDs)
+#define gearLED_0 17 // spinning up
+#define gearLED_1 22 // at target speed
+#define gearLED_2 27 // toggles on every resync (stall)
 
 // initialize encoder and associated variables
 ESP32Encoder encoder;
 
 long newPosition = 0, oldPosition = newPosition;
-double newSpeed = 0, oldSpeed = 0;
-String newDirection = "ccw", oldDirection = newDirection;
+double newSpeed = 0;
+const char *newDirection = "ccw";
 unsigned long newMicros = 0, oldMicros = 0; // loop timing
 unsigned long delta_t = 0;                  // in usec
 
@@ -49,51 +86,96 @@ const int line_0 = 0, line_1 = 10, line_2 = 20, line_3 = 30, line_4 = 40, line_5
 // initialize display text variables
 String msg = "", old_msg = "";
 
+// status screen: a label and a value on each line
+StatusPanel panel;
+int8_t directionField, positionField, speedField, rpmField, stepLengthField, periodField;
+
 //--------- OLED display function declarations ------------
-void update_display(String old_var1, String old_var2, String old_var3,
-                    String old_var4, String old_var5, String old_var6,
-                    String new_var1, String new_var2, String new_var3,
-                    String new_var4, String new_var5, String new_var6);
+void update_display();
 void OLED_setup();
 
 // define baseline starting and minimum driver signal pulse length
 uint64_t stepLength = 40000; // us (Bart: 40000) (this is the duration of delay in each stage of the 3-phase signal)
-uint64_t oldStepLength = stepLength;
-uint64_t minStepLength = 900; // us (Bart: 1400)
-double period = 0.0, oldPeriod = period;
+uint64_t minStepLength = 900; // us (Bart: 1400) (floor, whatever the controller asks for)
+#if SINE_DRIVE
+uint64_t minSineStepLength = 450; // us; sine drive floor (no stage interrupts, smooth torque)
+#endif
+double period = 0.0;
 
 // driving 2 x disk platters, I couldn't go that fast until I switched to quatriture SRM (six stages, overlapping)
 // then I got as fast as 900 somewhat stable in "5th gear" , but (POV patterns are "wobbly" -- switching back to 1400)
 
-// define how much each cycle will reduce the driver signal pulse duration
-const int accelerationFactor = 300; // us (faster than current period)(700 w 5v)
-const int firstGearSteps = 50;    // us (Bart: 5)
-const int secondGearSteps = 300;  // us (Bart: 300)
-const int thirdGearSteps = 50;    // us (Bart: 50)
-const int fourthGearSteps = 2;    // us (Bart: 2)
-const int fifthGearSteps = 1;     // us (Bart: 2)
-
-// define the threshold for when to shift gears (to steps above)
-const int gear_12_threshold = 39950; // us
-const int gear_23_threshold = 20000; // us
-const int gear_34_threshold = 3000;  // us
-const int gear_45_threshold = 1100;  // us
-
-const int delay_threshold = 16380; // us (above this use delay(ms), below use delayMicroseconds(us))
-
-int steps = firstGearSteps;
-
-bool secondgear = false;
-bool thirdgear = false;
-bool fourthgear = false;
-bool fifthgear = false;
-
-int gear = 0, oldGear = gear;
+// closed-loop speed control (replaces the 5 "gears"); 20 cycles of 6 steps per revolution,
+// 60 encoder counts per revolution
+const int stepsPerRevolution = 20 * 6;
+const int countsPerRevolution = 60;
+const float targetRPM = 550.0; // ~ the old 5th gear top speed (minStepLength)
+SpeedController speedController((float)stepsPerRevolution / countsPerRevolution,
+                                targetRPM * stepsPerRevolution / 60.0);
+double rpm = 0.0; // measured by the speed controller
+
+// commutation engine: the step timer ISR walks the phase table; the speed controller
+// publishes the step length in STEP_PERIOD (one aligned 32-bit store, so the ISR never
+// sees a torn value)
+Commutator commutator(phase1, phase2, phase3);
+hw_timer_t *stepTimer = NULL;
+volatile uint32_t STEP_PERIOD = stepLength; // us
+portMUX_TYPE stepTimerMux = portMUX_INITIALIZER_UNLOCKED;
+
+#if SINE_DRIVE
+// sine drive: the step timer ticks every SINE_TICK_US instead, and onSineTimer() writes
+// the three duties
+SineDrive sineDrive(SINE_DRIVE, SINE_PWM_BITS);
+#endif
+
+#if BEMF_MODE
+// sensorless mode: bemfTask() finds the zero crossings and re-times the step timer
+BemfSensor bemfSensor;
+volatile bool SENSORLESS = false; // commutating from the back-EMF (else open loop)
+volatile uint32_t STEP_START = 0; // micros() at the last commutation
+#endif
 
 //--------- function declarations ------------
-void myDelay(unsigned long stepMicroseconds);
-void switchStep(int stage);
-void adjustStepLength();
+void startCommutation();
+void startSineDrive();
+void speedTask(void *parameter);
+void bemfTask(void *parameter);
+
+// --------------- interrupt functions ---------------
+/*------------------------------------------------------------------------------
+   onStepTimer() -- next commutation stage
+  ------------------------------------------------------------------------------*/
+void IRAM_ATTR onStepTimer()
+{
+  portENTER_CRITICAL_ISR(&stepTimerMux);
+  const phaseWords &stage = commutator.next();
+  GPIO.out_w1tc = stage.clear;
+  GPIO.out_w1ts = stage.set;
+#if BEMF_MODE
+  STEP_START = micros();
+#endif
+  // takes effect from the next stage on (auto-reload)
+  timerAlarmWrite(stepTimer, STEP_PERIOD, true);
+  portEXIT_CRITICAL_ISR(&stepTimerMux);
+}
+
+#if SINE_DRIVE
+/*------------------------------------------------------------------------------
+   onSineTimer() -- advance the sine drive angle, write the phase duties
+   (ledcWrite() takes a mutex, so the high-speed channel registers are written directly;
+   the new duties start with the next PWM cycle)
+  ------------------------------------------------------------------------------*/
+void IRAM_ATTR onSineTimer()
+{
+  sineDrive.advance();
+  for (uint8_t phase = 0; phase < 3; phase++)
+  {
+    LEDC.channel_group[0].channel[SINE_CHANNEL_1 + phase].duty.duty = sineDrive.duty(phase) << 4;
+    LEDC.channel_group[0].channel[SINE_CHANNEL_1 + phase].conf0.sig_out_en = 1;
+    LEDC.channel_group[0].channel[SINE_CHANNEL_1 + phase].conf1.duty_start = 1;
+  }
+}
+#endif
 
 //---------- setup() -------------------------
 void setup()
@@ -159,7 +241,7 @@ void setup()
     Serial.println("==> Done");
   */
 
-  digitalWrite(gearLED_0, HIGH);
+  digitalWrite(gearLED_0, LOW);
   digitalWrite(gearLED_1, LOW);
   digitalWrite(gearLED_2, LOW);
   Serial.println("Done");
@@ -168,7 +250,7 @@ void setup()
   Heltec.display->display();
 
   Serial.println("Done setup");
-  Serial.println("Starting in first gear, stage 0");
+  Serial.printf("Spinning up to %d RPM, stage 0\n", (int)targetRPM);
   msg = "Done Setup";
   Serial.print(msg);
   Heltec.display->drawString(col0_x, line_4, msg);
@@ -180,44 +262,39 @@ void setup()
   Heltec.display->display();
   delay(1000);
 
-  gear = 1;
-  // GPIO.out_w1tc = (1 << phase1) | (1 << phase2); // LLH
-  digitalWrite(phase1, LOW);
-  digitalWrite(phase2, LOW);
-
-  // set up persistent display
+#if SINE_DRIVE
+  startSineDrive(); // at the angle of stage 0, then the timer turns it
+#else
+  startCommutation(); // LLH, then the step timer takes over
+#endif
+  xTaskCreatePinnedToCore(speedTask, "speed", 4096, NULL, 2, NULL, 1);
+#if BEMF_MODE
+  xTaskCreatePinnedToCore(bemfTask, "bemf", 4096, NULL, 1, NULL, 0);
+#endif
+
+  // set up persistent display: labels, and the values' places and formats
   Heltec.display->clear();
   Heltec.display->display();
-  msg = "Direction: ";
-  Heltec.display->drawString(col0_x, line_0, msg);
-  msg = "Position: ";
-  Heltec.display->drawString(col0_x, line_1, msg);
-  msg = "Speed: ";
-  Heltec.display->drawString(col0_x, line_2, msg);
-  msg = "Gear: ";
-  Heltec.display->drawString(col0_x, line_3, msg);
-  msg = "stepLength: ";
-  Heltec.display->drawString(col0_x, line_4, msg);
-  msg = "period: ";
-  Heltec.display->drawString(col0_x, line_5, msg);
+  panel.begin(Heltec.display, ArialMT_Plain_10);
+  panel.addLabel(col0_x, line_0, "Direction: ");
+  panel.addLabel(col0_x, line_1, "Position: ");
+  panel.addLabel(col0_x, line_2, "Speed: ");
+  panel.addLabel(col0_x, line_3, "RPM: ");
+  panel.addLabel(col0_x, line_4, "stepLength: ");
+  panel.addLabel(col0_x, line_5, "period: ");
+  directionField = panel.addField(col2_x, line_0);
+  positionField = panel.addField(col2_x, line_1);
+  speedField = panel.addField(col2_x, line_2, 2);
+  rpmField = panel.addField(col2_x, line_3, 2);
+  stepLengthField = panel.addField(col2_x, line_4);
+  periodField = panel.addField(col2_x, line_5, 6);
   // display initial placeholder data
-  update_display(oldDirection, String(oldPosition), String(oldSpeed),
-                 String(oldGear), String(oldStepLength), String(oldPeriod, 6),
-                 newDirection, String(newPosition), String(newSpeed),
-                 String(gear), String(stepLength), String(period, 6));
-  Heltec.display->display();
+  update_display();
 }
 
 //--------------- loop() --------------------------
 void loop()
 {
-  switchStep(0);
-  switchStep(1);
-  switchStep(2);
-  switchStep(3);
-  switchStep(4);
-  switchStep(5);
-  adjustStepLength();
 
   // periodically update display with encoder data
   newMicros = micros();
@@ -242,182 +319,164 @@ void loop()
     // Serial.printf("newDirection: %s\n", newDirection);
     // Serial.printf("newPosition: %d\n", newPosition);
     // Serial.printf("newSpeed: %.15f\n", newSpeed);
-    update_display(oldDirection, String(oldPosition), String(oldSpeed),
-                   String(oldGear), String(oldStepLength), String(oldPeriod, 6),
-                   newDirection, String(newPosition), String(newSpeed),
-                   String(gear), String(stepLength), String(period, 6));
+    update_display();
 
     oldMicros = newMicros;
     oldPosition = newPosition;
-    oldSpeed = newSpeed;
-    oldDirection = newDirection;
-    oldGear = gear;
-    oldStepLength = stepLength;
-    oldPeriod = period;
   }
 }
 
-//--------------- switchStep() --------------------------
-void switchStep(int stage)
+//--------------- startCommutation() --------------------------
+void startCommutation()
 {
-  switch (stage)
-  {
-  case 0:
-    /*
-      digitalWrite(phase1, LOW);
-      digitalWrite(phase2, LOW);
-      digitalWrite(phase3, HIGH);
-      */
-    // GPIO.out_w1tc = (1 << phase2); // LLH
-    digitalWrite(phase2, LOW);
-    myDelay(stepLength);
-    break;
-  case 1:
-    /*    digitalWrite(phase1, HIGH);
-        digitalWrite(phase2, LOW);
-        digitalWrite(phase3, HIGH);
-      */
-    // GPIO.out_w1ts = (1 << phase1); // HLH
-    digitalWrite(phase1, HIGH);
-    myDelay(stepLength);
-    break;
-
-  case 2:
-    /*    digitalWrite(phase1, HIGH);
-        digitalWrite(phase2, LOW);
-        digitalWrite(phase3, LOW);
-      */
-    // GPIO.out_w1tc = (1 << phase3); // HLL
-    digitalWrite(phase3, LOW);
-    myDelay(stepLength);
-    break;
-
-  case 3:
-    /*    digitalWrite(phase1, HIGH);
-        digitalWrite(phase2, HIGH);
-        digitalWrite(phase3, LOW);
-      */
-    // GPIO.out_w1ts = (1 << phase2); // HHL
-    digitalWrite(phase2, HIGH);
-    myDelay(stepLength);
-    break;
-
-  case 4:
-    /*    digitalWrite(phase1, LOW);
-        digitalWrite(phase2, HIGH);
-        digitalWrite(phase3, LOW);
-      */
-    // GPIO.out_w1tc = (1 << phase1); // LHL
-    digitalWrite(phase1, LOW);
-    myDelay(stepLength);
-    break;
-
-  default:
-    /*    digitalWrite(phase1, LOW);
-        digitalWrite(phase2, HIGH);
-        digitalWrite(phase3, HIGH);
-      */
-    // GPIO.out_w1ts = (1 << phase3); // LHH
-    digitalWrite(phase3, HIGH);
-    myDelay(stepLength);
-    break;
-  }
+  // drive stage 0 now; the step timer advances the stages from here on
+  const phaseWords &stage = commutator.start();
+  GPIO.out_w1tc = stage.clear;
+  GPIO.out_w1ts = stage.set;
+
+  // step timer: prescaler 80 to clock at 1mhz, 1us/tick; auto-reload every STEP_PERIOD
+  stepTimer = timerBegin(0, 80, true);
+  timerAttachInterrupt(stepTimer, &onStepTimer, true);
+  timerAlarmWrite(stepTimer, STEP_PERIOD, true);
+  timerAlarmEnable(stepTimer);
 }
 
-//--------------- myDelay() --------------------------
-void myDelay(unsigned long stepMicroseconds)
+#if SINE_DRIVE
+//--------------- startSineDrive() --------------------------
+void startSineDrive()
 {
-  if (stepMicroseconds > delay_threshold)
+  // phases to the LEDC channels, at the duties of stage 0
+  const uint8_t phasePins[3] = {phase1, phase2, phase3};
+  sineDrive.setStepMicros(STEP_PERIOD);
+  for (uint8_t phase = 0; phase < 3; phase++)
   {
-    delay(stepMicroseconds / 1000);
-  }
-  else
-  {
-    delayMicroseconds(stepMicroseconds);
+    ledcSetup(SINE_CHANNEL_1 + phase, SINE_PWM_FREQ, SINE_PWM_BITS);
+    ledcAttachPin(phasePins[phase], SINE_CHANNEL_1 + phase);
+    ledcWrite(SINE_CHANNEL_1 + phase, sineDrive.duty(phase));
   }
+
+  // same timer as the six-step drive, fixed tick: prescaler 80 to clock at 1mhz, 1us/tick
+  stepTimer = timerBegin(0, 80, true);
+  timerAttachInterrupt(stepTimer, &onSineTimer, true);
+  timerAlarmWrite(stepTimer, SINE_TICK_US, true);
+  timerAlarmEnable(stepTimer);
 }
+#endif
 
-//--------------- adjustStepLength() --------------------------
-void adjustStepLength()
+//--------------- speedTask() --------------------------
+// closed-loop speed control, every SPEED_TICK_MS (FreeRTOS tick-aligned)
+void speedTask(void *parameter)
 {
-  // adjust stepLength by stepSize
-  if (stepLength > minStepLength)
+  int64_t lastCount = encoder.getCount();
+  uint16_t resyncs = 0;
+  TickType_t wake = xTaskGetTickCount();
+  for (;;)
   {
-    if (gear < 5)
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(SPEED_TICK_MS));
+    int64_t count = encoder.getCount();
+    uint32_t step = speedController.update((int32_t)(count - lastCount));
+    lastCount = count;
+#if SINE_DRIVE
+    if (step < minSineStepLength)
     {
-      stepLength = stepLength - steps;
+      step = minSineStepLength;
     }
-    else
+    sineDrive.setStepMicros(step); // same speed as the six-step stage length
+#else
+    if (step < minStepLength)
     {
-      // estimate necessary steplength (usec)
-      // 20 cycles of 6 steps per revolution; convert to us; adjust to accelerate
-      stepLength = (uint64_t)((period * 1000000.0) / (20.0 * 6.0)) - accelerationFactor;
+      step = minStepLength;
+    }
+#endif
+#if BEMF_MODE
+    if (SENSORLESS)
+    {
+      step = STEP_PERIOD; // bemfTask() is commutating; just keep measuring
+    }
+#endif
+    STEP_PERIOD = step;
+    stepLength = step;
+    rpm = speedController.measured() * 60.0 / stepsPerRevolution;
+
+    // status LEDs
+    digitalWrite(gearLED_0, speedController.atSpeed() ? LOW : HIGH);
+    digitalWrite(gearLED_1, speedController.atSpeed() ? HIGH : LOW);
+    if (speedController.resyncs() != resyncs)
+    {
+      resyncs = speedController.resyncs();
+      digitalWrite(gearLED_2, resyncs & 1);
+      Serial.printf("stall: resync at %d RPM (%d)\n", (int)rpm, resyncs);
     }
   }
-  else
-  { // set minimum pulse length
-    stepLength = minStepLength;
-  }
+}
 
-  if (stepLength < gear_12_threshold)
+#if BEMF_MODE
+//--------------- bemfTask() --------------------------
+// sensorless mode (core 0): sample the floating phase, find a zero crossing in each
+// two-stage window; once they are regular, time the commutation that ends the window
+// 30 degrees electrical after its crossing
+void bemfTask(void *parameter)
+{
+  const uint8_t sensePins[3] = {sense1, sense2, sense3};
+  const uint32_t targetStep = (uint32_t)(60000000.0 / (targetRPM * stepsPerRevolution));
+  uint8_t stage = commutator.stage();
+  uint32_t lastYield = micros();
+  bemfSensor.reset(stage, STEP_PERIOD);
+  for (;;)
   {
-    if (!secondgear)
+    // follow the commutation, a stage at a time (a yield may have slept through one)
+    uint8_t current = commutator.stage();
+    bool moved = (stage != current);
+    while (stage != current)
     {
-      gear = 2;
-      secondgear = true;
-      // Serial.println("second gear");
-      // Serial.printf("stepLength: %d, steps: %d\n", stepLength, steps);
-      digitalWrite(gearLED_0, LOW);
-      digitalWrite(gearLED_1, HIGH);
-      digitalWrite(gearLED_2, LOW);
-      steps = secondGearSteps;
+      stage = (stage + 1) % COMMUTATION_STAGES;
+      bemfSensor.stageChanged(stage, STEP_START, STEP_PERIOD);
     }
-  }
 
-  if (stepLength < gear_23_threshold)
-  {
-    if (!thirdgear)
+    int16_t bemf = analogRead(sensePins[bemfSensor.phase()]) - analogRead(senseCenter);
+    bool crossed = bemfSensor.sample(bemf, micros(), targetStep);
+    if ((crossed || moved) && bemfSensor.closing() && SENSORLESS)
     {
-      gear = 3;
-      thirdgear = true;
-      // Serial.println("third gear");
-      // Serial.printf("stepLength: %d, steps: %d\n", stepLength, steps);
-      digitalWrite(gearLED_0, HIGH);
-      digitalWrite(gearLED_1, HIGH);
-      digitalWrite(gearLED_2, LOW);
-      steps = thirdGearSteps;
+      // restart the step timer so the commutation that ends the window comes delay() after
+      // the crossing (at once if that's past)
+      uint32_t since = micros() - bemfSensor.crossing();
+      uint32_t delay = bemfSensor.delay();
+      uint32_t period = bemfSensor.period();
+      portENTER_CRITICAL(&stepTimerMux);
+      if (commutator.stage() == stage)
+      {
+        STEP_PERIOD = (period < targetStep) ? targetStep : period; // the next window's first step
+        timerWrite(stepTimer, 0);
+        timerAlarmWrite(stepTimer, (delay > since) ? delay - since : 1, true);
+      }
+      portEXIT_CRITICAL(&stepTimerMux);
     }
-  }
 
-  if (stepLength < gear_34_threshold)
-  {
-    if (!fourthgear)
+    // hand over from the open-loop ramp, and back if the crossings are lost
+    if (!SENSORLESS && bemfSensor.locked() && rpm >= BEMF_HANDOFF_RPM)
     {
-      gear = 4;
-      fourthgear = true;
-      // Serial.println("fourth gear");
-      // Serial.printf("stepLength: %d, steps: %d\n", stepLength, steps);
-      digitalWrite(gearLED_0, LOW);
-      digitalWrite(gearLED_1, LOW);
-      digitalWrite(gearLED_2, HIGH);
-      steps = fourthGearSteps;
+      SENSORLESS = true;
+      Serial.printf("sensorless at %d RPM\n", (int)rpm);
     }
-  }
-  if (stepLength < gear_45_threshold)
-  {
-    if (!fifthgear)
+    else if (SENSORLESS && !bemfSensor.locked())
+    {
+      SENSORLESS = false;
+      speedController.resync();
+      bemfSensor.reset(stage, STEP_PERIOD);
+      Serial.printf("back-EMF lost at %d RPM; open loop\n", (int)rpm);
+    }
+
+    // let the idle task (and its watchdog) run: right after a crossing, when the next one
+    // is most of two steps away, or regardless if the crossings have stopped coming
+    uint32_t awake = micros() - lastYield;
+    if ((crossed && awake > BEMF_YIELD_US) || awake > 2 * BEMF_YIELD_US)
     {
-      gear = 5;
-      fifthgear = true;
-      // Serial.println("fifth gear");
-      // Serial.printf("stepLength: %d, steps: %d\n", stepLength, steps);
-      digitalWrite(gearLED_0, HIGH);
-      digitalWrite(gearLED_1, LOW);
-      digitalWrite(gearLED_2, HIGH);
-      steps = fifthGearSteps;
+      vTaskDelay(1);
+      lastYield = micros();
     }
   }
 }
+#endif
 
 //---------------------[ functions ]------------------------------------------------------------
 void OLED_setup()
@@ -448,29 +507,17 @@ void OLED_setup()
   Heltec.display->display();
 }
 
-void update_display(String old_var1, String old_var2, String old_var3,
-                    String old_var4, String old_var5, String old_var6,
-                    String new_var1, String new_var2, String new_var3,
-                    String new_var4, String new_var5, String new_var6)
+// redraw the values that changed, and send just that part of the screen
+void update_display()
 {
-  // blank out the old data
-  Heltec.display->setColor(BLACK);
-  Heltec.display->drawString(col2_x, line_0, old_var1);
-  Heltec.display->drawString(col2_x, line_1, old_var2);
-  Heltec.display->drawString(col2_x, line_2, old_var3);
-  Heltec.display->drawString(col2_x, line_3, old_var4);
-  Heltec.display->drawString(col2_x, line_4, old_var5);
-  Heltec.display->drawString(col2_x, line_5, old_var6);
-
-  Heltec.display->display();
-
-  // write the new data
-  Heltec.display->setColor(WHITE);
-  Heltec.display->drawString(col2_x, line_0, new_var1);
-  Heltec.display->drawString(col2_x, line_1, new_var2);
-  Heltec.display->drawString(col2_x, line_2, new_var3);
-  Heltec.display->drawString(col2_x, line_3, new_var4);
-  Heltec.display->drawString(col2_x, line_4, new_var5);
-  Heltec.display->drawString(col2_x, line_5, new_var6);
-  Heltec.display->display();
-}
\ No newline at end of file
+  panel.setText(directionField, newDirection);
+  panel.setValue(positionField, newPosition);
+  panel.setValue(speedField, newSpeed);
+  panel.setValue(rpmField, rpm);
+  panel.setValue(stepLengthField, stepLength);
+  panel.setValue(periodField, period);
+  if (panel.render())
+  {
+    oledFlush(Wire, Heltec.display->buffer, panel.window());
+  }
+}
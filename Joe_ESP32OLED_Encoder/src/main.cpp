@@ -2,18 +2,21 @@
  Encoder example w OLED
    Joe Brendler 19 Dec 2022
    OLED code from Heltec - https://github.com/HelTecAutomation/Heltec_ESP32
+   Status screen: a StatusPanel (Joe_OLED_Common) redraws only the values that changed
 -----------------------*/
 #include <Arduino.h>
 #include <heltec.h>
 #include "images.h"
+#include <statusPanel.h>
+#include <oledFlush.h>
 
 #include <ESP32Encoder.h>
 
 ESP32Encoder encoder;
 
 long oldPosition = -999, newPosition = 0;
-double newSpeed = 0, oldSpeed = 0;
-String newDirection = "ccw", oldDirection = newDirection;
+double newSpeed = 0;
+const char *newDirection = "ccw";
 unsigned long newMicros = 0, oldMicros = 0; // loop timing
 unsigned long delta_t = 0;                  // in usec
 
@@ -32,8 +35,12 @@ const int line_0 = 0, line_1 = 10, line_2 = 20, line_3 = 30, line_4 = 40;
 
 String msg = "", old_msg = "";
 
+// status screen: a label and a value on each line
+StatusPanel panel;
+int8_t directionField, positionField, speedField;
+
 //--------- function declarations ------------
-void update_display(String old_var1, String old_var2, String old_var3, String new_var1, String new_var2, String new_var3);
+void update_display();
 void OLED_setup();
 
 //---------- setup() -------------------------
@@ -71,18 +78,18 @@ void setup()
   Heltec.display->display();
   delay(2000); // time to read
 
-  // set up persistent display
+  // set up persistent display: labels, and the values' places and formats
   Heltec.display->clear();
   Heltec.display->display();
-  msg = "Direction: ";
-  Heltec.display->drawString(col0_x, line_1, msg);
-  msg = "Position: ";
-  Heltec.display->drawString(col0_x, line_2, msg);
-  msg = "Speed: ";
-  Heltec.display->drawString(col0_x, line_3, msg);
+  panel.begin(Heltec.display, ArialMT_Plain_10);
+  panel.addLabel(col0_x, line_1, "Direction: ");
+  panel.addLabel(col0_x, line_2, "Position: ");
+  panel.addLabel(col0_x, line_3, "Speed: ");
+  directionField = panel.addField(col2_x, line_1);
+  positionField = panel.addField(col2_x, line_2);
+  speedField = panel.addField(col2_x, line_3, 2);
   // display initial placeholder data
-  update_display(oldDirection, String(oldPosition), String(oldSpeed), newDirection, String(newPosition), String(newSpeed));
-  Heltec.display->display();
+  update_display();
 
   Serial.println("setup() done");
 }
@@ -110,12 +117,10 @@ void loop()
       Serial.printf("newDirection: %s\n", newDirection);
       Serial.printf("newPosition: %d\n", newPosition);
       Serial.printf("newSpeed: %.15f\n", newSpeed);
-      update_display(oldDirection, String(oldPosition), String(oldSpeed), newDirection, String(newPosition), String(newSpeed));
+      update_display();
 
       oldMicros = newMicros;
       oldPosition = newPosition;
-      oldSpeed = newSpeed;
-      oldDirection = newDirection;
     }
   }
 }
@@ -149,19 +154,14 @@ void OLED_setup()
   Heltec.display->display();
 }
 
-void update_display(String old_var1, String old_var2, String old_var3, String new_var1, String new_var2, String new_var3)
+// redraw the values that changed, and send just that part of the screen
+void update_display()
 {
-  // blank out the old data
-  Heltec.display->setColor(BLACK);
-  Heltec.display->drawString(col2_x, line_1, old_var1);
-  Heltec.display->drawString(col2_x, line_2, old_var2);
-  Heltec.display->drawString(col2_x, line_3, old_var3);
-  Heltec.display->display();
-
-  // write the new data
-  Heltec.display->setColor(WHITE);
-  Heltec.display->drawString(col2_x, line_1, new_var1);
-  Heltec.display->drawString(col2_x, line_2, new_var2);
-  Heltec.display->drawString(col2_x, line_3, new_var3);
-  Heltec.display->display();
+  panel.setText(directionField, newDirection);
+  panel.setValue(positionField, newPosition);
+  panel.setValue(speedField, newSpeed);
+  if (panel.render())
+  {
+    oledFlush(Wire, Heltec.display->buffer, panel.window());
+  }
 }
@@ -0,0 +1,61 @@
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+// Lock-free single-producer/single-consumer frame hand-over for the POV display
+// Three frames: the consumer (photo-trigger ISR, core 1) owns front(), the producer (pattern
+// task, core 0) owns back(), and the third sits in a shared "middle" slot.  publish() and
+// swap() each exchange their frame with the middle one in a single atomic operation, so
+// neither side ever waits on or locks out the other; a fresh flag on the middle slot tells
+// the consumer there is something new.  If the producer publishes twice before the next
+// swap(), the newer frame simply replaces the unseen one (latest wins, nothing tears).
+// Note: no Arduino/ESP32 headers, so it can be compiled natively
+
+#include <stdint.h>
+#include <atomic>
+
+template <class FRAME>
+class FrameQueue
+{
+public:
+    FrameQueue() : _middle(1)
+    {
+        _front = 0;
+        _back = 2;
+    }
+
+    // consumer: frame being displayed
+    FRAME &front() { return _frames[_front]; }
+
+    // consumer: take the newest published frame, if there is one; true if front() changed
+    bool swap()
+    {
+        if (!(_middle.load(std::memory_order_relaxed) & FRESH))
+        {
+            return false;
+        }
+        _front = _middle.exchange(_front, std::memory_order_acq_rel) & ~FRESH;
+        return true;
+    }
+
+    // producer: frame to produce into (never displayed while the producer holds it)
+    FRAME &back() { return _frames[_back]; }
+
+    // producer: hand back() over to the consumer, get a free frame in its place
+    void publish()
+    {
+        _back = _middle.exchange(_back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+    }
+
+    // 0-2; for bookkeeping that follows the frames around
+    uint8_t indexOf(const FRAME &frame) const { return &frame - _frames; }
+
+private:
+    static const uint32_t FRESH = 0x80; // middle frame has not been swapped in yet
+
+    FRAME _frames[3];
+    uint32_t _front;                // owned by the consumer
+    uint32_t _back;                 // owned by the producer
+    std::atomic<uint32_t> _middle;  // shared; frame index | FRESH
+};
+
+#endif
@@ -1,6 +1,14 @@
 #include <Arduino.h>
 #include <WiFi.h>
+#include <sys/time.h>
 #include <myNetworkInformation.h>
+#include "frameBuffer.h"  // shared POV pattern library (../Joe_POV_Common/PovPatterns)
+#include "patterns.h"
+#include "clockFace.h"
+#include "povOutput.h"
+#include "periodTracker.h"
+#include "slotEngine.h"
+#include "frameQueue.h"
 
 // define output pins
 #define LED2 2 // LED_BUILTIN
@@ -21,6 +29,37 @@
 
 #define checkerNumber_pin 36 // analog in; ADC0; pin 3
 
+// angular resolution: columns drawn per revolution (60, 120, 240 or 360)
+// (override with build_flags = -D POV_COLUMNS=360 in platformio.ini)
+#ifndef POV_COLUMNS
+#define POV_COLUMNS 60
+#endif
+
+// print slot engine diagnostics every n revolutions (~21 s)
+#define DIAG_REVOLUTIONS 1000
+
+// task layout: core 1 runs only the slot engine (photo-trigger and slot timer ISRs);
+// core 0 runs pattern production, time sync (WiFi) and diagnostics
+#define OUTPUT_CORE 1 // Arduino setup()/loop() core; ISRs attached in setup() are serviced here
+#define RENDER_CORE 0 // WiFi runs here too
+#define RENDER_STACK 8192
+#define TIMESYNC_STACK 4096
+#define EVENT_TIMEOUT_MS 10         // render task wakes at least this often
+#define NTP_RESYNC_MS 3600000       // re-sync local time from NTP every hour
+#define WIFI_CONNECT_TRIES 40       // x 500 ms, before a re-sync gives up
+
+// trace mode: report per-core busy time with the diagnostics
+// (build_flags = -D POV_TRACE=1 in platformio.ini)
+#ifndef POV_TRACE
+#define POV_TRACE 0
+#endif
+
+// second mark timing (us); the mark fires just after the NTP second edge so local time
+// has already rolled over, and is served in the dark gap at the end of a revolution
+#define SECOND_MARK_DELAY 2000    // fire this long after the second edge
+#define SECOND_LATE 100000        // served later than this after the mark = late
+#define DISK_STOPPED_MICROS 50000 // no end of revolution this long after the mark: serve anyway
+
 // used to set LED2 (active HIGH on ESP32, LOW on 8266)
 #define LED_ON HIGH
 #define LED_OFF LOW
@@ -36,35 +75,36 @@ const int daylightOffset_sec = 3600;
 const char *ntpServer1 = "time.nist.gov";
 const char *ntpServer2 = "pool.ntp.org";
 
-// define 3-bit RGB color values
-const byte BLACK = 0b000;
-const byte RED = 0b001;
-const byte GREEN = 0b010;
-const byte YELLOW = 0b011;
-const byte BLUE = 0b100;
-const byte MAGENTA = 0b101;
-const byte CYAN = 0b110;
-const byte WHITE = 0b111;
-
-// Map to 3-bit RGB colors
+// Map to 3-bit RGB colors (BLACK .. WHITE, see patterns.h)
 const String RGBstr[8] = {"Black", "Red", "Green", "Yellow", "Blue", "Magenta", "Cyan", "White"};
 
+// frame columns to the 3 x RGB LED bits of the GPIO register (w1ts/w1tc; see povOutput.h)
+typedef PovOutput<ConsecutiveRgb<uint32_t, RED_LED>, Esp32Gpio> ledOutput;
+
 uint8_t pattern = 0;       // what pattern (function) to draw
 uint8_t checkerNumber = 0; // how many times to repeat pattern (mapped from analog in)
 
-byte ClockFace[60];    // 60 valid positions, each with 3-bit RGB value to be displayed
-int clockPosition = 0; // position (0-59) on the clockface; index for ClockFace[]
+// clock face model: graduations < hour < minute < second layers, composited into 60
+// positions, each with 3-bit RGB value to be displayed (see clockFace.h)
+ClockLayers clockLayers;
+const uint64_t ALL_POSITIONS = (1ULL << CLOCK_POSITIONS) - 1;
+// clock positions each frame has not been redrawn for yet (bit p = position p)
+uint64_t stalePositions[3] = {ALL_POSITIONS, ALL_POSITIONS, ALL_POSITIONS};
+
+// frames produced by the patterns (see frameBuffer.h, patterns.h) are handed from core 0
+// to core 1 through a lock-free SPSC queue (see frameQueue.h): the slot engine reads
+// frameQueue.front(); patterns produce into frameQueue.back(), and the photo-trigger ISR
+// swaps in the newest published frame, so a revolution is never drawn from a half-rendered frame
+typedef PovFrame<POV_COLUMNS> povFrame;
+FrameQueue<povFrame> frameQueue;
 
 int hours = 0;             // 0-23
 int minutes = 0;           // 0-59
 int seconds = 0;           // 0-59
-uint64_t milliseconds = 0; //
 int newseconds = 0;        // integer number of seconds
 int newminutes = 0;        // integer number of minutes
 int newhours = 0;          // integer number of hours
 
-bool INITIALIZED = false; // clockface initialized?
-bool DONE_RADAR = false;  // done displaying radar scan?
 
 //-----[ user-configurable factors - emperically determined ]------------------------
 // const int compareTicks = 763; // actually observed
@@ -74,16 +114,18 @@ const int offset = 5; // (14) number of "seconds" slots to rotate display (ccw)
 //------[ period timing ]------------------------------------------------------------
 
 uint64_t periodMicros = 21500; // (21995) empirically determined (for prescaler 80)
-uint64_t radarSlot = 0;        // also in ticks (used in radar function)
+int radarSlot = 0;             // column (0 to POV_COLUMNS-1) of radar beacon / fan edge
 
-uint64_t lastTrigger = 0;
-uint64_t thisTrigger = 0;
-uint64_t delta = 0;
+// disk period is tracked by a PLL fed from the photo-trigger ISR (see periodTracker.h)
+PeriodTracker periodEstimator(periodMicros);
+volatile uint32_t trackedPeriodQ = periodMicros << PERIOD_FRAC_BITS; // copies for core 0 (32-bit
+volatile uint32_t trackedDelta = 0;                                   // stores are atomic)
+uint64_t delta = 0; // raw microseconds between the last two triggers
 //-----------------------------------------------------------------------------------
 
 // ToDO - calibration (for now 21.6ms period = 60 x 360us slots)
 // const unsigned int slotWidth = 360;
-uint64_t slotWidth = periodMicros / 60;
+uint64_t slotWidth = periodMicros / POV_COLUMNS;
 
 uint64_t intervalOn = (unsigned int)(slotWidth / 3);                     // draw skinnier lines
 uint64_t intervalOff = (unsigned int)(slotWidth - intervalOn);           // draw skinnier lines
@@ -92,15 +134,47 @@ int function = 0; // function read from 4 bits, selected by pushbutton
 
 // initialize timer and associated boolean flag
 hw_timer_t *slotTimer = NULL;
-volatile bool ENDSLOT = false;
+volatile bool ENDFRAME = false; // slot engine is past the last lit slot of the revolution
 hw_timer_t *secondTimer = NULL;
 volatile bool MARKSECOND = false;
 
+// second mark instrumentation
+volatile uint32_t markMicros = 0;     // micros() at the last second mark
+volatile uint32_t secondsMarked = 0;  // second marks fired
+volatile uint32_t secondsMissed = 0;  // marks fired while the previous one was still pending
+uint32_t secondsLate = 0;             // marks served more than SECOND_LATE after firing
+uint32_t secondLatencyMax = 0;        // us, worst mark-to-served time
+
 // initialize timer mux(s) to take care of the synchronization between
 // the main loop and the ISR, when modifying a shared variable (volatile bools)
 portMUX_TYPE slotTimerMux = portMUX_INITIALIZER_UNLOCKED;
 portMUX_TYPE secondTimerMux = portMUX_INITIALIZER_UNLOCKED;
 
+// tasks
+TaskHandle_t renderTaskHandle = NULL;
+TaskHandle_t timeSyncTaskHandle = NULL;
+
+#if POV_TRACE
+// per-core busy time (cycles) since the last diagnostics report
+volatile uint32_t engineBusyCycles = 0; // core 1: time spent in the slot engine ISRs
+uint64_t renderBusyCycles = 0;          // core 0: render task time outside waitForEvent()
+uint32_t renderResumeCycles = 0;
+uint32_t traceStartMicros = 0;
+#endif
+
+// -------- slot engine state (owned by the ISRs once ENGINE_RUNNING) -----------
+// each slot has an on-edge (write set/clear words) and, for thin lines, an off-edge;
+// slotTimer counts 1us ticks from the photo-trigger and its alarm is moved edge to edge
+// (edge times: see slotEngine.h; only touched under slotTimerMux)
+volatile bool ENGINE_RUNNING = false; // slot engine enabled by the current pattern
+volatile uint64_t nextEdge = 0;       // tick the alarm is set for
+SlotEngine<POV_COLUMNS> slotEngine;   // restarted from the period tracker at every trigger
+
+// edge latency instrumentation (ticks between scheduled and actual edge)
+volatile uint32_t edgeCount = 0;
+volatile uint32_t edgeLatencySum = 0;
+volatile uint32_t edgeLatencyMax = 0;
+
 // -------- define and initialize interrupt line structs -----------
 struct photoInterruptLine
 {
@@ -121,6 +195,10 @@ buttonInterruptLine buttonPress = {buttonInterruptPin, 0, false};
 int i = 0, j = 0; // integer loop counters
 
 // --------------- function declarations ---------------
+void renderTask(void *parameter);
+void timeSyncTask(void *parameter);
+bool syncTime(bool untilConnected);
+void waitForEvent();
 void setMyTime();
 void printLocalTime();
 void blink();
@@ -133,16 +211,90 @@ void loop_fn_checker_colors();
 void loop_fn_fan();
 void loop_fn_altClock();
 void loop_fn_multicolor_fan();
+void startPattern();
+void revolutionDone();
+povFrame &beginFrame();
+void publishFrame();
+void printDiagnostics();
+void alignSecondTimer();
+bool serveSecond();
 void recalibrate();
+void calculateClockFace();
+void renderClockFace();
 void dumpClockFace(); // for debugging
 
 // --------------- interrupt function declarations ---------------
+/*------------------------------------------------------------------------------
+   scheduleEdge() -- set the slot timer alarm for tick (since trigger)
+  ------------------------------------------------------------------------------*/
+void IRAM_ATTR scheduleEdge(int64_t tickQ)
+{
+    nextEdge = SlotEngine<POV_COLUMNS>::alarmTick(tickQ, timerRead(slotTimer));
+    timerAlarmWrite(slotTimer, nextEdge, false);
+    timerAlarmEnable(slotTimer);
+}
+
+/*------------------------------------------------------------------------------
+   slotOnEdge() -- write the current slot's column and schedule its next edge
+  ------------------------------------------------------------------------------*/
+void IRAM_ATTR slotOnEdge()
+{
+    uint8_t column = frameQueue.front().get(slotEngine.slot());
+    ledOutput::on(column);
+    if (slotEngine.lastSlot() && ledOutput::dark(column))
+    {
+        ENDFRAME = true; // last column is dark; dark until the next photo-trigger
+    }
+    scheduleEdge(slotEngine.onEdge(ledOutput::thin(column)));
+}
+
+/*------------------------------------------------------------------------------
+   wakeRenderTask() -- tell the render task (core 0) something happened
+  ------------------------------------------------------------------------------*/
+void IRAM_ATTR wakeRenderTask()
+{
+    BaseType_t woken = pdFALSE;
+    if (renderTaskHandle != NULL)
+    {
+        vTaskNotifyGiveFromISR(renderTaskHandle, &woken);
+    }
+    if (woken)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
 /*------------------------------------------------------------------------------
    trigger() -- photo-trigger interrupt
   ------------------------------------------------------------------------------*/
 void IRAM_ATTR trigger()
 {
+#if POV_TRACE
+    uint32_t startCycles = ESP.getCycleCount();
+#endif
+    // start of revolution; swap in the newest produced frame, if there is one
+    frameQueue.swap();
+
+    portENTER_CRITICAL_ISR(&slotTimerMux);
+    // track the disk period; late = how far this edge is behind the filtered revolution start
+    int32_t late = periodEstimator.update(micros());
+    trackedPeriodQ = periodEstimator.period();
+    trackedDelta = periodEstimator.lastDelta();
+
+    // restart the slot engine at slot 0, at the filtered (not the raw) revolution start
+    if (ENGINE_RUNNING)
+    {
+        timerWrite(slotTimer, 0);
+        slotEngine.start(periodEstimator.period(), late);
+        ENDFRAME = false;
+        slotOnEdge();
+    }
+    portEXIT_CRITICAL_ISR(&slotTimerMux);
     photoTrigger.TRIGGERED = true;
+#if POV_TRACE
+    engineBusyCycles += ESP.getCycleCount() - startCycles;
+#endif
+    wakeRenderTask();
 }
 
 /*------------------------------------------------------------------------------
@@ -151,23 +303,82 @@ void IRAM_ATTR trigger()
 void IRAM_ATTR set_loop_fn()
 {
     buttonPress.PRESSED = true;
+    wakeRenderTask();
 }
 
+/*------------------------------------------------------------------------------
+   onSecondTimer() -- fires once per second, aligned to the NTP second edge
+  ------------------------------------------------------------------------------*/
 void IRAM_ATTR onSecondTimer()
 {
-    portENTER_CRITICAL(&secondTimerMux);
+    portENTER_CRITICAL_ISR(&secondTimerMux);
+    if (MARKSECOND)
+    {
+        secondsMissed++; // previous second never got served
+    }
     MARKSECOND = true;
-    portEXIT_CRITICAL(&secondTimerMux);
+    markMicros = micros();
+    secondsMarked++;
+    portEXIT_CRITICAL_ISR(&secondTimerMux);
+    wakeRenderTask();
 }
 
+/*------------------------------------------------------------------------------
+   onSlotTimer() -- slot engine; drives LED on/off edges straight from the front frame
+  ------------------------------------------------------------------------------*/
 void IRAM_ATTR onSlotTimer()
 {
-    portENTER_CRITICAL(&slotTimerMux);
-    ENDSLOT = true;
-    portEXIT_CRITICAL(&slotTimerMux);
+#if POV_TRACE
+    uint32_t startCycles = ESP.getCycleCount();
+#endif
+    bool wasEndFrame = ENDFRAME;
+    portENTER_CRITICAL_ISR(&slotTimerMux);
+    uint32_t latency = (uint32_t)(timerRead(slotTimer) - nextEdge);
+    edgeCount++;
+    edgeLatencySum += latency;
+    if (latency > edgeLatencyMax)
+    {
+        edgeLatencyMax = latency;
+    }
+
+    if (slotEngine.offEdgeDue())
+    {
+        // off-edge: turn off this slot's thin line, then wait for the next slot
+        ledOutput::off();
+        if (slotEngine.lastSlot())
+        {
+            ENDFRAME = true; // dark until the next photo-trigger
+        }
+        scheduleEdge(slotEngine.offEdge());
+    }
+    else
+    {
+        // spinning slot has arrived at next position
+        if (slotEngine.nextSlot())
+        {
+            slotOnEdge();
+        }
+        else
+        {
+            // end of revolution; stay dark until the next photo-trigger
+            ledOutput::off();
+            timerAlarmDisable(slotTimer);
+            ENDFRAME = true;
+        }
+    }
+    portEXIT_CRITICAL_ISR(&slotTimerMux);
+#if POV_TRACE
+    engineBusyCycles += ESP.getCycleCount() - startCycles;
+#endif
+    if (ENDFRAME && !wasEndFrame)
+    {
+        wakeRenderTask(); // dark gap has started (see serveSecond())
+    }
 }
 
 //--------------- setup() --------------------------------
+// setup() runs on core 1 (OUTPUT_CORE), so the interrupts attached here (photo-trigger and
+// slot timer) are serviced on core 1; everything else is started by renderTask() on core 0
 void setup()
 {
 
@@ -194,30 +405,61 @@ void setup()
     Serial.print("==> Done\nTurning off LEDs... ");
     GPIO.out_w1tc = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
     Serial.println("==> Done");
+    Serial.printf("Drawing %d columns per revolution (%d bytes per frame)\n", POV_COLUMNS, (int)sizeof(povFrame));
 
     // Configure photo trigger interrupt pin
     Serial.print("Configure photo trigger interrupt pin... ");
     pinMode(photoTrigger.PIN, INPUT_PULLUP);
     Serial.println("==> Done");
-    Serial.print("Attach photo trigger interrupt... ");
+    Serial.printf("Attach photo trigger interrupt (core %d)... ", xPortGetCoreID());
     attachInterrupt(photoTrigger.PIN, trigger, FALLING);
     Serial.println("==> Done");
 
+    // Configure slot timer for interrupt (use prescaler 80 to clock at 1mhz, 1us/tick)
+    Serial.print("Configure slot timer for interrupt (use prescaler 80 to clock at 1mhz, 1us/tick)... ");
+    slotTimer = timerBegin(3, 80, true);
+    timerAttachInterrupt(slotTimer, &onSlotTimer, true);
+    timerAlarmWrite(slotTimer, slotWidth, false); // one-shot; moved edge to edge by the slot engine
+    timerAlarmDisable(slotTimer);                 // enabled by photoTrigger; disabled by self
+    Serial.println("==> Done");
+
+    // enable global interrupts
+    Serial.print("Now enabling interrupts globally... ");
+    sei();
+    Serial.println("==> Done");
+    digitalWrite(LED2, LED_ON); // demonstrate setup (blink uses delay, so it needs interrupts turned on
+    blink();
+
+    // everything else runs on the render core
+    Serial.printf("Starting render task on core %d... ", RENDER_CORE);
+    xTaskCreatePinnedToCore(renderTask, "render", RENDER_STACK, NULL, 1, &renderTaskHandle, RENDER_CORE);
+    Serial.println("==> Done");
+}
+
+/*------------------------------------------------------------------------------
+   loop() -- core 1 is left to the slot engine ISRs; the Arduino loop task isn't needed
+  ------------------------------------------------------------------------------*/
+void loop()
+{
+    vTaskDelete(NULL);
+}
+
+/*------------------------------------------------------------------------------
+   renderTask() -- core 0: pushbutton, time sync, pattern production and diagnostics
+  ------------------------------------------------------------------------------*/
+void renderTask(void *parameter)
+{
     // Configure function pushbutton interrupt pin
     Serial.print("Configure function pushbutton interrupt pin... ");
     pinMode(buttonPress.PIN, INPUT_PULLUP);
     Serial.println("==> Done");
-    Serial.print("Attach function pushbutton interrupt... ");
+    Serial.printf("Attach function pushbutton interrupt (core %d)... ", xPortGetCoreID());
     attachInterrupt(buttonPress.PIN, set_loop_fn, FALLING);
     Serial.println("==> Done");
 
-    // no interrupts
-    // Serial.print("Disabling interrupts... ");
-    // cli();
-    // Serial.println("==> Done");
-
     // Configure 4 x digital input pins used to select function
     Serial.print("Configure 4 x digital input pins used to select function... ");
+    gpio_config_t io_conf;
     io_conf.intr_type = (gpio_int_type_t)GPIO_PIN_INTR_DISABLE;
     io_conf.mode = GPIO_MODE_INPUT;
     io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
@@ -226,55 +468,29 @@ void setup()
     gpio_config(&io_conf);
     Serial.println("==> Done");
 
-    // Configure timers for interrupt (use prescaler 80 to clock at 1mhz, 1us/tick)
-    Serial.print("Configure timers for interrupt (use prescaler 80 to clock at 1mhz, 1us/tick)... ");
+    // Configure second timer for interrupt (use prescaler 80 to clock at 1mhz, 1us/tick)
+    Serial.print("Configure second timer for interrupt (use prescaler 80 to clock at 1mhz, 1us/tick)... ");
     secondTimer = timerBegin(0, 80, true);
     timerAttachInterrupt(secondTimer, &onSecondTimer, true);
-    timerAlarmWrite(secondTimer, slotWidth, false); // period will be reset by local time (seconds)
-    timerAlarmDisable(secondTimer);                 // enabled by photoTrigger; disabled by self
-    slotTimer = timerBegin(3, 80, true);
-    timerAttachInterrupt(slotTimer, &onSlotTimer, true);
-    timerAlarmWrite(slotTimer, slotWidth, false);
-    timerAlarmDisable(slotTimer); // enabled by clockHand timer; disabled by self
+    timerAlarmWrite(secondTimer, 1000000, true); // auto-reloading, once per second
+    timerAlarmDisable(secondTimer);              // enabled (and aligned) by the clock patterns
     Serial.println("==> Done");
 
-    // Configure and start the WiFi station
-    Serial.printf("Starting WiFi; connecting to %s ", ssid);
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(ssid, pass);
-    while (WiFi.status() != WL_CONNECTED)
-    {
-        delay(500);
-        Serial.print(".");
-    }
-    Serial.printf("\n==> Done. CONNECTED to WiFi [%s] on IP: ", ssid);
-    Serial.println(WiFi.localIP());
-    Serial.println("Setting local time from NTP server... ");
-
+    // WiFi is only ever started from core 0, so it can't interrupt the slot engine
     // print unititialized time, just to be able to compare
     printLocalTime();
-    setMyTime();
+    syncTime(true);
     printLocalTime();
     Serial.println("==> Done setting time");
-
-    // disconnect WiFi as it's no longer needed
-    WiFi.disconnect(true);
-    WiFi.mode(WIFI_OFF);
-    Serial.println("==> WiFi disconnected");
+    xTaskCreatePinnedToCore(timeSyncTask, "timeSync", TIMESYNC_STACK, NULL, 0, &timeSyncTaskHandle, RENDER_CORE);
 
     // read function from pattern bits (call isr for artificial button press)
     set_loop_fn();
 
-    // enable global interrupts
-    Serial.print("Done setup; now enabling interrupts globally... ");
-    sei();
-    Serial.println("==> Done");
-    digitalWrite(LED2, LED_ON); // demonstrate setup (blink uses delay, so it needs interrupts turned on
-    blink();
-
     // waid for disc to spin up
     delta = 50000;
     while (delta > 40000){
+        waitForEvent();
         if ( photoTrigger.TRIGGERED ) {
             recalibrate();
             Serial.printf("triggered, delta: %d\n", delta);
@@ -284,71 +500,135 @@ void setup()
 
     Serial.println("==> Setup complete");
     Serial.println("---------------[ Runtime Output Follows ]-------------------");
+#if POV_TRACE
+    traceStartMicros = micros();
+    renderResumeCycles = ESP.getCycleCount();
+#endif
+
+    for (;;)
+    {
+        if (buttonPress.PRESSED)
+        {
+            // read input pins, to set function - 4 x bits are active LOW so substract from 0xff
+            pattern = 0xff - (GPIO_REG_READ(GPIO_IN_REG) >> functionBit0) & 0b1111;
+            Serial.printf("Selected: [%d], Pressed %d times\n", pattern, buttonPress.numHits);
+            buttonPress.numHits++;
+            buttonPress.PRESSED = false;
+        }
+        // Note: pattern bits are active low, so take the bitwise NOT of pattern
+        switch (pattern)
+        {
+        case 0:
+            // Serial.println("Executing clock function");
+            loop_fn_clock();
+            break;
+        case 1:
+            // Serial.println("Executing radar function");
+            loop_fn_radar();
+            break;
+        case 2:
+            // Serial.println("Executing RedBlack function");
+            loop_fn_RedBlack();
+            break;
+        case 3:
+            // Serial.println("Executing colors function");
+            loop_fn_colors();
+            break;
+        case 4:
+            // Serial.println("Executing checkers function");
+            loop_fn_checkers();
+            break;
+        case 5:
+            // Serial.println("Executing checker_colors function");
+            loop_fn_checker_colors();
+            break;
+        case 6:
+            loop_fn_fan();
+            break;
+        case 7:
+            loop_fn_altClock();
+            break;
+        case 8:
+            loop_fn_multicolor_fan();
+            break;
+        // with current hardware (10 pos. rotary fn switch), case 9 falls to default (0)
+        default:
+            loop_fn_clock();
+            break;
+        }
+    }
 }
 
 /*------------------------------------------------------------------------------
-   loop()
+   timeSyncTask() -- core 0, lowest priority: re-sync local time from NTP now and then
   ------------------------------------------------------------------------------*/
-void loop()
+void timeSyncTask(void *parameter)
 {
-    if (buttonPress.PRESSED)
-    {
-        // read input pins, to set function - 4 x bits are active LOW so substract from 0xff
-        pattern = 0xff - (GPIO_REG_READ(GPIO_IN_REG) >> functionBit0) & 0b1111;
-        Serial.printf("Selected: [%d], Pressed %d times\n", pattern, buttonPress.numHits);
-        buttonPress.numHits++;
-        buttonPress.PRESSED = false;
-    }
-    // Note: pattern bits are active low, so take the bitwise NOT of pattern
-    switch (pattern)
-    {
-    case 0:
-        // Serial.println("Executing clock function");
-        loop_fn_clock();
-        break;
-    case 1:
-        // Serial.println("Executing radar function");
-        loop_fn_radar();
-        break;
-    case 2:
-        // Serial.println("Executing RedBlack function");
-        loop_fn_RedBlack();
-        break;
-    case 3:
-        // Serial.println("Executing colors function");
-        loop_fn_colors();
-        break;
-    case 4:
-        // Serial.println("Executing checkers function");
-        loop_fn_checkers();
-        break;
-    case 5:
-        // Serial.println("Executing checker_colors function");
-        loop_fn_checker_colors();
-        break;
-    case 6:
-        loop_fn_fan();
-        break;
-    case 7:
-        loop_fn_altClock();
-        break;
-    case 8:
-        loop_fn_multicolor_fan();
-        break;
-        
-            // with current hardware (10 pos. rotary fn switch), case 9 falls to default (0)
-            default : loop_fn_clock();
-        break;
-    }
-    delayMicroseconds(1);
+    for (;;)
+    {
+        vTaskDelay(pdMS_TO_TICKS(NTP_RESYNC_MS));
+        syncTime(false);
+    }
+}
+
+/*------------------------------------------------------------------------------
+   syncTime() -- connect WiFi, set local time from NTP, disconnect WiFi again
+     untilConnected - keep trying to connect forever (at startup), or give up after
+                      WIFI_CONNECT_TRIES (periodic re-sync; keeps the current time)
+  ------------------------------------------------------------------------------*/
+bool syncTime(bool untilConnected)
+{
+    // Configure and start the WiFi station
+    Serial.printf("Starting WiFi; connecting to %s ", ssid);
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(ssid, pass);
+    int tries = 0;
+    while (WiFi.status() != WL_CONNECTED)
+    {
+        if (!untilConnected && ++tries > WIFI_CONNECT_TRIES)
+        {
+            Serial.println("\n==> Failed to connect; keeping current time");
+            WiFi.disconnect(true);
+            WiFi.mode(WIFI_OFF);
+            return false;
+        }
+        delay(500);
+        Serial.print(".");
+    }
+    Serial.printf("\n==> Done. CONNECTED to WiFi [%s] on IP: ", ssid);
+    Serial.println(WiFi.localIP());
+    Serial.println("Setting local time from NTP server... ");
+    setMyTime();
+
+    // disconnect WiFi as it's no longer needed
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+    Serial.println("==> WiFi disconnected");
+    return true;
+}
+
+/*------------------------------------------------------------------------------
+   waitForEvent() -- block the render task until an ISR has news (trigger, second mark,
+     button, end of revolution) or EVENT_TIMEOUT_MS passes
+  ------------------------------------------------------------------------------*/
+void waitForEvent()
+{
+#if POV_TRACE
+    renderBusyCycles += ESP.getCycleCount() - renderResumeCycles;
+#endif
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(EVENT_TIMEOUT_MS));
+#if POV_TRACE
+    renderResumeCycles = ESP.getCycleCount();
+#endif
 }
 
 //--------------- setMyTime() --------------------------------
 void setMyTime()
 {
+    struct tm syncedTime; // (not the shared timeinfo; this runs in the time sync task too)
     configTime(gmtOffset_sec, daylightOffset_sec, ntpServer1, ntpServer2);
     // while (time(nullptr) < 8 * 3600)
-    while (!getLocalTime(&timeinfo))
+    while (!getLocalTime(&syncedTime))
     {
         Serial.println("Failed to obtain time");
         delay(5000);
@@ -414,126 +694,72 @@ void blink()
 }
 
 /*------------------------------------------------------------------------------
-   calculateClockFace() -- set the 60 values of the data to be displayed on clock
+   calculateClockFace() -- move the hands of the clock face model to the current time
   ------------------------------------------------------------------------------*/
 void calculateClockFace()
 {
-    // ClockFace[i] is an array modelling the 60 positions of the clock face, with
-    // each element set to the RGB value of color that should be displayed in that position
-    // this function updates this model with a minimum of instructions
-
-    if (!INITIALIZED)
+    // the layer stack recomposites only the positions a hand left or arrived at,
+    // and reports them as dirty ranges
+    setLocalTime(); // set new s, m, h; should be current, as long as NTP set it in setup()
+    clockLayers.setTime(newhours, newminutes, newseconds);
+    for (i = 0; i < clockLayers.dirtyCount(); i++)
     {
-        // blank the clockface
-        for (i = 0; i < 60; i++)
-        {
-            ClockFace[i] = 0;
-        }
-
-        // mark the "graduations"
-        for (i = 0; i < 60; i += 5)
-        {
-            if (i % 15 == 0)
-            {
-                // quater - mark yellow
-                ClockFace[i] = YELLOW;
-            }
-            else
-            {
-                // 1/12th - mark white
-                ClockFace[i] = WHITE;
-            }
-        }
-
-        // raise flag
-        INITIALIZED = true;
+        const dirtyRange &range = clockLayers.dirty(i);
+        uint64_t bits = ((1ULL << (range.last - range.first + 1)) - 1) << range.first;
+        stalePositions[0] |= bits;
+        stalePositions[1] |= bits;
+        stalePositions[2] |= bits;
     }
-    // display old time first, then adjust
-    ClockFace[(hours * 5)] = GREEN;
-    ClockFace[minutes] = BLUE;
-    ClockFace[seconds] = RED;
-
-    // Get new time; change only values that need to be changed
-    // Assign (if needed) in this order so each supercedes previous,
-    //   if more than one hand is in the same position on the clock
-    // Calculate/assign seconds every time b/c this function is called every second
-
-    setLocalTime(); // set new s, m, h; should be current, as long as NTP set it in setup()
+    seconds = newseconds;
+    minutes = newminutes;
+    hours = newhours;
+    // Serial.printf("%02d:%02d:%02d\n", hours, minutes, seconds);
+    renderClockFace();
+}
 
-    if (newseconds != seconds)
+/*------------------------------------------------------------------------------
+   renderClockFace() -- redraw the stale clock positions of the back frame, for swap
+     at next trigger (the back frame may have missed more than one update, so each
+     frame keeps its own set of stale positions)
+  ------------------------------------------------------------------------------*/
+void renderClockFace()
+{
+    povFrame &frame = beginFrame();
+    uint64_t &stale = stalePositions[frameQueue.indexOf(frame)];
+    int first = 0;
+    while (stale)
     {
-        ClockFace[seconds] = BLACK; // blank the old one
-        // if the old second hand was "covering" something else, rewrite that w supercession
-        if (seconds == minutes)
-        {
-            ClockFace[minutes] = BLUE;
-        }
-        else if (seconds == (hours * 5))
-        {
-            ClockFace[(hours * 5)] = GREEN;
-        }
-        else if (seconds % 5 == 0)
+        // redraw the next run of consecutive stale positions
+        while (!(stale & (1ULL << first)))
         {
-            if (seconds % 15 == 0)
-            {
-                ClockFace[seconds] = YELLOW;
-            }
-            else
-            {
-                ClockFace[seconds] = WHITE;
-            }
+            first++;
         }
-
-        // assign minutes only when seconds gets back to 0
-        if (newseconds == 0)
+        int last = first;
+        while (last + 1 < CLOCK_POSITIONS && (stale & (1ULL << (last + 1))))
         {
-            ClockFace[minutes] = BLACK; // blank the old one
-            // if the minute hand was "covering" something else, rewrite that w supercession
-            if (minutes == (hours * 5))
-            {
-                ClockFace[(hours * 5)] = GREEN;
-            }
-            else if (minutes % 5 == 0)
-            {
-                if (minutes % 15 == 0)
-                {
-                    ClockFace[minutes] = YELLOW;
-                }
-                else
-                {
-                    ClockFace[minutes] = WHITE;
-                }
-            }
+            last++;
         }
+        renderPositions(clockLayers.face(), frame, offset, first, last);
+        stale &= ~(((1ULL << (last - first + 1)) - 1) << first);
+        first = last + 1;
+    }
+    publishFrame();
+}
 
-        // assign hours only when minutes gets back to 0
-        if (newminutes == 0)
-        {
-            ClockFace[(hours * 5)] = BLACK; // blank the old one
-            // if the hour hand was "covering" something else, rewrite that w supercession
-            if ((hours * 5) % 5 == 0)
-            {
-                if ((hours * 5) % 15 == 0)
-                {
-                    ClockFace[(hours * 5)] = YELLOW;
-                }
-                else
-                {
-                    ClockFace[(hours * 5)] = WHITE;
-                }
-            }
-        }
-        if (newminutes == 0)
-            ClockFace[(newhours * 5)] = GREEN; // write the new one
-        if (newseconds == 0)
-            ClockFace[newminutes] = BLUE; // write the new one
-        ClockFace[newseconds] = RED;      // write the new one
+/*------------------------------------------------------------------------------
+   beginFrame() -- get the back frame for a pattern to produce into
+  ------------------------------------------------------------------------------*/
+povFrame &beginFrame()
+{
+    return frameQueue.back();
+}
 
-        seconds = newseconds;
-        minutes = newminutes;
-        hours = newhours;
-        // Serial.printf("%02d:%02d:%02d\n", hours, minutes, seconds);
-    }
+/*------------------------------------------------------------------------------
+   publishFrame() -- back frame is complete; swap it in at the next photo-trigger
+  ------------------------------------------------------------------------------*/
+void publishFrame()
+{
+    frameQueue.publish();
 }
 
 /*------------------------------------------------------------------------------
@@ -544,67 +770,157 @@ void dumpClockFace()
     Serial.println("[pos]: RGB value");
     for (i = 0; i <= 59; i++)
     {
-        Serial.printf("[ %02d]: %s\n", i, RGBstr[ClockFace[i]]);
+        Serial.printf("[ %02d]: %s\n", i, RGBstr[clockLayers.color(i)]);
     }
 }
 
+
 /*------------------------------------------------------------------------------
-   function 0:  loop_fn_clock() - display an accurate clock face
+   startPattern() -- common start for every pattern: LEDs off, blank frame, engine on
   ------------------------------------------------------------------------------*/
-void loop_fn_clock()
+void startPattern()
 {
-    Serial.println("In loop_fn_clock()");
     // turn LEDs off (clear output pins -- my LEDs are active LOW but driven by inverting NPN transistors)
-    GPIO.out_w1tc = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
-    // protect from interruption; enable slot timer, disable other timer(s) while in this function
-    portENTER_CRITICAL(&slotTimerMux);
-    timerAlarmWrite(slotTimer, (slotWidth), true); // make this auto-reloading for this function
-    timerAlarmEnable(slotTimer);
-    portEXIT_CRITICAL(&slotTimerMux);
+    ledOutput::off();
+    // protect from interruption; disable other timer(s) while in this function
     portENTER_CRITICAL(&secondTimerMux);
     timerAlarmDisable(secondTimer);
     portEXIT_CRITICAL(&secondTimerMux);
+    // don't show the previous pattern's frame; the pattern produces its own at next trigger
+    produceBlank(beginFrame());
+    publishFrame();
+    stalePositions[0] = stalePositions[1] = stalePositions[2] = ALL_POSITIONS; // clock has to redraw all frames
+    // slot engine (re)starts at every photo-trigger from here on
+    portENTER_CRITICAL(&slotTimerMux);
+    ENGINE_RUNNING = true;
+    portEXIT_CRITICAL(&slotTimerMux);
     Serial.println("- configured");
+}
+
+/*------------------------------------------------------------------------------
+   revolutionDone() -- lower the trigger flag, count it, print diagnostics now and then
+  ------------------------------------------------------------------------------*/
+void revolutionDone()
+{
+    photoTrigger.numHits++;
+    photoTrigger.TRIGGERED = false;
+    if (photoTrigger.numHits % DIAG_REVOLUTIONS == 0)
+    {
+        printDiagnostics();
+    }
+}
+
+/*------------------------------------------------------------------------------
+   printDiagnostics() -- report (and reset) slot engine edge latency
+  ------------------------------------------------------------------------------*/
+void printDiagnostics()
+{
+    uint32_t count, sum, max;
+    portENTER_CRITICAL(&slotTimerMux);
+    count = edgeCount;
+    sum = edgeLatencySum;
+    max = edgeLatencyMax;
+    edgeCount = 0;
+    edgeLatencySum = 0;
+    edgeLatencyMax = 0;
+    portEXIT_CRITICAL(&slotTimerMux);
+    Serial.printf("period: %d us (%s), slot: %d us, edges: %u, latency avg: %u us, max: %u us\n",
+                  (int)periodMicros, periodEstimator.locked() ? "locked" : "acquiring", (int)slotWidth,
+                  count, count ? sum / count : 0, max);
+    Serial.printf("seconds: marked %u, missed %u, late %u, latency max: %u us\n",
+                  secondsMarked, secondsMissed, secondsLate, secondLatencyMax);
+    secondLatencyMax = 0;
+#if POV_TRACE
+    // busy share of each core since the last report
+    uint32_t now = micros();
+    uint64_t windowCycles = (uint64_t)(now - traceStartMicros) * ESP.getCpuFreqMHz();
+    uint32_t engineCycles = engineBusyCycles;
+    engineBusyCycles = 0;
+    Serial.printf("trace: core %d (render) busy %d.%d%%, core %d (slot engine ISRs) busy %d.%d%%\n",
+                  RENDER_CORE, (int)(1000 * renderBusyCycles / windowCycles / 10), (int)(1000 * renderBusyCycles / windowCycles % 10),
+                  OUTPUT_CORE, (int)(1000 * (uint64_t)engineCycles / windowCycles / 10), (int)(1000 * (uint64_t)engineCycles / windowCycles % 10));
+    renderBusyCycles = 0;
+    traceStartMicros = now;
+#endif
+}
+
+/*------------------------------------------------------------------------------
+   alignSecondTimer() -- phase the second timer to fire just after each NTP second edge
+     (re-aligned every minute, so the timer crystal can't drift away from local time)
+  ------------------------------------------------------------------------------*/
+void alignSecondTimer()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    portENTER_CRITICAL(&secondTimerMux);
+    // counter = us since the last mark point (second edge + SECOND_MARK_DELAY)
+    timerWrite(secondTimer, (tv.tv_usec + 1000000 - SECOND_MARK_DELAY) % 1000000);
+    timerAlarmWrite(secondTimer, 1000000, true);
+    timerAlarmEnable(secondTimer);
+    portEXIT_CRITICAL(&secondTimerMux);
+}
+
+/*------------------------------------------------------------------------------
+   serveSecond() -- recalculate the clock face if a second mark is pending and the
+     slot engine is in the dark gap between the last slot and the next photo-trigger
+     (or the disk seems stopped); returns true if it did
+  ------------------------------------------------------------------------------*/
+bool serveSecond()
+{
+    if (!MARKSECOND)
+    {
+        return false;
+    }
+    uint32_t waited = micros() - markMicros;
+    if (!ENDFRAME && waited < DISK_STOPPED_MICROS)
+    {
+        return false;
+    }
+    portENTER_CRITICAL(&secondTimerMux);
+    MARKSECOND = false;
+    portEXIT_CRITICAL(&secondTimerMux);
+    if (waited > SECOND_LATE)
+    {
+        secondsLate++;
+    }
+    if (waited > secondLatencyMax)
+    {
+        secondLatencyMax = waited;
+    }
+
+    calculateClockFace();
+    if (secondsMarked % 60 == 0)
+    {
+        alignSecondTimer();
+    }
+    return true;
+}
+
+/*------------------------------------------------------------------------------
+   function 0:  loop_fn_clock() - display an accurate clock face
+  ------------------------------------------------------------------------------*/
+void loop_fn_clock()
+{
+    Serial.println("In loop_fn_clock()");
+    startPattern();
+
+    // make sure there is a frame to display (swapped in at next trigger)
+    calculateClockFace();
+    alignSecondTimer();
 
     // perform this function until reset
     while (!buttonPress.PRESSED)
     {
-        // (process trigger interrupt)
+        waitForEvent();
+        // (process trigger interrupt); the slot engine draws the frame
         if (photoTrigger.TRIGGERED)
         {
-            clockPosition = 0; // ToDo -- use relative number to "align the clock face"
-            // display the 0-marker; provides offset and reverses b/c disk rotates ccw
-            // (then write 3-bit RGB to the consecutive LED register bits)
-            GPIO.out_w1ts = ((ClockFace[59 - ((offset + clockPosition) % 60)]) << RED_LED);
-            // now delay slotwidth and then turn them off
-            delayMicroseconds(intervalOn);
-            GPIO.out_w1tc = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
-            photoTrigger.numHits++;
-            photoTrigger.TRIGGERED = false; // lower the Triggered flag
-        }
-
-        // display clock face
-        if (ENDSLOT) // spinning slot has arrived at new clock slot position
-        {
-            clockPosition++;
-            // set my active LED bits - up to the 60th position
-            if (clockPosition < 60)
-            { // provides offset and reverses b/c disk rotates ccw
-                GPIO.out_w1ts = ((ClockFace[59 - ((offset + clockPosition) % 60)]) << RED_LED);
-                // now delay slotwidth and then turn them off
-                delayMicroseconds(intervalOn);
-                GPIO.out_w1tc = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
-            }
-            ENDSLOT = false; // lower the clockTick flag
+            recalibrate();
+            revolutionDone();
         }
 
-        // every 1 seconds, recalculate the time
-        // assign milliseconds here to avoid having to do so again in calculateClockFace()
-        milliseconds = millis();
-        if (milliseconds % 1000 == 0)
-        {
-            calculateClockFace();
-        }
+        // every 1 seconds, recalculate the time (in the dark gap at the end of a revolution)
+        serveSecond();
     }
 }
 
@@ -614,42 +930,20 @@ void loop_fn_clock()
 void loop_fn_radar()
 {
     Serial.println("In loop_fn_radar()");
-    // turn LEDs off (clear output pins -- my LEDs are active LOW but driven by inverting NPN transistors)
-    GPIO.out_w1tc = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
-    // protect from interruption; disable timer(s) to start this function
-    portENTER_CRITICAL(&slotTimerMux);
-    timerAlarmDisable(slotTimer);
-    portEXIT_CRITICAL(&slotTimerMux);
-    portENTER_CRITICAL(&secondTimerMux);
-    timerAlarmDisable(secondTimer);
-    portEXIT_CRITICAL(&secondTimerMux);
-    Serial.println("- configured");
+    startPattern();
 
     // perform this function until reset
     while (!buttonPress.PRESSED)
     {
-        if (photoTrigger.TRIGGERED) // start pattern
+        waitForEvent();
+        if (photoTrigger.TRIGGERED) // produce next revolution
         {
-
-            // mark sync spot
-            GPIO.out_w1ts = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
-            delayMicroseconds(intervalOn);
-            GPIO.out_w1tc = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
-            // calculate how long to wait to display radar beacon - 5 sec to come 360 deg
             recalibrate();
-
-            milliseconds = millis();
-            radarSlot = (uint64_t)(periodMicros * (milliseconds % 5000) / 5000.0);
-            // Serial.printf("radarSlot: %d\n", radarSlot);
-
-            delayMicroseconds(radarSlot);
-            GPIO.out_w1ts = (1 << RED_LED);
-            delayMicroseconds(intervalOn);
-            GPIO.out_w1tc = (1 << RED_LED);
-
-            photoTrigger.numHits++;
-            // set flags
-            photoTrigger.TRIGGERED = false;
+            // radar beacon takes 5 sec to come 360 deg
+            radarSlot = (millis() % 5000) * POV_COLUMNS / 5000;
+            produceRadar(beginFrame(), radarSlot, RED);
+            publishFrame();
+            revolutionDone();
         }
     }
 }
@@ -660,36 +954,20 @@ void loop_fn_radar()
 void loop_fn_RedBlack()
 {
     Serial.println("In loop_fn_RedBlack()");
-    // turn LEDs off (clear output pins -- my LEDs are active LOW but driven by inverting NPN transistors)
-    GPIO.out_w1tc = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
-    // protect from interruption; disable timer(s) to start this function
-    portENTER_CRITICAL(&slotTimerMux);
-    timerAlarmDisable(slotTimer);
-    portEXIT_CRITICAL(&slotTimerMux);
-    portENTER_CRITICAL(&secondTimerMux);
-    timerAlarmDisable(secondTimer);
-    portEXIT_CRITICAL(&secondTimerMux);
-    Serial.println("- configured");
+    startPattern();
+
+    // draw 8 bands alternating red/black
+    produceBands(beginFrame(), 8, redBlack, 2);
+    publishFrame();
 
     // perform this function until reset
     while (!buttonPress.PRESSED)
     {
-        if (photoTrigger.TRIGGERED) // start pattern
+        waitForEvent();
+        if (photoTrigger.TRIGGERED)
         {
-            // calculate how long to wait to display radar beacon - 5 sec to come 360 deg
             recalibrate();
-
-            // draw 8 bands alternating red/black
-            for (i = 0; i <= 3; i++)
-            {
-                GPIO.out_w1ts = (RED << RED_LED); // RGB value shifted into consecutive register bits (red led is lsb)
-                delayMicroseconds(int(periodMicros / 8.0));
-                GPIO.out_w1tc = (RED << RED_LED); // RGB value shifted into consecutive register bits (red led is lsb)
-                delayMicroseconds(int(periodMicros / 8.0));
-            }
-            photoTrigger.numHits++;
-            // set flags
-            photoTrigger.TRIGGERED = false;
+            revolutionDone();
         }
     }
 }
@@ -700,35 +978,20 @@ void loop_fn_RedBlack()
 void loop_fn_colors()
 {
     Serial.println("In loop_fn_colors()");
-    // turn LEDs off (clear output pins -- my LEDs are active LOW but driven by inverting NPN transistors)
-    GPIO.out_w1tc = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
-    // protect from interruption; disable timer(s) to start this function
-    portENTER_CRITICAL(&slotTimerMux);
-    timerAlarmDisable(slotTimer);
-    portEXIT_CRITICAL(&slotTimerMux);
-    portENTER_CRITICAL(&secondTimerMux);
-    timerAlarmDisable(secondTimer);
-    portEXIT_CRITICAL(&secondTimerMux);
-    Serial.println("- configured");
+    startPattern();
+
+    // draw 8 bands of 3-bit RGB color
+    produceBands(beginFrame(), 8, allColors, 8);
+    publishFrame();
 
     // perform this function until reset
     while (!buttonPress.PRESSED)
     {
-        if (photoTrigger.TRIGGERED) // start pattern
+        waitForEvent();
+        if (photoTrigger.TRIGGERED)
         {
-            // calculate how long to wait to display radar beacon - 5 sec to come 360 deg
             recalibrate();
-
-            // draw 8 bands of 3-bit RGB color
-            for (i = 0; i <= 7; i++)
-            {
-                GPIO.out_w1ts = (i << RED_LED); // RGB value shifted into consecutive register bits (red led is lsb)
-                delayMicroseconds(int(periodMicros / 8.0));
-                GPIO.out_w1tc = (i << RED_LED); // RGB value shifted into consecutive register bits (red led is lsb)
-            }
-            photoTrigger.numHits++;
-            // set flags
-            photoTrigger.TRIGGERED = false;
+            revolutionDone();
         }
     }
 }
@@ -739,38 +1002,26 @@ void loop_fn_colors()
 void loop_fn_checkers()
 {
     Serial.println("In loop_fn_checkers()");
-    // turn LEDs off (clear output pins -- my LEDs are active LOW but driven by inverting NPN transistors)
-    GPIO.out_w1tc = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
-    // protect from interruption; disable timer(s) to start this function
-    portENTER_CRITICAL(&slotTimerMux);
-    timerAlarmDisable(slotTimer);
-    portEXIT_CRITICAL(&slotTimerMux);
-    portENTER_CRITICAL(&secondTimerMux);
-    timerAlarmDisable(secondTimer);
-    portEXIT_CRITICAL(&secondTimerMux);
-    Serial.println("- configured");
+    startPattern();
+    uint8_t lastCheckerNumber = 0xff; // force first frame
 
     // perform this function until reset
     while (!buttonPress.PRESSED)
     {
-        // get an even number between 0 and 30, for checker pattern
-        checkerNumber = 2 * map(analogRead(checkerNumber_pin), 0, 1023, 0, 15);
-        if (photoTrigger.TRIGGERED) // start pattern
+        waitForEvent();
+        if (photoTrigger.TRIGGERED) // produce next revolution, if the knob moved
         {
-            // calculate how long to wait to display radar beacon - 5 sec to come 360 deg
             recalibrate();
-
-            // draw 8 bands alternating red/black
-            for (i = 0; i <= checkerNumber; i++)
+            // get an even number between 0 and 30, for checker pattern
+            checkerNumber = 2 * map(analogRead(checkerNumber_pin), 0, 1023, 0, 15);
+            if (checkerNumber != lastCheckerNumber)
             {
-                GPIO.out_w1ts = (RED << RED_LED); // RGB value shifted into consecutive register bits (red led is lsb)
-                delayMicroseconds(int(periodMicros / checkerNumber));
-                GPIO.out_w1tc = (RED << RED_LED); // RGB value shifted into consecutive register bits (red led is lsb)
-                delayMicroseconds(int(periodMicros / checkerNumber));
+                // draw checkerNumber bands alternating red/black
+                produceBands(beginFrame(), checkerNumber, redBlack, 2);
+                publishFrame();
+                lastCheckerNumber = checkerNumber;
             }
-            photoTrigger.numHits++;
-            // set flags
-            photoTrigger.TRIGGERED = false;
+            revolutionDone();
         }
     }
 }
@@ -781,37 +1032,26 @@ void loop_fn_checkers()
 void loop_fn_checker_colors()
 {
     Serial.println("In loop_fn_checker_colors()");
-    // turn LEDs off (clear output pins -- my LEDs are active LOW but driven by inverting NPN transistors)
-    GPIO.out_w1tc = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
-    // protect from interruption; disable timer(s) to start this function
-    portENTER_CRITICAL(&slotTimerMux);
-    timerAlarmDisable(slotTimer);
-    portEXIT_CRITICAL(&slotTimerMux);
-    portENTER_CRITICAL(&secondTimerMux);
-    timerAlarmDisable(secondTimer);
-    portEXIT_CRITICAL(&secondTimerMux);
-    Serial.println("- configured");
+    startPattern();
+    uint8_t lastCheckerNumber = 0xff; // force first frame
 
     // perform this function until reset
     while (!buttonPress.PRESSED)
     {
-        // get an even number between 0 and 60, for checker pattern
-        checkerNumber = 2 * map(analogRead(checkerNumber_pin), 0, 1023, 0, 30);
-        if (photoTrigger.TRIGGERED) // start pattern
+        waitForEvent();
+        if (photoTrigger.TRIGGERED) // produce next revolution, if the knob moved
         {
-            // calculate how long to wait to display radar beacon - 5 sec to come 360 deg
             recalibrate();
-
-            // draw 8 bands alternating red/black
-            for (i = 0; i <= checkerNumber; i++)
+            // get an even number between 0 and 60, for checker pattern
+            checkerNumber = 2 * map(analogRead(checkerNumber_pin), 0, 1023, 0, 30);
+            if (checkerNumber != lastCheckerNumber)
             {
-                GPIO.out_w1ts = (i << RED_LED); // RGB value shifted into consecutive register bits (red led is lsb)
-                delayMicroseconds(int(periodMicros / checkerNumber));
-                GPIO.out_w1tc = (i << RED_LED); // RGB value shifted into consecutive register bits (red led is lsb)
+                // draw checkerNumber bands cycling through the 8 x 3-bit RGB colors
+                produceBands(beginFrame(), checkerNumber, allColors, 8);
+                publishFrame();
+                lastCheckerNumber = checkerNumber;
             }
-            photoTrigger.numHits++;
-            // set flags
-            photoTrigger.TRIGGERED = false;
+            revolutionDone();
         }
     }
 }
@@ -822,92 +1062,52 @@ void loop_fn_checker_colors()
 void loop_fn_fan()
 {
     Serial.println("In loop_fn_fan()");
-    // turn LEDs off (clear output pins -- my LEDs are active LOW but driven by inverting NPN transistors)
-    GPIO.out_w1tc = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
-    // protect from interruption; disable timer(s) to start this function
-    portENTER_CRITICAL(&slotTimerMux);
-    timerAlarmDisable(slotTimer);
-    portEXIT_CRITICAL(&slotTimerMux);
-    portENTER_CRITICAL(&secondTimerMux);
-    timerAlarmDisable(secondTimer);
-    portEXIT_CRITICAL(&secondTimerMux);
-    Serial.println("- configured");
+    startPattern();
 
     // perform this function until reset
     while (!buttonPress.PRESSED)
     {
-        if (photoTrigger.TRIGGERED) // start pattern
+        waitForEvent();
+        if (photoTrigger.TRIGGERED) // produce next revolution
         {
-
-            // mark sync spot
-            GPIO.out_w1ts = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
-            delayMicroseconds(intervalOn);
-            GPIO.out_w1tc = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
-            // calculate how long to wait to display radar beacon - 5 sec to come 360 deg
             recalibrate();
-
-            milliseconds = millis();
-            radarSlot = (uint64_t)(periodMicros * (milliseconds % 5000) / 5000.0);
-            // Serial.printf("radarSlot: %d\n", radarSlot);
-
-            GPIO.out_w1ts = (RED << RED_LED);
-            delayMicroseconds(radarSlot);
-            GPIO.out_w1ts = (WHITE << RED_LED);
-            delayMicroseconds(intervalOn);
-            GPIO.out_w1tc = (WHITE << RED_LED); // clearing white draws black
-
-            photoTrigger.numHits++;
-            // set flags
-            photoTrigger.TRIGGERED = false;
+            // fan edge takes 5 sec to come 360 deg
+            radarSlot = (millis() % 5000) * POV_COLUMNS / 5000;
+            produceFan(beginFrame(), radarSlot, RED);
+            publishFrame();
+            revolutionDone();
         }
     }
 }
 
 /*------------------------------------------------------------------------------
    function 7:  loop_fn_altClock() - display an accurate clock face
+     (recalibrating every revolution; with the slot engine this draws the same
+      frame as loop_fn_clock())
   ------------------------------------------------------------------------------*/
 void loop_fn_altClock()
 {
     Serial.println("In loop_fn_altClock()");
-    // turn LEDs off (clear output pins -- my LEDs are active LOW but driven by inverting NPN transistors)
-    GPIO.out_w1tc = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
-    // protect from interruption; disable timer(s) while in this function
-    portENTER_CRITICAL(&slotTimerMux);
-    timerAlarmDisable(slotTimer);
-    portEXIT_CRITICAL(&slotTimerMux);
-    portENTER_CRITICAL(&secondTimerMux);
-    timerAlarmDisable(secondTimer);
-    portEXIT_CRITICAL(&secondTimerMux);
-    Serial.println("- configured");
+    startPattern();
+
+    // make sure there is a frame to display (swapped in at next trigger)
+    calculateClockFace();
+    alignSecondTimer();
 
     // perform this function until reset
     while (!buttonPress.PRESSED)
     {
-        // (process trigger interrupt)
+        waitForEvent();
+        // (process trigger interrupt); the slot engine draws the frame
         if (photoTrigger.TRIGGERED)
         {
-            // ToDo -- use relative number to "align the clock face"
-            // display the 0-marker; provides offset and reverses b/c disk rotates ccw
-            // (then write 3-bit RGB to the consecutive LED register bits)
             recalibrate();
-            for (i = 0; i <= 59; i++)
-            {
-                GPIO.out_w1ts = ((ClockFace[59 - ((offset + i) % 60)]) << RED_LED);
-                // now delay slotwidth and then turn them off
-                delayMicroseconds(intervalOn);
-                GPIO.out_w1tc = (WHITE << RED_LED); // clear WHITE = draw BLACK
-                delayMicroseconds(intervalOff);
-            }
-            photoTrigger.numHits++;
-            photoTrigger.TRIGGERED = false; // lower the Triggered flag
+            revolutionDone();
         }
 
-        // every 1 seconds, recalculate the time
-        // assign milliseconds here to avoid having to do so again in calculateClockFace()
-        milliseconds = millis();
-        if (milliseconds % 1000 == 0)
+        // every 1 seconds, recalculate the time (in the dark gap at the end of a revolution)
+        if (serveSecond())
         {
-            calculateClockFace();
             // dumpClockFace();
             // exit(0);
         }
@@ -920,58 +1120,36 @@ void loop_fn_altClock()
 void loop_fn_multicolor_fan()
 {
     Serial.println("In loop_fn_multicolor_fan()");
-    // turn LEDs off (clear output pins -- my LEDs are active LOW but driven by inverting NPN transistors)
-    GPIO.out_w1tc = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
-    // protect from interruption; disable timer(s) to start this function
-    portENTER_CRITICAL(&slotTimerMux);
-    timerAlarmDisable(slotTimer);
-    portEXIT_CRITICAL(&slotTimerMux);
-    portENTER_CRITICAL(&secondTimerMux);
-    timerAlarmDisable(secondTimer);
-    portEXIT_CRITICAL(&secondTimerMux);
-    Serial.println("- configured");
+    startPattern();
 
     // perform this function until reset
     while (!buttonPress.PRESSED)
     {
-        if (photoTrigger.TRIGGERED) // start pattern
+        waitForEvent();
+        if (photoTrigger.TRIGGERED) // produce next revolution
         {
+            recalibrate();
             // get a number between 0 and 7, for RGB value of fan pattern
             checkerNumber = map(analogRead(checkerNumber_pin), 0, 1023, 0, 7);
-            // calculate how long to wait to display radar beacon - 5 sec to come 360 deg
-            recalibrate();
-             // mark sync spot
-            GPIO.out_w1ts = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
-            delayMicroseconds(intervalOn);
-            GPIO.out_w1tc = (1 << RED_LED) | (1 << GREEN_LED) | (1 << BLUE_LED);
-
-            milliseconds = millis();
-            radarSlot = (uint64_t)(periodMicros * (milliseconds % 5000) / 5000.0);
-            // Serial.printf("radarSlot: %d\n", radarSlot);
-
-            GPIO.out_w1ts = (checkerNumber << RED_LED);  // display selected color
-            delayMicroseconds(radarSlot);
-            GPIO.out_w1ts = (WHITE << RED_LED);
-            delayMicroseconds(intervalOn);
-            GPIO.out_w1tc = (WHITE << RED_LED); // clearing white draws black
-
-            photoTrigger.numHits++;
-            // set flags
-            photoTrigger.TRIGGERED = false;
+            // fan edge takes 5 sec to come 360 deg
+            radarSlot = (millis() % 5000) * POV_COLUMNS / 5000;
+            produceFan(beginFrame(), radarSlot, checkerNumber);
+            publishFrame();
+            revolutionDone();
         }
     }
 }
 
-void recalibrate() {
-    thisTrigger = micros();
-    delta = thisTrigger - lastTrigger;
-    lastTrigger = thisTrigger;
-    if (((periodMicros > delta) && (periodMicros - delta) < 40000) ||
-        ((periodMicros < delta) && (delta - periodMicros) < 40000))
-    {
-        periodMicros = delta;
-    }
-    slotWidth = periodMicros / 60;
+/*------------------------------------------------------------------------------
+   recalibrate() -- take a copy of the period tracked by the photo-trigger ISR (core 1)
+     (the slot engine reads the tracker directly; these copies are for the patterns
+      and diagnostics)
+  ------------------------------------------------------------------------------*/
+void recalibrate()
+{
+    delta = trackedDelta;
+    periodMicros = trackedPeriodQ >> PERIOD_FRAC_BITS;
+    slotWidth = periodMicros / POV_COLUMNS;
     intervalOn = (unsigned int)(slotWidth / 3);           // draw skinnier lines
     intervalOff = (unsigned int)(slotWidth - intervalOn); // draw skinnier lines
-}
\ No newline at end of file
+}
@@ -0,0 +1,393 @@
+// PanelCheck -- count the I2C bytes per display update, old way and StatusPanel's, on a PC
+// A mock bus decodes what goes over I2C as the SSD1306 would (control bytes, column and page
+// address commands, data written in horizontal addressing mode) into a mock display RAM, and
+// counts every byte on the bus (address bytes too).  Runs the HDD motor driver's status
+// screen (6 labels, 6 values at col2_x) through a spin-up, a stretch at speed, and idle:
+//   - before: update_display() drew the old values in BLACK and display()ed, then the new
+//     ones in WHITE and display()ed: twice the whole buffer, as OLEDDisplay's SSD1306Wire
+//     sends it (6 single commands, then 1024 bytes in 16 byte transmissions)
+//   - after: StatusPanel::render() and oledFlush() of its window
+// The panel draws through a stand-in OLEDDisplay that renders fonts as the library does
+// (drawString(), getStringWidth(), fillRect()).  Checks that after every update the display
+// RAM matches the frame buffer (the window covered every change), and the frame buffer
+// matches the panel drawn from scratch.  Also
+// checks the value formatting against printf().  Prints one CSV line per update: update,
+// bytes before, bytes after; summary on stderr.
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -I../../src PanelCheck.cpp -o panelcheck
+//   ./panelcheck --updates 300 --khz 400 > bytes.csv
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+// OLEDDisplay, as much of it as the panel uses: the frame buffer (PANEL_WIDTH bytes per page,
+// bit 0 the top row of the page), and text in its font format, left aligned
+enum OLEDDISPLAY_COLOR { BLACK = 0, WHITE = 1, INVERSE = 2 };
+enum OLEDDISPLAY_TEXT_ALIGNMENT { TEXT_ALIGN_LEFT = 0, TEXT_ALIGN_RIGHT = 1, TEXT_ALIGN_CENTER = 2 };
+class OLEDDisplay
+{
+public:
+    uint8_t buffer[128 * 64 / 8];
+    OLEDDisplay() : color(WHITE), font(NULL) { memset(buffer, 0, sizeof(buffer)); }
+
+    void setColor(OLEDDISPLAY_COLOR c) { color = c; }
+    void setFont(const uint8_t *f) { font = f; }
+    void setTextAlignment(OLEDDISPLAY_TEXT_ALIGNMENT alignment) { (void)alignment; } // (left only)
+
+    void fillRect(int16_t x, int16_t y, int16_t width, int16_t height)
+    {
+        for (int16_t column = x; column < x + width; column++)
+        {
+            for (int16_t row = y; row < y + height; row++)
+            {
+                setPixel(column, row);
+            }
+        }
+    }
+
+    uint16_t getStringWidth(const char *text, uint16_t length)
+    {
+        uint8_t first = font[2], chars = font[3];
+        uint16_t width = 0;
+        for (uint16_t i = 0; i < length; i++)
+        {
+            uint8_t code = (uint8_t)text[i];
+            width += (code >= first && code - first < chars) ? font[4 + (code - first) * 4 + 3] : 0;
+        }
+        return width;
+    }
+
+    // glyphs: a jump table of 4 bytes a character (offset msb, lsb -- 255, 255: none --,
+    // size, advance), then each glyph's columns, top to bottom, 8 rows a byte
+    void drawString(int16_t x, int16_t y, const char *text)
+    {
+        uint8_t height = font[1], first = font[2], chars = font[3];
+        const uint8_t *glyphs = font + 4 + chars * 4;
+        uint8_t raster = 1 + ((height - 1) >> 3);
+        for (int16_t cursor = x; *text; text++)
+        {
+            uint8_t code = (uint8_t)*text;
+            if (code < first || code - first >= chars)
+            {
+                continue;
+            }
+            const uint8_t *jump = font + 4 + (code - first) * 4;
+            if (!(jump[0] == 255 && jump[1] == 255))
+            {
+                const uint8_t *data = glyphs + ((jump[0] << 8) | jump[1]);
+                for (uint8_t i = 0; i < jump[2]; i++)
+                {
+                    for (uint8_t bit = 0; bit < 8; bit++)
+                    {
+                        if (data[i] & (1 << bit))
+                        {
+                            setPixel(cursor + i / raster, y + (i % raster) * 8 + bit);
+                        }
+                    }
+                }
+            }
+            cursor += jump[3];
+        }
+    }
+
+private:
+    OLEDDISPLAY_COLOR color;
+    const uint8_t *font;
+
+    void setPixel(int16_t x, int16_t y)
+    {
+        if (x < 0 || x >= 128 || y < 0 || y >= 64)
+        {
+            return;
+        }
+        uint8_t &cell = buffer[(y >> 3) * 128 + x];
+        cell = (color == WHITE) ? cell | (1 << (y & 7)) : (color == BLACK) ? cell & ~(1 << (y & 7)) : cell ^ (1 << (y & 7));
+    }
+};
+
+#include "statusPanel.h"
+#include "oledFlush.h"
+
+// settings (command line)
+struct settings
+{
+    int updates = 300; // display updates: a third spinning up, a third at speed, a third idle
+    int khz = 400;     // I2C clock, for the time per update
+};
+
+// a font in the OLEDDisplay format: 13 pixels high (2 bytes per column, as ArialMT_Plain_10),
+// 6 pixels per character ('.' 3, '-' 4, ' ' no glyph), made-up glyphs
+std::vector<uint8_t> makeFont()
+{
+    const uint8_t height = 13, first = 32, chars = 95;
+    std::vector<uint8_t> jump, glyphs;
+    for (int code = first; code < first + chars; code++)
+    {
+        uint8_t advance = (code == '.') ? 3 : (code == '-') ? 4 : 6;
+        if (code == ' ')
+        {
+            uint8_t none[4] = {255, 255, 0, advance};
+            jump.insert(jump.end(), none, none + 4);
+            continue;
+        }
+        uint16_t offset = glyphs.size();
+        uint8_t size = (advance - 1) * 2; // the last column is the gap
+        uint8_t entry[4] = {(uint8_t)(offset >> 8), (uint8_t)offset, size, advance};
+        jump.insert(jump.end(), entry, entry + 4);
+        for (int column = 0; column < advance - 1; column++)
+        {
+            uint32_t bits = (uint32_t)(code * 2654435761u) >> (column * 3);
+            glyphs.push_back((uint8_t)bits | 0x01);     // rows 0-7
+            glyphs.push_back((uint8_t)(bits >> 8) & 0x1f); // rows 8-12 (the font is 13 high)
+        }
+    }
+    std::vector<uint8_t> font = {6, height, first, chars};
+    font.insert(font.end(), jump.begin(), jump.end());
+    font.insert(font.end(), glyphs.begin(), glyphs.end());
+    return font;
+}
+
+// the I2C bus, with an SSD1306 on it
+struct MockBus
+{
+    uint8_t ram[PANEL_WIDTH * PANEL_HEIGHT / 8]; // display RAM
+    long bytes = 0;                              // on the bus
+    // decoder state
+    bool first = true, data = false;
+    uint8_t command = 0, args = 0, arg[2];
+    uint8_t col0 = 0, col1 = PANEL_WIDTH - 1, page0 = 0, page1 = PANEL_HEIGHT / 8 - 1, col = 0, page = 0;
+
+    MockBus() { memset(ram, 0, sizeof(ram)); }
+
+    void beginTransmission(uint8_t address)
+    {
+        bytes++; // the address byte
+        if (address != SSD1306_ADDRESS)
+        {
+            fprintf(stderr, "wrong address %02x\n", address);
+        }
+        first = true;
+    }
+
+    void write(uint8_t value)
+    {
+        bytes++;
+        if (first)
+        {
+            first = false;
+            data = (value == SSD1306_CONTROL_DATA); // (0x80, 0x00: commands)
+            return;
+        }
+        if (data)
+        {
+            ram[page * PANEL_WIDTH + col] = value;
+            if (++col > col1)
+            {
+                col = col0;
+                page = (page >= page1) ? page0 : page + 1;
+            }
+            return;
+        }
+        if (args > 0) // arguments of the command before (may come as single commands)
+        {
+            arg[2 - args] = value;
+            if (--args == 0)
+            {
+                if (command == SSD1306_COLUMNADDR)
+                {
+                    col0 = col = arg[0];
+                    col1 = arg[1];
+                }
+                else
+                {
+                    page0 = page = arg[0];
+                    page1 = arg[1];
+                }
+            }
+            return;
+        }
+        command = value;
+        args = (value == SSD1306_COLUMNADDR || value == SSD1306_PAGEADDR) ? 2 : 0;
+    }
+
+    void endTransmission() {}
+};
+
+// what OLEDDisplay's SSD1306Wire::display() sends: the whole buffer
+void displayAll(MockBus &bus, const uint8_t *buffer)
+{
+    const uint8_t commands[6] = {SSD1306_COLUMNADDR, 0, PANEL_WIDTH - 1, SSD1306_PAGEADDR, 0, PANEL_HEIGHT / 8 - 1};
+    for (int i = 0; i < 6; i++)
+    {
+        bus.beginTransmission(SSD1306_ADDRESS); // sendCommand()
+        bus.write(0x80);
+        bus.write(commands[i]);
+        bus.endTransmission();
+    }
+    for (int i = 0; i < PANEL_WIDTH * PANEL_HEIGHT / 8; i += 16)
+    {
+        bus.beginTransmission(SSD1306_ADDRESS);
+        bus.write(SSD1306_CONTROL_DATA);
+        for (int x = 0; x < 16; x++)
+        {
+            bus.write(buffer[i + x]);
+        }
+        bus.endTransmission();
+    }
+}
+
+// the HDD motor driver's status screen
+const int col2_x = 60;
+const char *labels[6] = {"Direction: ", "Position: ", "Speed: ", "RPM: ", "stepLength: ", "period: "};
+const uint8_t decimals[6] = {0, 0, 2, 2, 0, 6};
+
+struct Screen
+{
+    OLEDDisplay display;
+    uint8_t *buffer = display.buffer;
+    StatusPanel panel;
+    int8_t fields[6];
+
+    void begin(const uint8_t *font)
+    {
+        panel.begin(&display, font);
+        for (int line = 0; line < 6; line++)
+        {
+            panel.addLabel(0, line * 10, labels[line]);
+            fields[line] = panel.addField(col2_x, line * 10, decimals[line]);
+        }
+    }
+
+    void set(const char *direction, const double *values)
+    {
+        panel.setText(fields[0], direction);
+        for (int line = 1; line < 6; line++)
+        {
+            panel.setValue(fields[line], values[line]);
+        }
+    }
+};
+
+int main(int argc, char **argv)
+{
+    settings s;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--updates"))
+            s.updates = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--khz"))
+            s.khz = atoi(argv[i + 1]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--updates n] [--khz i2c clock]\n", argv[0]);
+            return 1;
+        }
+    }
+    int failures = 0;
+
+    // formatting, against printf (skipping values half way between two roundings: printf
+    // rounds the exact binary value, format() the scaled one)
+    srand(1);
+    for (int i = 0; i < 100000; i++)
+    {
+        double value = (rand() - RAND_MAX / 2) / (double)(1 << (rand() % 24));
+        uint8_t places = rand() % (PANEL_DECIMALS + 1);
+        double scaled = fabs(value) * pow(10, places);
+        if (fabs(scaled - floor(scaled) - 0.5) < 1e-6)
+        {
+            continue;
+        }
+        char ours[PANEL_TEXT], theirs[64];
+        StatusPanel::format(ours, value, places);
+        snprintf(theirs, sizeof(theirs), "%.*f", places, value);
+        if (scaled >= 1e15)
+        {
+            strcpy(theirs, (value < 0) ? "-ovf" : "ovf"); // (too many digits for a field)
+        }
+        if (!strcmp(theirs, "-0") || !strncmp(theirs, "-0.", 3))
+        {
+            bool zero = strspn(theirs + 1, "0.") == strlen(theirs + 1);
+            memmove(theirs, theirs + (zero ? 1 : 0), strlen(theirs)); // (no "-0.00")
+        }
+        if (strcmp(ours, theirs))
+        {
+            fprintf(stderr, "format(%.17g, %u): %s, printf: %s\n", value, places, ours, theirs);
+            failures++;
+            break;
+        }
+    }
+
+    std::vector<uint8_t> font = makeFont();
+    Screen screen;
+    screen.begin(font.data());
+    MockBus bus, before;
+    displayAll(bus, screen.buffer); // the sketch's clear() and display() before the panel
+
+    printf("update,before,after\n");
+    long total_before = 0, total_after = 0, phase_after[3] = {0, 0, 0};
+    long position = 0;
+    double rpm = 0;
+    for (int update = 0; update <= s.updates; update++)
+    {
+        // the motor: spins up, holds its speed, stops (an update every 50 ms)
+        int phase = (update * 3) / (s.updates + 1);
+        rpm = (phase == 0) ? 550.0 * update * 3 / s.updates : (phase == 1) ? 550 + (rand() % 5 - 2) * 0.25 : 0;
+        long counts = (long)(rpm * 60 / 60 * 0.05 + 0.5); // 60 counts per revolution
+        position -= counts;
+        double speed = -counts / 0.05;
+        double values[6] = {0, (double)position, speed, rpm, (rpm > 0) ? floor(60e6 / (rpm * 120)) : 40000,
+                            (speed != 0) ? -60.0 / speed : 0};
+        screen.set(position < 0 ? "ccw" : "cw", values);
+
+        // before: two whole buffers
+        long start = before.bytes;
+        displayAll(before, screen.buffer);
+        displayAll(before, screen.buffer);
+        long bytes_before = (update == 0) ? 0 : before.bytes - start;
+
+        // after: the window
+        start = bus.bytes;
+        if (screen.panel.render())
+        {
+            oledFlush(bus, screen.buffer, screen.panel.window());
+        }
+        long bytes_after = bus.bytes - start;
+        if (memcmp(bus.ram, screen.buffer, sizeof(bus.ram)))
+        {
+            fprintf(stderr, "update %d: display RAM differs from the frame buffer\n", update);
+            failures++;
+        }
+        Screen fresh;
+        fresh.begin(font.data());
+        fresh.set(position < 0 ? "ccw" : "cw", values);
+        fresh.panel.render();
+        if (memcmp(fresh.buffer, screen.buffer, sizeof(fresh.display.buffer)))
+        {
+            fprintf(stderr, "update %d: frame buffer differs from the panel drawn from scratch\n", update);
+            failures++;
+        }
+
+        if (update > 0) // (update 0 draws the labels: setup)
+        {
+            printf("%d,%ld,%ld\n", update, bytes_before, bytes_after);
+            total_before += bytes_before;
+            total_after += bytes_after;
+            phase_after[phase] += bytes_after;
+        }
+    }
+
+    int per_phase = s.updates / 3;
+    double ms_per_byte = 9.0 / s.khz; // 8 bits and the ack
+    fprintf(stderr, "before: %ld bytes per update (%.1f ms at %d kHz)\n", total_before / s.updates,
+            total_before / s.updates * ms_per_byte, s.khz);
+    fprintf(stderr, "after:  %ld bytes per update (%.1f ms): spinning up %ld, at speed %ld, idle %ld\n",
+            total_after / s.updates, total_after / (double)s.updates * ms_per_byte, phase_after[0] / per_phase,
+            phase_after[1] / per_phase, phase_after[2] / per_phase);
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "display matches");
+    return failures ? 1 : 0;
+}
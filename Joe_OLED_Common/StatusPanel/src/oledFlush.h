@@ -0,0 +1,68 @@
+#ifndef OLEDFLUSH_H
+#define OLEDFLUSH_H
+
+// Sends a window of the frame buffer (see statusPanel.h) to an SSD1306 over I2C, instead of
+// the whole buffer OLEDDisplay::display() sends: one transmission sets the column and page
+// range, then the window's bytes follow, page by page, OLED_CHUNK to a transmission (the
+// controller is in horizontal addressing mode, as OLEDDisplay leaves it, so the bytes wrap
+// from the window's last column to the first column of its next page)
+// BUS - anything with TwoWire's beginTransmission()/write()/endTransmission(): Wire on the
+//       board, or a mock that counts the bytes, natively
+// Note: kept free of Arduino/ESP32 headers so it can be compiled natively
+
+#include <stdint.h>
+#include "statusPanel.h"
+
+#define SSD1306_ADDRESS 0x3c // the Heltec boards' OLED
+#ifndef OLED_CHUNK
+#define OLED_CHUNK 16 // data bytes per transmission (fits AVR's 32 byte Wire buffer, too)
+#endif
+
+#define SSD1306_CONTROL_COMMANDS 0x00 // the bytes after it are commands
+#define SSD1306_CONTROL_DATA 0x40     // the bytes after it are display RAM data
+#define SSD1306_COLUMNADDR 0x21       // first, last column
+#define SSD1306_PAGEADDR 0x22         // first, last page
+
+template <class BUS>
+void oledFlush(BUS &bus, const uint8_t *buffer, const PanelWindow &window, uint8_t address = SSD1306_ADDRESS)
+{
+    if (window.empty())
+    {
+        return;
+    }
+    bus.beginTransmission(address);
+    bus.write((uint8_t)SSD1306_CONTROL_COMMANDS);
+    bus.write((uint8_t)SSD1306_COLUMNADDR);
+    bus.write(window.x0);
+    bus.write(window.x1);
+    bus.write((uint8_t)SSD1306_PAGEADDR);
+    bus.write(window.page0);
+    bus.write(window.page1);
+    bus.endTransmission();
+
+    uint8_t sent = 0; // in this transmission
+    for (uint8_t page = window.page0; page <= window.page1; page++)
+    {
+        const uint8_t *row = buffer + page * PANEL_WIDTH;
+        for (uint8_t column = window.x0; column <= window.x1; column++)
+        {
+            if (sent == 0)
+            {
+                bus.beginTransmission(address);
+                bus.write((uint8_t)SSD1306_CONTROL_DATA);
+            }
+            bus.write(row[column]);
+            if (++sent == OLED_CHUNK)
+            {
+                bus.endTransmission();
+                sent = 0;
+            }
+        }
+    }
+    if (sent > 0)
+    {
+        bus.endTransmission();
+    }
+}
+
+#endif
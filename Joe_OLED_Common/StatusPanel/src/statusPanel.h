@@ -0,0 +1,295 @@
+#ifndef STATUSPANEL_H
+#define STATUSPANEL_H
+
+// Retained-mode status panel for the 128x64 OLED (SSD1306, as on the Heltec boards)
+// Fields (a value at a fixed place on the screen) and labels are registered once; after that
+// the sketch only sets their values, and render() redraws just the fields whose text changed
+// into the display's frame buffer (through OLEDDisplay, without display()), and reports the
+// window of the buffer it touched, so only that window goes over I2C (see oledFlush.h)
+// instead of the whole 1 KB buffer.
+//   - values are formatted by the field's fixed format (a number with a fixed count of
+//     decimals, as String(value, decimals) prints it) into a stack buffer and kept as text,
+//     so an unchanged value costs a compare, not a String and a redraw
+//   - a changed field is blanked (fillRect() in BLACK) over the wider of its old and new
+//     text, then drawn again; any field whose box overlaps the blanked area is drawn again, too
+//   - text is drawn with drawString() in the panel's font, left aligned
+// Note: on the board this takes OLEDDisplay from heltec.h; natively, declare an OLEDDisplay
+// with the members used here before including it (examples/PanelCheck has one)
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#if defined(ARDUINO)
+#include <heltec.h> // OLEDDisplay
+#endif
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define PANEL_FONT_BYTE(address) pgm_read_byte(address)
+#else
+#define PANEL_FONT_BYTE(address) (*(const uint8_t *)(address))
+#endif
+
+#define PANEL_WIDTH 128  // pixels
+#define PANEL_HEIGHT 64  // pixels, 8 per page (buffer byte)
+#ifndef PANEL_FIELDS
+#define PANEL_FIELDS 16  // fields and labels (at most 32)
+#endif
+#define PANEL_TEXT 20    // characters per field, with the terminator
+#define PANEL_DECIMALS 6 // most decimals a field shows
+
+// the part of the frame buffer render() changed: columns x0 .. x1, pages page0 .. page1
+struct PanelWindow
+{
+    uint8_t x0, x1;
+    uint8_t page0, page1;
+    bool empty() const { return x0 > x1; }
+};
+
+/*------------------------------------------------------------------------------
+   StatusPanel -- labels and formatted values, redrawn only when they change
+  ------------------------------------------------------------------------------*/
+class StatusPanel
+{
+public:
+    StatusPanel()
+    {
+        _display = NULL;
+        _font = NULL;
+        _height = 0;
+        _count = 0;
+        clearWindow();
+    }
+
+    // display - Heltec.display; font - an OLEDDisplay font (ArialMT_Plain_10 ...)
+    void begin(OLEDDisplay *display, const uint8_t *font)
+    {
+        _display = display;
+        _font = font;
+        _height = PANEL_FONT_BYTE(font + 1);
+        _count = 0;
+        clearWindow();
+    }
+
+    // a value with its text's top left at (x, y), shown with decimals digits after the
+    // point; returns the field's id, or -1 when the panel is full
+    int8_t addField(uint8_t x, uint8_t y, uint8_t decimals = 0)
+    {
+        if (_count >= PANEL_FIELDS)
+        {
+            return -1;
+        }
+        Field &field = _fields[_count];
+        field.x = x;
+        field.y = y;
+        field.decimals = (decimals < PANEL_DECIMALS) ? decimals : PANEL_DECIMALS;
+        field.width = 0;
+        field.dirty = false;
+        field.text[0] = '\0';
+        return (int8_t)_count++;
+    }
+
+    // fixed text at (x, y), drawn by the next render()
+    int8_t addLabel(uint8_t x, uint8_t y, const char *text)
+    {
+        int8_t id = addField(x, y);
+        if (id >= 0)
+        {
+            setText(id, text);
+        }
+        return id;
+    }
+
+    void setText(int8_t id, const char *text)
+    {
+        if (id < 0 || id >= _count)
+        {
+            return;
+        }
+        Field &field = _fields[id];
+        if (strncmp(field.text, text, PANEL_TEXT - 1) == 0)
+        {
+            return; // unchanged: nothing to draw
+        }
+        uint8_t length = 0;
+        for (; length < PANEL_TEXT - 1 && text[length]; length++)
+        {
+            field.text[length] = text[length];
+        }
+        field.text[length] = '\0';
+        field.dirty = true;
+    }
+
+    void setValue(int8_t id, double value)
+    {
+        if (id < 0 || id >= _count)
+        {
+            return;
+        }
+        char text[PANEL_TEXT];
+        format(text, value, _fields[id].decimals);
+        setText(id, text);
+    }
+
+    // draws the fields that changed since the last render() into the frame buffer;
+    // returns true if anything did (then flush window())
+    bool render()
+    {
+        clearWindow();
+        if (_display == NULL)
+        {
+            return false;
+        }
+        _display->setFont(_font);
+        _display->setTextAlignment(TEXT_ALIGN_LEFT);
+        _display->setColor(BLACK);
+        uint32_t draw = 0;
+        for (uint8_t id = 0; id < _count; id++)
+        {
+            Field &field = _fields[id];
+            if (!field.dirty)
+            {
+                continue;
+            }
+            uint8_t width = textWidth(field.text);
+            uint8_t blank = (width > field.width) ? width : field.width;
+            if (blank > 0)
+            {
+                _display->fillRect(field.x, field.y, blank, _height);
+            }
+            addWindow(field.x, field.y, blank);
+            field.width = width;
+            field.dirty = false;
+            for (uint8_t other = 0; other < _count; other++)
+            {
+                if (other == id || overlaps(_fields[other], field.x, field.y, blank))
+                {
+                    draw |= 1UL << other; // (the blanking took some of its pixels)
+                }
+            }
+        }
+        _display->setColor(WHITE);
+        for (uint8_t id = 0; id < _count; id++)
+        {
+            if (draw & (1UL << id))
+            {
+                _display->drawString(_fields[id].x, _fields[id].y, _fields[id].text);
+            }
+        }
+        return !_window.empty();
+    }
+
+    const PanelWindow &window() const { return _window; }
+
+    // marks every field changed, so the next render() draws the whole panel again
+    void invalidate()
+    {
+        for (uint8_t id = 0; id < _count; id++)
+        {
+            _fields[id].dirty = true;
+        }
+    }
+
+    // the text's width in pixels, in the panel's font (set by render())
+    uint8_t textWidth(const char *text) const
+    {
+        uint16_t width = _display->getStringWidth(text, strlen(text));
+        return (width < PANEL_WIDTH) ? (uint8_t)width : PANEL_WIDTH;
+    }
+
+    // value as text, with decimals digits after the point ("nan", "ovf" when it doesn't fit)
+    static void format(char *text, double value, uint8_t decimals)
+    {
+        if (value != value)
+        {
+            strcpy(text, "nan");
+            return;
+        }
+        bool negative = value < 0;
+        double scaled = negative ? -value : value;
+        for (uint8_t i = 0; i < decimals; i++)
+        {
+            scaled *= 10;
+        }
+        if (scaled >= 1e15) // (and inf)
+        {
+            strcpy(text, negative ? "-ovf" : "ovf");
+            return;
+        }
+        uint64_t digits = (uint64_t)(scaled + 0.5);
+        negative = negative && digits > 0; // no "-0.00"
+        char reversed[PANEL_TEXT];
+        uint8_t length = 0;
+        for (uint8_t i = 0; i < decimals; i++)
+        {
+            reversed[length++] = '0' + digits % 10;
+            digits /= 10;
+        }
+        if (decimals > 0)
+        {
+            reversed[length++] = '.';
+        }
+        do
+        {
+            reversed[length++] = '0' + digits % 10;
+            digits /= 10;
+        } while (digits > 0);
+        if (negative)
+        {
+            reversed[length++] = '-';
+        }
+        for (uint8_t i = 0; i < length; i++)
+        {
+            text[i] = reversed[length - 1 - i];
+        }
+        text[length] = '\0';
+    }
+
+private:
+    struct Field
+    {
+        uint8_t x, y;
+        uint8_t decimals;
+        uint8_t width; // pixels of the text drawn now
+        bool dirty;    // text changed since it was drawn
+        char text[PANEL_TEXT];
+    };
+
+    bool overlaps(const Field &field, uint8_t x, uint8_t y, uint8_t width) const
+    {
+        return field.width > 0 && width > 0 &&
+               field.x < x + width && x < field.x + field.width &&
+               field.y < y + _height && y < field.y + _height;
+    }
+
+    void clearWindow()
+    {
+        _window.x0 = PANEL_WIDTH;
+        _window.x1 = 0;
+        _window.page0 = PANEL_HEIGHT / 8;
+        _window.page1 = 0;
+    }
+
+    void addWindow(uint8_t x, uint8_t y, uint8_t width)
+    {
+        if (width == 0 || x >= PANEL_WIDTH || y >= PANEL_HEIGHT)
+        {
+            return;
+        }
+        uint8_t x1 = (x + width - 1 < PANEL_WIDTH) ? x + width - 1 : PANEL_WIDTH - 1;
+        uint8_t y1 = (y + _height - 1 < PANEL_HEIGHT) ? y + _height - 1 : PANEL_HEIGHT - 1;
+        _window.x0 = (x < _window.x0) ? x : _window.x0;
+        _window.x1 = (x1 > _window.x1) ? x1 : _window.x1;
+        _window.page0 = ((y >> 3) < _window.page0) ? y >> 3 : _window.page0;
+        _window.page1 = ((y1 >> 3) > _window.page1) ? y1 >> 3 : _window.page1;
+    }
+
+    OLEDDisplay *_display;
+    const uint8_t *_font;
+    uint8_t _height; // font height, pixels
+    uint8_t _count;
+    Field _fields[PANEL_FIELDS];
+    PanelWindow _window;
+};
+
+#endif
@@ -0,0 +1,201 @@
+// ClockCheck -- check the layered clock face and its partial redraws against a brute-force face, on a PC
+// Sweeps all 43,200 seconds of a 12-hour dial (then random jumps, as after an NTP resync),
+// doing what the ESP32 sketch does every second: ClockLayers::setTime(), mark the dirty
+// ranges stale in all three frames, redraw the back frame's stale positions with
+// renderPositions(), and publish it; the photo-trigger swaps frames in at random (none,
+// one or several times a second).  Checks that
+//   - the composited face equals a face built from scratch: graduations, then the hour,
+//     minute and second hands on top, in that order
+//   - the dirty ranges are sorted, merged (no two touch), and hold exactly the positions
+//     a hand left or arrived at
+//   - every frame swapped in equals renderFrame() of the face at the time it was published
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -I../../src -I../../../../Joe_HDD_Multifunction_POV_ESP32_1_0/include ClockCheck.cpp -o clockcheck
+//   ./clockcheck
+
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include "clockFace.h"
+#include "frameBuffer.h"
+#include "frameQueue.h"
+
+#define DIAL_SECONDS (12L * 60 * 60) // 43,200
+#define JUMPS 20000                  // random time jumps after the sweep
+#define OFFSET 23                    // display rotation (as the sketch's offset)
+
+const uint64_t ALL_POSITIONS = (1ULL << CLOCK_POSITIONS) - 1;
+
+int failures = 0;
+void check(bool ok, const char *what)
+{
+    printf("  %-6s %s\n", ok ? "ok" : "FAILED", what);
+    failures += ok ? 0 : 1;
+}
+
+// the face built from scratch
+void bruteFace(uint8_t *face, int hours, int minutes, int seconds)
+{
+    for (int p = 0; p < CLOCK_POSITIONS; p++)
+    {
+        face[p] = graduationColor(p);
+    }
+    face[(hours % 12) * 5] = HOUR_COLOR;
+    face[minutes] = MINUTE_COLOR;
+    face[seconds] = SECOND_COLOR;
+}
+
+// positions whose hand coverage changed between two times (bit p = position p)
+uint64_t handMoves(const int *before, const int *after, bool first)
+{
+    uint64_t moved = 0;
+    for (int h = 0; h < 3; h++)
+    {
+        int from = (h == 0) ? (before[0] % 12) * 5 : before[h];
+        int to = (h == 0) ? (after[0] % 12) * 5 : after[h];
+        if (first || from != to)
+        {
+            moved |= (first ? 0 : 1ULL << from) | 1ULL << to;
+        }
+    }
+    return moved;
+}
+
+/*------------------------------------------------------------------------------
+   ClockRun -- the sketch's clock: layers, three frames with their stale positions,
+     and the photo-trigger end of the queue
+  ------------------------------------------------------------------------------*/
+template <uint16_t COLUMNS>
+struct ClockRun
+{
+    typedef PovFrame<COLUMNS> frame;
+
+    ClockLayers layers;
+    FrameQueue<frame> queue;
+    uint64_t stale[3];
+    long published[3]; // time each frame was last published at (-1: never)
+    int time[3];       // hours, minutes, seconds of the last setTime()
+    bool first;
+    long faceErrors, rangeErrors, frameErrors, swaps;
+
+    ClockRun()
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            stale[i] = ALL_POSITIONS;
+            published[i] = -1;
+            time[i] = 0;
+        }
+        first = true;
+        faceErrors = rangeErrors = frameErrors = swaps = 0;
+    }
+
+    // one second: calculateClockFace() and renderClockFace() of the sketch
+    void tick(long t)
+    {
+        int now[3] = {(int)(t / 3600 % 12), (int)(t / 60 % 60), (int)(t % 60)};
+        uint64_t moved = handMoves(time, now, first);
+        layers.setTime(now[0], now[1], now[2]);
+
+        uint8_t expected[CLOCK_POSITIONS];
+        bruteFace(expected, now[0], now[1], now[2]);
+        faceErrors += memcmp(expected, layers.face(), CLOCK_POSITIONS) ? 1 : 0;
+
+        uint64_t dirty = 0;
+        bool ok = true;
+        for (uint8_t i = 0; i < layers.dirtyCount(); i++)
+        {
+            const dirtyRange &range = layers.dirty(i);
+            ok = ok && range.first <= range.last;
+            ok = ok && (i == 0 || range.first > layers.dirty(i - 1).last + 1);
+            dirty |= ((1ULL << (range.last - range.first + 1)) - 1) << range.first;
+        }
+        rangeErrors += (ok && dirty == moved) ? 0 : 1;
+        for (int i = 0; i < 3; i++)
+        {
+            stale[i] |= dirty;
+            time[i] = now[i];
+        }
+        first = false;
+
+        frame &back = queue.back();
+        uint8_t index = queue.indexOf(back);
+        uint64_t &mask = stale[index];
+        int p = 0;
+        while (mask)
+        {
+            while (!(mask & (1ULL << p)))
+            {
+                p++;
+            }
+            int last = p;
+            while (last + 1 < CLOCK_POSITIONS && (mask & (1ULL << (last + 1))))
+            {
+                last++;
+            }
+            renderPositions(layers.face(), back, OFFSET, p, last);
+            mask &= ~(((1ULL << (last - p + 1)) - 1) << p);
+            p = last + 1;
+        }
+        published[index] = t;
+        queue.publish();
+    }
+
+    // photo-trigger: swap in the newest frame, which must be the face it was published at
+    void trigger()
+    {
+        if (!queue.swap())
+        {
+            return;
+        }
+        static frame expected;
+        const frame &front = queue.front();
+        long t = published[queue.indexOf(front)];
+        uint8_t face[CLOCK_POSITIONS];
+        bruteFace(face, t / 3600 % 12, t / 60 % 60, t % 60);
+        renderFrame(face, expected, OFFSET);
+        bool same = true;
+        for (uint16_t c = 0; c < COLUMNS; c++)
+        {
+            same = same && front.get(c) == expected.get(c);
+        }
+        frameErrors += same ? 0 : 1;
+        swaps++;
+    }
+};
+
+/*------------------------------------------------------------------------------
+   checkClock() -- the sweep and the jumps at COLUMNS columns
+  ------------------------------------------------------------------------------*/
+template <uint16_t COLUMNS>
+void checkClock(std::mt19937 &random)
+{
+    static ClockRun<COLUMNS> run;
+    char line[100];
+    printf("%d columns:\n", COLUMNS);
+    for (long t = 0; t < DIAL_SECONDS + JUMPS; t++)
+    {
+        run.tick((t < DIAL_SECONDS) ? t : (long)(random() % DIAL_SECONDS));
+        // revolutions per second are many, but the trigger may also miss a second or two
+        for (int swaps = random() % 4; swaps > 0; swaps--)
+        {
+            run.trigger();
+        }
+    }
+    snprintf(line, sizeof(line), "%ld sweep + %d random times: %ld faces wrong", DIAL_SECONDS, JUMPS, run.faceErrors);
+    check(run.faceErrors == 0, line);
+    snprintf(line, sizeof(line), "dirty ranges: %ld seconds wrong", run.rangeErrors);
+    check(run.rangeErrors == 0, line);
+    snprintf(line, sizeof(line), "%ld frames swapped in: %ld wrong", run.swaps, run.frameErrors);
+    check(run.frameErrors == 0, line);
+}
+
+int main()
+{
+    std::mt19937 random(1);
+    checkClock<60>(random);
+    checkClock<240>(random);
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+// FrameCheck -- check the rendered POV frames against the sketch's old indexing, on a PC
+// The ESP32 sketch used to light each slot with
+//     GPIO.out_w1ts = ClockFace[59 - ((offset + clockPosition) % 60)] << RED_LED
+// and clear the LEDs 1/3 slot later.  For every offset (0-119) and random clock faces this
+// renders the face with renderFrame() and plays each column through the ESP32 sketch's
+// PovOutput (LEDs from RED_LED up, on a RAM port standing in for GPIO), and checks that
+//   - every slot lights exactly the old word, and leaves the port's other bits alone
+//   - at 60 columns every column is thin (off at 1/3 slot, as delayMicroseconds(intervalOn));
+//     at 120 a position is its first column, thin; at 240/360 the first third of its columns
+//   - frames handed from the renderer to the slot engine through FrameQueue never tear:
+//     the renderer writes a column at a time, the photo-trigger swaps at random moments
+//     (more often than a render takes, then less often, so renders get dropped), and every
+//     frame swapped in is one whole render, the newest published
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -I../../src -I../../../../Joe_HDD_Multifunction_POV_ESP32_1_0/include FrameCheck.cpp -o framecheck
+//   ./framecheck
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+#include "frameBuffer.h"
+#include "povOutput.h"
+#include "frameQueue.h"
+
+#define RED_LED 17              // as the ESP32 sketch: LEDs on gpio 17, 18, 19
+#define OTHER_BITS 0xf0f0000fUL // port bits that aren't LEDs (must survive every write)
+#define FACES 200               // random faces per offset
+
+typedef ConsecutiveRgb<uint32_t, RED_LED> ledColor;
+typedef MemoryPort<uint32_t> gpioPort;
+typedef PovOutput<ledColor, gpioPort> ledOutput;
+
+int failures = 0;
+void check(bool ok, const char *what)
+{
+    printf("  %-6s %s\n", ok ? "ok" : "FAILED", what);
+    failures += ok ? 0 : 1;
+}
+
+// the old per-slot word
+uint32_t oldWord(const uint8_t *face, int offset, int clockPosition)
+{
+    return (uint32_t)face[59 - ((offset + clockPosition) % 60)] << RED_LED;
+}
+
+/*------------------------------------------------------------------------------
+   checkColumns() -- render random faces at every offset into COLUMNS columns, and
+     compare each position's columns with the old word
+   returns the number of mismatched columns
+  ------------------------------------------------------------------------------*/
+template <uint16_t COLUMNS>
+long checkColumns(std::mt19937 &random)
+{
+    static PovFrame<COLUMNS> frame;
+    const uint16_t perPosition = COLUMNS / CLOCK_POSITIONS;
+    const bool thin = (perPosition / 3 == 0);
+    const uint16_t lit = thin ? 1 : perPosition / 3;
+    uint8_t face[CLOCK_POSITIONS];
+    long wrong = 0;
+    for (int offset = 0; offset < 2 * CLOCK_POSITIONS; offset++)
+    {
+        for (int f = 0; f < FACES; f++)
+        {
+            for (int p = 0; p < CLOCK_POSITIONS; p++)
+            {
+                face[p] = random() & 0b111;
+            }
+            renderFrame(face, frame, offset);
+            for (uint16_t c = 0; c < COLUMNS; c++)
+            {
+                int position = c / perPosition;
+                uint8_t column = frame.get(c);
+                uint32_t expected = (c % perPosition < lit) ? oldWord(face, offset, position) : 0;
+
+                gpioPort::value = OTHER_BITS | ledColor::mask; // last slot lit white
+                ledOutput::on(column);
+                bool ok = gpioPort::value == (OTHER_BITS | expected);
+                ok = ok && (ledOutput::thin(column) == thin);
+                ledOutput::off();
+                ok = ok && gpioPort::value == OTHER_BITS;
+                wrong += ok ? 0 : 1;
+            }
+        }
+    }
+    return wrong;
+}
+
+/*------------------------------------------------------------------------------
+   checkQueue() -- renderer and photo-trigger interleaved at random; true if no
+     swapped-in frame was torn or went back in time
+  ------------------------------------------------------------------------------*/
+bool checkQueue(std::mt19937 &random, long &swaps)
+{
+    typedef PovFrame<CLOCK_POSITIONS> frame;
+    static FrameQueue<frame> queue;
+    uint8_t face[CLOCK_POSITIONS];
+    int rendering = 0, rendered = -1, shown = -1;
+    int column = 0;
+    bool ok = true;
+    swaps = 0;
+    while (rendering < 20000)
+    {
+        // the trigger comes more often than a render takes, and less often, by turns
+        if (random() % (((rendering / 1000) % 2) ? 400 : 4))
+        {
+            // renderer: face number n is (n + p) % 8 at position p; a column at a time
+            if (column == 0)
+            {
+                for (int p = 0; p < CLOCK_POSITIONS; p++)
+                {
+                    face[p] = (rendering + p) % 8;
+                }
+            }
+            renderPosition(queue.back(), face[column], column);
+            if (++column == CLOCK_POSITIONS)
+            {
+                queue.publish();
+                rendered = rendering++;
+                column = 0;
+            }
+        }
+        else if (queue.swap())
+        {
+            // photo-trigger: the frame swapped in must be one whole render, and the newest
+            const frame &front = queue.front();
+            int number = front.get(0) & 0b111;
+            for (int p = 1; p < CLOCK_POSITIONS; p++)
+            {
+                ok = ok && (front.get(p) & 0b111) == (number + p) % 8;
+            }
+            ok = ok && number == rendered % 8 && rendered > shown;
+            shown = rendered;
+            swaps++;
+        }
+    }
+    return ok;
+}
+
+int main()
+{
+    std::mt19937 random(1);
+    char line[100];
+    printf("old indexing vs renderFrame(), offsets 0-%d, %d random faces each:\n", 2 * CLOCK_POSITIONS - 1, FACES);
+    long wrong = checkColumns<60>(random);
+    snprintf(line, sizeof(line), "60 columns: %ld wrong", wrong);
+    check(wrong == 0, line);
+    wrong = checkColumns<120>(random);
+    snprintf(line, sizeof(line), "120 columns: %ld wrong", wrong);
+    check(wrong == 0, line);
+    wrong = checkColumns<240>(random);
+    snprintf(line, sizeof(line), "240 columns: %ld wrong", wrong);
+    check(wrong == 0, line);
+    wrong = checkColumns<360>(random);
+    snprintf(line, sizeof(line), "360 columns: %ld wrong", wrong);
+    check(wrong == 0, line);
+
+    printf("frame hand-over (FrameQueue):\n");
+    long swaps;
+    bool ok = checkQueue(random, swaps);
+    snprintf(line, sizeof(line), "20000 renders, %ld swapped in: none torn or stale", swaps);
+    check(ok, line);
+
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
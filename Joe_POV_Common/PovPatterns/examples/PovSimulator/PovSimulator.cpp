@@ -0,0 +1,557 @@
+// PovSimulator -- play the POV patterns on a simulated spinning disk, on a PC
+// Runs the ESP32 slot engine against a simulated timer: photo-trigger timestamps (with
+// jitter) feed PeriodTracker, and the same SlotEngine that trigger() and onSlotTimer() use
+// (slotEngine.h) places each edge on 1 us timer ticks; the simulated ISRs fire at those
+// ticks plus a random latency, read the timer as the sketch does, and drive the LEDs
+// through PovOutput with a MemoryPort.  The angle the slot is really at when each on-edge
+// lands is compared with where that column belongs.
+// The disk is either synthetic (--period, with --jitter, --wobble and a --ramp as it spins
+// up or slows down) or a recorded stream of trigger timestamps (--triggers: us, one per
+// line); a recording's true revolution starts are taken from a parabola fitted through
+// the triggers around each one (so a disk that speeds up or slows down is followed).
+// --isr-us gives each ISR a run time: an edge due while the one before is still running
+// waits for it, and an edge whose time has passed by the time it is scheduled is late (the
+// engine fires it at the next tick).  The load report counts late edges and the columns
+// never lit before the next trigger; sweep.sh builds the simulator for more and more
+// columns to find how many the engine sustains at a given period.
+// --estimator picks how the slot engine gets the period: "pll", PeriodTracker as the sketch
+// does now, or "delta", recalibrate() as it was (the last raw trigger-to-trigger time, slot
+// 0 at the raw trigger), on the same engine; "both" replays the disk through each.
+// Prints the angular error per column (degrees) and writes the persistence-of-vision
+// image (all simulated revolutions averaged) as a polar PPM.
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -I../../src PovSimulator.cpp -o povsim
+//   ./povsim --pattern clock --period 21500 --jitter 20 --revs 500 --image clock.ppm
+//   ./povsim --estimator both --jitter 30 --ramp -20 -v
+// add -DPOV_COLUMNS=360 to simulate another angular resolution
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <random>
+#include <vector>
+#include "frameBuffer.h"
+#include "patterns.h"
+#include "clockFace.h"
+#include "periodTracker.h"
+#include "slotEngine.h"
+#include "povOutput.h"
+
+#ifndef POV_COLUMNS
+#define POV_COLUMNS 60
+#endif
+
+#define IMAGE_SIZE 401    // pixels, square
+#define ANGLE_BINS 3600   // 0.1 degree resolution of the persistence image
+#define CLOCK_OFFSET 5    // as in the ESP32 sketch
+#define REPLAY_FIT 8      // recorded triggers: fit the true starts over this many each side
+
+typedef PovFrame<POV_COLUMNS> povFrame;
+typedef SlotEngine<POV_COLUMNS> slotEngine;
+typedef MemoryPort<uint8_t> simPort;
+typedef PovOutput<ConsecutiveRgb<uint8_t, 0>, simPort> simOutput;
+
+// simulation settings (command line)
+struct settings
+{
+    const char *pattern;   // clock, radar, redblack, colors, checkers, fan
+    double period;         // us per revolution
+    double jitter;         // us; std deviation of the photo-trigger timestamp
+    double wobble;         // fraction; disk speed varies +/- this much ...
+    double wobbleRevs;     // ... over this many revolutions
+    double ramp;           // fraction; disk speed changes this much over the run
+    double latency;        // us; slot timer ISR latency, uniform 0..latency
+    double isrUs;          // us; run time of each ISR (0 = instant)
+    int revolutions;
+    int bands;             // checkers: number of bands
+    unsigned seed;
+    const char *image;     // PPM file name, or NULL
+    const char *triggers;  // recorded trigger timestamps file, or NULL
+    const char *estimator; // pll, delta, both
+    bool verbose;          // per-column table
+};
+
+// slot engine load
+struct engineLoad
+{
+    long edges;  // ISRs (trigger and slot timer)
+    long late;   // edges scheduled after their time had passed
+    long lost;   // columns not lit before the next trigger
+    double busy; // us in ISRs
+    int revolutions;
+};
+
+// the spinning disk
+struct disk
+{
+    std::vector<double> start;   // us; true time the slot passes the photo-trigger
+    std::vector<double> period;  // us; true period of each revolution
+    std::vector<double> trigger; // us; photo-trigger timestamp
+};
+
+// per-column angular error statistics
+struct columnError
+{
+    double sum;
+    double sumSquares;
+    double max; // largest |error|
+    int count;
+};
+
+/*------------------------------------------------------------------------------
+   produce() -- produce the frame for one revolution, as the sketch's loop_fn_* would
+     micros - simulated time at the photo-trigger
+  ------------------------------------------------------------------------------*/
+void produce(const settings &s, povFrame &frame, ClockLayers &clock, double micros)
+{
+    uint16_t sweep = (uint16_t)(fmod(micros / 1000.0, 5000.0) * POV_COLUMNS / 5000.0);
+    if (!strcmp(s.pattern, "clock"))
+    {
+        long seconds = 10 * 3600 + 8 * 60 + (long)(micros / 1000000.0); // starts at 10:08:00
+        clock.setTime((seconds / 3600) % 12, (seconds / 60) % 60, seconds % 60);
+        renderFrame(clock.face(), frame, CLOCK_OFFSET);
+    }
+    else if (!strcmp(s.pattern, "radar"))
+        produceRadar(frame, sweep, RED);
+    else if (!strcmp(s.pattern, "redblack"))
+        produceBands(frame, 8, redBlack, 2);
+    else if (!strcmp(s.pattern, "colors"))
+        produceBands(frame, 8, allColors, 8);
+    else if (!strcmp(s.pattern, "checkers"))
+        produceBands(frame, s.bands, allColors, 8);
+    else if (!strcmp(s.pattern, "fan"))
+        produceFan(frame, sweep, RED);
+    else
+    {
+        fprintf(stderr, "unknown pattern: %s\n", s.pattern);
+        exit(1);
+    }
+}
+
+/*------------------------------------------------------------------------------
+   light() -- add the light of one lit interval (degrees from the trigger) to the image bins
+  ------------------------------------------------------------------------------*/
+void light(std::vector<float> *bins, uint8_t port, double fromDegrees, double toDegrees)
+{
+    int first = (int)floor(fromDegrees * ANGLE_BINS / 360.0);
+    int last = (int)floor(toDegrees * ANGLE_BINS / 360.0);
+    for (int b = first; b < last; b++)
+    {
+        int bin = ((b % ANGLE_BINS) + ANGLE_BINS) % ANGLE_BINS;
+        for (int led = 0; led < 3; led++)
+        {
+            if (port & (1 << led))
+            {
+                bins[led][bin] += 1.0f;
+            }
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+   writeImage() -- polar PPM: angle 0 (photo-trigger) at 12 o'clock, increasing clockwise
+  ------------------------------------------------------------------------------*/
+bool writeImage(const char *name, std::vector<float> *bins, int revolutions)
+{
+    FILE *file = fopen(name, "wb");
+    if (!file)
+    {
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", IMAGE_SIZE, IMAGE_SIZE);
+    const double center = IMAGE_SIZE / 2.0;
+    for (int y = 0; y < IMAGE_SIZE; y++)
+    {
+        for (int x = 0; x < IMAGE_SIZE; x++)
+        {
+            double dx = x - center, dy = center - y;
+            double radius = sqrt(dx * dx + dy * dy) / center;
+            unsigned char rgb[3] = {24, 24, 24}; // disk
+            if (radius > 1.0)
+            {
+                rgb[0] = rgb[1] = rgb[2] = 0;
+            }
+            else if (radius > 0.55 && radius < 0.95) // the slot's sweep
+            {
+                double degrees = atan2(dx, dy) * 180.0 / M_PI;
+                int bin = (int)((degrees < 0 ? degrees + 360.0 : degrees) * ANGLE_BINS / 360.0) % ANGLE_BINS;
+                for (int led = 0; led < 3; led++)
+                {
+                    // a bin lit for its whole width every revolution is full brightness
+                    double level = bins[led][bin] / revolutions;
+                    rgb[led] = (unsigned char)(24 + 231 * (level > 1.0 ? 1.0 : level));
+                }
+            }
+            fwrite(rgb, 1, 3, file);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+/*------------------------------------------------------------------------------
+   parse() -- command line to settings
+  ------------------------------------------------------------------------------*/
+settings parse(int argc, char **argv)
+{
+    settings s = {"clock", 21500, 20, 0.0, 200, 0.0, 5, 0.0, 500, 12, 1, NULL, NULL, "pll", false};
+    for (int i = 1; i < argc; i++)
+    {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : "";
+        if (!strcmp(argv[i], "--pattern"))
+            s.pattern = value, i++;
+        else if (!strcmp(argv[i], "--period"))
+            s.period = atof(value), i++;
+        else if (!strcmp(argv[i], "--jitter"))
+            s.jitter = atof(value), i++;
+        else if (!strcmp(argv[i], "--wobble"))
+            s.wobble = atof(value) / 100.0, i++;
+        else if (!strcmp(argv[i], "--wobble-revs"))
+            s.wobbleRevs = atof(value), i++;
+        else if (!strcmp(argv[i], "--ramp"))
+            s.ramp = atof(value) / 100.0, i++;
+        else if (!strcmp(argv[i], "--latency"))
+            s.latency = atof(value), i++;
+        else if (!strcmp(argv[i], "--isr-us"))
+            s.isrUs = atof(value), i++;
+        else if (!strcmp(argv[i], "--revs"))
+            s.revolutions = atoi(value), i++;
+        else if (!strcmp(argv[i], "--bands"))
+            s.bands = atoi(value), i++;
+        else if (!strcmp(argv[i], "--seed"))
+            s.seed = (unsigned)atoi(value), i++;
+        else if (!strcmp(argv[i], "--image"))
+            s.image = value, i++;
+        else if (!strcmp(argv[i], "--triggers"))
+            s.triggers = value, i++;
+        else if (!strcmp(argv[i], "--estimator"))
+            s.estimator = value, i++;
+        else if (!strcmp(argv[i], "-v"))
+            s.verbose = true;
+        else
+        {
+            printf("usage: %s [--pattern clock|radar|redblack|colors|checkers|fan] [--period us]\n"
+                   "       [--jitter us] [--wobble %%] [--wobble-revs n] [--ramp %%] [--triggers file]\n"
+                   "       [--estimator pll|delta|both] [--latency us] [--isr-us us] [--revs n] [--bands n]\n"
+                   "       [--seed n] [--image file.ppm] [-v]\n",
+                   argv[0]);
+            exit(1);
+        }
+    }
+    if (s.revolutions < 2)
+    {
+        s.revolutions = 2;
+    }
+    if (strcmp(s.estimator, "pll") && strcmp(s.estimator, "delta") && strcmp(s.estimator, "both"))
+    {
+        fprintf(stderr, "unknown estimator: %s\n", s.estimator);
+        exit(1);
+    }
+    return s;
+}
+
+/*------------------------------------------------------------------------------
+   spin() -- a synthetic disk: the settings' period, wobble, ramp and trigger jitter
+  ------------------------------------------------------------------------------*/
+disk spin(const settings &s)
+{
+    std::mt19937 random(s.seed);
+    std::normal_distribution<double> triggerNoise(0.0, s.jitter > 0 ? s.jitter : 1e-9);
+    disk d;
+    double start = 0;
+    for (int rev = 0; rev <= s.revolutions; rev++)
+    {
+        // this revolution's true period (constant within the revolution)
+        double speed = (1.0 + s.ramp * rev / s.revolutions) * (1.0 + s.wobble * sin(2.0 * M_PI * rev / s.wobbleRevs));
+        d.start.push_back(start);
+        d.period.push_back(s.period / speed);
+        d.trigger.push_back(start + triggerNoise(random));
+        start += d.period.back();
+    }
+    return d;
+}
+
+// determinant of the 3x3 matrix m, with column c replaced by column with (c < 0: none)
+double determinant(const double m[3][4], int c, int with)
+{
+    double a[3][3];
+    for (int r = 0; r < 3; r++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            a[r][k] = m[r][(k == c) ? with : k];
+        }
+    }
+    return a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) - a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) +
+           a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+}
+
+/*------------------------------------------------------------------------------
+   replay() -- a recorded disk: trigger timestamps (us, unwrapped), one per line
+   each true start (and period) is a least-squares parabola through the REPLAY_FIT
+   triggers each side of it, evaluated at the trigger
+  ------------------------------------------------------------------------------*/
+bool replay(const char *name, disk &d)
+{
+    FILE *file = fopen(name, "r");
+    if (!file)
+    {
+        return false;
+    }
+    double t;
+    while (fscanf(file, "%lf", &t) == 1)
+    {
+        d.trigger.push_back(t);
+    }
+    fclose(file);
+    int n = (int)d.trigger.size();
+    for (int i = 0; i < n; i++)
+    {
+        // trigger[i + x] = a + b x + c x^2: normal equations, by Cramer's rule
+        double m[3][4] = {{0}};
+        for (int k = (i > REPLAY_FIT) ? i - REPLAY_FIT : 0; k < n && k <= i + REPLAY_FIT; k++)
+        {
+            double x = k - i, power[3] = {1, x, x * x};
+            for (int r = 0; r < 3; r++)
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    m[r][c] += power[r] * power[c];
+                }
+                m[r][3] += power[r] * (d.trigger[k] - d.trigger[i]);
+            }
+        }
+        double coefficient[3];
+        double det = determinant(m, -1, 0);
+        for (int c = 0; c < 3; c++)
+        {
+            coefficient[c] = determinant(m, c, 3) / det;
+        }
+        d.start.push_back(d.trigger[i] + coefficient[0]);
+        d.period.push_back(coefficient[1] + coefficient[2]); // x = 0 to 1
+    }
+    return n >= 3;
+}
+
+/*------------------------------------------------------------------------------
+   simulate() -- play the pattern on the disk, the engine's period from PeriodTracker
+     (pll) or from recalibrate() as it was; adds to the image bins, column errors and
+     engine load
+   returns the number of revolutions measured (after the spin-up, once locked)
+  ------------------------------------------------------------------------------*/
+int simulate(const settings &s, const disk &d, bool pll, std::vector<float> *bins,
+             std::vector<columnError> &errors, engineLoad &load, PeriodTracker &tracker)
+{
+    std::mt19937 random(s.seed + 1); // the same ISR latencies for either estimator
+    std::uniform_real_distribution<double> isrLatency(0.0, s.latency);
+    static povFrame frame;
+    static slotEngine engine;
+    ClockLayers clock;
+    uint64_t periodMicros = (uint64_t)d.period[0]; // recalibrate(): the last raw delta
+    uint32_t lastTrigger = 0;
+
+    int revolutions = (int)d.trigger.size() - 1;
+    double lastChange = 0; // us; when the LEDs last changed
+    double busyUntil = 0;  // us; the ISR running now returns
+    int measured = 0;
+    for (int rev = 0; rev < revolutions; rev++)
+    {
+        double revolutionStart = d.start[rev], period = d.period[rev], nextTrigger = d.trigger[rev + 1];
+        bool stats = (!pll || tracker.locked()) && rev >= revolutions / 10; // skip the spin-up
+
+        // the LEDs' light since they last changed, up to t (us)
+        auto lightUntil = [&](double t) {
+            light(bins, simPort::value, (lastChange - revolutionStart) * 360.0 / period,
+                  (t - revolutionStart) * 360.0 / period);
+            lastChange = t;
+        };
+
+        // an ISR entered at t (us), once the one before has returned
+        auto enter = [&](double t) {
+            t = (t > busyUntil) ? t : busyUntil;
+            busyUntil = t + s.isrUs;
+            load.edges += stats ? 1 : 0;
+            load.busy += stats ? s.isrUs : 0;
+            return t;
+        };
+
+        // scheduleEdge(): the alarm for an edge at tickQ, the timer reading now
+        auto schedule = [&](int64_t tickQ, uint64_t now) {
+            load.late += (stats && (tickQ >> PERIOD_FRAC_BITS) <= (int64_t)now) ? 1 : 0;
+            return slotEngine::alarmTick(tickQ, now);
+        };
+
+        // slotOnEdge(), at t (us): light the column, returns the alarm for its next edge
+        double entered = enter(d.trigger[rev]);
+        uint32_t timestamp = (uint32_t)llround(entered);
+        int lit = 0;
+        auto onEdge = [&](double t) {
+            uint8_t value = frame.get(engine.slot());
+            lit++;
+            lightUntil(t);
+            simOutput::on(value);
+            if (stats)
+            {
+                double error = (t - revolutionStart) * 360.0 / period - engine.slot() * 360.0 / POV_COLUMNS;
+                columnError &e = errors[engine.slot()];
+                e.sum += error;
+                e.sumSquares += error * error;
+                e.max = (fabs(error) > e.max) ? fabs(error) : e.max;
+                e.count++;
+            }
+            return schedule(engine.onEdge(simOutput::thin(value)), (uint64_t)(t - timestamp));
+        };
+
+        // trigger(): timestamp (1 us micros()), period, timer restarted at 0, column 0 lit
+        if (pll)
+        {
+            int32_t late = tracker.update(timestamp);
+            engine.start(tracker.period(), late);
+        }
+        else
+        {
+            // recalibrate() as it was: the raw delta (unless it's off by 40 ms), from the raw edge
+            uint32_t delta = timestamp - lastTrigger;
+            lastTrigger = timestamp;
+            if (rev > 0 && ((periodMicros > delta) ? periodMicros - delta : delta - periodMicros) < 40000)
+            {
+                periodMicros = delta;
+            }
+            engine.start((uint32_t)(periodMicros << PERIOD_FRAC_BITS), 0);
+        }
+        produce(s, frame, clock, d.trigger[rev]);
+        uint64_t alarm = onEdge(entered);
+
+        // onSlotTimer(): each alarm fires late by the ISR latency, until the end of the
+        // revolution or the next trigger (which restarts the engine), whichever comes first
+        for (;;)
+        {
+            double t = timestamp + alarm + isrLatency(random);
+            if (t >= nextTrigger || busyUntil >= nextTrigger)
+            {
+                break;
+            }
+            t = enter(t);
+            if (engine.offEdgeDue())
+            {
+                lightUntil(t);
+                simOutput::off();
+                alarm = schedule(engine.offEdge(), (uint64_t)(t - timestamp));
+            }
+            else if (engine.nextSlot())
+            {
+                alarm = onEdge(t);
+            }
+            else
+            {
+                lightUntil(t);
+                simOutput::off();
+                break;
+            }
+        }
+        measured += stats ? 1 : 0;
+        load.lost += stats ? POV_COLUMNS - lit : 0;
+        load.revolutions += stats ? 1 : 0;
+        lightUntil(nextTrigger);
+    }
+    return measured;
+}
+
+/*------------------------------------------------------------------------------
+   report() -- angular error summary (and per column, if verbose) of one estimator
+  ------------------------------------------------------------------------------*/
+void report(const settings &s, const char *name, const std::vector<columnError> &errors)
+{
+    double sum = 0, sumSquares = 0, max = 0;
+    int count = 0;
+    for (int c = 0; c < POV_COLUMNS; c++)
+    {
+        const columnError &e = errors[c];
+        if (s.verbose && e.count)
+        {
+            printf("%s column %3d: mean %+7.3f, rms %6.3f, max %6.3f degrees\n",
+                   name, c, e.sum / e.count, sqrt(e.sumSquares / e.count), e.max);
+        }
+        sum += e.sum;
+        sumSquares += e.sumSquares;
+        max = (e.max > max) ? e.max : max;
+        count += e.count;
+    }
+    if (count)
+    {
+        printf("%s angular error: mean %+.3f, rms %.3f, max %.3f degrees (one column = %.3f degrees)\n",
+               name, sum / count, sqrt(sumSquares / count), max, 360.0 / POV_COLUMNS);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    settings s = parse(argc, argv);
+    disk d;
+    if (s.triggers)
+    {
+        if (!replay(s.triggers, d))
+        {
+            fprintf(stderr, "can't read trigger timestamps from %s\n", s.triggers);
+            return 1;
+        }
+        s.period = d.period[0];
+        s.revolutions = (int)d.trigger.size() - 1;
+        printf("pattern %s, %d columns, %d recorded triggers from %s, ISR latency 0-%.1f us, ISRs %.1f us\n",
+               s.pattern, POV_COLUMNS, (int)d.trigger.size(), s.triggers, s.latency, s.isrUs);
+    }
+    else
+    {
+        d = spin(s);
+        printf("pattern %s, %d columns, period %.0f us, trigger jitter %.1f us, wobble %.1f%%, ramp %+.1f%%,\n"
+               "ISR latency 0-%.1f us, ISRs %.1f us\n",
+               s.pattern, POV_COLUMNS, s.period, s.jitter, s.wobble * 100.0, s.ramp * 100.0, s.latency, s.isrUs);
+    }
+
+    std::vector<float> bins[3];
+    for (int e = 0; e < 2; e++)
+    {
+        bool pll = (e == 0);
+        if (strcmp(s.estimator, "both") && strcmp(s.estimator, pll ? "pll" : "delta"))
+        {
+            continue;
+        }
+        for (int led = 0; led < 3; led++)
+        {
+            bins[led].assign(ANGLE_BINS, 0.0f); // the image is of the last estimator run
+        }
+        std::vector<columnError> errors(POV_COLUMNS);
+        memset(&errors[0], 0, POV_COLUMNS * sizeof(columnError));
+        PeriodTracker tracker((uint32_t)s.period);
+        engineLoad load = {0, 0, 0, 0.0, 0};
+        int measured = simulate(s, d, pll, bins, errors, load, tracker);
+        if (pll)
+        {
+            printf("pll: tracker %s, period %.2f us; %d of %d revolutions measured\n",
+                   tracker.locked() ? "locked" : "acquiring", tracker.period() / 256.0, measured, s.revolutions);
+        }
+        else
+        {
+            printf("delta: %d of %d revolutions measured\n", measured, s.revolutions);
+        }
+        report(s, pll ? "pll" : "delta", errors);
+        if (load.revolutions)
+        {
+            printf("%s engine load: %.1f edges/rev, %.3f%% late, %.2f columns lost/rev, ISRs busy %.1f%%\n",
+                   pll ? "pll" : "delta", (double)load.edges / load.revolutions, 100.0 * load.late / load.edges,
+                   (double)load.lost / load.revolutions, 100.0 * load.busy / (load.revolutions * s.period));
+        }
+    }
+    if (s.image)
+    {
+        if (!writeImage(s.image, bins, s.revolutions))
+        {
+            fprintf(stderr, "can't write %s\n", s.image);
+            return 1;
+        }
+        printf("image: %s\n", s.image);
+    }
+    return 0;
+}
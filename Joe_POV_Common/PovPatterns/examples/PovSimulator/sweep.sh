@@ -0,0 +1,33 @@
+#!/bin/sh
+# sweep.sh -- how many columns the ESP32 slot engine sustains at a disk period
+# Builds PovSimulator for each column count (-DPOV_COLUMNS) and plays the colors pattern
+# (a column edge every column) with ISRs that take --isr-us to run; a column count is
+# sustained when no edge is late and no column is lost.  Measure the ISR time on the
+# board (POV_TRACE busy time / edges in printDiagnostics()) and pass it in.  Trigger
+# jitter is off by default: a late trigger also makes the first columns late, and an
+# early one cuts off the last, once the slots are narrower than the jitter.
+#
+# usage (from this directory): ./sweep.sh [period us] [ISR us] [ISR latency us] [jitter us]
+#   ./sweep.sh 21500 2.5 5
+
+period=${1:-21500}
+isr=${2:-2.5}
+latency=${3:-5}
+jitter=${4:-0}
+build=${TMPDIR:-/tmp}/povsim_sweep
+mkdir -p "$build" || exit 1
+
+echo "period $period us, ISRs $isr us, ISR latency 0-$latency us, trigger jitter $jitter us"
+echo "columns  slot us  edges/rev  late %  lost/rev  ISRs busy %"
+sustained=0
+for columns in 60 120 240 360 480 720 960 1440 1920 2880 3600 4800 7200; do
+    g++ -std=gnu++11 -O2 -DPOV_COLUMNS=$columns -I../../src PovSimulator.cpp -o "$build/povsim_$columns" || exit 1
+    load=$("$build/povsim_$columns" --pattern colors --period "$period" --isr-us "$isr" --latency "$latency" --jitter "$jitter" --revs 200 |
+        sed -n 's/.*engine load: \([0-9.]*\) edges\/rev, \([0-9.]*\)% late, \([0-9.]*\) columns lost\/rev, ISRs busy \([0-9.]*\)%.*/\1 \2 \3 \4/p')
+    set -- $load
+    echo "$columns $period $1 $2 $3 $4" | awk '{ printf "%7d  %7.1f  %9.1f  %6.3f  %8.2f  %11.1f\n", $1, $2 / $1, $3, $4, $5, $6 }'
+    if [ "$2" = "0.000" ] && [ "$3" = "0.00" ]; then
+        sustained=$columns
+    fi
+done
+echo "most columns sustained: $sustained"
@@ -0,0 +1,382 @@
+// SlotBench -- old busy-wait POV loop vs the timer-ISR slot engine, on a simulated core
+// Plays the clock face through both ways the ESP32 sketch has driven the LEDs, on one
+// simulated CPU (cycle counts at --mhz) that also runs other task work (Serial, the clock
+// face update, WiFi; bursts of --load-us, --load-every us apart on average):
+//   old - loop_fn_clock() as it was: the photo-trigger and an auto-reloading slot timer
+//         (slotWidth = period / 60, free running from the pattern's start) only raise
+//         flags; the loop polls them (--poll-cycles a pass), lights the position and
+//         busy-waits delayMicroseconds(intervalOn).  Other task work holds the loop off.
+//   new - trigger() and onSlotTimer() driving the same SlotEngine and PeriodTracker as the
+//         sketch (slotEngine.h, periodTracker.h): each edge is an ISR that preempts the
+//         task work, entered --isr-cycles after its alarm (plus up to --isr-jitter us for
+//         other interrupts).
+// Reports, per path, each slot's edge error against the slot's true position (us; mean,
+// rms, 99th percentile, max), slot positions lost, and the CPU cycles per revolution the
+// display takes, and the latency from the alarm (new; what printDiagnostics() reports on
+// target) or the flag going up (old) to the LED write.  The cycle costs are settings, not measurements: set them from the
+// board (printDiagnostics() latency, POV_TRACE busy time) to compare a real load.
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -I../../src SlotBench.cpp -o slotbench
+//   ./slotbench --load-us 300 --load-every 3000 -v
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+#include "frameBuffer.h"
+#include "clockFace.h"
+#include "periodTracker.h"
+#include "slotEngine.h"
+
+#define CLOCK_OFFSET 5 // as in the ESP32 sketch
+
+typedef SlotEngine<CLOCK_POSITIONS> slotEngine;
+
+// simulation settings (command line)
+struct settings
+{
+    double period = 21500;  // us per revolution
+    double jitter = 0;      // us; std deviation of the photo-trigger
+    int revolutions = 500;
+    double mhz = 240;       // CPU clock
+    int pollCycles = 100;   // old: one pass of the polling loop
+    int isrCycles = 500;    // new: interrupt entry to the LED write, and the rest of the ISR
+    double isrJitter = 1;   // us; new: other interrupts, uniform 0..isrJitter
+    double loadUs = 200;    // other task work: burst length ...
+    double loadEvery = 2000; // ... and mean time between bursts (0 = no load)
+    unsigned seed = 1;
+    bool verbose = false;   // per-slot table
+};
+
+// edge errors of one path
+struct pathStats
+{
+    std::vector<double> error; // us, every slot of every revolution
+    std::vector<double> slotSum, slotMax;
+    std::vector<int> slotCount;
+    std::vector<double> latency; // alarm (new) or flag (old) to the LED write (us)
+    long lost = 0;               // positions never lit
+    double busyCycles = 0;       // display work
+
+    pathStats() : slotSum(CLOCK_POSITIONS, 0), slotMax(CLOCK_POSITIONS, 0), slotCount(CLOCK_POSITIONS, 0) {}
+
+    void add(int slot, double us)
+    {
+        error.push_back(us);
+        slotSum[slot] += us;
+        slotMax[slot] = std::max(slotMax[slot], fabs(us));
+        slotCount[slot]++;
+    }
+};
+
+/*------------------------------------------------------------------------------
+   taskLoad -- bursts of other task work on the core (times in us)
+  ------------------------------------------------------------------------------*/
+struct taskLoad
+{
+    std::vector<double> start;
+    double length;
+
+    taskLoad(const settings &s, double until, std::mt19937 &random) : length(s.loadUs)
+    {
+        if (s.loadEvery <= 0)
+        {
+            return;
+        }
+        std::exponential_distribution<double> gap(1.0 / s.loadEvery);
+        for (double t = gap(random); t < until; t += length + gap(random))
+        {
+            start.push_back(t);
+        }
+    }
+
+    // the task resumes at t, or once the burst that holds it at t is over
+    double resume(double t) const
+    {
+        std::vector<double>::const_iterator b = std::upper_bound(start.begin(), start.end(), t);
+        if (b != start.begin() && t < *(b - 1) + length)
+        {
+            return *(b - 1) + length;
+        }
+        return t;
+    }
+
+    // task work of us microseconds, started at t: when it is done
+    double work(double t, double us) const
+    {
+        t = resume(t);
+        std::vector<double>::const_iterator b = std::upper_bound(start.begin(), start.end(), t);
+        while (b != start.end() && *b < t + us)
+        {
+            us -= *b - t;
+            t = *b + length;
+            ++b;
+        }
+        return t + us;
+    }
+
+    // busy-wait until t (a delayMicroseconds() that ends at t), as seen by the task
+    double waitUntil(double t) const { return resume(t); }
+};
+
+/*------------------------------------------------------------------------------
+   runOld() -- loop_fn_clock() before the slot engine
+  ------------------------------------------------------------------------------*/
+void runOld(const settings &s, const std::vector<double> &triggers, const std::vector<double> &starts,
+            const uint8_t *face, const taskLoad &load, pathStats &stats)
+{
+    const double poll = s.pollCycles / s.mhz;
+    const uint64_t slotWidth = (uint64_t)s.period / 60; // periodMicros / 60; never recalibrated
+    const uint64_t intervalOn = slotWidth / 3;
+    const double end = triggers.back();
+
+    size_t nextTrigger = 0;            // photo-trigger ISR: raises TRIGGERED
+    double nextSlot = slotWidth;       // slot timer ISR: raises ENDSLOT (timer started at 0)
+    bool triggered = false, endSlot = false;
+    double triggeredAt = 0, endSlotAt = 0; // when the flags went up
+    int clockPosition = 60, revolution = -1;
+    std::vector<bool> lit(CLOCK_POSITIONS);
+
+    double t = 0;
+    while (t < end)
+    {
+        // flags raised by the ISRs up to now (a flag raised twice is seen once)
+        while (nextTrigger < triggers.size() && triggers[nextTrigger] <= t)
+        {
+            triggeredAt = triggered ? triggeredAt : triggers[nextTrigger];
+            triggered = true;
+            nextTrigger++;
+        }
+        while (nextSlot <= t)
+        {
+            endSlotAt = endSlot ? endSlotAt : nextSlot;
+            endSlot = true;
+            nextSlot += slotWidth;
+        }
+
+        // one pass: the trigger's position 0, then the next slot's, as the loop did
+        double busyFrom = t;
+        t = load.work(t, poll);
+        auto show = [&](int position, double raised) {
+            // GPIO.out_w1ts = ClockFace[59 - ((offset + clockPosition) % 60)] << RED_LED
+            double ideal = starts[revolution] + position * s.period / 60.0;
+            if (face[59 - ((CLOCK_OFFSET + position) % 60)] && revolution >= (int)triggers.size() / 10)
+            {
+                stats.add(position, t - ideal);
+            }
+            lit[position] = true;
+            stats.latency.push_back(t - raised);
+            t = load.waitUntil(t + intervalOn); // delayMicroseconds(intervalOn)
+        };
+        if (triggered)
+        {
+            if (revolution >= 0)
+            {
+                stats.lost += std::count(lit.begin(), lit.end(), false);
+            }
+            revolution = (int)nextTrigger - 1;
+            std::fill(lit.begin(), lit.end(), false);
+            clockPosition = 0;
+            show(0, triggeredAt);
+            triggered = false;
+        }
+        if (endSlot)
+        {
+            if (++clockPosition < 60)
+            {
+                show(clockPosition, endSlotAt);
+            }
+            endSlot = false;
+        }
+        stats.busyCycles += (t - busyFrom) * s.mhz; // the loop never leaves the CPU
+    }
+}
+
+/*------------------------------------------------------------------------------
+   runNew() -- trigger() and onSlotTimer() with the slot engine
+   (interrupts preempt the task work, so the load only costs the task; edges are
+    only held off by other interrupts)
+  ------------------------------------------------------------------------------*/
+void runNew(const settings &s, const std::vector<double> &triggers, const std::vector<double> &starts,
+            const PovFrame<CLOCK_POSITIONS> &frame, std::mt19937 &random, pathStats &stats)
+{
+    std::uniform_real_distribution<double> otherIsr(0.0, s.isrJitter);
+    const double isr = s.isrCycles / s.mhz;
+    PeriodTracker tracker((uint32_t)s.period);
+    slotEngine engine;
+
+    for (size_t rev = 0; rev + 1 < triggers.size(); rev++)
+    {
+        bool measured = rev >= triggers.size() / 10;
+        std::vector<bool> lit(CLOCK_POSITIONS);
+
+        // trigger(): micros() at entry, timer restarted at 0, column 0 lit
+        double now = triggers[rev] + isr / 2 + otherIsr(random);
+        uint32_t timestamp = (uint32_t)llround(now);
+        engine.start(tracker.period(), tracker.update(timestamp));
+        double zero = now;
+
+        auto onEdge = [&](double t, double alarm) {
+            uint8_t column = frame.get(engine.slot());
+            lit[engine.slot()] = true;
+            if (measured && (column & 0b111))
+            {
+                stats.add(engine.slot(), t - (starts[rev] + engine.slot() * s.period / 60.0));
+            }
+            if (alarm >= 0)
+            {
+                stats.latency.push_back(t - alarm);
+            }
+            return slotEngine::alarmTick(engine.onEdge(column & COLUMN_THIN), (uint64_t)(t - zero));
+        };
+        uint64_t alarm = onEdge(now, -1);
+        stats.busyCycles += s.isrCycles;
+
+        for (;;)
+        {
+            double fired = zero + alarm;
+            double t = fired + otherIsr(random) + isr / 2; // the LED write, half way in
+            if (t >= triggers[rev + 1])
+            {
+                break;
+            }
+            stats.busyCycles += s.isrCycles;
+            if (engine.offEdgeDue())
+            {
+                alarm = slotEngine::alarmTick(engine.offEdge(), (uint64_t)(t - zero));
+            }
+            else if (engine.nextSlot())
+            {
+                alarm = onEdge(t, fired);
+            }
+            else
+            {
+                break;
+            }
+        }
+        if (rev > 0)
+        {
+            stats.lost += std::count(lit.begin(), lit.end(), false);
+        }
+    }
+}
+
+// nearest-rank percentile of |values|
+double percentile(std::vector<double> values, double fraction)
+{
+    if (values.empty())
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        values[i] = fabs(values[i]);
+    }
+    std::sort(values.begin(), values.end());
+    return values[(size_t)(fraction * (values.size() - 1))];
+}
+
+void report(const char *name, const settings &s, const pathStats &p)
+{
+    double sum = 0, squares = 0, max = 0;
+    for (size_t i = 0; i < p.error.size(); i++)
+    {
+        sum += p.error[i];
+        squares += p.error[i] * p.error[i];
+        max = std::max(max, fabs(p.error[i]));
+    }
+    size_t n = p.error.size() ? p.error.size() : 1;
+    printf("%s: edge error mean %+8.2f, rms %7.2f, p99 %7.2f, max %7.2f us; %ld positions lost; %.0f kcycles/rev (%.1f%% CPU)\n",
+           name, sum / n, sqrt(squares / n), percentile(p.error, 0.99), max, p.lost,
+           p.busyCycles / s.revolutions / 1000, 100.0 * p.busyCycles / (s.revolutions * s.period * s.mhz));
+    printf("     alarm/flag to LED write: mean %.2f, p99 %.2f, max %.2f us\n",
+           p.latency.empty() ? 0.0 : std::accumulate(p.latency.begin(), p.latency.end(), 0.0) / p.latency.size(),
+           percentile(p.latency, 0.99), percentile(p.latency, 1.0));
+    if (s.verbose)
+    {
+        for (int c = 0; c < CLOCK_POSITIONS; c++)
+        {
+            if (p.slotCount[c])
+            {
+                printf("  slot %2d: mean %+8.2f, max %7.2f us\n", c, p.slotSum[c] / p.slotCount[c], p.slotMax[c]);
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    settings s;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : "0";
+        if (!strcmp(argv[i], "--period"))
+            s.period = atof(value), i++;
+        else if (!strcmp(argv[i], "--jitter"))
+            s.jitter = atof(value), i++;
+        else if (!strcmp(argv[i], "--revs"))
+            s.revolutions = atoi(value), i++;
+        else if (!strcmp(argv[i], "--mhz"))
+            s.mhz = atof(value), i++;
+        else if (!strcmp(argv[i], "--poll-cycles"))
+            s.pollCycles = atoi(value), i++;
+        else if (!strcmp(argv[i], "--isr-cycles"))
+            s.isrCycles = atoi(value), i++;
+        else if (!strcmp(argv[i], "--isr-jitter"))
+            s.isrJitter = atof(value), i++;
+        else if (!strcmp(argv[i], "--load-us"))
+            s.loadUs = atof(value), i++;
+        else if (!strcmp(argv[i], "--load-every"))
+            s.loadEvery = atof(value), i++;
+        else if (!strcmp(argv[i], "--seed"))
+            s.seed = (unsigned)atoi(value), i++;
+        else if (!strcmp(argv[i], "-v"))
+            s.verbose = true;
+        else
+        {
+            printf("usage: %s [--period us] [--jitter us] [--revs n] [--mhz f] [--poll-cycles n]\n"
+                   "       [--isr-cycles n] [--isr-jitter us] [--load-us us] [--load-every us] [--seed n] [-v]\n",
+                   argv[0]);
+            return 1;
+        }
+    }
+    s.revolutions = std::max(s.revolutions, 10);
+
+    // the disk: true revolution starts, and the photo-trigger's view of them
+    std::mt19937 random(s.seed);
+    std::normal_distribution<double> triggerNoise(0.0, s.jitter > 0 ? s.jitter : 1e-9);
+    std::vector<double> starts, triggers;
+    for (int rev = 0; rev <= s.revolutions; rev++)
+    {
+        starts.push_back(1000.0 + rev * s.period);
+        triggers.push_back(starts.back() + triggerNoise(random));
+    }
+    taskLoad load(s, triggers.back() + s.period, random);
+
+    // the clock face at 10:08:20, and the frame the new path plays
+    ClockLayers clock;
+    clock.setTime(10, 8, 20);
+    static PovFrame<CLOCK_POSITIONS> frame;
+    renderFrame(clock.face(), frame, CLOCK_OFFSET);
+
+    pathStats oldPath, newPath;
+    runOld(s, triggers, starts, clock.face(), load, oldPath);
+    runNew(s, triggers, starts, frame, random, newPath);
+
+    printf("period %.0f us, trigger jitter %.1f us, %d revolutions, %.0f MHz; ",
+           s.period, s.jitter, s.revolutions, s.mhz);
+    if (s.loadEvery > 0)
+        printf("task load %.0f us every %.0f us\n", s.loadUs, s.loadEvery);
+    else
+        printf("no task load\n");
+    printf("old: %d-cycle polling pass; new: %d-cycle ISRs, other interrupts 0-%.1f us\n",
+           s.pollCycles, s.isrCycles, s.isrJitter);
+    report("old", s, oldPath);
+    report("new", s, newPath);
+    return 0;
+}
@@ -0,0 +1,152 @@
+#ifndef CLOCKFACE_H
+#define CLOCKFACE_H
+
+// Clock face model for the POV display, as a small stack of layers:
+//   graduations < hour hand < minute hand < second hand
+// The graduations are a compile-time table; the hands are one position each.  When the
+// time changes, only the positions a hand left or arrived at are recomposited, and those
+// positions are reported as a list of dirty ranges for the frame writer to redraw.
+// Note: kept free of Arduino/ESP32/AVR headers so it can be compiled natively
+
+#include <stdint.h>
+
+#ifndef CLOCK_POSITIONS
+#define CLOCK_POSITIONS 60 // positions on the clock face (one per "second")
+#endif
+
+// 3-bit RGB colors of the layers (red is lsb)
+#define QUARTER_COLOR 0b011 // yellow; graduations at 0, 15, 30, 45
+#define TWELFTH_COLOR 0b111 // white; other graduations (every 5)
+#define HOUR_COLOR 0b010    // green
+#define MINUTE_COLOR 0b100  // blue
+#define SECOND_COLOR 0b001  // red
+
+#define NO_HAND 0xff       // hand position before the first setTime()
+#define MAX_DIRTY_RANGES 6 // 3 hands x (old, new) position
+
+// static graduation layer
+constexpr uint8_t GRADUATIONS[CLOCK_POSITIONS] = {
+    QUARTER_COLOR, 0, 0, 0, 0, TWELFTH_COLOR, 0, 0, 0, 0, TWELFTH_COLOR, 0, 0, 0, 0,
+    QUARTER_COLOR, 0, 0, 0, 0, TWELFTH_COLOR, 0, 0, 0, 0, TWELFTH_COLOR, 0, 0, 0, 0,
+    QUARTER_COLOR, 0, 0, 0, 0, TWELFTH_COLOR, 0, 0, 0, 0, TWELFTH_COLOR, 0, 0, 0, 0,
+    QUARTER_COLOR, 0, 0, 0, 0, TWELFTH_COLOR, 0, 0, 0, 0, TWELFTH_COLOR, 0, 0, 0, 0};
+
+// graduation rule the table must follow
+constexpr uint8_t graduationColor(int position)
+{
+    return (position % 15 == 0) ? QUARTER_COLOR : ((position % 5 == 0) ? TWELFTH_COLOR : 0);
+}
+// every entry from position on follows the rule (recursive: C++11 constexpr has no loops)
+constexpr bool graduationsFollowRule(int position = 0)
+{
+    return position >= CLOCK_POSITIONS ||
+           (GRADUATIONS[position] == graduationColor(position) && graduationsFollowRule(position + 1));
+}
+static_assert(graduationsFollowRule(), "graduation table does not match graduationColor()");
+
+// inclusive range of clock positions
+struct dirtyRange
+{
+    uint8_t first;
+    uint8_t last;
+};
+
+class ClockLayers
+{
+public:
+    ClockLayers()
+    {
+        for (uint8_t p = 0; p < CLOCK_POSITIONS; p++)
+        {
+            _face[p] = GRADUATIONS[p];
+        }
+        _hand[0] = _hand[1] = _hand[2] = NO_HAND;
+        _dirtyCount = 0;
+    }
+
+    /*------------------------------------------------------------------------------
+       setTime() -- move the hands (hours 0-11, minutes 0-59, seconds 0-59)
+       recomposites only the positions that changed; returns the number of dirty ranges
+      ------------------------------------------------------------------------------*/
+    uint8_t setTime(int hours, int minutes, int seconds)
+    {
+        uint8_t moved[2 * 3];
+        uint8_t count = 0;
+        const uint8_t position[3] = {(uint8_t)((hours % 12) * 5), (uint8_t)minutes, (uint8_t)seconds};
+        for (uint8_t h = 0; h < 3; h++)
+        {
+            if (position[h] != _hand[h])
+            {
+                if (_hand[h] != NO_HAND)
+                {
+                    moved[count++] = _hand[h];
+                }
+                moved[count++] = position[h];
+                _hand[h] = position[h];
+            }
+        }
+        for (uint8_t i = 0; i < count; i++)
+        {
+            _face[moved[i]] = composite(moved[i]);
+        }
+        collectDirty(moved, count);
+        return _dirtyCount;
+    }
+
+    uint8_t color(uint8_t position) const { return _face[position]; }
+    const uint8_t *face() const { return _face; }
+
+    // dirty ranges left by the last setTime(), in ascending order
+    uint8_t dirtyCount() const { return _dirtyCount; }
+    const dirtyRange &dirty(uint8_t i) const { return _dirty[i]; }
+
+private:
+    // color of the topmost layer at position
+    uint8_t composite(uint8_t position) const
+    {
+        if (position == _hand[2])
+            return SECOND_COLOR;
+        if (position == _hand[1])
+            return MINUTE_COLOR;
+        if (position == _hand[0])
+            return HOUR_COLOR;
+        return GRADUATIONS[position];
+    }
+
+    // sort the (at most 6) moved positions and merge neighbours into ranges
+    void collectDirty(uint8_t *moved, uint8_t count)
+    {
+        for (uint8_t i = 1; i < count; i++)
+        {
+            uint8_t p = moved[i];
+            int8_t j = i - 1;
+            while (j >= 0 && moved[j] > p)
+            {
+                moved[j + 1] = moved[j];
+                j--;
+            }
+            moved[j + 1] = p;
+        }
+        _dirtyCount = 0;
+        for (uint8_t i = 0; i < count; i++)
+        {
+            if (_dirtyCount > 0 && moved[i] <= _dirty[_dirtyCount - 1].last + 1)
+            {
+                _dirty[_dirtyCount - 1].last = moved[i];
+            }
+            else
+            {
+                _dirty[_dirtyCount].first = moved[i];
+                _dirty[_dirtyCount].last = moved[i];
+                _dirtyCount++;
+            }
+        }
+    }
+
+    uint8_t _face[CLOCK_POSITIONS]; // composited colors
+    uint8_t _hand[3];               // hour, minute, second positions
+    dirtyRange _dirty[MAX_DIRTY_RANGES];
+    uint8_t _dirtyCount;
+};
+
+#endif
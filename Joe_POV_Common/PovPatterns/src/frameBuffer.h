@@ -0,0 +1,133 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+// Per-revolution frame buffer for the POV display
+// A frame holds COLUMNS columns (angular positions) per revolution, packed two per byte:
+// each 4-bit column is a 3-bit RGB color (red is lsb) plus a "thin" flag (bit 3).
+// Columns are written to the LEDs by PovOutput (see povOutput.h), which maps them onto
+// whichever port the build drives
+// Note: kept free of Arduino/ESP32/AVR headers so it can be compiled natively
+
+#include <stdint.h>
+
+#ifndef CLOCK_POSITIONS
+#define CLOCK_POSITIONS 60 // positions on the clock face (one per "second")
+#endif
+#define COLUMN_THIN 0b1000 // column flag: turn off at the off-edge (draw skinnier lines)
+
+/*------------------------------------------------------------------------------
+   PovFrame -- COLUMNS columns per revolution, packed two per byte
+  ------------------------------------------------------------------------------*/
+template <uint16_t COLUMNS>
+class PovFrame
+{
+public:
+    static_assert(COLUMNS % CLOCK_POSITIONS == 0, "columns must be a multiple of 60 (60/120/240/360)");
+    static const uint16_t columns = COLUMNS;
+
+    // set column to 3-bit RGB color; thin = turn off at the off-edge
+    void set(uint16_t column, uint8_t color, bool thin)
+    {
+        uint8_t value = (color & 0b111) | (thin ? COLUMN_THIN : 0);
+        uint8_t &pair = _packed[column >> 1];
+        if (column & 1)
+        {
+            pair = (pair & 0x0f) | (value << 4);
+        }
+        else
+        {
+            pair = (pair & 0xf0) | value;
+        }
+    }
+
+    // 4-bit column value (color | COLUMN_THIN)
+    uint8_t get(uint16_t column) const
+    {
+        return (_packed[column >> 1] >> ((column & 1) << 2)) & 0x0f;
+    }
+
+    // set every column to the same color
+    void fill(uint8_t color, bool thin)
+    {
+        uint8_t value = (color & 0b111) | (thin ? COLUMN_THIN : 0);
+        for (uint16_t i = 0; i < sizeof(_packed); i++)
+        {
+            _packed[i] = value | (value << 4);
+        }
+    }
+
+private:
+    uint8_t _packed[(COLUMNS + 1) / 2];
+};
+
+/*------------------------------------------------------------------------------
+   renderPosition() -- draw the columns of one clock position into a frame
+     color    - 3-bit RGB value of the position
+     block    - display order of the position (0 = at the photo-trigger)
+   Each position is drawn as a line 1/3 of its width: a thin column at 60 columns,
+   otherwise the first third of its columns (at least one) lit for the whole column
+  ------------------------------------------------------------------------------*/
+template <uint16_t COLUMNS>
+void renderPosition(PovFrame<COLUMNS> &frame, uint8_t color, int block)
+{
+    const uint16_t perPosition = COLUMNS / CLOCK_POSITIONS;
+    const uint16_t lit = perPosition / 3;
+    uint16_t column = block * perPosition;
+    for (uint16_t c = 0; c < perPosition; c++)
+    {
+        if (lit == 0)
+        {
+            frame.set(column++, (c == 0) ? color : 0, true);
+        }
+        else
+        {
+            frame.set(column++, (c < lit) ? color : 0, false);
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+   renderFrame() -- render the 60-position clock face model into a frame
+     face     - CLOCK_POSITIONS positions, each a 3-bit RGB value (red is lsb)
+     offset   - number of positions to rotate display (ccw) for orientation
+   block k shows face[59 - ((offset + k) % 60)]: offset and reversal (disk rotates ccw)
+   are applied here, with a decrementing index instead of a modulo
+  ------------------------------------------------------------------------------*/
+template <uint16_t COLUMNS>
+void renderFrame(const uint8_t *face, PovFrame<COLUMNS> &frame, int offset)
+{
+    int position = (CLOCK_POSITIONS - 1) - (offset % CLOCK_POSITIONS);
+    for (int block = 0; block < CLOCK_POSITIONS; block++)
+    {
+        renderPosition(frame, face[position], block);
+        if (--position < 0)
+        {
+            position = CLOCK_POSITIONS - 1;
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+   renderPositions() -- redraw only face positions first..last (inclusive) in a frame
+   (the inverse of renderFrame()'s mapping: position p is drawn at block
+    (59 - offset - p) mod 60)
+  ------------------------------------------------------------------------------*/
+template <uint16_t COLUMNS>
+void renderPositions(const uint8_t *face, PovFrame<COLUMNS> &frame, int offset, uint8_t first, uint8_t last)
+{
+    int block = (CLOCK_POSITIONS - 1) - (offset % CLOCK_POSITIONS) - first;
+    if (block < 0)
+    {
+        block += CLOCK_POSITIONS;
+    }
+    for (int p = first; p <= last; p++)
+    {
+        renderPosition(frame, face[p], block);
+        if (--block < 0)
+        {
+            block = CLOCK_POSITIONS - 1;
+        }
+    }
+}
+
+#endif
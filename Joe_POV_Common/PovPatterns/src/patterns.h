@@ -0,0 +1,92 @@
+#ifndef PATTERNS_H
+#define PATTERNS_H
+
+// POV pattern table producers
+// Each pattern fills one revolution's frame (see frameBuffer.h), at whatever column count
+// the frame was built with, which the sketch's slot engine then plays back column by
+// column; the patterns themselves don't own the LEDs or wait on timing
+// Shared by the ESP32 and ATmega328P POV sketches
+// Note: kept free of Arduino/ESP32/AVR headers so it can be compiled natively
+
+#include "frameBuffer.h"
+
+// 3-bit RGB color values (red is lsb)
+const uint8_t BLACK = 0b000;
+const uint8_t RED = 0b001;
+const uint8_t GREEN = 0b010;
+const uint8_t YELLOW = 0b011;
+const uint8_t BLUE = 0b100;
+const uint8_t MAGENTA = 0b101;
+const uint8_t CYAN = 0b110;
+const uint8_t WHITE = 0b111;
+
+// color cycles for banded patterns (see produceBands())
+const uint8_t redBlack[2] = {RED, BLACK};
+const uint8_t allColors[8] = {BLACK, RED, GREEN, YELLOW, BLUE, MAGENTA, CYAN, WHITE};
+
+#define SYNC_COLOR 0b111 // white marker drawn at the photo-trigger (column 0)
+
+/*------------------------------------------------------------------------------
+   produceBlank() -- all columns dark
+  ------------------------------------------------------------------------------*/
+template <uint16_t COLUMNS>
+void produceBlank(PovFrame<COLUMNS> &frame)
+{
+    frame.fill(0, false);
+}
+
+/*------------------------------------------------------------------------------
+   produceRadar() -- sync marker at column 0, radar beacon (thin line) at column position
+  ------------------------------------------------------------------------------*/
+template <uint16_t COLUMNS>
+void produceRadar(PovFrame<COLUMNS> &frame, uint16_t position, uint8_t color)
+{
+    frame.fill(0, false);
+    frame.set(0, SYNC_COLOR, true);
+    frame.set(position % COLUMNS, color, true);
+}
+
+/*------------------------------------------------------------------------------
+   produceBands() -- divide the revolution into bands, cycling through colors[]
+     bands    - number of bands per revolution (0 is treated as 1)
+     colors   - 3-bit RGB values; band b is drawn in colors[b % numColors]
+  ------------------------------------------------------------------------------*/
+template <uint16_t COLUMNS>
+void produceBands(PovFrame<COLUMNS> &frame, int bands, const uint8_t *colors, int numColors)
+{
+    if (bands < 1)
+    {
+        bands = 1;
+    }
+    // band number of column c is (c * bands / COLUMNS); step it without dividing per column
+    int band = 0;
+    int accumulator = 0;
+    for (uint16_t c = 0; c < COLUMNS; c++)
+    {
+        frame.set(c, colors[band % numColors], false);
+        accumulator += bands;
+        while (accumulator >= COLUMNS)
+        {
+            accumulator -= COLUMNS;
+            band++;
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+   produceFan() -- sync marker, fan of color filled up to column position, thin white edge there
+  ------------------------------------------------------------------------------*/
+template <uint16_t COLUMNS>
+void produceFan(PovFrame<COLUMNS> &frame, uint16_t position, uint8_t color)
+{
+    position %= COLUMNS;
+    frame.fill(0, false);
+    for (uint16_t c = 1; c < position; c++)
+    {
+        frame.set(c, color, false);
+    }
+    frame.set(0, SYNC_COLOR, true);
+    frame.set(position, SYNC_COLOR, true);
+}
+
+#endif
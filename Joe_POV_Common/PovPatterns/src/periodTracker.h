@@ -0,0 +1,101 @@
+#ifndef PERIODTRACKER_H
+#define PERIODTRACKER_H
+
+// Disk period tracker for the POV display -- a fixed-point 2nd order PLL (alpha-beta filter)
+// fed with photo-trigger timestamps, so one noisy edge nudges the estimate instead of
+// replacing it.  Each trigger is compared with the predicted one; a fraction of the
+// phase error corrects the phase (KP) and a smaller fraction corrects the period (KI),
+// which lets the loop follow the disk while it spins up or drifts.
+// Wild edges (more than 1/16 revolution off: missed or spurious triggers) are ignored;
+// several in a row force a re-acquire from the raw trigger-to-trigger interval.
+// Note: integer math only, no Arduino headers, so it can be compiled natively
+
+#include <stdint.h>
+
+#define PERIOD_FRAC_BITS 8    // period is kept in Q8 microseconds (1/256 us resolution)
+#define PERIOD_KP_DIV 4       // phase correction = error / 4
+#define PERIOD_KI_SHIFT 4     // period correction = error / 16
+#define PERIOD_MAX_OUTLIERS 4 // consecutive wild edges before re-acquiring
+
+class PeriodTracker
+{
+public:
+    PeriodTracker(uint32_t initialMicros)
+    {
+        _period = initialMicros << PERIOD_FRAC_BITS;
+        _predicted = 0;
+        _fraction = 0;
+        _lastTrigger = 0;
+        _lastDelta = initialMicros;
+        _outliers = 0;
+        _locked = false;
+        _started = false;
+    }
+
+    /*------------------------------------------------------------------------------
+       update() -- feed one trigger timestamp (us; wraps at 2^32)
+       returns how late (us) this trigger was, relative to the filtered start of the
+       revolution; positive = late, negative = early, 0 while (re)acquiring
+      ------------------------------------------------------------------------------*/
+    int32_t update(uint32_t timestamp)
+    {
+        _lastDelta = timestamp - _lastTrigger;
+        _lastTrigger = timestamp;
+        if (!_started)
+        {
+            _started = true;
+            _predicted = timestamp;
+            return 0;
+        }
+
+        // advance prediction by one period (keeping the sub-microsecond remainder)
+        uint32_t step = _period + _fraction;
+        _predicted += step >> PERIOD_FRAC_BITS;
+        _fraction = step & ((1 << PERIOD_FRAC_BITS) - 1);
+
+        int32_t error = (int32_t)(timestamp - _predicted);
+        int32_t gate = (int32_t)(_period >> (PERIOD_FRAC_BITS + 4)); // 1/16 revolution
+        if (error > gate || error < -gate)
+        {
+            if (++_outliers >= PERIOD_MAX_OUTLIERS)
+            {
+                acquire(timestamp);
+            }
+            return 0;
+        }
+        _outliers = 0;
+        _locked = true;
+
+        int32_t phaseCorrection = error / PERIOD_KP_DIV;
+        _predicted += phaseCorrection;
+        _period += (error * (1 << PERIOD_FRAC_BITS)) >> PERIOD_KI_SHIFT;
+        return error - phaseCorrection;
+    }
+
+    uint32_t period() { return _period; }        // Q8 microseconds
+    uint32_t periodMicros() { return _period >> PERIOD_FRAC_BITS; }
+    uint32_t lastDelta() { return _lastDelta; } // raw microseconds between the last two triggers
+    bool locked() { return _locked; }
+
+private:
+    // restart the loop from the raw trigger-to-trigger interval
+    void acquire(uint32_t timestamp)
+    {
+        _period = _lastDelta << PERIOD_FRAC_BITS;
+        _predicted = timestamp;
+        _fraction = 0;
+        _outliers = 0;
+        _locked = false;
+    }
+
+    uint32_t _period;      // Q8 us
+    uint32_t _predicted;   // us; predicted (filtered) time of the latest trigger
+    uint32_t _fraction;    // Q8 remainder of _predicted
+    uint32_t _lastTrigger; // us; raw time of the latest trigger
+    uint32_t _lastDelta;   // us
+    uint8_t _outliers;
+    bool _locked;
+    bool _started;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef POVOUTPUT_H
+#define POVOUTPUT_H
+
+// LED output for the POV display: writes one frame column (see frameBuffer.h) to the LEDs
+// PovOutput is put together at compile time from two policies:
+//   COLOR - encodes a 3-bit RGB color (red is lsb) as port bits (which pins the LEDs are on)
+//   PORT  - writes set/clear bits to the hardware (PORTB on AVR, GPIO w1ts/w1tc on ESP32)
+// Everything is static and inlined, so a column write compiles to the same direct register
+// stores the sketches used to hand-code, with no runtime dispatch.
+// The hardware port policies are only defined for their own target; MemoryPort builds
+// anywhere (natively, too), so patterns can be played back on a PC
+
+#include <stdint.h>
+#include "frameBuffer.h"
+
+#if defined(__AVR__)
+#include <avr/io.h>
+#elif defined(ESP32)
+#include <soc/gpio_struct.h>
+#endif
+
+#ifndef POV_INLINE
+#define POV_INLINE inline __attribute__((always_inline)) // safe to call from IRAM ISRs
+#endif
+
+/*------------------------------------------------------------------------------
+   ConsecutiveRgb -- red, green, blue LEDs on consecutive port bits, starting at FIRST_BIT
+  ------------------------------------------------------------------------------*/
+template <typename WORD, uint8_t FIRST_BIT>
+struct ConsecutiveRgb
+{
+    typedef WORD word;
+    static const WORD mask = (WORD)(0b111 << FIRST_BIT);
+    static POV_INLINE WORD encode(uint8_t color) { return (WORD)((color & 0b111) << FIRST_BIT); }
+};
+
+/*------------------------------------------------------------------------------
+   MappedRgb -- red, green, blue LEDs on arbitrary bits of the same port
+  ------------------------------------------------------------------------------*/
+template <typename WORD, uint8_t RED_BIT, uint8_t GREEN_BIT, uint8_t BLUE_BIT>
+struct MappedRgb
+{
+    typedef WORD word;
+    static const WORD mask = (WORD)((1UL << RED_BIT) | (1UL << GREEN_BIT) | (1UL << BLUE_BIT));
+    static POV_INLINE WORD encode(uint8_t color)
+    {
+        return (WORD)(((color & 0b001) ? (1UL << RED_BIT) : 0) |
+                      ((color & 0b010) ? (1UL << GREEN_BIT) : 0) |
+                      ((color & 0b100) ? (1UL << BLUE_BIT) : 0));
+    }
+};
+
+#if defined(__AVR__)
+/*------------------------------------------------------------------------------
+   AvrPortB -- LEDs on PORTB (one read-modify-write store; other PORTB pins kept)
+  ------------------------------------------------------------------------------*/
+struct AvrPortB
+{
+    typedef uint8_t word;
+    static POV_INLINE void write(uint8_t set, uint8_t clear) { PORTB = (PORTB & ~clear) | set; }
+    static POV_INLINE void clear(uint8_t bits) { PORTB &= ~bits; }
+};
+#endif
+
+#if defined(ESP32)
+/*------------------------------------------------------------------------------
+   Esp32Gpio -- LEDs on gpio 0-31 (write-1-to-clear / write-1-to-set registers)
+  ------------------------------------------------------------------------------*/
+struct Esp32Gpio
+{
+    typedef uint32_t word;
+    static POV_INLINE void write(uint32_t set, uint32_t clear)
+    {
+        GPIO.out_w1tc = clear;
+        GPIO.out_w1ts = set;
+    }
+    static POV_INLINE void clear(uint32_t bits) { GPIO.out_w1tc = bits; }
+};
+#endif
+
+/*------------------------------------------------------------------------------
+   MemoryPort -- a port in RAM; for playing patterns back natively
+  ------------------------------------------------------------------------------*/
+template <typename WORD>
+struct MemoryPort
+{
+    typedef WORD word;
+    static WORD value;
+    static void write(WORD set, WORD clear) { value = (value & ~clear) | set; }
+    static void clear(WORD bits) { value &= ~bits; }
+};
+template <typename WORD>
+WORD MemoryPort<WORD>::value = 0;
+
+/*------------------------------------------------------------------------------
+   PovOutput -- write frame columns (color | COLUMN_THIN) to the LEDs
+  ------------------------------------------------------------------------------*/
+template <class COLOR, class PORT>
+struct PovOutput
+{
+    typedef typename PORT::word word;
+
+    // on-edge of a column: light its color, darken the other LEDs
+    static POV_INLINE void on(uint8_t column)
+    {
+        word bits = COLOR::encode(column);
+        PORT::write(bits, (word)(COLOR::mask & ~bits));
+    }
+
+    // off-edge of a thin column, end of revolution, pattern change: all LEDs dark
+    static POV_INLINE void off() { PORT::clear(COLOR::mask); }
+
+    // column needs an off-edge (is drawn as a thin line)
+    static POV_INLINE bool thin(uint8_t column) { return (column & COLUMN_THIN) != 0; }
+
+    // column lights no LEDs
+    static POV_INLINE bool dark(uint8_t column) { return (column & 0b111) == 0; }
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef SLOTENGINE_H
+#define SLOTENGINE_H
+
+// Slot engine timing for the POV display: when each column's edges fall in a revolution
+// The engine's timer counts 1 us ticks from the photo-trigger.  Each column has an on-edge
+// and, for thin columns, an off-edge 1/3 slot later; edges are kept in Q8 ticks
+// (PERIOD_FRAC_BITS) so the truncated slot widths still add up to the whole revolution.
+// The sketch's ISRs own the timer and the LEDs and ask the engine where the next alarm
+// goes; the native simulator drives the very same engine from a simulated timer
+// Note: integer math only, no Arduino headers, so it can be compiled natively
+
+#include <stdint.h>
+#include "periodTracker.h"
+
+#ifndef POV_INLINE
+#define POV_INLINE inline __attribute__((always_inline)) // safe to call from IRAM ISRs
+#endif
+
+template <uint16_t COLUMNS>
+class SlotEngine
+{
+public:
+    SlotEngine()
+    {
+        _slotStartQ = 0;
+        _slotWidthQ = 0;
+        _intervalOnQ = 0;
+        _slot = 0;
+        _offEdgeDue = false;
+    }
+
+    /*------------------------------------------------------------------------------
+       start() -- restart at column 0, at the filtered revolution start
+         periodQ  - tracked period (Q8 us; PeriodTracker::period())
+         late     - how late the trigger was (us; PeriodTracker::update())
+       call with the timer just restarted at 0, then onEdge() for column 0
+      ------------------------------------------------------------------------------*/
+    POV_INLINE void start(uint32_t periodQ, int32_t late)
+    {
+        _slotWidthQ = periodQ / COLUMNS;
+        _intervalOnQ = _slotWidthQ / 3;
+        _slot = 0;
+        _slotStartQ = -((int64_t)late << PERIOD_FRAC_BITS);
+        _offEdgeDue = false;
+    }
+
+    /*------------------------------------------------------------------------------
+       onEdge() -- slot() has just been lit; returns the tick (Q8) of its next edge
+         thin     - the column is drawn as a thin line (needs an off-edge)
+      ------------------------------------------------------------------------------*/
+    POV_INLINE int64_t onEdge(bool thin)
+    {
+        _offEdgeDue = thin;
+        return _slotStartQ + (thin ? _intervalOnQ : _slotWidthQ);
+    }
+
+    /*------------------------------------------------------------------------------
+       offEdge() -- slot()'s thin line has just been turned off; returns the tick (Q8)
+         of the next slot's on-edge
+      ------------------------------------------------------------------------------*/
+    POV_INLINE int64_t offEdge()
+    {
+        _offEdgeDue = false;
+        return _slotStartQ + _slotWidthQ;
+    }
+
+    /*------------------------------------------------------------------------------
+       nextSlot() -- the spinning slot has arrived at the next column; false at the end
+         of the revolution (dark until the next start())
+      ------------------------------------------------------------------------------*/
+    POV_INLINE bool nextSlot()
+    {
+        _slotStartQ += _slotWidthQ;
+        return ++_slot < COLUMNS;
+    }
+
+    /*------------------------------------------------------------------------------
+       alarmTick() -- timer alarm for an edge at tickQ (Q8), the timer reading now
+       an alarm already in the past would not fire until the counter wraps; fire asap instead
+      ------------------------------------------------------------------------------*/
+    static POV_INLINE uint64_t alarmTick(int64_t tickQ, uint64_t now)
+    {
+        int64_t tick = tickQ >> PERIOD_FRAC_BITS;
+        return (tick > (int64_t)now) ? (uint64_t)tick : now + 1;
+    }
+
+    POV_INLINE uint16_t slot() const { return _slot; }           // column being displayed
+    POV_INLINE bool offEdgeDue() const { return _offEdgeDue; }   // next alarm is slot()'s off-edge
+    POV_INLINE bool lastSlot() const { return _slot == COLUMNS - 1; }
+    POV_INLINE uint32_t slotWidth() const { return _slotWidthQ; } // Q8 ticks
+
+private:
+    int64_t _slotStartQ;   // current slot's on-edge (since trigger); < 0 if trigger was late
+    uint32_t _slotWidthQ;  // period / COLUMNS
+    uint32_t _intervalOnQ; // slot width / 3 (draw skinnier lines)
+    uint16_t _slot;
+    bool _offEdgeDue;
+};
+
+#endif
@@ -0,0 +1,180 @@
+// MicrostepCheck -- check the microstepping duties (StepperSine.h), on a PC
+// Walks one electrical turn in microsteps, as the step timer ISR does, and checks that
+//   - the quarter-wave table, mirrored, matches sin() over the whole turn
+//   - at each phase table state's angle (full and half step) the duties reproduce the
+//     state: a pin is HIGH in the table where its duty is above half (so switching
+//     between the phase table and microstepping doesn't move the motor)
+//   - the field the duties make turns evenly: its angle is within half a 1/32 step of
+//     the commanded angle at every microstep, at a constant strength
+// for 3 pins (3-phase, half bridges) and 4 pins (2 coils, H-bridges).  Then reports the
+// time one microstep (duty lookup and pin writes, as Stepper::microMotor()) takes on
+// this machine; the stepper_speedTest sketch measures it on the board itself.
+// Prints one CSV line per microstep of the --pins wiring: microstep, angle, the duties.
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -I../../src MicrostepCheck.cpp -o microstepcheck
+//   ./microstepcheck --pins 3 --microsteps 16 --bits 10 > duties.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "StepperPhases.h"
+#include "StepperSine.h"
+
+// settings (command line)
+struct settings
+{
+    int pins = 3;
+    int microsteps = 16; // per full step
+    int bits = 10;       // PWM resolution (ESP32 10, AVR 8)
+};
+
+// the field of the duties: angle (units) and strength (1 = full)
+void field(int pins, const uint16_t *duty, int bits, double &angle, double &strength)
+{
+    double full = (1 << bits) - 1, x = 0, y = 0;
+    if (pins == 3)
+    {
+        // each half bridge pushes along its phase, from the midpoint
+        for (int k = 0; k < 3; k++)
+        {
+            double d = duty[k] / full - 0.5, phase = 2 * M_PI * k / 3;
+            x += d * cos(phase);
+            y += d * sin(phase);
+        }
+        x /= 0.75; // 3 phases of +-1/2: 3/2 * 1/2
+        y /= 0.75;
+    }
+    else
+    {
+        x = (duty[0] - (double)duty[1]) / full; // coil A
+        y = (duty[2] - (double)duty[3]) / full; // coil B
+    }
+    angle = atan2(y, x) * STEPPER_SINE_TURN / (2 * M_PI);
+    angle = (angle < 0) ? angle + STEPPER_SINE_TURN : angle;
+    strength = sqrt(x * x + y * y);
+}
+
+int check(int pins, int bits)
+{
+    int failures = 0;
+    // the phase table states
+    for (int half = 0; half <= 1; half++)
+    {
+        uint8_t count;
+        const uint8_t *levels = stepperPhases(pins, half, count);
+        for (uint8_t state = 0; state < count; state++)
+        {
+            uint16_t duty[4];
+            stepperMicroDuties(pins, stepperPhaseAngle(pins, half, state), bits, duty);
+            uint8_t high = 0;
+            for (int k = 0; k < pins; k++)
+            {
+                high |= (duty[k] > (1 << (bits - 1))) ? 1 << k : 0;
+            }
+            if (high != levels[state])
+            {
+                fprintf(stderr, "%d pins, %s step state %d: duties give %02x, table %02x\n", pins,
+                        half ? "half" : "full", state, high, levels[state]);
+                failures++;
+            }
+        }
+    }
+    // the field, at every angle unit (1/32 step is 3 or 4 units)
+    double worst_angle = 0, weakest = 2, strongest = 0;
+    for (int angle = 0; angle < STEPPER_SINE_TURN; angle++)
+    {
+        uint16_t duty[4];
+        double at, strength;
+        stepperMicroDuties(pins, angle, bits, duty);
+        field(pins, duty, bits, at, strength);
+        double error = fabs(at - angle);
+        error = (error > STEPPER_SINE_TURN / 2) ? STEPPER_SINE_TURN - error : error;
+        worst_angle = fmax(worst_angle, error);
+        weakest = fmin(weakest, strength);
+        strongest = fmax(strongest, strength);
+    }
+    double half_micro = stepperFullStepAngle(pins) / STEPPER_MAX_MICROSTEPS / 2.0;
+    fprintf(stderr, "%d pins, %d bits: field within %.3f units of the angle (1/32 step = %.0f), strength %.4f .. %.4f\n",
+            pins, bits, worst_angle, 2 * half_micro, weakest, strongest);
+    if (worst_angle > half_micro || strongest - weakest > 0.02)
+    {
+        fprintf(stderr, "%d pins: uneven field\n", pins);
+        failures++;
+    }
+    return failures;
+}
+
+volatile uint16_t outputs[4]; // stand-in for the PWM duty registers
+
+int main(int argc, char **argv)
+{
+    settings s;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--pins"))
+            s.pins = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--microsteps"))
+            s.microsteps = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--bits"))
+            s.bits = atoi(argv[i + 1]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--pins 3|4] [--microsteps 2..32] [--bits 8..16]\n", argv[0]);
+            return 1;
+        }
+    }
+    if ((s.pins != 3 && s.pins != 4) || s.microsteps < 1 || s.microsteps > STEPPER_MAX_MICROSTEPS ||
+        (s.microsteps & (s.microsteps - 1)) || s.bits < 8 || s.bits > 16)
+    {
+        fprintf(stderr, "pins 3 or 4, microsteps a power of 2 up to 32, bits 8 .. 16\n");
+        return 1;
+    }
+
+    int failures = 0;
+    double worst = 0;
+    for (int angle = 0; angle < 3 * STEPPER_SINE_TURN; angle++)
+    {
+        worst = fmax(worst, fabs(stepperSine(angle) - 65535 * sin(2 * M_PI * angle / STEPPER_SINE_TURN)));
+    }
+    fprintf(stderr, "sine table within %.2f of sin() * 65535\n", worst);
+    failures += (worst > 1) ? 1 : 0;
+    failures += check(3, 10) + check(3, 8) + check(4, 10) + check(4, 8);
+
+    // one turn of the --pins wiring
+    const int angle_step = stepperFullStepAngle(s.pins) / s.microsteps;
+    printf("microstep,angle");
+    for (int k = 0; k < s.pins; k++)
+        printf(",duty%d", k + 1);
+    printf("\n");
+    for (int micro = 0, angle = 0; angle < STEPPER_SINE_TURN; micro++, angle += angle_step)
+    {
+        uint16_t duty[4];
+        stepperMicroDuties(s.pins, angle, s.bits, duty);
+        printf("%d,%d", micro, angle);
+        for (int k = 0; k < s.pins; k++)
+            printf(",%u", duty[k]);
+        printf("\n");
+    }
+
+    // per-microstep cost: angle step, duties, writes
+    const long steps = 20000000;
+    unsigned int angle = 0;
+    clock_t begin = clock();
+    for (long i = 0; i < steps; i++)
+    {
+        angle += angle_step;
+        angle = (angle >= STEPPER_SINE_TURN) ? angle - STEPPER_SINE_TURN : angle;
+        uint16_t duty[4];
+        stepperMicroDuties(s.pins, angle, s.bits, duty);
+        for (int k = 0; k < s.pins; k++)
+            outputs[k] = duty[k];
+    }
+    double ns = 1e9 * (clock() - begin) / CLOCKS_PER_SEC / steps;
+    fprintf(stderr, "%d pins: %.1f ns/microstep on this machine, up to %.0f microsteps/s (%.0f full steps/s at 1/%d)\n",
+            s.pins, ns, 1e9 / ns, 1e9 / ns / s.microsteps, s.microsteps);
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "duties ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,22 @@
+// The few Arduino calls Stepper uses, for QueueCheck: on simulated time, with the pins'
+// levels kept for the check to read (see QueueCheck.cpp).  No board is defined, so
+// Stepper.cpp takes its polled step timer and digitalWrite() outputs.
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+
+unsigned long micros();
+unsigned long millis();
+void yield();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+void analogWrite(uint8_t pin, int value);
+
+#endif
@@ -0,0 +1,192 @@
+// RampCheck -- check the step timing of an accelerated move (StepperRamp.h), on a PC
+// Plans a move as Stepper::queueMove() would, takes its steps from a StepperRamp as the
+// step timer ISR would, and compares the time of each step with an ideal (continuous)
+// profile of the same cruise speed, acceleration and jerk, integrated in 1 us slices.
+// Prints one CSV line per step: step, delay (us), time, ideal time; the summary (stderr)
+// gives the largest position error (steps ahead of (+) or behind (-) the ideal profile)
+// and the time next() takes per step on this machine.  Then checks a cruise delay past
+// what Q8 us holds in 32 bits (20 s, as queueMove(n, 20000000UL) or setSpeed(1) on a
+// 3-step motor): without a ramp every step must be the full 20 s, with one the cruise must
+// be held at STEPPER_RAMP_MAX_DELAY, not a wrapped delay.
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -I../../src RampCheck.cpp -o rampcheck
+//   ./rampcheck --steps 2000 --delay 200 --accel 5000 --jerk 50000 > scurve.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include "StepperRamp.h"
+
+// move settings (command line)
+struct settings
+{
+    unsigned long steps = 2000;
+    unsigned long delay = 200;  // us per step at cruise speed
+    unsigned long accel = 5000; // steps/s^2
+    unsigned long jerk = 0;     // steps/s^3; 0 = trapezoidal
+};
+
+// steps to reach speed v from standstill (as StepperProfile plans it)
+double rampDistance(double v, double a, double j)
+{
+    if (j == 0)
+    {
+        return v * v / (2 * a);
+    }
+    return v / 2 * ((v * j >= a * a) ? v / a + a / j : 2 * sqrt(v / j));
+}
+
+// time (s) of each step 1..steps of the ideal profile
+std::vector<double> idealTimes(const settings &s)
+{
+    double a = s.accel, j = s.jerk, top = 1e6 / s.delay;
+    if (2 * rampDistance(top, a, j) > s.steps)
+    {
+        double low = 0, high = top; // short move: the top speed it can reach
+        for (int i = 0; i < 60; i++)
+        {
+            double v = (low + high) / 2;
+            (2 * rampDistance(v, a, j) > s.steps) ? high = v : low = v;
+        }
+        top = low;
+    }
+    double ramp = rampDistance(top, a, j);
+    double peak = (j == 0 || top * j >= a * a) ? a : sqrt(top * j);
+    double easing = (j == 0) ? 0 : peak * peak / (2 * j); // speed change while the acceleration eases off
+
+    std::vector<double> t(s.steps + 1, 0);
+    const double dt = 1e-6;
+    double x = 0, v = 0, acc = 0, time = 0;
+    bool decelerating = false, eased = false;
+    unsigned long n = 1;
+    while (n <= s.steps && time < 1000)
+    {
+        if (!decelerating && x >= s.steps - ramp)
+        {
+            decelerating = true;
+            eased = false;
+            acc = (j == 0) ? -peak : 0;
+        }
+        if (j == 0)
+        {
+            acc = decelerating ? -peak : ((v < top) ? peak : 0);
+        }
+        else if (!decelerating)
+        {
+            eased = eased || v >= top - easing;
+            acc = eased ? fmax(acc - j * dt, 0) : fmin(acc + j * dt, peak);
+        }
+        else
+        {
+            eased = eased || v <= easing;
+            acc = eased ? fmin(acc + j * dt, 0) : fmax(acc - j * dt, -peak);
+        }
+        v = fmax(v + acc * dt, decelerating ? 1e-3 : 0); // creep onto the last step
+        x += v * dt;
+        time += dt;
+        while (n <= s.steps && x >= n)
+        {
+            t[n++] = time;
+        }
+    }
+    return t;
+}
+
+int main(int argc, char **argv)
+{
+    settings s;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--steps"))
+            s.steps = atol(argv[i + 1]);
+        else if (!strcmp(argv[i], "--delay"))
+            s.delay = atol(argv[i + 1]);
+        else if (!strcmp(argv[i], "--accel"))
+            s.accel = atol(argv[i + 1]);
+        else if (!strcmp(argv[i], "--jerk"))
+            s.jerk = atol(argv[i + 1]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--steps n] [--delay us] [--accel steps/s^2] [--jerk steps/s^3]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (s.steps < 3 || s.delay == 0 || s.accel == 0)
+    {
+        fprintf(stderr, "needs at least 3 steps, a delay and an acceleration\n");
+        return 1;
+    }
+
+    StepperProfile profile;
+    profile.plan(s.steps, s.delay, s.accel, s.jerk);
+    StepperRamp ramp;
+    ramp.start(profile);
+    std::vector<double> ideal = idealTimes(s);
+
+    double time = 0, maxError = 0, timeBeforeLast = 0;
+    unsigned long shortest = ~0UL;
+    printf("step,delay_us,t_s,ideal_s\n");
+    for (unsigned long n = 1; n <= s.steps; n++)
+    {
+        unsigned long delay = ramp.next();
+        time += delay * 1e-6;
+        shortest = (delay < shortest) ? delay : shortest;
+        printf("%lu,%lu,%.6f,%.6f\n", n, delay, time, ideal[n]);
+        if (n + 2 <= s.steps) // the ideal profile only creeps onto the last steps
+        {
+            double speed = 1.0 / ((n > 1) ? ideal[n] - ideal[n - 1] : ideal[1]);
+            double error = (ideal[n] - time) * speed;
+            maxError = (fabs(error) > fabs(maxError)) ? error : maxError;
+            timeBeforeLast = time;
+        }
+    }
+
+    // per-step cost: time whole moves through next()
+    const int moves = 2000;
+    unsigned long sum = 0;
+    clock_t start = clock();
+    for (int i = 0; i < moves; i++)
+    {
+        ramp.start(profile);
+        for (unsigned long n = 0; n < s.steps; n++)
+        {
+            sum += ramp.next();
+        }
+    }
+    double ns = 1e9 * (clock() - start) / CLOCKS_PER_SEC / ((double)moves * s.steps);
+
+    fprintf(stderr, "%lu steps, %lu us cruise, %lu steps/s^2, %lu steps/s^3 (%s)\n", s.steps, s.delay, s.accel, s.jerk,
+            (s.jerk > 0) ? "S-curve" : "trapezoidal");
+    fprintf(stderr, "move %.4f s, %.4f s to step %lu (ideal %.4f s), shortest delay %lu us\n", time, timeBeforeLast,
+            s.steps - 2, ideal[s.steps - 2], shortest);
+    fprintf(stderr, "max position error %+.2f steps\n", maxError);
+    fprintf(stderr, "next(): %.1f ns/step on this machine [%lu]\n", ns, sum & 1);
+
+    // a 20 s step delay, without and with a ramp
+    int failures = 0;
+    const unsigned long slow = 20000000UL;
+    unsigned long longest = 0, wrong = 0;
+    profile.plan(4, slow, 0, 0);
+    ramp.start(profile);
+    for (int n = 0; n < 4; n++)
+    {
+        wrong += (ramp.next() != slow) ? 1 : 0;
+    }
+    fprintf(stderr, "4 steps at %lu us, no ramp: %lu delays wrong\n", slow, wrong);
+    failures += wrong ? 1 : 0;
+    profile.plan(40, slow, s.accel, 0);
+    ramp.start(profile);
+    for (int n = 0; n < 40; n++)
+    {
+        unsigned long delay = ramp.next();
+        longest = (delay > longest) ? delay : longest;
+    }
+    fprintf(stderr, "40 steps at %lu us, ramped: cruising at %lu us\n", slow, longest);
+    failures += (longest != STEPPER_RAMP_MAX_DELAY) ? 1 : 0;
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "slow moves ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+/*
+ Stepper speed test - steps per second for each wiring
+
+ Times how fast the library can switch a motor's coils, for 2, 3, 4 and 5
+ pin motors, two ways (like multi_bit_write_speed_test's old_way/new_way):
+   digitalWrite  - the phase sequence written a digitalWrite() per pin, as
+                   stepMotor() used to
+   stepNow       - Stepper::stepNow(): one table lookup and one port write per
+                   step, as the pins below are all on one port
+ and, for 3 and 4 pins, a third:
+   microstep    - stepNow() with setMicrostep(16): a sine table lookup and a
+                  PWM duty write per pin per microstep (ESP32: LEDC; AVR:
+                  analogWrite(), needs PWM pins off Timer1, e.g. 3, 5, 6, 11
+                  on an Uno; not on ESP8266)
+ Each line gives steps per second and the time per step: the ISR's budget,
+ so the highest step rate the board can run.  No motor needed (better
+ none: the pins switch as fast as they can).
+
+ Pins: ESP32 GPIO 16-19 and 21, ESP8266 GPIO 4, 5, 12-14, AVR digital
+ pins 8-12 (PORTB).  Put a pin on another port (e.g. GPIO 33 on an ESP32)
+ to see the digitalWrite() fallback.
+
+ */
+
+#include <Stepper.h>
+
+#if defined(ESP32)
+const int pins[5] = {16, 17, 18, 19, 21};
+#elif defined(ESP8266)
+const int pins[5] = {4, 5, 12, 13, 14};
+#else
+const int pins[5] = {8, 9, 10, 11, 12};
+#endif
+
+const long testSteps = 20000;
+
+// the phase sequence, a digitalWrite() per pin per step
+unsigned long digitalWriteMicros(int pinCount) {
+  uint8_t count;
+  const uint8_t *levels = stepperPhases(pinCount, pinCount == 3 || pinCount == 5, count);
+  int state = 0;
+  unsigned long start = micros();
+  for (long i = 0; i < testSteps; i++) {
+    state = (state + 1 < count) ? state + 1 : 0;
+    for (int pin = 0; pin < pinCount; pin++) {
+      digitalWrite(pins[pin], (levels[state] >> pin) & 1);
+    }
+  }
+  return micros() - start;
+}
+
+// the same steps through the library
+unsigned long stepNowMicros(Stepper &motor) {
+  unsigned long start = micros();
+  for (long i = 0; i < testSteps; i++) {
+    motor.stepNow(1);
+  }
+  return micros() - start;
+}
+
+void report(const char *how, int pinCount, unsigned long us) {
+  Serial.print(pinCount);
+  Serial.print(" pins, ");
+  Serial.print(how);
+  Serial.print(": ");
+  Serial.print(testSteps * 1000000.0 / us, 0);
+  Serial.print(" steps/s, ");
+  Serial.print(1000.0 * us / testSteps, 0);
+  Serial.println(" ns/step");
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(500);
+  Serial.println("Stepper speed test");
+
+  Stepper motor2(200, pins[0], pins[1]);
+  Stepper motor3(200, pins[0], pins[1], pins[2]);
+  Stepper motor4(200, pins[0], pins[1], pins[2], pins[3]);
+  Stepper motor5(200, pins[0], pins[1], pins[2], pins[3], pins[4]);
+  Stepper *motors[4] = {&motor2, &motor3, &motor4, &motor5};
+
+  for (int pinCount = 2; pinCount <= 5; pinCount++) {
+    report("digitalWrite", pinCount, digitalWriteMicros(pinCount));
+    report("stepNow     ", pinCount, stepNowMicros(*motors[pinCount - 2]));
+    if (pinCount == 3 || pinCount == 4) {
+      if (motors[pinCount - 2]->setMicrostep(16)) {
+        report("microstep   ", pinCount, stepNowMicros(*motors[pinCount - 2]));
+        motors[pinCount - 2]->setMicrostep(1);
+      } else {
+        Serial.print(pinCount);
+        Serial.println(" pins, microstep: no PWM on these pins");
+      }
+    }
+    yield();
+  }
+}
+
+void loop() {
+}
@@ -0,0 +1,213 @@
+/*
+ * StepperGroup.cpp - coordinated moves of several Steppers (see StepperGroup.h)
+ *
+ * The step timer (StepperTimer.h) runs one tick per major axis step; each
+ * tick steps the axes StepperLineQueue picked for it, and times the next.
+ */
+
+#include "Arduino.h"
+#include "StepperGroup.h"
+#include "StepperTimer.h"
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR // (AVR) ISR code needs no special placement
+#endif
+
+StepperGroup::StepperGroup()
+{
+  this->axes = 0;
+  this->running = false;
+  this->pending_step = 0;
+  this->pending_reverse = 0;
+  this->timer_wait = 0;
+  this->last_step_time = 0;
+  for (uint8_t axis = 0; axis < STEPPER_GROUP_AXES; axis++)
+  {
+    this->motors[axis] = NULL;
+    this->end[axis] = 0;
+    this->positions[axis] = 0;
+  }
+  this->queue.setAxes(0);
+}
+
+/*
+ * Adds motor as the next axis (0, 1, ...).
+ */
+bool StepperGroup::addAxis(Stepper &motor)
+{
+  if (this->axes >= STEPPER_GROUP_AXES || this->running)
+  {
+    return false;
+  }
+  this->motors[this->axes++] = &motor;
+  this->queue.setAxes(this->axes);
+  return true;
+}
+
+/*
+ * Sets the acceleration of the segments queued after it, and how sharp a
+ * corner between two segments may be taken without slowing down: no axis's
+ * speed may jump by more than jump steps/s there.
+ */
+void StepperGroup::setAcceleration(long accel, long jump)
+{
+  this->queue.setAcceleration((accel > 0) ? accel : 0, (jump > 0) ? jump : 0);
+}
+
+/*
+ * Queues a straight line of steps[axis] steps (one entry per axis added), the
+ * major axis step_delay us per step, and returns at once.  The segments
+ * already queued are planned again, to run into this one.
+ */
+bool StepperGroup::move(const long *steps, unsigned long step_delay)
+{
+  stepTimerSetup();
+  // plan outside the lock (the float math of the lookahead); publish inside,
+  // unless the ISR started a segment meanwhile: then plan again
+  while (true)
+  {
+    if (!this->queue.plan(steps, step_delay))
+    {
+      return false; // full, or nothing to move
+    }
+    stepTimerLock();
+    if (!stepTimerClaim(this, &StepperGroup::timerHandler))
+    {
+      stepTimerUnlock(); // a Stepper is moving on its own
+      return false;
+    }
+    if (this->queue.commit())
+    {
+      break;
+    }
+    stepTimerUnlock();
+  }
+
+  // (still locked)
+  for (uint8_t axis = 0; axis < this->axes; axis++)
+  {
+    this->end[axis] += steps[axis];
+  }
+  uint8_t step, reverse;
+  unsigned long first_delay;
+  if (!this->running && this->queue.take(step, reverse, first_delay))
+  {
+    // idle: start the timer for the first tick
+    this->running = true;
+    this->pending_step = step;
+    this->pending_reverse = reverse;
+    unsigned long since = micros() - this->last_step_time;
+    unsigned long wait = (since < first_delay) ? first_delay - since : 1;
+    unsigned long piece = (wait < stepTimerMaxWait) ? wait : stepTimerMaxWait;
+    this->timer_wait = wait - piece;
+    stepTimerStart(piece);
+  }
+  stepTimerUnlock();
+  return true;
+}
+
+/*
+ * Queues a straight line to targets[axis] (positions as position() counts
+ * them), from where the queued segments end.
+ */
+bool StepperGroup::moveTo(const long *targets, unsigned long step_delay)
+{
+  long steps[STEPPER_GROUP_AXES];
+  for (uint8_t axis = 0; axis < this->axes; axis++)
+  {
+    steps[axis] = targets[axis] - this->end[axis];
+  }
+  return this->move(steps, step_delay);
+}
+
+/*
+ * Returns true while segments are still queued or being stepped.
+ */
+bool StepperGroup::isBusy()
+{
+  stepTimerPoll();
+  return this->running;
+}
+
+/*
+ * Stops after the tick in progress, dropping the queued segments.
+ */
+void StepperGroup::stop()
+{
+  stepTimerLock();
+  if (this->running)
+  {
+    stepTimerStop();
+    this->running = false;
+    stepTimerRelease(this);
+  }
+  this->queue.clear();
+  this->timer_wait = 0;
+  for (uint8_t axis = 0; axis < this->axes; axis++)
+  {
+    this->end[axis] = this->positions[axis];
+  }
+  stepTimerUnlock();
+}
+
+long StepperGroup::position(uint8_t axis)
+{
+  stepTimerLock();
+  long where = (axis < this->axes) ? this->positions[axis] : 0;
+  stepTimerUnlock();
+  return where;
+}
+
+void IRAM_ATTR StepperGroup::timerHandler(void *group)
+{
+  ((StepperGroup *)group)->onStepTimer();
+}
+
+/*
+ * Step timer interrupt (with the ISR locked out of everything else): step
+ * the axes of the tick that is due, and time the next tick.
+ */
+void IRAM_ATTR StepperGroup::onStepTimer()
+{
+  if (this->timer_wait > 0)
+  {
+    this->schedule(this->timer_wait); // the next piece of a long wait
+    return;
+  }
+  this->last_step_time = micros();
+  for (uint8_t axis = 0; axis < this->axes; axis++)
+  {
+    uint8_t bit = 1 << axis;
+    if (this->pending_step & bit)
+    {
+      int direction = (this->pending_reverse & bit) ? -1 : 1;
+      this->motors[axis]->advance(direction);
+      this->positions[axis] += direction;
+    }
+  }
+
+  uint8_t step, reverse;
+  unsigned long tick_delay;
+  if (this->queue.take(step, reverse, tick_delay))
+  {
+    this->pending_step = step;
+    this->pending_reverse = reverse;
+    this->schedule(tick_delay);
+  }
+  else
+  {
+    stepTimerStop(); // all segments done
+    this->running = false;
+    stepTimerRelease(this);
+  }
+}
+
+/*
+ * Times the next tick, wait us after the one just taken.
+ */
+void IRAM_ATTR StepperGroup::schedule(unsigned long wait)
+{
+  unsigned long piece = (wait < stepTimerMaxWait) ? wait : stepTimerMaxWait;
+  this->timer_wait = wait - piece;
+  stepTimerArm((piece > 0) ? piece : 1);
+}
@@ -0,0 +1,72 @@
+/*
+ * StepperGroup.h - coordinated moves of several Steppers
+ *
+ * Drives up to STEPPER_GROUP_AXES motors (Stepper objects, any wiring)
+ * together: move() and moveTo() queue a straight line (steps per axis) and
+ * return at once; the step timer ISR interleaves the axes' steps Bresenham
+ * style (StepperLine.h), so they all start and finish each segment together.
+ * Speeds and accelerations are those of the axis with the most steps in the
+ * segment (the major axis).  With an acceleration set, segments queued back
+ * to back run into each other without stopping, as fast as the corner
+ * between them allows (lookahead, see StepperLine.h).
+ *
+ * The group owns the step timer while it moves, so its motors' own
+ * step()/stepAsync() wait (or are refused) until it is done.
+ *
+ *   Stepper x(200, 16, 17, 18), y(200, 19, 21, 22);
+ *   StepperGroup xy;
+ *   xy.addAxis(x);
+ *   xy.addAxis(y);
+ *   xy.setAcceleration(4000, 200);
+ *   long corner[2] = {400, 300};
+ *   xy.moveTo(corner, 500);
+ */
+
+// ensure this library description is only included once
+#ifndef StepperGroup_h
+#define StepperGroup_h
+
+#include "Stepper.h"
+#include "StepperLine.h"
+
+class StepperGroup
+{
+public:
+        StepperGroup();
+
+        // adds the next axis (false if the group is full or moving)
+        bool addAxis(Stepper &motor);
+
+        // accel in major axis steps/s^2 (0 = no ramps, each segment at its
+        // speed throughout); jump: the largest sudden speed change allowed of
+        // any axis, where the segments meet, in steps/s
+        void setAcceleration(long accel, long jump);
+
+        // queue a segment, step_delay us per major axis step (false if the
+        // queue is full, or another Stepper is using the step timer):
+        bool move(const long *steps, unsigned long step_delay);      // steps per axis, negative = reverse
+        bool moveTo(const long *targets, unsigned long step_delay);  // to these positions
+        bool isBusy();                                               // segments still queued or in progress
+        void stop();                                                 // drop all queued segments
+
+        long position(uint8_t axis); // steps the axis has taken (from 0, where the group started)
+
+private:
+        void onStepTimer();
+        static void timerHandler(void *group);
+        void schedule(unsigned long wait);
+
+        Stepper *motors[STEPPER_GROUP_AXES];
+        uint8_t axes;                             // motors added
+        StepperLineQueue queue;                   // segments not taken yet
+        long end[STEPPER_GROUP_AXES];             // position at the end of the queued segments
+        volatile long positions[STEPPER_GROUP_AXES]; // position now
+
+        volatile bool running;    // the step timer is running for this group
+        uint8_t pending_step;     // axes stepping on the tick the timer is timing
+        uint8_t pending_reverse;  // and those of them stepping backwards
+        unsigned long timer_wait; // us still to wait after this timer period
+        unsigned long last_step_time; // time stamp in us of the last tick
+};
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * StepperPhases.h - phase tables for the Stepper library
+ *
+ * The control signal sequence of each wiring (2, 3, 4 or 5 pins), full and
+ * half step, as one byte per state: bit 0 = motor_pin_1 ... bit 4 =
+ * motor_pin_5 (1 = HIGH).  The sequences are the ones listed in Stepper.h;
+ * the half step tables put the in-between state after each full step
+ * state.  Stepper turns them into port bits once, in its constructor, so
+ * stepMotor() only looks up a word and writes the port.
+ *
+ * Kept free of Arduino headers so it can be compiled natively.
+ */
+
+// ensure this library description is only included once
+#ifndef StepperPhases_h
+#define StepperPhases_h
+
+#include <stdint.h>
+
+#define STEPPER_MAX_PHASES 10 // states in the longest table (5 pins, half step)
+
+// one word of output port bits
+#if defined(__AVR__)
+typedef uint8_t stepper_port_t;
+#else
+typedef uint32_t stepper_port_t;
+#endif
+
+// 2 wires (the driver inverts them for the other 2 coil ends): full step only
+static const uint8_t STEPPER_PHASES_2[4] = {0b10, 0b11, 0b01, 0b00};
+
+// 3 wires (3-phase): two coils on, or one and two coils in turn
+static const uint8_t STEPPER_PHASES_3_FULL[3] = {0b101, 0b011, 0b110};
+static const uint8_t STEPPER_PHASES_3_HALF[6] = {0b100, 0b101, 0b001, 0b011, 0b010, 0b110};
+
+// 4 wires: two coils on, or two and one coil in turn
+static const uint8_t STEPPER_PHASES_4_FULL[4] = {0b0101, 0b0110, 0b1010, 0b1001};
+static const uint8_t STEPPER_PHASES_4_HALF[8] = {0b0101, 0b0100, 0b0110, 0b0010,
+                                                 0b1010, 0b1000, 0b1001, 0b0001};
+
+// 5 wires (5-phase): three coils on, or three and two coils in turn
+static const uint8_t STEPPER_PHASES_5_FULL[5] = {0b10110, 0b11010, 0b01011, 0b01101, 0b10101};
+static const uint8_t STEPPER_PHASES_5_HALF[10] = {0b10110, 0b10010, 0b11010, 0b01010, 0b01011,
+                                                  0b01001, 0b01101, 0b00101, 0b10101, 0b10100};
+
+/*
+ * The table for pin_count pins; its length in count.  2 pins have no half
+ * step table (the full step one is returned).
+ */
+static inline const uint8_t *stepperPhases(int pin_count, bool half_step, uint8_t &count)
+{
+        switch (pin_count)
+        {
+        case 3:
+                count = half_step ? 6 : 3;
+                return half_step ? STEPPER_PHASES_3_HALF : STEPPER_PHASES_3_FULL;
+        case 4:
+                count = half_step ? 8 : 4;
+                return half_step ? STEPPER_PHASES_4_HALF : STEPPER_PHASES_4_FULL;
+        case 5:
+                count = half_step ? 10 : 5;
+                return half_step ? STEPPER_PHASES_5_HALF : STEPPER_PHASES_5_FULL;
+        default:
+                count = 4;
+                return STEPPER_PHASES_2;
+        }
+}
+
+#endif
@@ -0,0 +1,347 @@
+/*
+ * StepperRamp.h - acceleration-limited step timing for the Stepper library
+ *
+ * A move starts from standstill, accelerates to its cruise speed, and
+ * decelerates to a stop on its last step, either
+ *   trapezoidal - constant acceleration, or
+ *   S-curve     - jerk-limited: the acceleration itself ramps up and down.
+ *
+ * The delay from one step to the next comes from David Leib's recurrence
+ * ("Generate stepper-motor speed profiles in real time"): with p the step
+ * delay and R = a * p^2 (a = acceleration, time in us),
+ *     p' = p * (1 - R + 1.5 * R^2)   accelerating,
+ *     p' = p * (1 + R + 1.5 * R^2)   decelerating,
+ * and for the S-curve a changes by jerk * p each step.  The series is only
+ * good once R is small, so the first steps from standstill (and the last
+ * ones into it) follow a table of delay ratios instead: step n of a constant
+ * acceleration is at sqrt(n) times the first step's time, of a constant jerk
+ * at cbrt(n) times.  All of it is integer multiplies and shifts, no division
+ * or floating point per step, so it keeps up on an ATmega328P.  The division
+ * and square roots happen once per move, in plan().
+ *
+ * Fixed point: planned delays are Q8 us, the running delay Q16 (at 10000
+ * steps/s a step changes the delay by a few thousandths of a us); the
+ * acceleration is kept as Leib's multiplier K = a * 2^52 / 10^12, so that
+ * R (Q32) = (p^2 * K) >> 20 for p in us; the jerk as the change in K (Q16)
+ * per Q8 us of delay.
+ *
+ * A move can also start and end moving (StepperGroup's lookahead joins
+ * segments that way): a speed v is given as the steps it takes to reach it
+ * from standstill, v^2 / (2 * a), and the ramp picks up the tables and the
+ * recurrence from there, as if it had started that many steps earlier.
+ * Such moves are trapezoidal.
+ *
+ * Kept free of Arduino headers so it can be compiled natively.
+ */
+
+// ensure this library description is only included once
+#ifndef StepperRamp_h
+#define StepperRamp_h
+
+#include <stdint.h>
+#include <math.h>
+
+#define STEPPER_RAMP_MAX_DELAY 4000000UL // us; slowest step (Q8 fits 32 bits)
+#define STEPPER_RAMP_TABLE 16          // steps from/to standstill timed from the tables
+
+// delay of step n+1 / delay of step n (Q14), n = 1..15, from standstill:
+// constant acceleration (sqrt), constant jerk (cbrt)
+static const uint16_t STEPPER_RATIO_SQRT[STEPPER_RAMP_TABLE - 1] = {
+    6786, 12572, 13812, 14435, 14812, 15067, 15250, 15388, 15496, 15583, 15655, 15714, 15765, 15809, 15846};
+static const uint16_t STEPPER_RATIO_CBRT[STEPPER_RAMP_TABLE - 1] = {
+    4259, 11493, 13043, 13836, 14322, 14651, 14889, 15070, 15211, 15325, 15419, 15497, 15564, 15621, 15671};
+// and the other way round, into standstill: delay of step n / delay of step n+1
+static const uint16_t STEPPER_INVERSE_SQRT[STEPPER_RAMP_TABLE - 1] = {
+    39554, 21352, 19434, 18597, 18123, 17817, 17602, 17444, 17322, 17226, 17147, 17082, 17027, 16980, 16940};
+static const uint16_t STEPPER_INVERSE_CBRT[STEPPER_RAMP_TABLE - 1] = {
+    63035, 23356, 20580, 19402, 18744, 18322, 18029, 17813, 17647, 17516, 17410, 17321, 17247, 17184, 17129};
+
+/*
+ * A planned move (computed when it is queued).
+ */
+struct StepperProfile
+{
+        unsigned long steps;      // steps in the move
+        unsigned long decel_from; // steps taken when the deceleration starts
+        uint32_t p_first;         // Q8 us: first step, from standstill
+        uint32_t p_min;           // Q8 us: cruise step delay (at most STEPPER_RAMP_MAX_DELAY)
+        unsigned long delay;      // us: cruise step delay as given (constant speed moves, any length)
+        uint32_t k_peak;          // acceleration (K); 0 = constant speed, p_min
+        uint32_t jerk;            // K change (Q16) per Q8 us; 0 = trapezoidal
+        uint32_t p_knee;          // Q8 us: S-curve, start easing the acceleration off
+        uint32_t p_knee_low;      // Q8 us: S-curve, start easing the deceleration off
+        uint32_t p_last;          // Q8 us: last step, into the exit speed
+        unsigned long entry;      // entry speed, as steps from standstill (0 = standstill)
+        unsigned long exit;       // exit speed, the same way
+        uint8_t table_steps;      // steps from/to standstill timed from the tables
+
+        /*
+         * Plans a move of steps steps, cruising at step_delay us per step.
+         * accel in steps/s^2 (0 = no ramp: every step step_delay apart, as
+         * setSpeed() always did), jerk in steps/s^3 (0 = trapezoidal).
+         * Moves too short to reach the cruise speed peak lower; ramped moves
+         * cruise no slower than STEPPER_RAMP_MAX_DELAY.  entry and
+         * exit (steps from standstill at accel, see above; trapezoidal only)
+         * must be reachable: |entry - exit| <= steps, neither above cruise.
+         */
+        void plan(unsigned long steps, unsigned long step_delay, unsigned long accel, unsigned long jerk,
+                  unsigned long entry = 0, unsigned long exit = 0)
+        {
+                this->steps = steps;
+                this->delay = step_delay;
+                this->p_min = (uint32_t)((step_delay < STEPPER_RAMP_MAX_DELAY) ? step_delay : STEPPER_RAMP_MAX_DELAY) << 8;
+                this->k_peak = 0;
+                this->jerk = 0;
+                this->decel_from = steps;
+                this->p_first = this->p_last = this->p_knee = this->p_knee_low = this->p_min;
+                this->entry = this->exit = 0;
+                this->table_steps = 0;
+                if (accel == 0 || steps == 0)
+                {
+                        return;
+                }
+                accel = (accel < 950000UL) ? accel : 950000UL; // K fits 32 bits
+                float a = accel, j = jerk;
+                if (j > 0 && (a * a * a / (6 * j * j) < 2 || entry > 0 || exit > 0))
+                {
+                        j = 0; // jerk phase under 2 steps, or joined moves: trapezoidal
+                }
+                if (j == 0)
+                {
+                        this->planTrapezoid(steps, step_delay, a, entry, exit);
+                        return;
+                }
+
+                // top speed: the cruise speed, unless half the move is too short to get there
+                float v = 1e6f / ((step_delay > 0) ? step_delay : 1);
+                if (2 * distance(v, a, j) > steps)
+                {
+                        float low = 0, high = v;
+                        for (uint8_t i = 0; i < 24; i++)
+                        {
+                                v = (low + high) / 2;
+                                (2 * distance(v, a, j) > steps) ? high = v : low = v;
+                        }
+                        v = low;
+                }
+                unsigned long ramp = (unsigned long)(distance(v, a, j) + 0.5f);
+                this->decel_from = steps - ((ramp < steps / 2) ? ramp : steps / 2);
+
+                // peak acceleration: a, or less if the speed is reached first
+                float peak = (v * j < a * a) ? sqrtf(v * j) : a;
+                this->k_peak = kOf(peak);
+                this->jerk = (uint32_t)(j * 4.5035996e-3f * 65536.0f / 256.0f + 0.5f);
+                this->p_first = this->p_last = delayOf(cbrtf(6.0f / j)); // step n at cbrt(6n / j)
+                // the tables only hold while the jerk alone sets the pace
+                float jerk_steps = peak * peak * peak / (6 * j * j);
+                this->table_steps = (jerk_steps < STEPPER_RAMP_TABLE) ? (uint8_t)jerk_steps : STEPPER_RAMP_TABLE;
+                // the speed change still to come when the acceleration eases off
+                float easing = peak * peak / (2 * j);
+                this->p_knee = delayOf(1.0f / (v - easing));
+                this->p_knee_low = delayOf(1.0f / easing);
+        }
+
+        // steps from standstill to reach v steps/s at accel (entry and exit speeds)
+        static unsigned long speedSteps(float v, unsigned long accel)
+        {
+                return (accel > 0) ? (unsigned long)(v * v / (2.0f * accel) + 0.5f) : 0;
+        }
+
+private:
+        void planTrapezoid(unsigned long steps, unsigned long step_delay, float a, unsigned long entry,
+                           unsigned long exit)
+        {
+                // top speed, as steps from standstill: the cruise speed, or where
+                // the ramp up from the entry speed meets the ramp down to the exit
+                float v = 1e6f / ((step_delay > 0) ? step_delay : 1);
+                float top = v * v / (2 * a);
+                top = (2 * top < steps + entry + exit) ? top : (steps + entry + exit) / 2.0f;
+                float ramp_down = (top > exit) ? top - exit : 0;
+                this->decel_from = steps - ((ramp_down < steps) ? (unsigned long)(ramp_down + 0.5f) : steps);
+                this->entry = entry;
+                this->exit = exit;
+                this->k_peak = kOf(a);
+                // step n from standstill at sqrt(2n / a)
+                float unit = sqrtf(2.0f / a);
+                this->p_first = delayOf(unit * (sqrtf(entry + 1.0f) - sqrtf((float)entry)));
+                this->p_last = delayOf(unit * (sqrtf(exit + 1.0f) - sqrtf((float)exit)));
+                this->table_steps = STEPPER_RAMP_TABLE;
+        }
+
+        // steps to reach speed v from standstill
+        static float distance(float v, float a, float j)
+        {
+                if (j == 0)
+                {
+                        return v * v / (2 * a);
+                }
+                // symmetric S-curve: average speed v/2 for the ramp time
+                float time = (v * j >= a * a) ? v / a + a / j : 2 * sqrtf(v / j);
+                return v / 2 * time;
+        }
+
+        static uint32_t kOf(float a) { return (uint32_t)(a * 4503.5996f + 0.5f); }
+
+        // Q8 us, seconds in, capped at STEPPER_RAMP_MAX_DELAY
+        static uint32_t delayOf(float seconds)
+        {
+                float us = seconds * 1e6f;
+                return (uint32_t)(((us > 0 && us < STEPPER_RAMP_MAX_DELAY) ? us : STEPPER_RAMP_MAX_DELAY) * 256.0f);
+        }
+};
+
+/*
+ * Step timing for one planned move (ISR side).
+ */
+class StepperRamp
+{
+public:
+        void start(const StepperProfile &profile)
+        {
+                this->profile = &profile;
+                this->step_count = 0;
+                this->p = (uint64_t)profile.p_first << 8;
+                this->k = (profile.jerk > 0) ? 0 : (uint64_t)profile.k_peak << 16;
+                this->phase = ACCELERATING;
+                this->easing = false;
+                this->fraction = 0;
+        }
+
+        /*
+         * The delay (us) from the step before to the next step of the move.
+         */
+        inline unsigned long next()
+        {
+                const StepperProfile &plan = *this->profile;
+                this->step_count++;
+                if (plan.k_peak == 0)
+                {
+                        return plan.delay; // constant speed
+                }
+                if (this->step_count == 1)
+                {
+                        this->updateAcceleration(false);
+                        return this->whole(); // from standstill
+                }
+                if (this->step_count > plan.decel_from && this->phase != DECELERATING)
+                {
+                        this->phase = DECELERATING;
+                        this->k = (plan.jerk > 0) ? 0 : (uint64_t)plan.k_peak << 16;
+                        this->easing = false;
+                }
+
+                unsigned long left = plan.steps - this->step_count; // steps after this one
+                switch (this->phase)
+                {
+                case ACCELERATING:
+                        if (this->step_count + plan.entry <= plan.table_steps)
+                        {
+                                this->p = scale(this->p, ratio(plan, this->step_count + plan.entry - 1, false));
+                        }
+                        else
+                        {
+                                this->p -= this->change(false);
+                        }
+                        this->updateAcceleration(this->p <= q16(plan.p_knee));
+                        if (this->p <= q16(plan.p_min) || (plan.jerk > 0 && this->k == 0))
+                        {
+                                this->p = (this->p > q16(plan.p_min)) ? this->p : q16(plan.p_min);
+                                this->phase = CRUISING;
+                        }
+                        break;
+                case CRUISING:
+                        break;
+                case DECELERATING:
+                        if (left + 1 + plan.exit < plan.table_steps)
+                        {
+                                this->p = scale(this->p, ratio(plan, left + 1 + plan.exit, true));
+                        }
+                        else
+                        {
+                                this->p += this->change(true);
+                        }
+                        this->updateAcceleration(this->p >= q16(plan.p_knee_low));
+                        this->p = (this->p < q16(plan.p_last)) ? this->p : q16(plan.p_last);
+                        break;
+                }
+                return this->whole();
+        }
+
+private:
+        enum rampPhase
+        {
+                ACCELERATING,
+                CRUISING,
+                DECELERATING
+        };
+
+        // p in whole us, carrying the fraction over to the next step (so the
+        // time of each step is right, not just its delay rounded down)
+        inline unsigned long whole()
+        {
+                uint64_t total = this->p + this->fraction;
+                this->fraction = total & 0xFFFF;
+                return (unsigned long)(total >> 16);
+        }
+
+        static inline uint64_t q16(uint32_t q8) { return (uint64_t)q8 << 8; }
+
+        // table ratio for step n (1-15) from standstill, or into it
+        static inline uint16_t ratio(const StepperProfile &plan, unsigned long n, bool into)
+        {
+                if (plan.jerk > 0)
+                {
+                        return into ? STEPPER_INVERSE_CBRT[n - 1] : STEPPER_RATIO_CBRT[n - 1];
+                }
+                return into ? STEPPER_INVERSE_SQRT[n - 1] : STEPPER_RATIO_SQRT[n - 1];
+        }
+
+        static inline uint64_t scale(uint64_t p, uint16_t q14) { return (p * q14) >> 14; }
+
+        // S-curve: ramp the acceleration up to its peak, and back down once ease_off
+        inline void updateAcceleration(bool ease_off)
+        {
+                const StepperProfile &plan = *this->profile;
+                if (plan.jerk == 0)
+                {
+                        return;
+                }
+                if (ease_off && !this->easing)
+                {
+                        this->easing = true; // the knee falls within this step: hold the acceleration
+                        return;
+                }
+                uint64_t delta = (uint64_t)plan.jerk * (uint32_t)(this->p >> 8);
+                if (this->easing)
+                {
+                        this->k = (this->k > delta) ? this->k - delta : 0;
+                }
+                else
+                {
+                        this->k += delta;
+                        uint64_t peak = (uint64_t)plan.k_peak << 16;
+                        this->k = (this->k < peak) ? this->k : peak;
+                }
+        }
+
+        // |p' - p| (Q16) from Leib's recurrence
+        inline uint64_t change(bool decelerating)
+        {
+                uint64_t p8 = this->p >> 8;                             // Q8
+                uint64_t r = (((p8 * p8) >> 16) * (uint32_t)(this->k >> 16)) >> 20; // R (Q32) = p^2 (us^2) * K
+                uint64_t first = (p8 * r) >> 24;                        // p * R
+                uint64_t second = (first * r) >> 32;                    // p * R^2
+                uint64_t delta = decelerating ? first + second + (second >> 1) : first - second - (second >> 1);
+                return (delta < this->p) ? delta : this->p - 65536; // (accelerating) keep p > 0
+        }
+
+        const StepperProfile *profile;
+        unsigned long step_count;
+        uint64_t p; // Q16 us, current step delay
+        uint64_t k; // acceleration (K, Q16)
+        rampPhase phase;
+        bool easing;      // S-curve: acceleration ramping down
+        uint16_t fraction; // Q16 us not yet timed
+};
+
+#endif
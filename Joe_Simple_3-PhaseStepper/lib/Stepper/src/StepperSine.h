@@ -0,0 +1,121 @@
+/*
+ * StepperSine.h - microstepping duties for the Stepper library
+ *
+ * In microstep mode the motor pins are PWM outputs, and the coil currents
+ * follow a sine of the electrical angle instead of switching between the
+ * phase table states:
+ *   3 pins (3-phase, half bridges) - pin k gets 1/2 + 1/2 cos(angle - k 120deg)
+ *   4 pins (2 coils, H-bridges)    - coil A (pins 1, 2) cos(angle), coil B
+ *                                    (pins 3, 4) sin(angle): the magnitude on
+ *                                    pin 1 or 3 when positive, pin 2 or 4 when
+ *                                    negative, the other pin off
+ * One electrical turn is STEPPER_SINE_TURN angle units: 3 full steps of 128
+ * (3-phase) or 4 of 96 (4 pins), so 1/2 .. 1/32 steps are whole units.  The
+ * full (and half) step states of StepperPhases.h sit at the angles
+ * stepperPhaseAngle() gives, so switching modes doesn't move the motor.
+ *
+ * Only a quarter of the sine is stored (in flash on AVR); the other three
+ * quadrants are mirror images of it.  Integer math only, for the ISR.
+ *
+ * Kept free of Arduino headers so it can be compiled natively.
+ */
+
+// ensure this library description is only included once
+#ifndef StepperSine_h
+#define StepperSine_h
+
+#include <stdint.h>
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define STEPPER_FLASH PROGMEM
+#define stepperFlashWord(address) pgm_read_word(address)
+#else
+#define STEPPER_FLASH
+#define stepperFlashWord(address) (*(address))
+#endif
+
+#define STEPPER_SINE_TURN 384   // angle units per electrical turn
+#define STEPPER_SINE_QUARTER 96 // and per 90 degrees
+#define STEPPER_MAX_MICROSTEPS 32
+
+// sin(i * 90deg / 96) * 65535, i = 0 .. 96
+static const uint16_t STEPPER_SINE[STEPPER_SINE_QUARTER + 1] STEPPER_FLASH = {
+        0, 1072, 2144, 3216, 4286, 5356, 6424, 7490, 8554, 9616, 10675, 11732,
+        12785, 13835, 14881, 15924, 16962, 17995, 19024, 20047, 21066, 22078, 23085, 24085,
+        25079, 26066, 27047, 28020, 28985, 29943, 30893, 31835, 32767, 33692, 34607, 35513,
+        36409, 37296, 38173, 39039, 39895, 40741, 41575, 42398, 43210, 44011, 44799, 45576,
+        46340, 47092, 47832, 48558, 49272, 49972, 50659, 51333, 51992, 52638, 53270, 53887,
+        54490, 55079, 55652, 56211, 56755, 57284, 57797, 58294, 58777, 59243, 59693, 60128,
+        60546, 60949, 61335, 61704, 62057, 62393, 62713, 63016, 63302, 63571, 63823, 64058,
+        64276, 64476, 64660, 64826, 64974, 65106, 65219, 65316, 65395, 65456, 65500, 65526,
+        65535};
+
+/*
+ * sin(angle) * 65535, angle in units (any value below 3 turns).
+ */
+static inline int32_t stepperSine(uint16_t angle)
+{
+        while (angle >= STEPPER_SINE_TURN)
+        {
+                angle -= STEPPER_SINE_TURN;
+        }
+        if (angle < STEPPER_SINE_QUARTER)
+        {
+                return stepperFlashWord(&STEPPER_SINE[angle]);
+        }
+        if (angle < 2 * STEPPER_SINE_QUARTER)
+        {
+                return stepperFlashWord(&STEPPER_SINE[2 * STEPPER_SINE_QUARTER - angle]);
+        }
+        if (angle < 3 * STEPPER_SINE_QUARTER)
+        {
+                return -(int32_t)stepperFlashWord(&STEPPER_SINE[angle - 2 * STEPPER_SINE_QUARTER]);
+        }
+        return -(int32_t)stepperFlashWord(&STEPPER_SINE[STEPPER_SINE_TURN - angle]);
+}
+
+/*
+ * Angle units per full step: 120deg (3 pins) or 90deg (4 pins); 0 for the
+ * wirings without microstepping.
+ */
+static inline uint16_t stepperFullStepAngle(int pin_count)
+{
+        return (pin_count == 3) ? STEPPER_SINE_TURN / 3 : (pin_count == 4) ? STEPPER_SINE_TURN / 4 : 0;
+}
+
+/*
+ * The angle of state phase of the full or half step table (StepperPhases.h).
+ */
+static inline uint16_t stepperPhaseAngle(int pin_count, bool half_step, uint8_t phase)
+{
+        uint16_t per_state = stepperFullStepAngle(pin_count) / (half_step ? 2 : 1);
+        // 3 pins: 0b101 (pin 2 low) points at 300deg; 4 pins: 0b0101 (both coils +) at 45deg
+        uint16_t first = (pin_count == 3) ? (half_step ? 256 : 320) : 48;
+        return (first + phase * per_state) % STEPPER_SINE_TURN;
+}
+
+/*
+ * The PWM duties (0 .. 2^bits - 1, bits <= 16) of the pins at angle.
+ */
+static inline void stepperMicroDuties(int pin_count, uint16_t angle, uint8_t bits, uint16_t *duty)
+{
+        if (pin_count == 3)
+        {
+                // cos(angle - k 120deg) = sin(angle + 90deg + k 240deg)
+                for (uint8_t k = 0; k < 3; k++)
+                {
+                        int32_t wave = stepperSine(angle + STEPPER_SINE_QUARTER + k * (2 * STEPPER_SINE_TURN / 3));
+                        duty[k] = (uint16_t)((uint32_t)(65535 + wave) >> (17 - bits));
+                }
+                return;
+        }
+        int32_t a = stepperSine(angle + STEPPER_SINE_QUARTER); // cos
+        int32_t b = stepperSine(angle);
+        duty[0] = (a > 0) ? (uint16_t)((uint32_t)a >> (16 - bits)) : 0;
+        duty[1] = (a < 0) ? (uint16_t)((uint32_t)-a >> (16 - bits)) : 0;
+        duty[2] = (b > 0) ? (uint16_t)((uint32_t)b >> (16 - bits)) : 0;
+        duty[3] = (b < 0) ? (uint16_t)((uint32_t)-b >> (16 - bits)) : 0;
+}
+
+#endif
@@ -0,0 +1,302 @@
+// AutotuneCheck -- check the relay autotune (PID_ATune) on simulated plants, on a PC
+//   - first order plus dead time: a plant whose ultimate gain and period are known
+//     (atan(w tau) + w L = pi, Ku = sqrt(1 + (w tau)^2) / K, Pu = 2 pi / w).  The relay's
+//     describing function is an approximation (from the fundamental alone), good to a few %
+//     on these: passes when Pu and Ku are within 10%
+//   - a joeBot3 wheel, as the sketch tunes it: a first order motor (0.15 s) with a dead band,
+//     counted an edge at a time, the speed from the real EncoderSampler (10 ms samples, over
+//     the last 4), cruising on the sketch's PID_fix<20> tunings, then the relay from there
+//     (+/- 40 PWM, noise band 25 ticks/s: one step of that speed).  At 10.8, 12.1 and 13.2 V
+//     (the motor's speed per PWM in proportion): passes when it converges within 10 s every
+//     time, Pu agrees within 10% and Ku * volts within 15% (the loop's the same but for the
+//     motor's gain)
+//   - the tunings in use: setpoint steps (from fast: medium, fast, medium) with the sketch's
+//     tunings and the tuned ones: the mean absolute error (ticks/s) and overshoot of each
+//     step, and the rms error over its last second.  Passes when the tuned loop settles
+//     (last second's rms error under 3% of the setpoint)
+//   - a relay that can't move the input (below the dead band) fails, by the timeout
+//   - PID_SaveTunings() / PID_LoadTunings(): round trip, erased and corrupted EEPROM
+// The tuning runs' speeds and outputs, every sample, go to stdout (CSV), the results to stderr.
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -DARDUINO=100 -I. -I../shim -I../../lib/PID_v1 -I../../lib/EncoderSampler AutotuneCheck.cpp ../../lib/EncoderSampler/EncoderSampler.cpp -o autotunecheck
+//   ./autotunecheck > tuning.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "Arduino.h"
+#include "EEPROM.h"
+#include "Encoder.h"
+#include "EncoderSampler.h"
+#include "PID_fix.h"
+#include "PID_AutoTune.h"
+
+#define TICKS_PER_PWM 19.6419 // ticks/s per PWM unit at 12.1 V, as the sketch's setpoint
+#define CONTROL_MS 10
+#define STEP_US 50
+
+EEPROMClass EEPROM;
+unsigned long now_us = 0;
+unsigned long millis() { return now_us / 1000; }
+
+int failures = 0;
+void check(bool ok, const char *what)
+{
+    fprintf(stderr, "  %-6s %s\n", ok ? "ok" : "FAILED", what);
+    failures += ok ? 0 : 1;
+}
+
+//------------------------------- first order plus dead time -------------------------------
+bool fopdt(double K, double tau, double L)
+{
+    // the ultimate frequency: atan(w tau) + w L = pi
+    double lo = 1e-6, hi = M_PI / L;
+    for (int i = 0; i < 100; i++)
+    {
+        double w = (lo + hi) / 2;
+        ((atan(w * tau) + w * L < M_PI) ? lo : hi) = w;
+    }
+    double w = (lo + hi) / 2, KuTrue = sqrt(1 + w * tau * w * tau) / K, PuTrue = 2 * M_PI / w;
+
+    // the plant at 1 ms, sampled every 10; settled at the setpoint to start
+    double input = 1, output = 1 / K, setpoint = 1, y = 1;
+    std::vector<double> delayed((size_t)(L * 1000), output);
+    size_t slot = 0;
+    PID_ATune<double> tune(&input, &output, &setpoint);
+    tune.SetSampleTime(CONTROL_MS);
+    tune.Start(output, 0.5 / K);
+    int result = ATUNE_RUNNING, ms = 0;
+    for (; result == ATUNE_RUNNING && ms < 120000; ms++)
+    {
+        if (ms % CONTROL_MS == 0)
+        {
+            input = y;
+            result = tune.Runtime();
+        }
+        double u = delayed[slot];
+        delayed[slot] = output;
+        slot = (slot + 1) % delayed.size();
+        y += (K * u - y) * 0.001 / tau;
+    }
+    double puErr = tune.GetPu() / PuTrue - 1, kuErr = tune.GetKu() / KuTrue - 1;
+    fprintf(stderr, "  K %.1f tau %.2f s L %.2f s: Ku %.3f (%.3f, %+.0f%%) Pu %.3f s (%.3f, %+.0f%%) in %.1f s\n", K, tau,
+            L, tune.GetKu(), KuTrue, kuErr * 100, tune.GetPu(), PuTrue, puErr * 100, ms / 1000.0);
+    return result == ATUNE_DONE && fabs(puErr) <= 0.10 && fabs(kuErr) <= 0.10;
+}
+
+//------------------------------------ a joeBot3 wheel -------------------------------------
+struct wheel
+{
+    double gain, deadband = 30, tau = 0.15;
+    double speed = 0, position = 0; // ticks/s, ticks
+    long counted = 0;
+    Encoder encoder;
+
+    void step(double pwm, double dt)
+    {
+        double target = (fabs(pwm) < deadband) ? 0 : gain * pwm;
+        speed += (target - speed) * dt / tau;
+        position += speed * dt;
+        long c = (long)floor(position);
+        encoder.position += c - counted;
+        counted = c;
+    }
+};
+
+struct loop
+{
+    wheel w;
+    EncoderSampler sampler;
+    long input = 0, output = 0, setpoint;
+    PID_fix<20> pid;
+    FILE *trace;
+
+    loop(double volts, double kp, double ki, double kd, FILE *csv)
+        : sampler(w.encoder, w.encoder, CONTROL_MS, 4), setpoint(190 * 196419L / 10000),
+          pid(&input, &output, &setpoint, kp, ki, kd, DIRECT), trace(csv)
+    {
+        now_us = 0;
+        w.gain = TICKS_PER_PWM * volts / 12.1;
+        output = 190;
+        pid.SetMode(AUTOMATIC);
+        pid.SetSampleTime(CONTROL_MS);
+        sampler.begin();
+    }
+
+    // one sample: its speed to input, control(), then the output to the motor (after ~0.5 ms)
+    template <class F> void sample(F control)
+    {
+        while (!sampler.available())
+        {
+            w.step(output, STEP_US * 1e-6);
+            now_us += STEP_US;
+            if (now_us % 1000 == 0)
+            {
+                sampler.tick();
+            }
+        }
+        input = sampler.leftSpeed();
+        control();
+        if (trace)
+        {
+            fprintf(trace, "%lu,%ld,%ld,%ld\n", now_us / 1000, setpoint, input, output);
+        }
+    }
+};
+
+struct tuning
+{
+    int result;
+    double seconds, Ku, Pu, Kp, Ki;
+};
+
+tuning tuneWheel(double volts, FILE *csv)
+{
+    loop l(volts, 0.01705407711, 0.16077170418, 0.01, csv);
+    for (int t = 0; t < 300; t++) // cruise 3 s, to the output that holds the setpoint
+    {
+        l.sample([&] { l.pid.ComputeTick(); });
+    }
+    PID_ATune<long> tune(&l.input, &l.output, &l.setpoint);
+    tune.SetSampleTime(CONTROL_MS);
+    tune.SetNoiseBand(25);
+    tune.SetControlType(ATUNE_PI);
+    l.pid.SetMode(MANUAL);
+    tune.Start(l.output, 40);
+    int result = ATUNE_RUNNING, t = 0;
+    for (; result == ATUNE_RUNNING && t < 3000; t++)
+    {
+        l.sample([&] { result = tune.Runtime(); });
+    }
+    tuning r = {result, t * CONTROL_MS / 1000.0, tune.GetKu(), tune.GetPu(), tune.GetKp(), tune.GetKi()};
+    return r;
+}
+
+// setpoint steps: medium, fast, medium, 3 s each, from cruising at fast
+void steps(double volts, double kp, double ki, double kd, double iae[3], double over[3], double rms[3])
+{
+    loop l(volts, kp, ki, kd, NULL);
+    for (int t = 0; t < 300; t++)
+    {
+        l.sample([&] { l.pid.ComputeTick(); });
+    }
+    const int pwm[3] = {125, 190, 125};
+    for (int s = 0; s < 3; s++)
+    {
+        long from = l.setpoint;
+        l.setpoint = pwm[s] * 196419L / 10000;
+        iae[s] = over[s] = rms[s] = 0;
+        for (int t = 0; t < 300; t++)
+        {
+            l.sample([&] { l.pid.ComputeTick(); });
+            double e = l.w.speed - l.setpoint, beyond = (l.setpoint > from) ? -e : e;
+            iae[s] += fabs(e) / 300;
+            over[s] = (-beyond > over[s]) ? -beyond : over[s];
+            if (t >= 200)
+            {
+                rms[s] += e * e / 100;
+            }
+        }
+        rms[s] = sqrt(rms[s]);
+    }
+}
+
+int main()
+{
+    fprintf(stderr, "first order plus dead time, against the exact ultimate gain and period:\n");
+    check(fopdt(1, 1, 0.2), "relay estimates, L/tau 0.2");
+    check(fopdt(2, 0.5, 0.25), "relay estimates, L/tau 0.5");
+    check(fopdt(0.5, 0.3, 0.3), "relay estimates, L/tau 1");
+
+    fprintf(stderr, "joeBot3 wheel, relay +/-40 PWM from cruising at 190 PWM (3732 ticks/s):\n");
+    const double volts[3] = {10.8, 12.1, 13.2};
+    tuning tuned[3];
+    printf("volts,t_ms,setpoint,speed,pwm\n");
+    bool converged = true;
+    for (int v = 0; v < 3; v++)
+    {
+        FILE *csv = tmpfile();
+        tuned[v] = tuneWheel(volts[v], csv);
+        rewind(csv);
+        char line[80];
+        while (fgets(line, sizeof line, csv))
+        {
+            printf("%.1f,%s", volts[v], line);
+        }
+        fclose(csv);
+        fprintf(stderr, "  %.1f V: %s in %.2f s, Ku %.4f Pu %.3f s -> Kp %.4f Ki %.4f\n", volts[v],
+                tuned[v].result == ATUNE_DONE ? "done" : "FAILED", tuned[v].seconds, tuned[v].Ku, tuned[v].Pu,
+                tuned[v].Kp, tuned[v].Ki);
+        converged = converged && tuned[v].result == ATUNE_DONE && tuned[v].seconds <= 10;
+    }
+    check(converged, "converges within 10 s at each voltage");
+    double puLo = 1e9, puHi = 0, kvLo = 1e9, kvHi = 0;
+    for (int v = 0; v < 3; v++)
+    {
+        double kv = tuned[v].Ku * volts[v];
+        puLo = fmin(puLo, tuned[v].Pu);
+        puHi = fmax(puHi, tuned[v].Pu);
+        kvLo = fmin(kvLo, kv);
+        kvHi = fmax(kvHi, kv);
+    }
+    check(puHi - puLo <= 0.10 * puLo, "Pu agrees across voltages");
+    check(kvHi - kvLo <= 0.15 * kvLo, "Ku follows the motor's gain (Ku * volts agrees)");
+
+    fprintf(stderr, "setpoint steps to 125, 190, 125 PWM: mean |error|, overshoot (ticks/s), last second rms\n");
+    bool settles = true;
+    for (int v = 0; v < 3; v++)
+    {
+        double iae[2][3], over[2][3], rms[2][3];
+        steps(volts[v], 0.01705407711, 0.16077170418, 0.01, iae[0], over[0], rms[0]);
+        steps(volts[v], tuned[v].Kp, tuned[v].Ki, 0, iae[1], over[1], rms[1]);
+        for (int k = 0; k < 2; k++)
+        {
+            fprintf(stderr, "  %.1f V %-8s", volts[v], k ? "tuned" : "sketch's");
+            for (int s = 0; s < 3; s++)
+            {
+                fprintf(stderr, "  %5.0f %5.0f %4.0f", iae[k][s], over[k][s], rms[k][s]);
+                if (k)
+                {
+                    settles = settles && rms[k][s] < 0.03 * 125 * 19.6419;
+                }
+            }
+            fprintf(stderr, "\n");
+        }
+    }
+    check(settles, "tuned loops settle");
+
+    fprintf(stderr, "relay below the dead band:\n");
+    {
+        loop l(12.1, 0.017, 0.16, 0.01, NULL);
+        PID_ATune<long> tune(&l.input, &l.output, &l.setpoint);
+        tune.SetSampleTime(CONTROL_MS);
+        tune.SetNoiseBand(25);
+        tune.Start(10, 10);
+        int result = ATUNE_RUNNING, t = 0;
+        for (; result == ATUNE_RUNNING && t < 3000; t++)
+        {
+            l.sample([&] { result = tune.Runtime(); });
+        }
+        check(result == ATUNE_FAILED && t <= 1001 && l.output == 10, "fails at the 10 s timeout, output left at the start");
+    }
+
+    fprintf(stderr, "EEPROM:\n");
+    double kp = -1, ki = -1, kd = -1;
+    check(!PID_LoadTunings(0, &kp, &ki, &kd) && kp == -1, "nothing loaded from erased EEPROM");
+    PID_SaveTunings(0, tuned[1].Kp, tuned[1].Ki, 0);
+    PID_SaveTunings(sizeof(PID_StoredTunings), 0.5, 0.25, 0.125);
+    bool loaded = PID_LoadTunings(0, &kp, &ki, &kd);
+    check(loaded && fabs(kp - tuned[1].Kp) < 1e-6 * kp && fabs(ki - tuned[1].Ki) < 1e-6 * ki && kd == 0,
+          "saved tunings load back (as float)");
+    loaded = PID_LoadTunings(sizeof(PID_StoredTunings), &kp, &ki, &kd);
+    check(loaded && kp == 0.5 && ki == 0.25 && kd == 0.125, "a second set, next to it");
+    EEPROM.data[5] ^= 0x10;
+    kp = -1;
+    check(!PID_LoadTunings(0, &kp, &ki, &kd) && kp == -1, "a corrupted set isn't loaded");
+
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "autotune ok");
+    return failures ? 1 : 0;
+}
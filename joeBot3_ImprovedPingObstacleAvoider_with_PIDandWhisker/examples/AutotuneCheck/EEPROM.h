@@ -0,0 +1,26 @@
+// EEPROM for AutotuneCheck: the ATmega328P's 1 kB, erased (all 0xFF) to start with
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include <stdint.h>
+#include <string.h>
+
+struct EEPROMClass
+{
+    uint8_t data[1024];
+    EEPROMClass() { memset(data, 0xFF, sizeof data); }
+    template <typename T> T &get(int address, T &t)
+    {
+        memcpy(&t, data + address, sizeof(T));
+        return t;
+    }
+    template <typename T> const T &put(int address, const T &t)
+    {
+        memcpy(data + address, &t, sizeof(T));
+        return t;
+    }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
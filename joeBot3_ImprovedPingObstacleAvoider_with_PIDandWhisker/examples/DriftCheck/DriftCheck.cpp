@@ -0,0 +1,362 @@
+// DriftCheck -- joeBot3 driving straight, with the old and the timer sampled speed loops, on a PC
+// A two wheel robot: each wheel a first order motor (--tau s) with a dead band, the right one
+// --mismatch weaker than the left, counted by its encoder an edge at a time (100 ticks per cm,
+// the right one counting down going forward, as on the robot), the wheels --track cm apart.
+// Both wheels' PID_fix<20>s (the sketch's tunings) hold the cruise speed; the robot's heading
+// and sideways drift are integrated from the wheel speeds.  The loop is modelled on the
+// sketch's: passes of a few tens of us, the control run ~0.5 ms, telemetry every 200 ms and
+// the histogram dump (~25 ms) every 30 s; millis() steps as the Arduino core's does
+// (1.024 ms per Timer0 overflow, with a catch-up ms every 125/3 of them).  Four ways to
+// drive straight:
+//   as was:    the sketch before the sampler: unsigned counts (the right one counts down),
+//              the encoders reset each control run, over the time since setup()
+//   reset:     that with the sign and the time fixed: counts since the last run, over the
+//              millis() between runs (whole ms, of a 10 ms run: up to ~10% off each time)
+//   sampled:   EncoderSampler (the real one): counts latched every 10 ms on the timer tick,
+//              speed from the differences, ComputeTick() on each sample
+//   sampled/4: that with the speed over the last 4 samples (the sketch's setting)
+// For each: the heading and the sideways drift after --seconds, and over the second half
+// the heading's drift, the wheels' speed error (rms, ticks/s) and the PWM's rms step between
+// control runs.  The heading at the end of the first half is mostly the start from rest (the
+// dead bands and the weaker motor): speed loops hold the speeds equal, not the heading, so
+// the drift that tells is the second half's.  Passes when the sampled loops drift less than
+// the reset one there, and the sketch's (sampled/4) under half a degree.
+// The heading of each, every 100 ms, goes to stdout (CSV), the results to stderr.
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -DARDUINO=100 -I../shim -I../../lib/EncoderSampler -I../../lib/PID_v1 DriftCheck.cpp ../../lib/EncoderSampler/EncoderSampler.cpp -o driftcheck
+//   ./driftcheck --seconds 40 > heading.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "Arduino.h"
+#include "Encoder.h"
+#include "EncoderSampler.h"
+#include "PID_fix.h"
+
+#define TICKS_PER_PWM 19.6419 // ticks/s per PWM unit, as the sketch's setpoint
+#define TICKS_PER_CM 100.0
+#define CONTROL_MS 10
+#define VARIANTS 4
+
+enum variant
+{
+    AS_WAS,
+    RESET,
+    SAMPLED,
+    SAMPLED_WINDOW
+};
+const char *variantName[VARIANTS] = {"as was", "reset", "sampled", "sampled/4"};
+
+// settings (command line)
+struct settings
+{
+    int seconds = 40;
+    double tau = 0.15;        // s, the wheels' time constant
+    double mismatch = 0.06;   // the right motor this much weaker than the left
+    double track = 13;        // cm between the wheels
+    double deadbandL = 25;    // PWM below which a wheel doesn't turn
+    double deadbandR = 35;
+    double kp = 0.01705407711; // the sketch's tunings
+    double ki = 0.16077170418;
+    double kd = 0.01;
+};
+
+unsigned long now_us = 0;
+unsigned long micros() { return now_us & ~3UL; }
+unsigned long millis()
+{
+    unsigned long overflows = now_us / 1024; // Timer0: 64 x 256 cycles at 16 MHz
+    return overflows + overflows * 3 / 125;
+}
+
+// a wheel, going forward for positive PWM, its encoder counting sign per tick forward
+struct wheel
+{
+    double gain, deadband, tau;
+    int sign;
+    double speed = 0;    // ticks/s, forward
+    double position = 0; // ticks
+    long counted = 0;
+    Encoder encoder;
+
+    void step(double pwm, double dt)
+    {
+        double target = (fabs(pwm) < deadband) ? 0 : gain * pwm;
+        speed += (target - speed) * dt / tau;
+        position += speed * dt;
+        long c = (long)floor(position);
+        if (c != counted)
+        {
+            encoder.position += sign * (c - counted);
+            counted = c;
+        }
+    }
+};
+
+struct robot
+{
+    wheel left, right;
+    double pwmL = 0, pwmR = 0; // forward, each wheel
+    double x = 0, y = 0, heading = 0; // cm, radians
+    double track;
+    EncoderSampler *sampler = NULL;
+
+    void advance(unsigned long us)
+    {
+        for (unsigned long i = 0; i < us; i++)
+        {
+            const double dt = 1e-6;
+            left.step(pwmL, dt);
+            right.step(pwmR, dt);
+            double v = (left.speed + right.speed) / 2 / TICKS_PER_CM;
+            heading += (left.speed - right.speed) / TICKS_PER_CM / track * dt;
+            x += v * cos(heading) * dt;
+            y += v * sin(heading) * dt;
+            now_us++;
+            if (sampler && now_us % 1000 == 0)
+            {
+                sampler->tick(); // Timer2, every ms
+            }
+        }
+    }
+};
+
+struct result
+{
+    double heading, drift, distance; // degrees, cm, cm
+    double halfDrift;                // degrees, over the second half
+    double speedError, pwmStep;      // rms over the second half
+    unsigned long samples, missed;
+};
+
+result simulate(variant v, const settings &s, std::vector<double> *headings)
+{
+    now_us = 0;
+    srand(1);
+    robot bot;
+    bot.track = s.track;
+    bot.left.gain = TICKS_PER_PWM * (1 + s.mismatch / 2);
+    bot.right.gain = TICKS_PER_PWM * (1 - s.mismatch / 2);
+    bot.left.deadband = s.deadbandL;
+    bot.right.deadband = s.deadbandR;
+    bot.left.tau = bot.right.tau = s.tau;
+    bot.left.sign = 1;
+    bot.right.sign = -1;
+
+    // as the sketch's setup()
+    long setpoint = 190 * 196419L / 10000, L_Input = 0, R_Input = 0, L_Output = 190, R_Output = 190;
+    PID_fix<20> L_PID(&L_Input, &L_Output, &setpoint, s.kp, s.ki, s.kd, DIRECT);
+    PID_fix<20> R_PID(&R_Input, &R_Output, &setpoint, s.kp, s.ki, s.kd, DIRECT);
+    L_PID.SetMode(AUTOMATIC);
+    R_PID.SetMode(AUTOMATIC);
+    L_PID.SetSampleTime(CONTROL_MS);
+    R_PID.SetSampleTime(CONTROL_MS);
+    EncoderSampler sampler(bot.left.encoder, bot.right.encoder, CONTROL_MS, (v == SAMPLED_WINDOW) ? 4 : 1);
+    if (v == SAMPLED || v == SAMPLED_WINDOW)
+    {
+        sampler.begin();
+        bot.sampler = &sampler;
+    }
+    unsigned long t_ref = millis();
+    unsigned long due = micros() + CONTROL_MS * 1000UL;
+    unsigned long nextTelemetry = 200000, nextReport = 30000000, nextHeading = 0;
+
+    const unsigned long end = s.seconds * 1000000UL;
+    double speedSq = 0, pwmSq = 0, lastL = 0, lastR = 0, halfHeading = 0;
+    bool half = false;
+    unsigned long speedN = 0, pwmN = 0;
+    while (now_us < end)
+    {
+        // one loop pass
+        unsigned long pass = 30 + rand() % 60;
+        bool control = false;
+        if (bot.sampler)
+        {
+            control = sampler.available();
+        }
+        else if ((long)(micros() - due) >= 0)
+        {
+            control = true;
+            due += CONTROL_MS * 1000UL;
+            if ((long)(micros() - due) >= 0)
+            {
+                due += ((micros() - due) / (CONTROL_MS * 1000UL) + 1) * CONTROL_MS * 1000UL;
+            }
+        }
+        if (control)
+        {
+            bot.advance(230); // the whiskers' analogRead()s
+            if (v == AS_WAS)
+            {
+                unsigned long l_ticks = (uint32_t)bot.left.encoder.read();
+                bot.advance(4);
+                unsigned long r_ticks = (uint32_t)bot.right.encoder.read();
+                bot.advance(4);
+                bot.left.encoder.write(0);
+                bot.advance(4);
+                bot.right.encoder.write(0);
+                long dt = millis() - t_ref;
+                L_Input = (long)(uint32_t)((uint32_t)(1000UL * l_ticks) / (uint32_t)dt); // (32 bit, as on the AVR)
+                R_Input = (long)(uint32_t)((uint32_t)(1000UL * r_ticks) / (uint32_t)dt);
+                L_PID.Compute();
+                R_PID.Compute();
+            }
+            else if (v == RESET)
+            {
+                long l_ticks = bot.left.encoder.read();
+                bot.advance(4);
+                long r_ticks = -bot.right.encoder.read();
+                bot.advance(4);
+                bot.left.encoder.write(0);
+                bot.advance(4);
+                bot.right.encoder.write(0);
+                long dt = millis() - t_ref;
+                t_ref = millis();
+                if (dt > 0)
+                {
+                    L_Input = 1000L * l_ticks / dt;
+                    R_Input = 1000L * r_ticks / dt;
+                }
+                L_PID.Compute();
+                R_PID.Compute();
+            }
+            else
+            {
+                L_Input = sampler.leftSpeed();
+                R_Input = -1 * sampler.rightSpeed();
+                L_PID.ComputeTick();
+                R_PID.ComputeTick();
+            }
+            bot.advance(250); // the PIDs
+            bot.pwmL = L_Output;
+            bot.pwmR = R_Output; // (R_Motor.go(-1 * R_Output): forward on the right)
+            if (now_us > end / 2)
+            {
+                pwmSq += (L_Output - lastL) * (L_Output - lastL) + (R_Output - lastR) * (R_Output - lastR);
+                pwmN += 2;
+            }
+            lastL = L_Output;
+            lastR = R_Output;
+        }
+        if (now_us >= nextTelemetry)
+        {
+            pass += 300;
+            nextTelemetry += 200000;
+        }
+        if (now_us >= nextReport)
+        {
+            pass += 25000;
+            nextReport += 30000000;
+        }
+        bot.advance(pass);
+        if (!half && now_us > end / 2)
+        {
+            halfHeading = bot.heading;
+            half = true;
+        }
+        if (now_us > end / 2)
+        {
+            double el = bot.left.speed - setpoint, er = bot.right.speed - setpoint;
+            speedSq += el * el + er * er;
+            speedN += 2;
+        }
+        while (now_us >= nextHeading && headings)
+        {
+            headings->push_back(bot.heading * 180 / M_PI);
+            nextHeading += 100000;
+        }
+    }
+    result r;
+    r.heading = bot.heading * 180 / M_PI;
+    r.halfDrift = (bot.heading - halfHeading) * 180 / M_PI;
+    r.drift = bot.y;
+    r.distance = bot.x;
+    r.speedError = sqrt(speedSq / (speedN ? speedN : 1));
+    r.pwmStep = sqrt(pwmSq / (pwmN ? pwmN : 1));
+    r.samples = bot.sampler ? sampler.samples() : 0;
+    r.missed = bot.sampler ? sampler.missed() : 0;
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    settings s;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--seconds"))
+            s.seconds = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--tau"))
+            s.tau = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--mismatch"))
+            s.mismatch = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--track"))
+            s.track = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--kp"))
+            s.kp = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--ki"))
+            s.ki = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--kd"))
+            s.kd = atof(argv[i + 1]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--seconds s] [--tau s] [--mismatch m] [--track cm] [--kp k] [--ki k] [--kd k]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (s.seconds < 1 || s.seconds > 4000)
+    {
+        fprintf(stderr, "--seconds: 1 to 4000\n");
+        return 1;
+    }
+
+    std::vector<double> headings[VARIANTS];
+    result r[VARIANTS];
+    for (int v = 0; v < VARIANTS; v++)
+    {
+        r[v] = simulate((variant)v, s, &headings[v]);
+    }
+    printf("t_ms");
+    for (int v = 0; v < VARIANTS; v++)
+    {
+        printf(",%s", variantName[v]);
+    }
+    printf("\n");
+    for (size_t t = 0; t < headings[0].size(); t++)
+    {
+        printf("%lu", (unsigned long)t * 100);
+        for (int v = 0; v < VARIANTS; v++)
+        {
+            printf(",%.3f", t < headings[v].size() ? headings[v][t] : 0.0);
+        }
+        printf("\n");
+    }
+
+    fprintf(stderr, "%d s straight, right motor %.0f%% weaker: heading (deg), sideways drift and distance (cm);\n",
+            s.seconds, s.mismatch * 100);
+    fprintf(stderr, "over the second half: heading drift (deg), speed error (rms ticks/s), PWM step per control run\n");
+    fprintf(stderr, "(rms); samples (missed)\n");
+    for (int v = 0; v < VARIANTS; v++)
+    {
+        fprintf(stderr, "  %-10s %9.2f %7.1f %6.0f   %9.2f %6.0f %6.1f", variantName[v], r[v].heading, r[v].drift,
+                r[v].distance, r[v].halfDrift, r[v].speedError, r[v].pwmStep);
+        if (v >= SAMPLED)
+        {
+            fprintf(stderr, "   %lu (%lu)", r[v].samples, r[v].missed);
+        }
+        fprintf(stderr, "\n");
+    }
+    int failures = 0;
+    for (int v = SAMPLED; v < VARIANTS; v++)
+    {
+        bool ok = fabs(r[v].halfDrift) < fabs(r[RESET].halfDrift) && (v != SAMPLED_WINDOW || fabs(r[v].halfDrift) < 0.5);
+        fprintf(stderr, "  %-10s %s\n", variantName[v], ok ? "ok" : "FAILED: drifts as much as the reset loop, or too much");
+        failures += ok ? 0 : 1;
+    }
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "sampled speed loop ok");
+    return failures ? 1 : 0;
+}
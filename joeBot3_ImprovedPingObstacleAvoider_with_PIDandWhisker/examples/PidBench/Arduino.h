@@ -0,0 +1,9 @@
+// The one Arduino call the PID libraries use, for PidBench: millis() on simulated time
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+
+unsigned long millis();
+
+#endif
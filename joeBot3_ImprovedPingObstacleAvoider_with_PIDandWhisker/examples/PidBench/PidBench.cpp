@@ -0,0 +1,336 @@
+// PidBench -- compare PID_fix with the double PID (PID_v1), on a PC
+// Step responses are recorded from the double PID driving a model of a joeBot3 wheel with
+// the sketch's tunings and control tick (--tick ms, the PIDs' sample time): a first order
+// motor, 19.64 ticks/s per unit of PWM (the sketch's setpoint scale) with a --tau s time
+// constant, measured as the encoder ticks counted in each tick (so in steps of 100
+// ticks/s at 10 ms).  The setpoint steps through fast, medium, slow, beyond what 255
+// reaches (the integral winds up against the limit) and stop, 3 s each.  Then:
+//   - replay: the recorded inputs are fed to PID_fix<16> and PID_fix<20> too, and their
+//     outputs compared with the double PID's, sample by sample.  The fixed point outputs
+//     are whole numbers, so differ by up to 0.5 from rounding alone; the rest is the gains'
+//     rounding to 2^-FRAC (Ki per sample is ~0.0016 at 10 ms).  Passes within 2 PWM.
+//   - saturation: inputs far beyond what the products reach (+/-10^6 ticks/s, jumping by
+//     up to 2*10^6) with the limits at +/-255: PID_fix's products saturate in 32 bits and
+//     must still drive the output where the double PID does, within 2 PWM.
+//   - closed loop: each controller drives its own wheel model: for each step, the
+//     overshoot, the settling time (within 5% + one count) and the mean error over its
+//     second half.  The quantized speed and the derivative term make each run noisy, so
+//     these agree statistically, not sample by sample.
+//   - timing: Compute() over the recorded inputs, in ns and (on x86) TSC cycles per call,
+//     the best of 5 passes.  The PC has floating point hardware, so the two come out about
+//     the same here and say nothing about the AVR, which emulates floating point in
+//     software: time them on the board with the PID_v1 example PID_Timing.
+// The recorded step response goes to stdout (CSV), the comparison to stderr.
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -DARDUINO=100 -I. -I../../lib/PID_v1 PidBench.cpp ../../lib/PID_v1/PID_v1.cpp -o pidbench
+//   ./pidbench --tick 10 > steps.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include "Arduino.h"
+#include "PID_v1.h"
+#include "PID_fix.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#define TICKS_PER_PWM 19.6419 // ticks/s per PWM unit, as the sketch's setpoint
+#define STEP_MS 3000L         // per setpoint step
+#define STEPS 5
+
+// settings (command line)
+struct settings
+{
+    int tick = 10;             // ms, the control tick (the PIDs' sample time)
+    double tau = 0.15;         // s, the wheel's time constant
+    double kp = 0.01705407711; // the sketch's tunings
+    double ki = 0.16077170418;
+    double kd = 0.01;
+    int repeat = 200;          // timing passes over the recording
+};
+
+unsigned long now_ms = 0;
+unsigned long millis() { return now_ms; }
+
+long setpointAt(long ms)
+{
+    // (268: more than 255 reaches, to wind the integral up against the limit)
+    static const int pwm[STEPS] = {190, 125, 60, 268, 0};
+    return lround(pwm[(ms / STEP_MS) % STEPS] * TICKS_PER_PWM);
+}
+
+// a wheel: first order speed response to PWM, counted by the encoder every tick
+struct wheel
+{
+    double speed = 0;    // ticks/s
+    double position = 0; // ticks
+    long counted = 0;
+
+    long step(double pwm, const settings &s) // -> measured ticks/s over the tick
+    {
+        double dt = s.tick / 1000.0 / 10, target = TICKS_PER_PWM * pwm;
+        for (int i = 0; i < 10; i++) // (integrated in tenths of the tick)
+        {
+            speed += (target - speed) * dt / s.tau;
+            position += speed * dt;
+        }
+        long ticks = (long)floor(position) - counted;
+        counted += ticks;
+        return ticks * 1000 / s.tick;
+    }
+};
+
+// closed loop with any of the controllers; returns the measured speeds
+template <class CONTROLLER, typename IO>
+std::vector<long> closedLoop(const settings &s, int ticks, std::vector<double> *outputs)
+{
+    IO input = 0, output = 0, setpoint = 0;
+    CONTROLLER pid(&input, &output, &setpoint, s.kp, s.ki, s.kd, DIRECT);
+    pid.SetSampleTime(s.tick);
+    pid.SetMode(AUTOMATIC);
+    wheel w;
+    std::vector<long> speed;
+    for (int t = 0; t < ticks; t++)
+    {
+        now_ms += s.tick;
+        setpoint = setpointAt((long)t * s.tick);
+        pid.Compute();
+        if (outputs)
+        {
+            outputs->push_back(output);
+        }
+        input = w.step(output, s);
+        speed.push_back(lround(input));
+    }
+    return speed;
+}
+
+// replays recorded inputs into a controller; returns its outputs
+template <class CONTROLLER, typename IO>
+std::vector<double> replay(const settings &s, const std::vector<long> &inputs)
+{
+    IO input = 0, output = 0, setpoint = 0;
+    CONTROLLER pid(&input, &output, &setpoint, s.kp, s.ki, s.kd, DIRECT);
+    pid.SetSampleTime(s.tick);
+    pid.SetMode(AUTOMATIC);
+    std::vector<double> out;
+    for (size_t t = 0; t < inputs.size(); t++)
+    {
+        now_ms += s.tick;
+        setpoint = setpointAt((long)t * s.tick);
+        input = (t == 0) ? 0 : inputs[t - 1];
+        pid.Compute();
+        out.push_back(output);
+    }
+    return out;
+}
+
+// inputs far out of range into a controller, limits +/-255; returns its outputs
+template <class CONTROLLER, typename IO>
+std::vector<double> saturation(const settings &s)
+{
+    static const long inputs[] = {0, 1000000, 1000000, -1000000, -1000000, 0, 0, 300, 0, -300, 1000000, 0, 0};
+    IO input = 0, output = 0, setpoint = 0;
+    CONTROLLER pid(&input, &output, &setpoint, s.kp, s.ki, s.kd, DIRECT);
+    pid.SetSampleTime(s.tick);
+    pid.SetOutputLimits(-255, 255);
+    pid.SetMode(AUTOMATIC);
+    std::vector<double> out;
+    for (size_t t = 0; t < sizeof(inputs) / sizeof(inputs[0]); t++)
+    {
+        now_ms += s.tick;
+        input = inputs[t];
+        pid.Compute();
+        out.push_back(output);
+    }
+    return out;
+}
+
+// Compute() time per call over the recording, the best of 5 passes
+template <class CONTROLLER, typename IO>
+void timing(const settings &s, const std::vector<long> &inputs, double *ns, double *cycles, double *sum)
+{
+    IO input = 0, output = 0, setpoint = 0;
+    CONTROLLER pid(&input, &output, &setpoint, s.kp, s.ki, s.kd, DIRECT);
+    pid.SetSampleTime(1);
+    pid.SetMode(AUTOMATIC);
+    double total = 0;
+    *ns = *cycles = 0;
+    for (int pass = 0; pass < 5; pass++)
+    {
+        auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_TSC
+        unsigned long long c0 = __rdtsc();
+#endif
+        for (int r = 0; r < s.repeat; r++)
+        {
+            for (size_t t = 0; t < inputs.size(); t++)
+            {
+                now_ms++;
+                setpoint = setpointAt((long)t * s.tick);
+                input = inputs[t];
+                pid.Compute();
+                total += output;
+            }
+        }
+#ifdef HAVE_TSC
+        double c = (double)(__rdtsc() - c0) / (s.repeat * inputs.size());
+        *cycles = (pass == 0 || c < *cycles) ? c : *cycles;
+#endif
+        double n = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+                   (s.repeat * inputs.size());
+        *ns = (pass == 0 || n < *ns) ? n : *ns;
+    }
+    *sum = total;
+}
+
+// a step's overshoot (ticks/s), settling time (ms) and mean error over its second half
+void stepStats(const settings &s, const std::vector<long> &speed, int step, char *text, size_t size)
+{
+    int per = STEP_MS / s.tick;
+    long set = setpointAt(step * STEP_MS), from = step ? setpointAt((step - 1) * STEP_MS) : 0;
+    double band = fabs(set - from) * 0.05 + 1000 / s.tick, overshoot = 0, error = 0;
+    int settle = 0;
+    for (int t = 0; t < per; t++)
+    {
+        long v = speed[step * per + t];
+        double over = (set >= from) ? v - set : set - v;
+        overshoot = (over > overshoot) ? over : overshoot;
+        if (fabs(v - set) > band)
+        {
+            settle = t + 1;
+        }
+        if (t >= per / 2)
+        {
+            error += fabs(v - set) / (per - per / 2);
+        }
+    }
+    snprintf(text, size, "%5.0f %5d %5.0f", overshoot, settle * s.tick, error);
+}
+
+int main(int argc, char **argv)
+{
+    settings s;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--tick"))
+            s.tick = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--tau"))
+            s.tau = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--kp"))
+            s.kp = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--ki"))
+            s.ki = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--kd"))
+            s.kd = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--repeat"))
+            s.repeat = atoi(argv[i + 1]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--tick ms] [--tau s] [--kp k] [--ki k] [--kd k] [--repeat n]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (s.tick < 1 || STEP_MS % s.tick)
+    {
+        fprintf(stderr, "--tick: a whole number of ms that divides %ld\n", STEP_MS);
+        return 1;
+    }
+    const int ticks = STEPS * STEP_MS / s.tick;
+    int failures = 0;
+
+    // the recording: the double PID's closed loop step responses
+    std::vector<double> recordedOut;
+    std::vector<long> recorded = closedLoop<PID, double>(s, ticks, &recordedOut);
+    printf("t_ms,setpoint,speed,pwm\n");
+    for (int t = 0; t < ticks; t++)
+    {
+        printf("%ld,%ld,%ld,%.3f\n", (long)t * s.tick, setpointAt((long)t * s.tick), recorded[t], recordedOut[t]);
+    }
+
+    // replay
+    std::vector<double> ref = replay<PID, double>(s, recorded);
+    std::vector<double> q16 = replay<PID_fix<16>, long>(s, recorded);
+    std::vector<double> q20 = replay<PID_fix<20>, long>(s, recorded);
+    struct
+    {
+        const char *name;
+        std::vector<double> *out;
+    } variants[] = {{"PID_fix<16>", &q16}, {"PID_fix<20>", &q20}};
+    fprintf(stderr, "replay of the recorded step responses (%d samples at %d ms), against the double PID:\n", ticks,
+            s.tick);
+    for (auto &v : variants)
+    {
+        double worst = 0, sq = 0;
+        for (int t = 0; t < ticks; t++)
+        {
+            double d = (*v.out)[t] - ref[t];
+            worst = (fabs(d) > worst) ? fabs(d) : worst;
+            sq += d * d;
+        }
+        bool ok = worst <= 2.0;
+        fprintf(stderr, "  %-12s %s  output within %.2f PWM, rms %.2f\n", v.name, ok ? "ok    " : "FAILED", worst,
+                sqrt(sq / ticks));
+        failures += ok ? 0 : 1;
+    }
+
+    // saturation
+    std::vector<double> satRef = saturation<PID, double>(s);
+    std::vector<double> sat16 = saturation<PID_fix<16>, long>(s);
+    std::vector<double> sat20 = saturation<PID_fix<20>, long>(s);
+    variants[0].out = &sat16;
+    variants[1].out = &sat20;
+    fprintf(stderr, "saturation: inputs to +/-10^6 ticks/s, limits +/-255, against the double PID:\n");
+    for (auto &v : variants)
+    {
+        double worst = 0;
+        for (size_t t = 0; t < satRef.size(); t++)
+        {
+            double d = fabs((*v.out)[t] - satRef[t]);
+            worst = (d > worst) ? d : worst;
+        }
+        bool ok = worst <= 2.0;
+        fprintf(stderr, "  %-12s %s  output within %.2f PWM over %d samples\n", v.name, ok ? "ok    " : "FAILED", worst,
+                (int)satRef.size());
+        failures += ok ? 0 : 1;
+    }
+
+    // closed loop
+    std::vector<long> cl16 = closedLoop<PID_fix<16>, long>(s, ticks, NULL);
+    std::vector<long> cl20 = closedLoop<PID_fix<20>, long>(s, ticks, NULL);
+    fprintf(stderr, "closed loop, each step: overshoot (ticks/s), settling (ms), mean error (ticks/s)\n");
+    fprintf(stderr, "  step to       double             PID_fix<16>        PID_fix<20>\n");
+    for (int st = 0; st < STEPS; st++)
+    {
+        char a[40], b[40], c[40];
+        stepStats(s, recorded, st, a, sizeof a);
+        stepStats(s, cl16, st, b, sizeof b);
+        stepStats(s, cl20, st, c, sizeof c);
+        fprintf(stderr, "  %5ld   %s  %s  %s\n", setpointAt(st * STEP_MS), a, b, c);
+    }
+
+    // timing
+    double ns[3], cycles[3], sums[3];
+    timing<PID, double>(s, recorded, &ns[0], &cycles[0], &sums[0]);
+    timing<PID_fix<16>, long>(s, recorded, &ns[1], &cycles[1], &sums[1]);
+    timing<PID_fix<20>, long>(s, recorded, &ns[2], &cycles[2], &sums[2]);
+    const char *names[] = {"double", "PID_fix<16>", "PID_fix<20>"};
+    fprintf(stderr, "Compute() on this PC:");
+    for (int i = 0; i < 3; i++)
+    {
+#ifdef HAVE_TSC
+        fprintf(stderr, "  %s %.1f ns (%.0f TSC cycles)", names[i], ns[i], cycles[i]);
+#else
+        fprintf(stderr, "  %s %.1f ns", names[i], ns[i]);
+#endif
+    }
+    fprintf(stderr, "  [checksums %.0f %.0f %.0f]\n", sums[0], sums[1], sums[2]);
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "fixed point PID ok");
+    return failures ? 1 : 0;
+}
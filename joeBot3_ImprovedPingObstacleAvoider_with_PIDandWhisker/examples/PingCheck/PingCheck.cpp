@@ -0,0 +1,224 @@
+// PingCheck -- check the asynchronous HC_SR04 ranging against a simulated sensor, on a PC
+// Runs the real HC_SR04.cpp on simulated time (the Arduino.h here): a simulated HC-SR04
+// answers each trigger pulse by raising its echo pin ~450 us later, for the round trip to
+// the obstacle (58.2 us/cm), or for 38 ms when nothing echoes; each edge runs the echo
+// interrupt handler a few us late (other interrupts).  micros() counts in 4 us steps, as on
+// the 16 MHz ATmega328P.  A robot loop that takes --loop us per pass polls available() and
+// restarts the ping, as joeBot3 does.  Checks, for each case:
+//   - obstacles within range: every reading within 1 cm
+//   - beyond the range limit, or no echo at all: HC_SR04_OUT_OF_RANGE, reported at the
+//     range limit's round trip after the trigger, not after the sensor's own 38 ms
+//   - a silent sensor: 0, after HC_SR04_RISE_TIMEOUT_US
+//   - the loop is never held up by more than the trigger pulse
+// and compares the loop passes per second with those of the old blocking ping() (300 us +
+// 1000 us trigger, then pulseIn() with its 1 s timeout).  Prints one CSV line per case.
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -I. -I../../lib/HC_SR04 PingCheck.cpp ../../lib/HC_SR04/HC_SR04.cpp -o pingcheck
+//   ./pingcheck --loop 300 --pings 50 > ping.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "Arduino.h"
+#include "HC_SR04.h"
+
+#define TRIG_PIN 13
+#define ECHO_PIN 6
+#define NO_ECHO_US 38000 // the sensor gives up after this long with no echo
+
+// settings (command line)
+struct settings
+{
+    unsigned long loop = 300; // us per robot loop pass (whiskers, PID, motors)
+    int pings = 50;           // per case
+};
+
+// simulated time and sensor
+unsigned long now_us = 0;
+bool echo_level = false, trig_level = false;
+unsigned long trig_rise = 0;
+unsigned long echo_rise_at = 0, echo_fall_at = 0; // pending edges (0: none)
+double obstacle_cm = 100;   // < 0: nothing echoes
+bool silent = false;        // the sensor doesn't answer at all
+void (*echo_handler)() = NULL;
+unsigned long blocked = 0;  // longest time spent in one HC_SR04 call
+bool in_isr = false;
+
+// runs simulated time to t, firing the echo edges (and their interrupt) on the way
+void runTo(unsigned long t)
+{
+    while (true)
+    {
+        unsigned long next = echo_rise_at ? echo_rise_at : echo_fall_at;
+        if (next == 0 || next > t)
+        {
+            break;
+        }
+        now_us = next;
+        echo_level = (echo_rise_at != 0);
+        if (echo_rise_at)
+        {
+            echo_rise_at = 0;
+        }
+        else
+        {
+            echo_fall_at = 0;
+        }
+        now_us += rand() % 12; // interrupt latency
+        if (echo_handler)
+        {
+            in_isr = true;
+            echo_handler();
+            in_isr = false;
+        }
+    }
+    now_us = (t > now_us) ? t : now_us;
+}
+
+// each call takes about a microsecond (so busy-waits on it end)
+unsigned long micros()
+{
+    if (!in_isr)
+    {
+        runTo(now_us + 1);
+    }
+    return now_us & ~3UL;
+}
+void delayMicroseconds(unsigned int us) { runTo(now_us + us); }
+void pinMode(uint8_t, uint8_t) {}
+int digitalRead(uint8_t pin) { return (pin == ECHO_PIN && echo_level) ? HIGH : LOW; }
+void noInterrupts() {}
+void interrupts() {}
+int digitalPinToInterrupt(uint8_t pin) { return pin; }
+void attachInterrupt(int, void (*handler)(), int) { echo_handler = handler; }
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (pin != TRIG_PIN)
+    {
+        return;
+    }
+    if (value && !trig_level)
+    {
+        trig_rise = now_us;
+    }
+    else if (!value && trig_level && now_us - trig_rise >= 10 && !echo_level && !echo_rise_at && !silent)
+    {
+        // a trigger pulse while idle: the burst goes out, the echo pulse follows
+        echo_rise_at = now_us + 420 + rand() % 60;
+        unsigned long round_trip = (obstacle_cm < 0 || obstacle_cm > 400) ? NO_ECHO_US : lround(obstacle_cm * 58.2);
+        echo_fall_at = echo_rise_at + round_trip;
+    }
+    trig_level = value;
+}
+
+// the old blocking ping(): loop time it took
+unsigned long oldPing(double cm)
+{
+    unsigned long pulse = silent ? 1000000 : (cm < 0 || cm > 400) ? NO_ECHO_US : lround(cm * 58.2);
+    return 300 + 1000 + (silent ? 0 : 450) + pulse;
+}
+
+int main(int argc, char **argv)
+{
+    settings s;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--loop"))
+            s.loop = atol(argv[i + 1]);
+        else if (!strcmp(argv[i], "--pings"))
+            s.pings = atoi(argv[i + 1]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--loop us] [--pings n]\n", argv[0]);
+            return 1;
+        }
+    }
+    srand(1);
+    HC_SR04 sensor(TRIG_PIN, ECHO_PIN, HC_SR04_MAX_CM);
+    int failures = 0;
+
+    struct test
+    {
+        const char *name;
+        double cm;
+        bool silent;
+    } cases[] = {{"2 cm", 2, false},     {"10 cm", 10, false},   {"20 cm", 20, false},
+                 {"57.5 cm", 57.5, false}, {"150 cm", 150, false}, {"299 cm", 299, false},
+                 {"350 cm (beyond the limit)", 350, false},      {"no echo", -1, false},
+                 {"silent sensor", 100, true}};
+
+    printf("case,readings,expected_cm,min_cm,max_cm,us_per_reading,max_latency_us,loops_per_s,old_loops_per_s,"
+           "longest_block_us\n");
+    for (const test &c : cases)
+    {
+        obstacle_cm = c.cm;
+        silent = c.silent;
+        int readings = 0, low = 1 << 30, high = -1;
+        unsigned long start = now_us, passes = 0, trigger = 0, latency = 0;
+        while (readings < s.pings)
+        {
+            // one robot loop pass
+            unsigned long before = now_us;
+            if (sensor.available())
+            {
+                int cm = sensor.lastDistanceCm();
+                low = (cm < low) ? cm : low;
+                high = (cm > high) ? cm : high;
+                latency = (now_us - trigger > latency) ? now_us - trigger : latency;
+                readings++;
+            }
+            if (sensor.startPing())
+            {
+                trigger = now_us;
+            }
+            blocked = (now_us - before > blocked) ? now_us - before : blocked;
+            runTo(now_us + s.loop);
+            passes++;
+        }
+        double seconds = (now_us - start) * 1e-6;
+        int expected = c.silent ? 0 : (c.cm < 0 || c.cm > HC_SR04_MAX_CM) ? HC_SR04_OUT_OF_RANGE : (int)lround(c.cm);
+        bool ok = (expected == 0 || expected == HC_SR04_OUT_OF_RANGE) ? (low == expected && high == expected)
+                                                                      : (low >= expected - 1 && high <= expected + 1);
+        // no echo: the result at the range limit (+ the echo's start, a loop pass), not at 38 ms
+        double per_reading = (now_us - start) / (double)readings;
+        if (c.cm < 0 && latency > 500 + HC_SR04_MAX_CM * 291UL / 5 + s.loop + 20)
+        {
+            fprintf(stderr, "%s: the result came %lu us after the trigger\n", c.name, latency);
+            ok = false;
+        }
+        unsigned long old = oldPing(c.cm) + s.loop;
+        printf("%s,%d,%d,%d,%d,%.0f,%lu,%.0f,%.1f,%lu\n", c.name, readings, expected, low, high, per_reading, latency,
+               passes / seconds, 1e6 / old, blocked);
+        fprintf(stderr, "%-26s %s  %d..%d cm, a reading every %.1f ms (%.1f ms after the trigger), %.0f loops/s"
+                        " (old ping(): %.1f)\n",
+                c.name, ok ? "ok    " : "FAILED", low, high, per_reading / 1000, latency / 1000.0, passes / seconds,
+                1e6 / old);
+        failures += ok ? 0 : 1;
+
+        // let the sensor finish before the next case
+        runTo(now_us + NO_ECHO_US + 1000);
+        sensor.available();
+    }
+
+    // the blocking ping() still works, bounded by the range limit
+    obstacle_cm = 123;
+    silent = false;
+    int cm = sensor.ping();
+    if (cm < 122 || cm > 124)
+    {
+        fprintf(stderr, "ping(): %d cm, not 123\n", cm);
+        failures++;
+    }
+    if (blocked > 2 + HC_SR04_TRIGGER_US + 4)
+    {
+        fprintf(stderr, "the loop was held up for %lu us\n", blocked);
+        failures++;
+    }
+    fprintf(stderr, "longest hold-up of the loop: %lu us (old ping(): %lu us with no echo, 1 s with no sensor)\n",
+            blocked, oldPing(-1));
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ranging ok");
+    return failures ? 1 : 0;
+}
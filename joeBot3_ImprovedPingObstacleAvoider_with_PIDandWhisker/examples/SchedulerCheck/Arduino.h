@@ -0,0 +1,23 @@
+// The few Arduino calls RateScheduler uses, for SchedulerCheck: on simulated time, with
+// Serial going out at 115200 baud through a 64 byte buffer (see SchedulerCheck.cpp)
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+unsigned long micros();
+
+class Print
+{
+public:
+    size_t write(uint8_t c); // waits while the transmit buffer is full, as HardwareSerial does
+    size_t print(const char *s);
+    size_t print(unsigned long n);
+    size_t print(long n);
+    size_t print(int n) { return print((long)n); }
+    size_t println(const char *s) { return print(s) + print("\r\n"); }
+    size_t println(unsigned long n) { return print(n) + print("\r\n"); }
+};
+
+#endif
@@ -0,0 +1,280 @@
+// SchedulerCheck -- check RateScheduler with joeBot3's tasks, on a PC
+// Runs the real RateScheduler.cpp on simulated time (the Arduino.h here) with the sketch's
+// four tasks, each taking about as long as it does on the 16 MHz ATmega328P:
+//   control    every 10 ms: two analogRead()s, the encoders, two double PIDs  (~1 ms)
+//   ranging    every 50 ms: available() and startPing()                       (~40 us)
+//   telemetry  every 200 ms: a line of Serial.print()s
+//   report     every 30 s: printHistogram() (the real one)
+// Serial goes out at 115200 baud through the 64 byte transmit buffer, print() waiting
+// while it is full, so long prints hold up the loop as they do on the robot.  One task run
+// stalls for --stall us, to see the scheduler skip instead of bursting.  Checks:
+//   - every task keeps its rate over --seconds: runs + late runs = the periods elapsed
+//   - a late task skips the missed runs: never two control runs in one 10 ms slot
+//   - the histogram counts every loop pass
+//   - obstacle reaction: a whisker closing at a random time is seen by the next control
+//     run, within one tick plus the longest other task run (the old loop waited for the
+//     whole maneuver it was in: Avoid_Straight, 3000 ticks, ~0.8 s at the cruise speed)
+// The robot's Serial output (telemetry is left out) goes to stdout, the results to stderr.
+//
+// Build and run (from this directory):
+//   g++ -std=gnu++11 -O2 -I. -I../../lib/RateScheduler SchedulerCheck.cpp ../../lib/RateScheduler/RateScheduler.cpp -o schedulercheck
+//   ./schedulercheck --seconds 61 --stall 35000
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Arduino.h"
+#include "RateScheduler.h"
+
+#define CONTROL_US 10000UL
+#define RANGING_US 50000UL
+#define TELEMETRY_US 200000UL
+#define REPORT_US 30000000UL
+#define BYTE_US 87     // one byte at 115200 baud (10 bits)
+#define TX_BUFFER 64   // HardwareSerial's transmit buffer
+#define CRUISE_TICKS_PER_S 3732.0 // the sketch's setpoint: fast * 19.6419
+
+// settings (command line)
+struct settings
+{
+    double seconds = 61;
+    unsigned long stall = 35000; // us, once, in a telemetry run
+    int events = 2000;           // whisker closings
+};
+
+// simulated time, and the serial port's transmit buffer
+unsigned long now_us = 0;
+unsigned long tx_queued = 0, tx_since = 0;
+bool echo_serial = true;
+
+unsigned long micros() { return now_us & ~3UL; }
+
+static void drain()
+{
+    unsigned long sent = (now_us - tx_since) / BYTE_US;
+    if (sent >= tx_queued)
+    {
+        tx_queued = 0;
+        tx_since = now_us;
+    }
+    else
+    {
+        tx_queued -= sent;
+        tx_since += sent * BYTE_US;
+    }
+}
+
+size_t Print::write(uint8_t c)
+{
+    drain();
+    if (tx_queued >= TX_BUFFER)
+    {
+        now_us = tx_since + BYTE_US; // wait for a byte to go
+        drain();
+    }
+    tx_queued++;
+    now_us += 4;
+    if (echo_serial)
+    {
+        putchar(c);
+    }
+    return 1;
+}
+
+size_t Print::print(const char *s)
+{
+    size_t n = 0;
+    while (*s)
+    {
+        n += write(*s++);
+    }
+    return n;
+}
+
+size_t Print::print(unsigned long n)
+{
+    char text[12];
+    snprintf(text, sizeof text, "%lu", n);
+    return print(text);
+}
+
+size_t Print::print(long n)
+{
+    char text[12];
+    snprintf(text, sizeof text, "%ld", n);
+    return print(text);
+}
+
+Print Serial;
+RateScheduler Scheduler;
+settings s;
+
+// control run start times; runs, late runs and loop passes over the whole run (the
+// reports clear the scheduler's)
+unsigned long *controlRuns = NULL;
+size_t controlCount = 0, controlSize = 0;
+unsigned long runs[3] = {0, 0, 0}, late[3] = {0, 0, 0}, passes = 0, reports = 0;
+unsigned long longestOther = 0; // longest run of the other tasks (us)
+bool stalled = false;
+
+void addUp()
+{
+    for (int8_t t = 0; t < 3; t++)
+    {
+        late[t] += Scheduler.late(t);
+    }
+    passes += Scheduler.passes();
+}
+
+void ControlTask()
+{
+    if (controlCount == controlSize)
+    {
+        controlSize = controlSize ? 2 * controlSize : 1024;
+        controlRuns = (unsigned long *)realloc(controlRuns, controlSize * sizeof *controlRuns);
+    }
+    controlRuns[controlCount++] = now_us;
+    runs[0]++;
+    now_us += 224 + 60 + 700; // analogRead() x2, encoders, PID x2
+}
+
+void RangingTask()
+{
+    unsigned long start = now_us;
+    runs[1]++;
+    now_us += 40;
+    longestOther = (now_us - start > longestOther) ? now_us - start : longestOther;
+}
+
+void TelemetryTask()
+{
+    unsigned long start = now_us;
+    runs[2]++;
+    echo_serial = false;
+    Serial.print("distance: ");
+    Serial.print(57L);
+    Serial.print(" cm (");
+    Serial.print("Go straight");
+    Serial.println(")");
+    echo_serial = true;
+    if (!stalled && now_us > 5000000)
+    {
+        now_us += s.stall; // something holds the loop up once
+        stalled = true;
+    }
+    longestOther = (now_us - start > longestOther) ? now_us - start : longestOther;
+}
+
+void ReportTask()
+{
+    unsigned long start = now_us;
+    Scheduler.printHistogram(Serial);
+    addUp();
+    Scheduler.clearHistogram();
+    reports++;
+    printf("(%lu us to print)\n", now_us - start);
+    longestOther = (now_us - start > longestOther) ? now_us - start : longestOther;
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--seconds"))
+            s.seconds = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--stall"))
+            s.stall = atol(argv[i + 1]);
+        else if (!strcmp(argv[i], "--events"))
+            s.events = atoi(argv[i + 1]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--seconds s] [--stall us] [--events n]\n", argv[0]);
+            return 1;
+        }
+    }
+    srand(1);
+    int failures = 0;
+
+    now_us = 1000; // (setup())
+    unsigned long begin = now_us;
+    int8_t control = Scheduler.addTask(ControlTask, CONTROL_US);
+    int8_t ranging = Scheduler.addTask(RangingTask, RANGING_US);
+    int8_t telemetry = Scheduler.addTask(TelemetryTask, TELEMETRY_US);
+    Scheduler.addTask(ReportTask, REPORT_US);
+
+    // loop()
+    unsigned long end = begin + (unsigned long)(s.seconds * 1e6);
+    unsigned long loops = 0;
+    while (now_us < end)
+    {
+        Scheduler.run();
+        loops++;
+        now_us += 20 + rand() % 20; // the rest of the pass (Serial.available(), ...)
+    }
+    addUp();
+    unsigned long elapsed = now_us - begin;
+
+    // every task kept its rate: a run or a skipped one every period
+    const char *name[] = {"control", "ranging", "telemetry"};
+    unsigned long period[] = {CONTROL_US, RANGING_US, TELEMETRY_US};
+    for (int8_t t = control; t <= telemetry; t++)
+    {
+        unsigned long periods = elapsed / period[t];
+        bool ok = runs[t] + late[t] + 1 >= periods && runs[t] + late[t] <= periods + 1;
+        fprintf(stderr, "%-10s %s  %lu runs + %lu late in %lu periods\n", name[t], ok ? "ok    " : "FAILED", runs[t],
+                late[t], periods);
+        failures += ok ? 0 : 1;
+    }
+    (void)ranging;
+
+    // the histogram timed every pass but the first and those after the reports (untimed)
+    if (passes + 1 + reports != loops)
+    {
+        fprintf(stderr, "the histogram counted %lu passes of %lu\n", passes, loops);
+        failures++;
+    }
+
+    // no bursts: at most one control run in each 10 ms slot of the grid
+    for (size_t i = 1; i < controlCount; i++)
+    {
+        if ((controlRuns[i] - begin) / CONTROL_US <= (controlRuns[i - 1] - begin) / CONTROL_US)
+        {
+            fprintf(stderr, "two control runs in one slot, at %lu and %lu us\n", controlRuns[i - 1], controlRuns[i]);
+            failures++;
+            break;
+        }
+    }
+
+    // reaction: from a whisker closing to the next control run
+    unsigned long worst = 0;
+    double total = 0;
+    for (int e = 0; e < s.events; e++)
+    {
+        unsigned long at = begin + (unsigned long)((double)rand() / RAND_MAX * (elapsed - 2 * CONTROL_US));
+        size_t lo = 0, hi = controlCount;
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi) / 2;
+            if (controlRuns[mid] < at)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        unsigned long latency = controlRuns[lo] - at;
+        worst = (latency > worst) ? latency : worst;
+        total += latency;
+    }
+    unsigned long bound = CONTROL_US + longestOther + 1000 + 100;
+    fprintf(stderr, "loop passes: %lu in %.1f s, the longest other task run: %lu us\n", passes, elapsed * 1e-6,
+            longestOther);
+    fprintf(stderr, "whisker to control: %.1f ms on average, %.1f ms at worst (bound %.1f ms); "
+                    "the old loop: up to %.0f ms (Avoid_Straight)\n",
+            total / s.events / 1000, worst / 1000.0, bound / 1000.0, 3000 / CRUISE_TICKS_PER_S * 1000);
+    if (worst > bound)
+    {
+        failures++;
+    }
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "scheduling ok");
+    free(controlRuns);
+    return failures ? 1 : 0;
+}
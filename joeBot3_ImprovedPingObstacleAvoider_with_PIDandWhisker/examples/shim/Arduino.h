@@ -0,0 +1,16 @@
+// The few Arduino calls EncoderSampler and the PID libraries use, for DriftCheck and
+// AutotuneCheck: on simulated time (each check defines millis() and micros() as it needs
+// them), with interrupts never actually on
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+unsigned long millis();
+unsigned long micros();
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+#endif
@@ -0,0 +1,17 @@
+// Encoder for DriftCheck and AutotuneCheck: the count the simulated wheel has made since the last write()
+#ifndef Encoder_h_
+#define Encoder_h_
+
+#include "Arduino.h"
+
+class Encoder
+{
+public:
+    Encoder() : position(0) {}
+    int32_t read() { return position; }
+    int32_t readInISR() { return position; }
+    void write(int32_t p) { position = p; }
+    int32_t position; // moved on by the simulation, an edge at a time
+};
+
+#endif
@@ -230,6 +230,18 @@ public:
 
 	}
 
+	// read() for an interrupt handler, or other code running with interrupts
+
+	// already off: read() would turn them back on before it returns
+
+	inline int32_t readInISR() {
+
+		if (interrupts_in_use < 2) update(&encoder);
+
+		return encoder.position;
+
+	}
+
 #else
 
 	inline int32_t read() {
@@ -246,6 +258,12 @@ public:
 
 	}
 
+	inline int32_t readInISR() {
+
+		return read();
+
+	}
+
 #endif
 
 
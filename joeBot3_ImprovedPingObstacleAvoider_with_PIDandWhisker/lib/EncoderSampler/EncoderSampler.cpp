@@ -0,0 +1,132 @@
+/*
+ EncoderSampler.cpp
+ Samples two encoders together, at a fixed period, from a timer interrupt
+*/
+
+#include "Arduino.h"
+#include "EncoderSampler.h"
+
+#if defined(__AVR__) && defined(TIMER2_COMPA_vect)
+#define SAMPLER_TIMER2
+// Timer2 compare match, every ms
+static EncoderSampler *timerSampler = NULL;
+
+ISR(TIMER2_COMPA_vect) { if (timerSampler) timerSampler->tick(); }
+#endif
+
+// EncoderSampler Constructor
+EncoderSampler::EncoderSampler(Encoder &left, Encoder &right, uint8_t periodMs, uint8_t window)
+{
+  _left = &left;
+  _right = &right;
+  _period = ( periodMs > 0 ) ? periodMs : 1;
+  if ( window < 1 ) {
+    window = 1;
+  }
+  _window = ( window > SAMPLER_WINDOW_MAX ) ? SAMPLER_WINDOW_MAX : window;
+  _ms = 0;
+  _head = 0;
+  _samples = 0;
+  _taken = 0;
+  _missed = 0;
+  _lCount = _rCount = 0;
+  _lSpeed = _rSpeed = 0;
+}
+
+// Starts from the counts as they are: the first sample is periodMs from now
+void EncoderSampler::begin(){
+  noInterrupts();
+  long l = _left->readInISR();
+  long r = _right->readInISR();
+  for ( uint8_t i = 0; i <= SAMPLER_WINDOW_MAX; i++ ) {
+    _lRing[i] = l;
+    _rRing[i] = r;
+  }
+  _head = 0;
+  _ms = 0;
+  _samples = 0;
+  _taken = 0;
+  _missed = 0;
+  _lCount = l;
+  _rCount = r;
+  _lSpeed = _rSpeed = 0;
+#ifdef SAMPLER_TIMER2
+  timerSampler = this;
+  TCCR2A = _BV(WGM21);              // CTC: clear at OCR2A
+  TCCR2B = _BV(CS22);               // clk/64
+  OCR2A = F_CPU / 64 / 1000 - 1;    // 1 ms
+  TCNT2 = 0;
+  TIMSK2 = _BV(OCIE2A);
+#endif
+  interrupts();
+}
+
+// Counts the ms to the next sample (from the timer interrupt)
+void EncoderSampler::tick(){
+  if ( ++_ms >= _period ) {
+    _ms = 0;
+    sample();
+  }
+}
+
+// Latches both counts (interrupts off: from the timer interrupt)
+void EncoderSampler::sample(){
+  uint8_t head = ( _head < SAMPLER_WINDOW_MAX ) ? _head + 1 : 0;
+  _lRing[head] = _left->readInISR();
+  _rRing[head] = _right->readInISR();
+  _head = head;
+  _samples++;
+}
+
+// Takes the latest sample, if it's new: its counts, and the speeds to it
+bool EncoderSampler::available(){
+  noInterrupts();
+  unsigned long samples = _samples;
+  uint8_t head = _head;
+  uint8_t span = ( samples < _window ) ? samples : _window;
+  uint8_t from = ( head >= span ) ? head - span : head + SAMPLER_WINDOW_MAX + 1 - span;
+  long l = _lRing[head];
+  long r = _rRing[head];
+  long l0 = _lRing[from];
+  long r0 = _rRing[from];
+  interrupts();
+
+  if ( samples == _taken ) {
+    return false;
+  }
+  _missed += samples - _taken - 1;
+  _taken = samples;
+  _lCount = l;
+  _rCount = r;
+  long ms = (long)span * _period;
+  _lSpeed = ( l - l0 ) * 1000L / ms;
+  _rSpeed = ( r - r0 ) * 1000L / ms;
+  return true;
+}
+
+long EncoderSampler::leftCount(){
+  return _lCount;
+}
+
+long EncoderSampler::rightCount(){
+  return _rCount;
+}
+
+long EncoderSampler::leftSpeed(){
+  return _lSpeed;
+}
+
+long EncoderSampler::rightSpeed(){
+  return _rSpeed;
+}
+
+unsigned long EncoderSampler::samples(){
+  noInterrupts();
+  unsigned long samples = _samples;
+  interrupts();
+  return samples;
+}
+
+unsigned long EncoderSampler::missed(){
+  return _missed;
+}
@@ -0,0 +1,64 @@
+/*
+ EncoderSampler.h
+ Samples two encoders together, at a fixed period, from a timer interrupt
+
+ Every periodMs the timer interrupt latches both encoders' counts.  Interrupts
+ are off in the handler, so the two counts are from the same instant, and no
+ edge is counted between them.  The counts are never reset: a speed is the
+ difference between two latched counts a whole number of periods apart, so it
+ doesn't depend on when loop() gets round to it.  available() is true once
+ for each new sample, which is the cue to compute: a PID run on it (see
+ PID_fix::ComputeTick()) has exactly periodMs between its inputs.
+
+ The speed can span the last few samples (window): quantized to one count
+ per window rather than per period, for a less noisy derivative term, at the
+ cost of a little lag.
+
+ On AVR, Timer2 interrupts every 1 ms (CTC mode, clk/64: exact at 16 MHz), so
+ this takes Timer2 from analogWrite() on pins 3 and 11, and from tone().
+ Without Timer2, begin() starts nothing: call sample() every periodMs from a
+ timer of your own.
+*/
+
+#ifndef EncoderSampler_h
+#define EncoderSampler_h
+
+#include "Arduino.h"
+#include "Encoder.h"
+
+#define SAMPLER_WINDOW_MAX 8  // samples a speed can span
+
+class EncoderSampler
+{
+  public:
+    EncoderSampler(Encoder &left, Encoder &right, uint8_t periodMs, uint8_t window = 1);
+    void begin();             // takes the counts as they are, and starts sampling
+    bool available();         // true once for each new sample (takes it)
+    long leftCount();         // counts at the sample taken
+    long rightCount();
+    long leftSpeed();         // counts/s, over the last window samples to it
+    long rightSpeed();
+    unsigned long samples();  // since begin()
+    unsigned long missed();   // samples replaced before available() took them
+    void sample();            // latches both counts: timer interrupt only
+    void tick();              // timer interrupt, every ms: sample() every periodMs
+  private:
+    Encoder *_left;
+    Encoder *_right;
+    uint8_t _period;          // ms
+    uint8_t _window;          // samples
+    volatile uint8_t _ms;     // since the last sample
+    volatile long _lRing[SAMPLER_WINDOW_MAX + 1];  // latched counts
+    volatile long _rRing[SAMPLER_WINDOW_MAX + 1];
+    volatile uint8_t _head;   // the last latched
+    volatile unsigned long _samples;
+    unsigned long _taken;     // _samples at the last one available() took
+    unsigned long _missed;
+    long _lCount;
+    long _rCount;
+    long _lSpeed;
+    long _rSpeed;
+
+};
+
+#endif
@@ -9,39 +9,158 @@
 #include "Arduino.h"
 #include "HC_SR04.h"
 
+// ping states
+#define PING_IDLE 0
+#define PING_WAIT_RISE 1 // trigger sent, waiting for the echo pulse to start
+#define PING_WAIT_FALL 2 // echo pulse started, waiting for it to end
+#define PING_DONE 3      // echo pulse ended, not read yet
+
+#if defined(__AVR__)
+// the sensor on HC_SR04_PCINT_GROUP's vector (the only one the library defines)
+#if HC_SR04_PCINT_GROUP == 0
+#define HC_SR04_PCINT_VECT PCINT0_vect
+#elif HC_SR04_PCINT_GROUP == 1
+#define HC_SR04_PCINT_VECT PCINT1_vect
+#elif HC_SR04_PCINT_GROUP == 2
+#define HC_SR04_PCINT_VECT PCINT2_vect
+#elif HC_SR04_PCINT_GROUP != -1
+#error "HC_SR04_PCINT_GROUP: 0, 1, 2 or -1"
+#endif
+
+#ifdef HC_SR04_PCINT_VECT
+static HC_SR04 *pcintSensor = NULL;
+
+ISR(HC_SR04_PCINT_VECT) { if (pcintSensor) pcintSensor->echoChanged(); }
+#endif
+#else
+// other boards: attachInterrupt(), which passes no argument, so one sensor
+static HC_SR04 *echoSensor = NULL;
+
+static void onEcho() { if (echoSensor) echoSensor->echoChanged(); }
+#endif
+
 // HC_SR04 Constructor
-HC_SR04::HC_SR04(int trigPin, int echoPin)
+HC_SR04::HC_SR04(int trigPin, int echoPin, int maxCm)
 {
   pinMode(trigPin, OUTPUT);
   pinMode(echoPin, INPUT);
   _trigPin = trigPin;
   _echoPin = echoPin;
+  _state = PING_IDLE;
+  _rise = _fall = _start = 0;
+  _distance = 0;
+  // the echo pulse is the round trip: 58.2 us per cm (29.1 us/cm each way)
+  _timeoutUs = (unsigned long)maxCm * 291 / 5;
+
+#if defined(__AVR__)
+  _echoPort = portInputRegister(digitalPinToPort(echoPin));
+  _echoMask = digitalPinToBitMask(echoPin);
+  // enabled only with a vector to take it: the library's, or (-1) the sketch's
+  uint8_t group = digitalPinToPCICRbit(echoPin);
+  if (digitalPinToPCICR(echoPin) != NULL && (HC_SR04_PCINT_GROUP == -1 || group == HC_SR04_PCINT_GROUP))
+  {
+#ifdef HC_SR04_PCINT_VECT
+    pcintSensor = this;
+#endif
+    *digitalPinToPCMSK(echoPin) |= _BV(digitalPinToPCMSKbit(echoPin));
+    *digitalPinToPCICR(echoPin) |= _BV(group);
+  }
+#else
+  echoSensor = this;
+  attachInterrupt(digitalPinToInterrupt(echoPin), onEcho, CHANGE);
+#endif
 }
 
+// Measures and waits for the result (bounded by the range limit, not pulseIn()'s 1 s)
 int HC_SR04::ping(){
-  long _duration;
-  int _distance;
+  unsigned long begin = micros();
+  while ( !startPing() ) {
+    if ( micros() - begin > HC_SR04_BUSY_TIMEOUT_US ) {
+      return 0; // the echo pin is stuck high
+    }
+  }
+  while ( !available() ) {
+  }
+  return _distance;
+}
+
+// Sends the trigger pulse and returns; false while the last ping is still out
+bool HC_SR04::startPing(){
+  if ( _state == PING_WAIT_RISE || _state == PING_WAIT_FALL ) {
+    return false;
+  }
+  if ( echoHigh() ) {
+    return false; // the sensor is still timing out a ping that found no echo
+  }
 
   // trigger ultrasonic pulse. LOW to clear 2 microseconds, then HIGH for 10
-  // microseconds, then LOW
+  // microseconds, then LOW (was 300 us LOW, 1000 us HIGH: 1.3 ms of the loop)
   digitalWrite(_trigPin, LOW);
-//  delayMicroseconds(3);
-//  digitalWrite(_trigPin, HIGH);
-//  delayMicroseconds(11);
-  delayMicroseconds(300);
+  delayMicroseconds(2);
   digitalWrite(_trigPin, HIGH);
-  delayMicroseconds(1000);
+  delayMicroseconds(HC_SR04_TRIGGER_US);
   digitalWrite(_trigPin, LOW);
 
-  // Time the duration untill arrival of the echo'd return pulse
-  // and calculate the distance (half the round trip travelling at the speed of sound)
-  // Vs=343.643m/s, or 29.1 microseconds per centimeter.
-  // Set pulseIn() timeout to duration of time to return of pulse from obstacle at 
-  // 3m distance (17460 microseconds round trip); pulseIn() will ignore and return 0
-  // at distances larger than 3m taking more than that long to return
-  _duration = pulseIn(_echoPin, HIGH);
-  _distance = (_duration/2) / 29.1;
+  noInterrupts();
+  _start = micros();
+  _state = PING_WAIT_RISE;
+  interrupts();
+  return true;
+}
+
+// True once the ping started last has a result (lastDistanceCm())
+bool HC_SR04::available(){
+  noInterrupts();
+  uint8_t state = _state;
+  unsigned long rise = _rise;
+  unsigned long fall = _fall;
+  unsigned long now = micros();
+  bool done = (state == PING_DONE) ||
+              (state == PING_WAIT_RISE && now - _start > HC_SR04_RISE_TIMEOUT_US) ||
+              (state == PING_WAIT_FALL && now - rise > _timeoutUs);
+  if ( done ) {
+    _state = PING_IDLE;
+  }
+  interrupts();
+  if ( !done ) {
+    return false;
+  }
+
+  if ( state == PING_WAIT_RISE ) {
+    _distance = 0; // no echo pulse at all (as pulseIn() returned)
+  } else if ( state == PING_WAIT_FALL || fall - rise > _timeoutUs ) {
+    _distance = HC_SR04_OUT_OF_RANGE;
+  } else {
+    // half the round trip travelling at the speed of sound: Vs=343.643m/s, or
+    // 29.1 microseconds per centimeter, so cm = us / 58.2, rounded
+    _distance = (int)(((fall - rise) * 5 + 145) / 291);
+  }
+  return true;
+}
 
+// Centimeters, from the last ping available() reported; HC_SR04_OUT_OF_RANGE when
+// the echo took longer than the range limit, 0 when the sensor didn't answer
+int HC_SR04::lastDistanceCm(){
   return _distance;
+}
+
+// Timestamps the echo pulse's edges (interrupts off)
+void HC_SR04::echoChanged(){
+  unsigned long now = micros();
+  bool high = echoHigh();
+  if ( _state == PING_WAIT_RISE && high ) {
+    _rise = now;
+    _state = PING_WAIT_FALL;
+  } else if ( _state == PING_WAIT_FALL && !high ) {
+    _fall = now;
+    _state = PING_DONE;
+  }
+}
 
+bool HC_SR04::echoHigh(){
+#if defined(__AVR__)
+  return (*_echoPort & _echoMask) != 0;
+#else
+  return digitalRead(_echoPin) == HIGH;
+#endif
 }
@@ -1,9 +1,19 @@
-/* 
+/*
  HC_SR04.h
  Joe Brendler
  16 Dec 2013
  HC-SR04 Ping distance sensor (returns distance in centimeters)
  Some code inspired by http://www.instructables.com/id/Simple-Arduino-and-HC-SR04-Example
+
+ Asynchronous ranging: startPing() sends the trigger pulse and returns; the
+ echo pin's edges are timestamped by a pin change interrupt (AVR; one sensor,
+ see HC_SR04_PCINT_GROUP) or attachInterrupt() (other boards; one sensor), and
+ available() turns the pulse
+ into whole centimeters with integer math once it has ended, or once it runs
+ past the range limit. So the sketch keeps running while the sound travels:
+   if (Sensor.available()) dist = Sensor.lastDistanceCm();
+   Sensor.startPing(); // (refused while a ping is still out)
+ ping() still measures and waits for the result, bounded by the range limit.
 */
 
 #ifndef HC_SR04_h
@@ -11,17 +21,44 @@
 
 #include "Arduino.h"
 
+#define HC_SR04_MAX_CM 300            // default range limit (cm)
+#define HC_SR04_OUT_OF_RANGE 32767    // lastDistanceCm(): nothing within the range limit
+#define HC_SR04_TRIGGER_US 10         // trigger pulse length (the datasheet's 10 us)
+#define HC_SR04_RISE_TIMEOUT_US 6000  // the echo pulse starts this soon after the trigger, or the sensor is silent
+#define HC_SR04_BUSY_TIMEOUT_US 250000 // ping(): longest wait for the sensor to finish a ping that found no echo
+
+// AVR: the pin change interrupt group the library takes the vector of (PCINT0-2: port B,
+// C, D on the ATmega328P; default 2, for joeBot3's echo on pin 6), leaving the others to
+// other libraries.  The echo pin must be in it.  -1 (build_flags = -D HC_SR04_PCINT_GROUP=-1):
+// no vector at all; the sketch's own ISR(PCINTn_vect) calls echoChanged()
+#ifndef HC_SR04_PCINT_GROUP
+#define HC_SR04_PCINT_GROUP 2
+#endif
+
 
 class HC_SR04
 {
   public:
-    HC_SR04(int trigPin, int echoPin);
+    HC_SR04(int trigPin, int echoPin, int maxCm = HC_SR04_MAX_CM);
     int ping();
+    bool startPing();
+    bool available();
+    int lastDistanceCm();
+    void echoChanged(); // echo pin edge (from the pin change interrupt; see HC_SR04_PCINT_GROUP)
   private:
-    long _duration;
+    bool echoHigh();
+    volatile uint8_t _state;
+    volatile unsigned long _rise; // micros() at the echo pulse's edges
+    volatile unsigned long _fall;
+    unsigned long _start;         // micros() at the trigger
+    unsigned long _timeoutUs;     // longest echo pulse within the range limit
     int _distance;
     int _trigPin;
     int _echoPin;
+#if defined(__AVR__)
+    volatile uint8_t *_echoPort;
+    uint8_t _echoMask;
+#endif
 
 };
 
@@ -0,0 +1,75 @@
+/********************************************************
+ * PID Timing Example
+ * Times Compute() of PID (double) and PID_fix<20>
+ * (fixed point, as joeBot3 uses) on the board, over a
+ * wheel's speeds rising to a setpoint: microseconds per
+ * call, on the serial monitor at 115200 baud.
+ * Compute() only computes once per SampleTime, so each
+ * call waits for the next millisecond and is timed on its
+ * own; an empty timing is taken off (micros() counts in
+ * 4 us steps at 16 MHz, which averages out over the calls)
+ ********************************************************/
+
+#include <PID_v1.h>
+#include <PID_fix.h>
+
+const double kp = 0.017, ki = 0.16, kd = 0.01;
+const int calls = 2000;
+
+//a wheel's measured speeds, ticks/s
+const int inputs[] = {0, 300, 900, 1500, 2000, 2400, 2800, 3100, 3300, 3500,
+                      3600, 3700, 3800, 3800, 3700, 3700, 3800, 3700, 3700, 3600};
+const int inputCount = sizeof(inputs) / sizeof(inputs[0]);
+
+double dSetpoint = 3732, dInput, dOutput;
+long lSetpoint = 3732, lInput, lOutput;
+
+PID dPID(&dInput, &dOutput, &dSetpoint, kp, ki, kd, DIRECT);
+PID_fix<20> fPID(&lInput, &lOutput, &lSetpoint, kp, ki, kd, DIRECT);
+
+//waits for millis() to tick, so Compute() is due
+void nextMillisecond() {
+  unsigned long now = millis();
+  while (millis() == now);
+}
+
+//total microseconds of the calls (which: 0 none, 1 PID, 2 PID_fix)
+unsigned long computeMicros(int which) {
+  unsigned long total = 0;
+  for (int i = 0; i < calls; i++) {
+    dInput = lInput = inputs[i % inputCount];
+    nextMillisecond();
+    unsigned long start = micros();
+    if (which == 1) dPID.Compute();
+    else if (which == 2) fPID.Compute();
+    total += micros() - start;
+  }
+  return total;
+}
+
+void report(const char *how, unsigned long us, unsigned long empty) {
+  Serial.print(how);
+  Serial.print(": ");
+  Serial.print((double)(us - empty) / calls, 1);
+  Serial.println(" us per call");
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(500);
+  Serial.println("PID timing");
+
+  dPID.SetSampleTime(1);
+  fPID.SetSampleTime(1);
+  dPID.SetMode(AUTOMATIC);
+  fPID.SetMode(AUTOMATIC);
+
+  unsigned long empty = computeMicros(0);
+  report("PID (double)", computeMicros(1), empty);
+  report("PID_fix<20> ", computeMicros(2), empty);
+}
+
+void loop()
+{
+}
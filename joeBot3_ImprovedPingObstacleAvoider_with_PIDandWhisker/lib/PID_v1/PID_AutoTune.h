@@ -0,0 +1,379 @@
+#ifndef PID_AutoTune_h
+#define PID_AutoTune_h
+
+/**********************************************************************************************
+ * Arduino PID Library - relay feedback autotune, for PID and PID_fix
+ *
+ * Tunes a loop by an experiment on the loop itself (Astrom and Hagglund's relay method):
+ * in place of the PID, Runtime() switches the output between Start()'s output plus and
+ * minus a step, each time the input crosses the setpoint by more than the noise band.
+ * Most loops settle into an oscillation of steady amplitude a and period Pu, the ultimate
+ * period; the relay's describing function gives the ultimate gain,
+ *     Ku = 4 * step / (pi * sqrt(a^2 - band^2))
+ * The function's a is the amplitude of the oscillation's fundamental: here pi/2 times the
+ * input's mean distance from the setpoint over each cycle, which is a sine's amplitude and
+ * within a few % of the fundamental of the rounded triangles most loops give.  Averaged
+ * over the cycle, it isn't held to the input's resolution as the peaks would be, and the
+ * period is timed between crossings interpolated between samples, for the same reason.
+ * Once the last ATUNE_CYCLES cycles agree, the tunings follow from Ku and Pu by Ziegler
+ * and Nichols' rules (those of the PID_AutoTune_v0 library):
+ *     PI:  Kp = 0.4 Ku,  Ki = 0.48 Ku / Pu
+ *     PID: Kp = 0.6 Ku,  Ki = 1.2 Ku / Pu,  Kd = 0.075 Ku * Pu
+ * Start the relay from the output that holds the setpoint (the PID's, once it has settled)
+ * for an even oscillation, and keep that output +/- the step within the output's range.
+ *
+ * Runtime() must be called once per sample, every SampleTime: periods are counted in
+ * samples, as for a PID run on a timer tick (PID_fix::ComputeTick()). Put the PID in MANUAL
+ * while tuning, so that it picks up without a bump when set back to AUTOMATIC.
+ *
+ * PID_SaveTunings() and PID_LoadTunings() keep a set of tunings in EEPROM (on the ESP32
+ * and ESP8266, the EEPROM library's emulation in flash), with a check, so a sketch can
+ * start from the last ones it tuned.  The emulation is always opened at PID_EEPROM_SIZE
+ * bytes, which every set saved must fit inside: opened at another size, the ESP32 cuts
+ * the stored blob to it and the ESP8266 rewrites only that much of the flash sector, so
+ * saving one set would lose the sets past it.  Define PID_EEPROM_SIZE (before including
+ * this) to match a sketch that uses the EEPROM for more.
+ *
+ *   PID_ATune<long> tune(&input, &output, &setpoint);
+ *   tune.Start(output, 40);
+ *   ...every sample: if(tune.Runtime() == ATUNE_DONE) myPID.SetTunings(tune.GetKp(), ...
+ **********************************************************************************************/
+
+#if ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+#include <math.h>
+#include <stddef.h>
+#include <EEPROM.h>
+
+//Runtime() results
+#define ATUNE_RUNNING  0
+#define ATUNE_DONE     1
+#define ATUNE_FAILED   2
+
+//Control types
+#define ATUNE_PI   0
+#define ATUNE_PID  1
+
+#define ATUNE_CYCLES      3     // the last cycles that must agree (after the first)
+#define ATUNE_MAX_CYCLES  20    // cycles before giving up
+#define ATUNE_AGREE       0.05  // how far they may differ (of their mean)
+
+template <typename IO = double>
+class PID_ATune
+{
+
+
+  public:
+
+  //commonly used functions **************************************************************************
+    PID_ATune(IO*, IO*, IO*);             // * constructor.  links the autotune to the Input, Output, and
+                                          //   Setpoint of the PID to be tuned
+
+    void Start(IO, IO);                   // * starts the experiment: the output relays between the
+                                          //   first +/- the second, from the next Runtime()
+
+    int Runtime();                        // * one sample of the experiment.  ATUNE_RUNNING until the
+                                          //   cycles agree (ATUNE_DONE), or they never will (ATUNE_FAILED);
+                                          //   then the output is left at Start()'s
+
+    void Cancel();                        // * stops the experiment, leaving the output at Start()'s
+
+
+  //available but not commonly used functions ********************************************************
+    void SetNoiseBand(IO);                // * how far past the setpoint the input must go to switch
+                                          //   the relay: a few counts of the input's noise. default 0
+    void SetControlType(int);             // * ATUNE_PI (the default) or ATUNE_PID
+    void SetSampleTime(int);              // * the Milliseconds between Runtime()s.  default is 100
+    void SetTimeout(int);                 // * the Seconds without a switch before giving up. default 10
+
+
+  //Display functions ****************************************************************
+    double GetKp();                       // the tunings, once ATUNE_DONE
+    double GetKi();
+    double GetKd();
+    double GetKu();                       // the ultimate gain and period (seconds)
+    double GetPu();
+    bool IsRunning();
+
+  private:
+    void Stop();
+    bool CyclesAgree(const double*, double);
+
+    IO *myInput;
+    IO *myOutput;
+    IO *mySetpoint;
+
+    IO outputStart, outputStep, noiseBand;
+    int controlType;
+    unsigned long SampleTime;           // ms
+    unsigned long timeout;              // s
+
+    bool running, relayHigh, risen;
+    int result;
+    unsigned long samples;              // since Start()
+    unsigned long lastSwitch;
+    double lastRise;                    // when the relay last switched high (samples)
+    double cycleSum;                    // |input - setpoint| over the cycle so far
+    unsigned int cycleSamples;
+    IO lastInput;
+    uint8_t cycles;
+    double period[ATUNE_CYCLES];        // the last cycles' (s), round the ring
+    double amplitude[ATUNE_CYCLES];
+    double Ku, Pu;
+};
+
+/*Constructor (...)*********************************************************
+ *    links to the PID's variables: Runtime() reads the Input and Setpoint,
+ *    and drives the Output
+ ***************************************************************************/
+template <typename IO>
+PID_ATune<IO>::PID_ATune(IO* Input, IO* Output, IO* Setpoint)
+{
+    myInput = Input;
+    myOutput = Output;
+    mySetpoint = Setpoint;
+    outputStart = outputStep = noiseBand = 0;
+    controlType = ATUNE_PI;
+    SampleTime = 100;
+    timeout = 10;
+    running = false;
+    result = ATUNE_FAILED;
+    Ku = Pu = 0;
+}
+
+/* Start(...)*******************************************************************
+ * relays from the side of the setpoint the input is on now
+ ******************************************************************************/
+template <typename IO>
+void PID_ATune<IO>::Start(IO OutputStart, IO OutputStep)
+{
+    outputStart = OutputStart;
+    outputStep = OutputStep;
+    relayHigh = (*myInput < *mySetpoint);
+    risen = false;
+    samples = lastSwitch = 0;
+    lastRise = 0;
+    cycleSum = 0;
+    cycleSamples = 0;
+    lastInput = *myInput;
+    cycles = 0;
+    Ku = Pu = 0;
+    result = ATUNE_RUNNING;
+    running = true;
+}
+
+/* Runtime() *******************************************************************
+ *   A cycle runs from one switch high (the input fallen below the band) to the
+ *   next: its period, and its amplitude from the mean |input - setpoint|.  The
+ *   first cycle is the start from wherever the loop was, so it's left out of
+ *   the agreement
+ ******************************************************************************/
+template <typename IO>
+int PID_ATune<IO>::Runtime()
+{
+   if(!running) return result;
+   IO input = *myInput;
+   samples++;
+   double error = (double)input - (double)*mySetpoint;
+   cycleSum += (error < 0) ? -error : error;
+   cycleSamples++;
+
+   if(relayHigh && input > *mySetpoint + noiseBand)
+   {
+      relayHigh = false;
+      lastSwitch = samples;
+   }
+   else if(!relayHigh && input < *mySetpoint - noiseBand)
+   {
+      relayHigh = true;
+      lastSwitch = samples;
+      /*when the input crossed the band, between the last sample and this one*/
+      double below = (double)*mySetpoint - (double)noiseBand - (double)input;
+      double rise = samples - below / ((double)lastInput - (double)input);
+      if(risen)
+      {
+         /*a whole cycle*/
+         uint8_t slot = cycles % ATUNE_CYCLES;
+         period[slot] = (rise - lastRise) * SampleTime / 1000;
+         amplitude[slot] = 1.57079633 * cycleSum / cycleSamples;
+         cycles++;
+         if(cycles > ATUNE_CYCLES && CyclesAgree(period, (double)SampleTime / 1000) && CyclesAgree(amplitude, 0))
+         {
+            double a = 0;
+            Pu = 0;
+            for(uint8_t i = 0; i < ATUNE_CYCLES; i++)
+            {
+               a += amplitude[i] / ATUNE_CYCLES;
+               Pu += period[i] / ATUNE_CYCLES;
+            }
+            double band = (double)noiseBand;
+            if(a > band)
+            {
+               Ku = 4 * (double)outputStep / (3.14159265 * sqrt(a * a - band * band));
+               result = ATUNE_DONE;
+            }
+            else result = ATUNE_FAILED;   // the swing is all noise
+            Stop();
+            return result;
+         }
+         if(cycles >= ATUNE_MAX_CYCLES)
+         {
+            result = ATUNE_FAILED;
+            Stop();
+            return result;
+         }
+      }
+      risen = true;
+      lastRise = rise;
+      cycleSum = 0;
+      cycleSamples = 0;
+   }
+   lastInput = input;
+
+   if((samples - lastSwitch) * SampleTime > timeout * 1000)
+   {
+      /*the relay can't move the input across the setpoint*/
+      result = ATUNE_FAILED;
+      Stop();
+      return result;
+   }
+   *myOutput = relayHigh ? outputStart + outputStep : outputStart - outputStep;
+   return ATUNE_RUNNING;
+}
+
+template <typename IO>
+void PID_ATune<IO>::Cancel()
+{
+   if(!running) return;
+   result = ATUNE_FAILED;
+   Stop();
+}
+
+template <typename IO>
+void PID_ATune<IO>::Stop()
+{
+   running = false;
+   *myOutput = outputStart;
+}
+
+/* CyclesAgree(...) ************************************************************
+ * the last cycles' periods (or amplitudes) all within ATUNE_AGREE of their mean,
+ * or within slack.  (A sampled loop's oscillation is a whole number of samples
+ * long, and one a few samples long may take turns between two of them)
+ ******************************************************************************/
+template <typename IO>
+bool PID_ATune<IO>::CyclesAgree(const double* x, double slack)
+{
+   double lo = x[0], hi = x[0], mean = 0;
+   for(uint8_t i = 0; i < ATUNE_CYCLES; i++)
+   {
+      if(x[i] < lo) lo = x[i];
+      if(x[i] > hi) hi = x[i];
+      mean += x[i] / ATUNE_CYCLES;
+   }
+   return (hi - lo) <= ATUNE_AGREE * mean || (hi - lo) <= slack;
+}
+
+template <typename IO>
+void PID_ATune<IO>::SetNoiseBand(IO Band)
+{
+   if(Band >= 0) noiseBand = Band;
+}
+
+template <typename IO>
+void PID_ATune<IO>::SetControlType(int Type)
+{
+   controlType = (Type == ATUNE_PID) ? ATUNE_PID : ATUNE_PI;
+}
+
+template <typename IO>
+void PID_ATune<IO>::SetSampleTime(int NewSampleTime)
+{
+   if(NewSampleTime > 0) SampleTime = (unsigned long)NewSampleTime;
+}
+
+template <typename IO>
+void PID_ATune<IO>::SetTimeout(int Seconds)
+{
+   if(Seconds > 0) timeout = (unsigned long)Seconds;
+}
+
+/* Status Funcions*************************************************************
+ * The tunings by Ziegler and Nichols' rules, from the ultimate gain and period
+ ******************************************************************************/
+template <typename IO> double PID_ATune<IO>::GetKp(){ return (controlType == ATUNE_PID) ? 0.6 * Ku : 0.4 * Ku; }
+template <typename IO> double PID_ATune<IO>::GetKi(){ return (Pu <= 0) ? 0 : ((controlType == ATUNE_PID) ? 1.2 * Ku / Pu : 0.48 * Ku / Pu); }
+template <typename IO> double PID_ATune<IO>::GetKd(){ return (controlType == ATUNE_PID) ? 0.075 * Ku * Pu : 0; }
+template <typename IO> double PID_ATune<IO>::GetKu(){ return Ku; }
+template <typename IO> double PID_ATune<IO>::GetPu(){ return Pu; }
+template <typename IO> bool PID_ATune<IO>::IsRunning(){ return running; }
+
+
+/* PID_SaveTunings(...), PID_LoadTunings(...)***********************************
+ * a set of tunings at an EEPROM address (sizeof(PID_StoredTunings) bytes; on
+ * the ESP32 and ESP8266, within PID_EEPROM_SIZE, or nothing is saved).
+ * Loading fails, leaving the tunings alone, unless the check matches: nothing
+ * saved there yet, or something else has been
+ ******************************************************************************/
+struct PID_StoredTunings
+{
+    float Kp, Ki, Kd;           // (double is float on AVR)
+    uint16_t magic;
+    uint16_t check;
+};
+
+#define PID_TUNINGS_MAGIC 0x5054   // "PT"
+
+#ifndef PID_EEPROM_SIZE
+#define PID_EEPROM_SIZE 512        // bytes of the ESP32/ESP8266 emulated EEPROM
+#endif
+
+inline uint16_t PID_TuningsCheck(const PID_StoredTunings& t)
+{
+   const uint8_t* p = (const uint8_t*)&t;
+   uint16_t check = 0;
+   for(uint8_t i = 0; i < offsetof(PID_StoredTunings, check); i++)
+   {
+      check = (uint16_t)((check << 1) | (check >> 15)) ^ p[i];   // rotate and add in
+   }
+   return check;
+}
+
+inline void PID_SaveTunings(int address, double Kp, double Ki, double Kd)
+{
+   PID_StoredTunings t;
+   t.magic = PID_TUNINGS_MAGIC;
+   t.Kp = Kp; t.Ki = Ki; t.Kd = Kd;
+   t.check = PID_TuningsCheck(t);
+#if defined(ESP32) || defined(ESP8266)
+   if(address < 0 || address + sizeof(t) > PID_EEPROM_SIZE) return;
+   EEPROM.begin(PID_EEPROM_SIZE);
+   EEPROM.put(address, t);
+   EEPROM.end();                  // (commits)
+#else
+   EEPROM.put(address, t);        // (only the bytes that change are written)
+#endif
+}
+
+inline bool PID_LoadTunings(int address, double* Kp, double* Ki, double* Kd)
+{
+   PID_StoredTunings t;
+#if defined(ESP32) || defined(ESP8266)
+   if(address < 0 || address + sizeof(t) > PID_EEPROM_SIZE) return false;
+   EEPROM.begin(PID_EEPROM_SIZE);
+   EEPROM.get(address, t);
+   EEPROM.end();
+#else
+   EEPROM.get(address, t);
+#endif
+   if(t.magic != PID_TUNINGS_MAGIC || t.check != PID_TuningsCheck(t)) return false;
+   if(!(t.Kp >= 0) || !(t.Ki >= 0) || !(t.Kd >= 0)) return false;
+   *Kp = t.Kp; *Ki = t.Ki; *Kd = t.Kd;
+   return true;
+}
+
+#endif
@@ -0,0 +1,341 @@
+#ifndef PID_fix_h
+#define PID_fix_h
+
+/**********************************************************************************************
+ * Arduino PID Library - fixed point variant of PID_v1
+ *
+ * The same controller as PID (PID_v1.h): same functions, modes and directions, derivative
+ * on measurement, and the integral term clamped to the output limits (anti-windup), but
+ * with no floating point in Compute(). The linked Input, Output and Setpoint are whole
+ * numbers (long): encoder counts or rates, analogRead() values, analogWrite() duty. The
+ * gains and the integral term are fixed point, Q(31-FRAC).FRAC (Q15.16 by default): each
+ * Compute() is three 32 x 32 -> 32 bit multiplies and a few adds and compares, where PID
+ * does about a dozen software floating point operations on an AVR. Each product is
+ * saturated at +/-2^29, well past the output limits, so no sum can overflow 32 bits: the
+ * output is exact unless two saturated terms (a huge error and a huge jump of the input)
+ * pull against each other.
+ *
+ * FRAC trades the smallest gain step (2^-FRAC) against the largest output limit
+ * (2^(29-FRAC) - 1, e.g. 8191 at Q16, 511 at Q20): Ki and Kd are stored scaled by the
+ * sample time, so a small Ki at a short sample time wants more fraction bits. The double
+ * tunings are converted once, in SetTunings() and SetSampleTime(), and kept for
+ * GetKp() etc.
+ *
+ *   long input, output, setpoint;
+ *   PID_fix<> myPID(&input, &output, &setpoint, 0.017, 0.16, 0.01, DIRECT);
+ **********************************************************************************************/
+
+#if ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+#include "PID_v1.h"   // AUTOMATIC, MANUAL, DIRECT, REVERSE
+
+template <uint8_t FRAC = 16>
+class PID_fix
+{
+
+
+  public:
+
+  //commonly used functions **************************************************************************
+    PID_fix(long*, long*, long*,          // * constructor.  links the PID to the Input, Output, and
+        double, double, double, int);     //   Setpoint.  Initial tuning parameters are also set here
+
+    void SetMode(int Mode);               // * sets PID to either Manual (0) or Auto (non-0)
+
+    bool Compute();                       // * performs the PID calculation.  it should be
+                                          //   called every time loop() cycles. ON/OFF and
+                                          //   calculation frequency can be set using SetMode
+                                          //   SetSampleTime respectively
+
+    bool ComputeTick();                   // * performs the PID calculation now: for a caller
+                                          //   that runs it on a timer, every SampleTime, where
+                                          //   the millis() check in Compute() would jitter
+
+    void SetOutputLimits(long, long);     //clamps the output to a specific range. 0-255 by default,
+                                          //and at most +/-(2^(29-FRAC) - 1)
+
+
+  //available but not commonly used functions ********************************************************
+    void SetTunings(double, double,       // * While most users will set the tunings once in the
+                    double);              //   constructor, this function gives the user the option
+                                          //   of changing tunings during runtime for Adaptive control
+    void SetControllerDirection(int);     // * Sets the Direction, or "Action" of the controller. DIRECT
+                                          //   means the output will increase when error is positive. REVERSE
+                                          //   means the opposite.
+    void SetSampleTime(int);              // * sets the frequency, in Milliseconds, with which
+                                          //   the PID calculation is performed.  default is 100
+
+
+  //Display functions ****************************************************************
+    double GetKp();                       // These functions query the pid for interal values.
+    double GetKi();                       //  they were created mainly for the pid front-end,
+    double GetKd();                       // where it's important to know what is actually
+    int GetMode();                        //  inside the PID.
+    int GetDirection();                   //
+
+  private:
+    void Initialize();
+    void ScaleTunings();
+    static int32_t ToFixed(double);
+    static int32_t Reach(int32_t);
+    static int32_t Product(int32_t, int32_t, int32_t);
+    int32_t Clamp(int32_t);
+
+    double dispKp;              // * we'll hold on to the tuning parameters in user-entered
+    double dispKi;              //   format for display purposes
+    double dispKd;              //
+
+    int32_t kp;                 // * (P)roportional Tuning Parameter   (Q.FRAC)
+    int32_t ki;                 // * (I)ntegral Tuning Parameter, per sample
+    int32_t kd;                 // * (D)erivative Tuning Parameter, per sample
+    int32_t kpReach, kiReach, kdReach;  // largest error / input change each product holds
+
+    int controllerDirection;
+
+    long *myInput;              // * Pointers to the Input, Output, and Setpoint variables
+    long *myOutput;
+    long *mySetpoint;
+
+    unsigned long lastTime;
+    int32_t ITerm;              // Q.FRAC, within the output limits
+    long lastInput;
+
+    unsigned long SampleTime;
+    int32_t outMin, outMax;     // Q.FRAC
+    bool inAuto;
+};
+
+/*Constructor (...)*********************************************************
+ *    The parameters specified here are those for for which we can't set up
+ *    reliable defaults, so we need to have the user set them.
+ ***************************************************************************/
+template <uint8_t FRAC>
+PID_fix<FRAC>::PID_fix(long* Input, long* Output, long* Setpoint,
+        double Kp, double Ki, double Kd, int ControllerDirection)
+{
+    myOutput = Output;
+    myInput = Input;
+    mySetpoint = Setpoint;
+    inAuto = false;
+    ITerm = 0;
+    lastInput = 0;
+
+    SetOutputLimits(0, 255);                 //default output limit corresponds to
+                                             //the arduino pwm limits
+
+    SampleTime = 100;                        //default Controller Sample Time is 0.1 seconds
+
+    controllerDirection = ControllerDirection;
+    dispKp = dispKi = dispKd = 0;
+    SetTunings(Kp, Ki, Kd);
+
+    lastTime = millis()-SampleTime;
+}
+
+
+/* Compute() **********************************************************************
+ *   As PID::Compute(): returns true when the output is computed, false when
+ *   nothing has been done.  The integral and the output are clamped to the limits
+ *   before the output is rounded to a whole number.
+ **********************************************************************************/
+template <uint8_t FRAC>
+bool PID_fix<FRAC>::Compute()
+{
+   if(!inAuto) return false;
+   unsigned long now = millis();
+   unsigned long timeChange = (now - lastTime);
+   if(timeChange>=SampleTime) return ComputeTick();
+   else return false;
+}
+
+/* ComputeTick() ******************************************************************
+ *   The calculation, whenever it's called (in automatic mode): the caller keeps
+ *   the SampleTime, e.g. from a timer interrupt's samples, to the tick
+ **********************************************************************************/
+template <uint8_t FRAC>
+bool PID_fix<FRAC>::ComputeTick()
+{
+   if(!inAuto) return false;
+
+   /*Compute all the working error variables*/
+   long input = *myInput;
+   int32_t error = *mySetpoint - input;
+   ITerm = Clamp(ITerm + Product(ki, error, kiReach));
+   int32_t dInput = (input - lastInput);
+
+   /*Compute PID Output*/
+   int32_t output = Clamp(Product(kp, error, kpReach) + ITerm - Product(kd, dInput, kdReach));
+   *myOutput = (output + ((int32_t)1 << (FRAC - 1))) >> FRAC;
+
+   /*Remember some variables for next time*/
+   lastInput = input;
+   lastTime = millis();
+   return true;
+}
+
+
+/* SetTunings(...)*************************************************************
+ * This function allows the controller's dynamic performance to be adjusted.
+ * it's called automatically from the constructor, but tunings can also
+ * be adjusted on the fly during normal operation
+ ******************************************************************************/
+template <uint8_t FRAC>
+void PID_fix<FRAC>::SetTunings(double Kp, double Ki, double Kd)
+{
+   if (Kp<0 || Ki<0 || Kd<0) return;
+
+   dispKp = Kp; dispKi = Ki; dispKd = Kd;
+   ScaleTunings();
+}
+
+/* SetSampleTime(...) *********************************************************
+ * sets the period, in Milliseconds, at which the calculation is performed
+ ******************************************************************************/
+template <uint8_t FRAC>
+void PID_fix<FRAC>::SetSampleTime(int NewSampleTime)
+{
+   if (NewSampleTime > 0)
+   {
+      SampleTime = (unsigned long)NewSampleTime;
+      ScaleTunings();
+   }
+}
+
+/* SetOutputLimits(...)****************************************************
+ *     As PID::SetOutputLimits(); the limits are cut to +/-(2^(29-FRAC) - 1),
+ *     so the output and the integral stay within the products' saturation.
+ **************************************************************************/
+template <uint8_t FRAC>
+void PID_fix<FRAC>::SetOutputLimits(long Min, long Max)
+{
+   const long biggest = ((long)1 << (29 - FRAC)) - 1;
+   if(Min < -biggest) Min = -biggest;
+   if(Max > biggest) Max = biggest;
+   if(Min >= Max) return;
+   outMin = (int32_t)Min * ((int32_t)1 << FRAC);
+   outMax = (int32_t)Max * ((int32_t)1 << FRAC);
+
+   if(inAuto)
+   {
+      if(*myOutput > Max) *myOutput = Max;
+      else if(*myOutput < Min) *myOutput = Min;
+
+      ITerm = Clamp(ITerm);
+   }
+}
+
+/* SetMode(...)****************************************************************
+ * Allows the controller Mode to be set to manual (0) or Automatic (non-zero)
+ * when the transition from manual to auto occurs, the controller is
+ * automatically initialized
+ ******************************************************************************/
+template <uint8_t FRAC>
+void PID_fix<FRAC>::SetMode(int Mode)
+{
+    bool newAuto = (Mode == AUTOMATIC);
+    if(newAuto == !inAuto)
+    {  /*we just went from manual to auto*/
+        Initialize();
+    }
+    inAuto = newAuto;
+}
+
+/* Initialize()****************************************************************
+ *  does all the things that need to happen to ensure a bumpless transfer
+ *  from manual to automatic mode.
+ ******************************************************************************/
+template <uint8_t FRAC>
+void PID_fix<FRAC>::Initialize()
+{
+   long output = *myOutput;
+   if(output > (outMax >> FRAC)) ITerm = outMax;
+   else if(output < (outMin >> FRAC)) ITerm = outMin;
+   else ITerm = (int32_t)output * ((int32_t)1 << FRAC);
+   lastInput = *myInput;
+}
+
+/* SetControllerDirection(...)*************************************************
+ * The PID will either be connected to a DIRECT acting process (+Output leads
+ * to +Input) or a REVERSE acting process(+Output leads to -Input.)  we need to
+ * know which one, because otherwise we may increase the output when we should
+ * be decreasing.  This is called from the constructor.
+ ******************************************************************************/
+template <uint8_t FRAC>
+void PID_fix<FRAC>::SetControllerDirection(int Direction)
+{
+   controllerDirection = Direction;
+   ScaleTunings();
+}
+
+/* ScaleTunings()**************************************************************
+ * the fixed point gains from the displayed ones: Ki and Kd per sample, and
+ * negative for a REVERSE acting process
+ ******************************************************************************/
+template <uint8_t FRAC>
+void PID_fix<FRAC>::ScaleTunings()
+{
+   double SampleTimeInSec = ((double)SampleTime)/1000;
+   double sign = (controllerDirection == REVERSE) ? -1 : 1;
+   kp = ToFixed(sign * dispKp);
+   ki = ToFixed(sign * dispKi * SampleTimeInSec);
+   kd = ToFixed(sign * dispKd / SampleTimeInSec);
+   kpReach = Reach(kp);
+   kiReach = Reach(ki);
+   kdReach = Reach(kd);
+}
+
+/* ToFixed(...), Reach(...), Product(...), Clamp(...)**************************
+ * a double to Q.FRAC, rounded and saturated; the largest whole number a gain
+ * can multiply within +/-2^29; a gain times a whole number, saturated at
+ * +/-2^29 beyond its reach; a sum of at most three such to the output limits
+ ******************************************************************************/
+template <uint8_t FRAC>
+int32_t PID_fix<FRAC>::ToFixed(double x)
+{
+   x *= (double)((int32_t)1 << FRAC);
+   if(x >= 2147483647.0) return 2147483647L;
+   if(x <= -2147483647.0) return -2147483647L;
+   return (int32_t)(x < 0 ? x - 0.5 : x + 0.5);
+}
+
+template <uint8_t FRAC>
+int32_t PID_fix<FRAC>::Reach(int32_t k)
+{
+   const int32_t saturated = (int32_t)1 << 29;
+   if(k == 0) return 2147483647L;
+   return saturated / (k < 0 ? -k : k);
+}
+
+template <uint8_t FRAC>
+int32_t PID_fix<FRAC>::Product(int32_t k, int32_t x, int32_t reach)
+{
+   const int32_t saturated = (int32_t)1 << 29;
+   if(x > reach) return (k < 0) ? -saturated : saturated;
+   if(x < -reach) return (k < 0) ? saturated : -saturated;
+   return k * x;
+}
+
+template <uint8_t FRAC>
+int32_t PID_fix<FRAC>::Clamp(int32_t x)
+{
+   if(x > outMax) return outMax;
+   if(x < outMin) return outMin;
+   return x;
+}
+
+/* Status Funcions*************************************************************
+ * Just because you set the Kp=-1 doesn't mean it actually happened.  these
+ * functions query the internal state of the PID.  they're here for display
+ * purposes.  this are the functions the PID Front-end uses for example
+ ******************************************************************************/
+template <uint8_t FRAC> double PID_fix<FRAC>::GetKp(){ return  dispKp; }
+template <uint8_t FRAC> double PID_fix<FRAC>::GetKi(){ return  dispKi;}
+template <uint8_t FRAC> double PID_fix<FRAC>::GetKd(){ return  dispKd;}
+template <uint8_t FRAC> int PID_fix<FRAC>::GetMode(){ return  inAuto ? AUTOMATIC : MANUAL;}
+template <uint8_t FRAC> int PID_fix<FRAC>::GetDirection(){ return controllerDirection;}
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ RateScheduler.cpp
+ Cooperative fixed-rate task scheduler for loop()
+*/
+
+#include "Arduino.h"
+#include "RateScheduler.h"
+
+// RateScheduler Constructor
+RateScheduler::RateScheduler()
+{
+  _tasks = 0;
+  _lastPass = 0;
+  clearHistogram();
+}
+
+// Runs task every periodUs, the first time periodUs from now
+int8_t RateScheduler::addTask(RateTask task, unsigned long periodUs){
+  if ( _tasks >= RATE_TASKS_MAX || task == NULL || periodUs == 0 ) {
+    return -1;
+  }
+  _task[_tasks] = task;
+  _period[_tasks] = periodUs;
+  _due[_tasks] = micros() + periodUs;
+  _runs[_tasks] = 0;
+  _late[_tasks] = 0;
+  _longest[_tasks] = 0;
+  return _tasks++;
+}
+
+// Runs the tasks that are due; call from loop() every pass
+void RateScheduler::run(){
+  unsigned long now = micros();
+  if ( _timing ) {
+    unsigned long pass = now - _lastPass;
+    uint8_t bin = 0;
+    for ( unsigned long limit = 8; pass >= limit && bin < LOOP_HISTOGRAM_BINS - 1; limit <<= 1 ) {
+      bin++;
+    }
+    _bins[bin]++;
+    if ( pass > _longestPass ) {
+      _longestPass = pass;
+    }
+  }
+  _lastPass = now;
+  _timing = true;
+
+  for ( int8_t i = 0; i < _tasks; i++ ) {
+    if ( (long)(now - _due[i]) < 0 ) {
+      continue;
+    }
+    unsigned long start = micros();
+    _task[i]();
+    unsigned long took = micros() - start;
+    if ( took > _longest[i] ) {
+      _longest[i] = took;
+    }
+    _runs[i]++;
+    // next run a whole period on, so the rate holds whatever this one's start
+    _due[i] += _period[i];
+    now = micros();
+    if ( (long)(now - _due[i]) >= 0 ) {
+      // a whole period behind: skip the missed runs, don't burst
+      _late[i] += (now - _due[i]) / _period[i] + 1;
+      _due[i] += ((now - _due[i]) / _period[i] + 1) * _period[i];
+    }
+  }
+}
+
+// Prints the loop pass histogram, and each task's runs, late runs and longest run
+void RateScheduler::printHistogram(Print &out){
+  out.println("loop pass (us)   passes");
+  unsigned long low = 0;
+  unsigned long high = 8;
+  for ( uint8_t bin = 0; bin < LOOP_HISTOGRAM_BINS; bin++ ) {
+    if ( _bins[bin] ) {
+      out.print(low);
+      if ( bin < LOOP_HISTOGRAM_BINS - 1 ) {
+        out.print("-");
+        out.print(high - 1);
+      } else {
+        out.print("+");
+      }
+      out.print(": ");
+      out.println(_bins[bin]);
+    }
+    low = high;
+    high <<= 1;
+  }
+  out.print("longest pass: ");
+  out.print(_longestPass);
+  out.println(" us");
+  for ( int8_t i = 0; i < _tasks; i++ ) {
+    out.print("task ");
+    out.print(i);
+    out.print(" every ");
+    out.print(_period[i]);
+    out.print(" us: ");
+    out.print(_runs[i]);
+    out.print(" runs, ");
+    out.print(_late[i]);
+    out.print(" late, longest ");
+    out.print(_longest[i]);
+    out.println(" us");
+  }
+}
+
+void RateScheduler::clearHistogram(){
+  for ( uint8_t bin = 0; bin < LOOP_HISTOGRAM_BINS; bin++ ) {
+    _bins[bin] = 0;
+  }
+  _longestPass = 0;
+  for ( int8_t i = 0; i < _tasks; i++ ) {
+    _runs[i] = 0;
+    _late[i] = 0;
+    _longest[i] = 0;
+  }
+  _timing = false;  // (the pass this is called in isn't timed)
+}
+
+unsigned long RateScheduler::passes(){
+  unsigned long total = 0;
+  for ( uint8_t bin = 0; bin < LOOP_HISTOGRAM_BINS; bin++ ) {
+    total += _bins[bin];
+  }
+  return total;
+}
+
+unsigned long RateScheduler::longestPass(){
+  return _longestPass;
+}
+
+unsigned long RateScheduler::late(int8_t task){
+  return (task >= 0 && task < _tasks) ? _late[task] : 0;
+}
@@ -0,0 +1,53 @@
+/*
+ RateScheduler.h
+ Cooperative fixed-rate task scheduler for loop()
+
+ Each task is a function run every periodUs microseconds.  run() is called
+ from loop() as often as it can be; it starts each task that is due, in the
+ order they were added.  Due times advance by whole periods, so a task keeps
+ its rate however long the other tasks and loop passes take, without drift.
+ A task that falls a whole period behind skips the missed runs (counted as
+ late) rather than running several times to catch up.  Nothing preempts:
+ a task that takes long holds up the others, so tasks must not wait.
+
+ run() also keeps a histogram of the time between loop passes (powers of
+ two of microseconds), and each task's longest run, for printHistogram().
+*/
+
+#ifndef RateScheduler_h
+#define RateScheduler_h
+
+#include "Arduino.h"
+
+#define RATE_TASKS_MAX 6      // tasks per scheduler
+#define LOOP_HISTOGRAM_BINS 16 // bin 0: under 8 us; bin n: 2^(n+2) to 2^(n+3) us; the last: longer
+
+typedef void (*RateTask)();
+
+class RateScheduler
+{
+  public:
+    RateScheduler();
+    int8_t addTask(RateTask task, unsigned long periodUs); // -1 when full
+    void run();
+    void printHistogram(Print &out);
+    void clearHistogram();
+    unsigned long passes();         // loop passes timed since clearHistogram()
+    unsigned long longestPass();    // us
+    unsigned long late(int8_t task); // runs skipped since clearHistogram()
+  private:
+    RateTask _task[RATE_TASKS_MAX];
+    unsigned long _period[RATE_TASKS_MAX];
+    unsigned long _due[RATE_TASKS_MAX];   // micros() of the next run
+    unsigned long _runs[RATE_TASKS_MAX];
+    unsigned long _late[RATE_TASKS_MAX];
+    unsigned long _longest[RATE_TASKS_MAX]; // longest run (us)
+    int8_t _tasks;
+    unsigned long _lastPass;  // micros() at the last run()
+    bool _timing;             // _lastPass is set
+    unsigned long _bins[LOOP_HISTOGRAM_BINS];
+    unsigned long _longestPass;
+
+};
+
+#endif
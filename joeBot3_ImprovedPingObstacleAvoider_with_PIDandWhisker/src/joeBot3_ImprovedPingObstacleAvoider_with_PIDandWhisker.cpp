@@ -5,20 +5,25 @@
  * http://www.pjrc.com/teensy/td_libs_Encoder.html
  * and DC Motor (L293D) library written by Joe Brendler
  * and DCmotor library by Joe Brendler
- * and standard HC_SR04 and PID_V1 Arduino Libraries
+ * and standard HC_SR04 and PID_V1 Arduino Libraries (PID_v1's fixed point PID_fix
+ * and relay autotune PID_ATune)
+ * and EncoderSampler (Timer2) and RateScheduler libraries by Joe Brendler
  */
 
 // Basic Idea:  use two instances of PID to control speeds
 //  of motors; reset when avoiding
-//  --> loop = motor.go(pid_output), ping, 
-//             if not safe then avoid,
-//             else compute-for-pid;
+//  --> every encoder sample (the control tick): if not safe then start avoiding,
+//             step the maneuver, else compute-for-pid, motor.go(pid_output);
+//      ping (in the background) every ranging tick
 
 #include <Arduino.h>
 #include <DCmotor2.h>
 #include <Encoder.h>
+#include <EncoderSampler.h>
 #include <HC_SR04.h>
-#include <PID_v1.h>
+#include <PID_AutoTune.h>
+#include <PID_fix.h>
+#include <RateScheduler.h>
 
 // instantiate L293D driven DC motors (int 1A, int pwm EN1/2)
 // (int 3A, int pwm EN3/4 ) if you're using the other L293D channel
@@ -50,11 +55,27 @@ double ki = 0.16077170418;
 double kd = 0.01;
 
 //Define Variables we'll be connecting to
-double mySetpoint, L_Input, L_Output, R_Input, R_Output;
+long mySetpoint, L_Input, L_Output, R_Input, R_Output;  // ticks/s, PWM
 
 //Specify the links and initial tuning parameters
-PID L_PID(&L_Input, &L_Output, &mySetpoint, kp, ki, kd, DIRECT);
-PID R_PID(&R_Input, &R_Output, &mySetpoint, kp, ki, kd, DIRECT);
+//(fixed point, no floating point per Compute(); 20 fraction bits, as Ki per
+// 10 ms control tick is only ~0.0016)
+PID_fix<20> L_PID(&L_Input, &L_Output, &mySetpoint, kp, ki, kd, DIRECT);
+PID_fix<20> R_PID(&R_Input, &R_Output, &mySetpoint, kp, ki, kd, DIRECT);
+
+// the tunings above were found by hand at 12.1 v; these find them again (at the
+// battery's voltage now) when sent 't', or on the first cruise if none are
+// saved: each wheel's output relays +/- tune_step around the one it cruises
+// on, and the PI tunings from the oscillation go to EEPROM for setup() to use
+PID_ATune<long> L_Tune(&L_Input, &L_Output, &mySetpoint);
+PID_ATune<long> R_Tune(&R_Input, &R_Output, &mySetpoint);
+const long tune_step = 40;     // PWM
+const long tune_band = 25;     // ticks/s: one step of the sampled speed
+const unsigned long tune_settle = 300;  // samples cruising before the relay starts
+const int L_tunings = 0;       // EEPROM addresses
+const int R_tunings = sizeof(PID_StoredTunings);
+bool tuning = false;
+bool tunePending = false;      // tune once cruising has settled
 
 // default speed settings (CAUTION: 100% duty cycle draws too much current
 // and the 7805 voltage regulator may go into thermal protection.
@@ -75,120 +96,294 @@ long dist = 0;
 long minSafeDist = 20;  // cm
 long ticksPerCm = 100;
 
-unsigned long t_ref = 0;
-long dt = 0;
-
-unsigned long l_ticks = 0;  // encoder displacement reading
-unsigned long r_ticks = 0;
+long l_start = 0;  // encoder counts at the start of the maneuver
+long r_start = 0;
+unsigned long cruiseFrom = 0;  // Sampler.samples() when the cruise began
 
 int j = 0;
 
+// the control tick: Timer2 latches both encoders every 10 ms, and control
+// runs on each sample: whiskers, maneuvers and the PIDs, so any obstacle is
+// acted on within one tick, even in the middle of a maneuver, and the PIDs'
+// speeds are over exactly whole ticks (the last 4: 40 ms, steadier than one)
+const uint8_t control_ms = 10;
+const uint8_t speed_window = 4;
+EncoderSampler Sampler( L_Encoder, R_Encoder, control_ms, speed_window );
+
+// fixed-rate tasks (cooperative: each runs to completion, none waits):
+//   ranging at 20 Hz: collects the last ping and sends the next (the longest,
+//     nothing in range, is back in ~18 ms)
+//   telemetry at 5 Hz, and the loop timing histogram every 30 sec (or send 'h')
+const unsigned long ranging_us = 50000;
+const unsigned long telemetry_us = 200000;
+const unsigned long report_us = 30000000;
+RateScheduler Scheduler;
+
+// maneuvers run one control tick at a time, until their encoder target
+// (counted from the start of the maneuver: the encoders are never reset)
+enum Maneuver { CRUISE, AVOID_LEFT, AVOID_RIGHT, AVOID_STRAIGHT };
+const char *maneuverName[] = { "Go straight", "Avoid Left", "Avoid Right", "Avoid Straight" };
+Maneuver maneuver = CRUISE;
+bool distValid = false;  // dist is from a ping sent since the last maneuver
+bool pingClean = false;  // the ping out now was sent while cruising
+
 //---------- function declarations ------------
-void Avoid_Left();
-void Avoid_Right();
-void Avoid_Straight();
+void ControlTask();
+void RangingTask();
+void TelemetryTask();
+void ReportTask();
+void StartManeuver(Maneuver next);
+bool Avoid_Left();
+bool Avoid_Right();
+bool Avoid_Straight();
 void GoStraight();
+void StartTuning();
+void StepTuning();
+void EndTuning();
 
 //----------- setup() -----------------------
 void setup() {
   Serial.begin(115200);
   L_Encoder.write(0);
   R_Encoder.write(0);
-  mySetpoint = drive_speed * 19.6419;
+  mySetpoint = drive_speed * 196419L / 10000;  // (x 19.6419 ticks/s)
   R_Output = drive_speed;
   L_Output = drive_speed;
 
-  //turn the PID on
+  //turn the PID on, computing every control tick
   L_PID.SetMode(AUTOMATIC);
   R_PID.SetMode(AUTOMATIC);
+  L_PID.SetSampleTime(control_ms);
+  R_PID.SetSampleTime(control_ms);
   // DIRECT will work, since the avoider only goes forward
   L_PID.SetControllerDirection(DIRECT);
   L_PID.SetControllerDirection(DIRECT);
 
-  t_ref = millis();
+  // the last tunings found, if any (else find them)
+  double p, i, d;
+  if ( PID_LoadTunings(L_tunings, &p, &i, &d) ) {
+    L_PID.SetTunings(p, i, d);
+  } else {
+    tunePending = true;
+  }
+  if ( PID_LoadTunings(R_tunings, &p, &i, &d) ) {
+    R_PID.SetTunings(p, i, d);
+  } else {
+    tunePending = true;
+  }
+  L_Tune.SetSampleTime(control_ms);
+  R_Tune.SetSampleTime(control_ms);
+  L_Tune.SetNoiseBand(tune_band);
+  R_Tune.SetNoiseBand(tune_band);
+
+  Scheduler.addTask(RangingTask, ranging_us);
+  Scheduler.addTask(TelemetryTask, telemetry_us);
+  Scheduler.addTask(ReportTask, report_us);
+
+  Sampler.begin();
 }
 
 //---------------------- loop() -----------------------
 void loop() {
-  unsigned long refTime = millis();
-  while ( millis() < refTime + 30000 ) {
-    dist = Sensor.ping();
-    Serial.print("distance: ");
-    Serial.print(dist);
-    Serial.print(" cm");
-    if ( analogRead(L_Whisker) < v_closed ) {
-      Serial.println(" (Avoid Left)");
-      Avoid_Left();
-    } else if ( analogRead(R_Whisker) < v_closed ) {
-      Serial.println(" (Avoid Right)");
-      Avoid_Right();
-    } else if ( dist < minSafeDist ) {
-      Serial.println(" (Avoid Straight)");
-      Avoid_Straight();
-    } else {
-      //go straight
-      Serial.println(" (Go straight)");
-      GoStraight();
+  if ( Sampler.available() ) {
+    ControlTask();
+  }
+  Scheduler.run();
+  if ( Serial.available() ) {
+    char c = Serial.read();
+    if ( c == 'h' ) {
+      ReportTask();
+    } else if ( c == 't' ) {
+      tunePending = true;
+    }
+  }
+}
+
+//---------------------- tasks -----------------------
+void ControlTask(){
+  // a whisker starts its maneuver whatever is going on (or keeps it going);
+  // the ping only while cruising, from a ping sent since the last maneuver
+  if ( analogRead(L_Whisker) < v_closed ) {
+    if ( maneuver != AVOID_LEFT ) {
+      StartManeuver(AVOID_LEFT);
     }
+  } else if ( analogRead(R_Whisker) < v_closed ) {
+    if ( maneuver != AVOID_RIGHT ) {
+      StartManeuver(AVOID_RIGHT);
+    }
+  } else if ( maneuver == CRUISE && distValid && dist < minSafeDist ) {
+    StartManeuver(AVOID_STRAIGHT);
+  }
+
+  bool done = false;
+  switch ( maneuver ) {
+    case AVOID_LEFT:
+      done = Avoid_Left();
+      break;
+    case AVOID_RIGHT:
+      done = Avoid_Right();
+      break;
+    case AVOID_STRAIGHT:
+      done = Avoid_Straight();
+      break;
+    default:
+      GoStraight();
+      break;
+  }
+  if ( done ) {
+    maneuver = CRUISE;
+    distValid = false;
+    cruiseFrom = Sampler.samples();
+  }
+}
+
+void RangingTask(){
+  if ( Sensor.available() ) {
+    dist = Sensor.lastDistanceCm();
+    distValid = pingClean;
+  }
+  if ( Sensor.startPing() ) {  // (refused while the last one is still out)
+    pingClean = ( maneuver == CRUISE );
+  }
+}
+
+void TelemetryTask(){
+  Serial.print("distance: ");
+  Serial.print(dist);
+  Serial.print(" cm (");
+  Serial.print(maneuverName[maneuver]);
+  Serial.println( tuning ? ", tuning)" : ")" );
+}
+
+void ReportTask(){
+  // (the dump holds up the loop ~25 ms at 115200 baud, which shows as two or
+  // three missed encoder samples in the next one)
+  Scheduler.printHistogram(Serial);
+  Scheduler.clearHistogram();
+  Serial.print("encoder samples missed: ");
+  Serial.println(Sampler.missed());
+}
+
+void StartManeuver(Maneuver next){
+  if ( tuning ) {
+    // the relay needs the cruise: try again after this
+    L_Tune.Cancel();
+    R_Tune.Cancel();
+    EndTuning();
+    tunePending = true;
+    Serial.println("(tuning cancelled)");
   }
+  Serial.print("(");
+  Serial.print(maneuverName[next]);
+  Serial.println(")");
+  l_start = Sampler.leftCount();
+  r_start = Sampler.rightCount();
+  maneuver = next;
 }
 
-void Avoid_Left(){
+//---------------------- maneuvers -----------------------
+// each drives the wheels for one control tick; true when at its encoder target
+
+bool Avoid_Left(){
   // note: motors mounted opposite one another take
   // opposite signs for same direction, and vice versa
   // (-1 * speed) is forward on the right  (r_encoder - is positive)
-  L_Encoder.write(0);
-  R_Encoder.write(0);
-  while ( R_Encoder.read() < 400 ) {
-    L_Motor.halt();
-    R_Motor.go(drive_speed);  // back away 4 cm
+  if ( Sampler.rightCount() - r_start >= 400 ) {
+    return true;
   }
+  L_Motor.halt();
+  R_Motor.go(drive_speed);  // back away 4 cm
+  return false;
 }
 
-void Avoid_Right(){
+bool Avoid_Right(){
   // note: motors mounted opposite one another take
   // opposite signs for same direction, and vice versa
   // (-1 * speed) is forward on the right  (r_encoder - is positive)
-  L_Encoder.write(0);
-  R_Encoder.write(0);
-  while ( L_Encoder.read() > -400 ) {
-    R_Motor.halt();
-    L_Motor.go(-1 * drive_speed);  // back away 4 cm
+  if ( Sampler.leftCount() - l_start <= -400 ) {
+    return true;
   }
+  R_Motor.halt();
+  L_Motor.go(-1 * drive_speed);  // back away 4 cm
+  return false;
 }
 
-void Avoid_Straight(){
+bool Avoid_Straight(){
   // note: motors mounted opposite one another take
   // opposite signs for same direction, and vice versa
   // (-1 * speed) is forward on the right  (r_encoder - is positive)
-  L_Encoder.write(0);
-  R_Encoder.write(0);
-  while ( L_Encoder.read() < 3000 ) {
-    L_Motor.go(drive_speed);
-    R_Motor.go(drive_speed);   // rotate ~1ft of arc-distance on each wheel
+  if ( Sampler.leftCount() - l_start >= 3000 ) {
+    return true;
   }
+  L_Motor.go(drive_speed);
+  R_Motor.go(drive_speed);   // rotate ~1ft of arc-distance on each wheel
+  return false;
 }
 
 void GoStraight(){
   // note: motors mounted opposite one another take
   // opposite signs for same direction, and vice versa
-  // (-1 * speed) is forward on the right
-  l_ticks = L_Encoder.read();
-  r_ticks = R_Encoder.read();
-  //reset encoder for next delta-t
-  L_Encoder.write(0);
-  R_Encoder.write(0);
-  dt = millis() - t_ref;
-  L_Input = double ( 1000.0 * l_ticks ) / double( dt ) ;
-  R_Input = double ( 1000.0 * r_ticks ) / double( dt ) ;
-  L_PID.Compute();
-  R_PID.Compute();
+  // (-1 * speed) is forward on the right  (r_encoder - is positive)
+  // speeds from the encoder sample this tick runs on; compute on it
+  L_Input = Sampler.leftSpeed();
+  R_Input = -1 * Sampler.rightSpeed();
+  if ( tunePending && !tuning && Sampler.samples() - cruiseFrom >= tune_settle ) {
+    StartTuning();
+  }
+  if ( tuning ) {
+    StepTuning();
+  } else {
+    L_PID.ComputeTick();
+    R_PID.ComputeTick();
+  }
 
   L_Motor.go ( L_Output );
   R_Motor.go ( -1 * R_Output );
 }
 
+//---------------------- autotune -----------------------
+void StartTuning(){
+  // relay from the outputs the PIDs cruise on (each step kept within 0-255)
+  Serial.println("(tuning)");
+  tunePending = false;
+  L_PID.SetMode(MANUAL);
+  R_PID.SetMode(MANUAL);
+  L_Tune.Start(L_Output, min(tune_step, min(L_Output, 255 - L_Output)));
+  R_Tune.Start(R_Output, min(tune_step, min(R_Output, 255 - R_Output)));
+  tuning = true;
+}
 
+void StepTuning(){
+  // both wheels relay until both are done (one done first holds its cruising
+  // output); the new tunings are used and saved only if both were found
+  int l = L_Tune.Runtime();
+  int r = R_Tune.Runtime();
+  if ( l == ATUNE_RUNNING || r == ATUNE_RUNNING ) {
+    return;
+  }
+  if ( l == ATUNE_DONE && r == ATUNE_DONE ) {
+    L_PID.SetTunings(L_Tune.GetKp(), L_Tune.GetKi(), L_Tune.GetKd());
+    R_PID.SetTunings(R_Tune.GetKp(), R_Tune.GetKi(), R_Tune.GetKd());
+    PID_SaveTunings(L_tunings, L_Tune.GetKp(), L_Tune.GetKi(), L_Tune.GetKd());
+    PID_SaveTunings(R_tunings, R_Tune.GetKp(), R_Tune.GetKi(), R_Tune.GetKd());
+    Serial.print("(tuned: kp ");
+    Serial.print(L_Tune.GetKp(), 5);
+    Serial.print(" ");
+    Serial.print(R_Tune.GetKp(), 5);
+    Serial.print(", ki ");
+    Serial.print(L_Tune.GetKi(), 5);
+    Serial.print(" ");
+    Serial.print(R_Tune.GetKi(), 5);
+    Serial.println(")");
+  } else {
+    Serial.println("(tuning failed: tunings kept)");
+  }
+  EndTuning();
+}
 
-
-
+void EndTuning(){
+  // back to the PIDs, picking up from the relay's outputs
+  tuning = false;
+  L_PID.SetMode(AUTOMATIC);
+  R_PID.SetMode(AUTOMATIC);
+}